@@ -4,6 +4,9 @@
 #include <cstdint>
 #include <tuple>
 
+#include "bioimage-coder/concurrently.hpp"
+#include "bioimage-coder/cost-model.hpp"
+#include "bioimage-coder/loop-planner.hpp"
 #include "bioimage-coder/repeat-for.hpp"
 #include "fiber-messages.h"
 #include "frame-commands.h"
@@ -18,10 +21,13 @@ using fiber_messages::capture::dark_frame_t;
 using fiber_messages::capture::fluorescence_frame_t;
 using fiber_messages::capture::fpm_frame_t;
 using next_illumination_angle = next;
+using bioimage_coder::concurrently;
+using bioimage_coder::plan;
 using bioimage_coder::Range;
 using bioimage_coder::repeat_for;
 using message::CloseAllCameraWorkers;
 using message::SleepFor;
+using message::WaitSettled;
 using led_at = message::led_matrix::switch_to;
 using fiber_messages::capture::camera::init_sequence_t;
 using EG = fiber_messages::capture::camera::exposure_gain_t;
@@ -45,24 +51,35 @@ cameraInitProtocol() {
 
 constexpr auto
 fpmImagingProtocol(const uint8_t led_id) {
-    return Steps{
-        SleepFor{500ms},           // Wait for the z-stage to settle
-        fpm_frame_t{led_id},       // Capture frames
-        next_illumination_angle{}  // Move to the next LED
-    };
+    return Steps{concurrently(  //
+        fpm_frame_t{led_id},         // Capture frames
+        next_illumination_angle{},   // Move to the next LED once exposed
+        WaitSettled::atLeast(500ms)  // Let the LED settle while the frames drain
+        )};
 }
 
+constexpr channel_t fluorescence_channels[] = {EGFP, TXRED};
+
 constexpr auto
-fluorescenceImagingProtocol(const int16_t z) {
+fluorescenceImagingProtocol(const int16_t z, const uint8_t c) {
     return Steps{
-        move_to_z{z},                   // Move to stage position
-        laser{1s, 16, EGFP},            // Turn on laser EGFP
-        fluorescence_frame_t{z, EGFP},  // Capture fluorescence images
-        laser{1s, 16, TXRED},           // Turn on laser TXRED
-        fluorescence_frame_t{z, TXRED}  // Capture fluorescence images
+        move_to_z{z},                                     // Move to stage position
+        laser{1s, 16, fluorescence_channels[c]},          // Turn on laser
+        fluorescence_frame_t{z, fluorescence_channels[c]} // Capture fluorescence images
     };
 }
 
+/** Every z-position by every laser channel, each channel swept through the
+ * z-stack in turn. */
+constexpr auto fluorescence_stack =
+    repeat_for(Range<'z', int16_t>{-4, 4, 2}, Range<'c', uint8_t>{0, 2},
+               fluorescenceImagingProtocol);
+
+// The z-stage moves back once, instead of the laser switching at every z.
+static_assert(bioimage_coder::deadTime(plan(fluorescence_stack)) <
+                  bioimage_coder::deadTime(fluorescence_stack),
+              "The loop order of the fluorescence stack is not optimized.");
+
 constexpr auto
 mainProtocol() {
     return Steps{
@@ -75,8 +92,9 @@ mainProtocol() {
             blank{},                      //
             dark_frame_t{},               //
             led_at{0, 0},                 // Switch on LED
-            move_to_z{0},                 // Move to neutral position
-            EG::setExposureGain<1>(30ms)  // Expose for 30 millisecond at 1x analog gain.
+            move_to_z{0},                  // Move to neutral position
+            EG::setExposureGain<1>(30ms),  // Expose for 30 millisecond at 1x analog gain.
+            WaitSettled::atLeast(500ms)    // Wait for the first LED to settle
         },
 
         // Capture FPM images
@@ -86,7 +104,7 @@ mainProtocol() {
             blank{},                        // Turn off LED.
             EG::setExposureGain<16>(200ms)  // Expose for 100 millisecond at 16x analog gain.
         },
-        repeat_for(Range<'z', int16_t>{-4, 4, 2}, fluorescenceImagingProtocol),  //
+        plan(fluorescence_stack),  //
 
         // De-init all devices
         Steps{
@@ -97,4 +115,19 @@ mainProtocol() {
     };
 }
 
+/** Resources of the acquisition workstation per well plate. */
+namespace budget {
+constexpr uint64_t disk_bytes = uint64_t{32} << 30;
+constexpr auto plate_time = 5min;
+constexpr double disk_bandwidth = 1.5e9;
+}  // namespace budget
+
+constexpr auto main_protocol_cost = bioimage_coder::protocolCost(mainProtocol());
+static_assert(main_protocol_cost.bytes() <= budget::disk_bytes,
+              "The protocol overflows the acquisition disk.");
+static_assert(main_protocol_cost.min_duration <= budget::plate_time,
+              "The protocol cannot complete within the time slot of the well plate.");
+static_assert(main_protocol_cost.minWriteBandwidth() <= budget::disk_bandwidth,
+              "The protocol outpaces the acquisition disk.");
+
 }  // namespace
\ No newline at end of file
@@ -0,0 +1,130 @@
+#include <fmt/format.h>
+#include <sched.h>
+#include <sys/prctl.h>
+
+#include <csignal>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "board-link.h"
+#include "board-process.h"
+#include "hot-log.h"
+#include "image_capture_worker.h"
+
+namespace {
+
+struct options_t {
+    enum role_t { CAPTURE, WRITER } role{CAPTURE};
+    uint8_t usb_id{};
+
+    /** Shared memory of the board, from the supervisor. */
+    std::string link_name{};
+
+    /** Where the capture process streams the USB bulk transfers from. */
+    enum source_t { MOCK, RECORD, REPLAY } source{MOCK};
+    std::string capture_dir{};
+    bool realtime{false};
+
+    /** CPU to run on, e.g. one of the NUMA node of the board. Negative for
+     * any. */
+    int32_t cpu{-1};
+
+    capture_process_config_t capture_config{};
+};
+
+/** Parse the command line options, from capture-images --processes:
+ *
+ *   --capture N     Run the capture worker of the board of USB ID N
+ *   --write N       Run the file writer of the board of USB ID N
+ *   --link NAME     Shared memory of the board, e.g. /bioimage-board0
+ *   --record DIR    Record the bulk transfers to DIR/usbN.cap
+ *   --replay DIR    Replay the bulk transfers from DIR/usbN.cap
+ *   --realtime      Replay at the recorded timing instead of as fast as possible
+ *   --cpu N         Pin the process to CPU N
+ *   --crash-after-frames N
+ *                   Abort the capture process once it has handed over N frames,
+ *                   to exercise the restart by the supervisor
+ */
+options_t
+parseArguments(int argc, char* argv[]) {
+    options_t options{};
+    for (int i = 1; i < argc; i++) {
+        const std::string_view arg{argv[i]};
+        if ((arg == "--capture" || arg == "--write") && i + 1 < argc) {
+            options.role = (arg == "--capture") ? options_t::CAPTURE : options_t::WRITER;
+            options.usb_id = static_cast<uint8_t>(std::stoul(argv[++i]));
+        } else if (arg == "--link" && i + 1 < argc) {
+            options.link_name = argv[++i];
+        } else if ((arg == "--record" || arg == "--replay") && i + 1 < argc) {
+            options.source = (arg == "--record") ? options_t::RECORD : options_t::REPLAY;
+            options.capture_dir = argv[++i];
+        } else if (arg == "--realtime") {
+            options.realtime = true;
+        } else if (arg == "--cpu" && i + 1 < argc) {
+            options.cpu = std::stoi(argv[++i]);
+        } else if (arg == "--crash-after-frames" && i + 1 < argc) {
+            options.capture_config.crash_after_frames = std::stoull(argv[++i]);
+        } else {
+            throw std::invalid_argument(fmt::format(FMT_STRING("Unknown option: {:s}"), arg));
+        }
+    }
+    if (options.link_name.empty()) {
+        throw std::invalid_argument("The board link is required, e.g. --link /bioimage-board0");
+    }
+    return options;
+}
+
+capture_worker_fn
+captureWorker(const options_t& options) {
+    const uint8_t usb_id = options.usb_id;
+    const auto capture_path = fmt::format(FMT_STRING("{:s}/usb{:d}.cap"), options.capture_dir,
+                                          usb_id);
+    switch (options.source) {
+        case options_t::RECORD:
+            return [=](auto& capture_queue, auto& write_queue) {
+                recordingCaptureWorker(usb_id, capture_path, capture_queue, write_queue);
+            };
+        case options_t::REPLAY:
+            return [=, realtime = options.realtime](auto& capture_queue, auto& write_queue) {
+                replayCaptureWorker(usb_id, capture_path, realtime, capture_queue, write_queue);
+            };
+        default:
+            return [=](auto& capture_queue, auto& write_queue) {
+                imageCaptureWorker(usb_id, capture_queue, write_queue);
+            };
+    }
+}
+
+}  // namespace
+
+/** Worker process of one board in capture-images --processes: its capture
+ * worker, or its file writer. See board-link.h. */
+int
+main(int argc, char* argv[]) {
+    const auto options = parseArguments(argc, argv);
+
+    // Do not outlive the supervisor, e.g. once it gives up the plate.
+    ::prctl(PR_SET_PDEATHSIG, SIGKILL);
+
+    if (options.cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(options.cpu, &cpus);
+        if (::sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+            throw std::runtime_error(fmt::format(FMT_STRING("Cannot pin the process to CPU {:d}"),
+                                                 options.cpu));
+        }
+    }
+
+    board_link::board_link_t link{options.link_name};
+    if (options.role == options_t::CAPTURE) {
+        linkedCaptureWorker(link, captureWorker(options), options.capture_config);
+    } else {
+        linkedFileWriteWorker(link);
+    }
+
+    telemetry::log::flush();
+    return 0;
+}
@@ -0,0 +1,168 @@
+/** Dry run of the protocol in virtual time.
+ *
+ * Runs the executor, the capture workers and the file writer of capture-images
+ * against the simulated instrument: hardware_drivers::SimulatedUSB for the
+ * frame capture cards, and hardware_drivers::SimulatedSerial for the firmware.
+ * The fibers sleep in the virtual time of simulator::virtual_time_scheduler_t,
+ * so that the run takes the CPU time of the pipeline alone.
+ *
+ * Prints the predicted acquisition time, the utilization of each stage, and
+ * the channel stalls per protocol step, to evaluate protocol and queue depth
+ * changes before running them on a real plate. The timing follows the
+ * assumptions of simulator::time_model.
+ */
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <array>
+#include <boost/fiber/all.hpp>
+#include <chrono>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "bioimage-coder/bytecode.hpp"
+#include "bioimage-coder/executor.hpp"
+#include "file_write_worker.h"
+#include "hot-log.h"
+#include "image_capture_worker.h"
+#include "illumination.h"
+#include "instrumented-channel.h"
+#include "master_task.h"
+#include "metrics.h"
+#include "utilization.h"
+#include "virtual-clock.h"
+#include "virtual-time-scheduler.h"
+
+using boost::fibers::fiber;
+
+// Dependency injection of the simulated serial port happens at the link-time
+// of the binary.
+hardware_drivers::SimulatedSerial serial_port{};
+
+// The capture queues are created in main(), at the depth of the options.
+std::array<fiber_messages::capture::queue_t*, frame_capture_card::n_boards>
+    image_capture_handlers{};
+
+namespace {
+
+struct options_t {
+    /** Capture commands in flight per board. Zero for the boards in lockstep. */
+    size_t credit_window{0};
+
+    /** Capture commands each capture queue holds. Zero for the depth of
+     * capture-images. */
+    size_t capture_queue_depth{0};
+
+    /** Frames the write queue holds, as in capture-images by default. */
+    size_t write_queue_depth{3};
+
+    /** Protocol bytecode to run. Empty for the protocol compiled in. */
+    std::string protocol_path{};
+};
+
+/** Parse the command line options:
+ *
+ *   --credit-window N  As in capture-images
+ *   --capture-queue N  Hold N capture commands per board, instead of one, or
+ *                      the credit window in the run-ahead mode
+ *   --write-queue N    Hold N frames in the write queue, instead of 3
+ *   --protocol FILE    As in capture-images
+ */
+options_t
+parseArguments(int argc, char* argv[]) {
+    options_t options{};
+    for (int i = 1; i < argc; i++) {
+        const std::string_view arg{argv[i]};
+        if (arg == "--credit-window" && i + 1 < argc) {
+            options.credit_window = std::stoul(argv[++i]);
+        } else if (arg == "--capture-queue" && i + 1 < argc) {
+            options.capture_queue_depth = std::stoul(argv[++i]);
+        } else if (arg == "--write-queue" && i + 1 < argc) {
+            options.write_queue_depth = std::stoul(argv[++i]);
+        } else if (arg == "--protocol" && i + 1 < argc) {
+            options.protocol_path = argv[++i];
+        } else {
+            throw std::invalid_argument(fmt::format(FMT_STRING("Unknown option: {:s}"), arg));
+        }
+    }
+    if (options.write_queue_depth == 0) {
+        throw std::invalid_argument("The write queue must hold at least one frame");
+    }
+    return options;
+}
+
+/** Account the time the capture workers and the file writer spent on each
+ * command, as measured by the pipeline metrics in virtual time. */
+void
+accountWorkerTime() {
+    using std::chrono::microseconds;
+    const auto& metrics = telemetry::metrics();
+    for (size_t b = 0; b < frame_capture_card::n_boards; b++) {
+        simulator::busyTime(fmt::format(FMT_STRING("capture board {:d}"), b))
+            .add(microseconds{metrics.boards[b].command_time.sumMicroseconds()});
+    }
+    simulator::busyTime("file writer")
+        .add(microseconds{metrics.writer.write_latency.sumMicroseconds()});
+}
+
+}  // namespace
+
+int
+main(int argc, char* argv[]) {
+    const auto options = parseArguments(argc, argv);
+
+    std::optional<bioimage_coder::bytecode_program_t> program{};
+    if (!options.protocol_path.empty()) {
+        program = bioimage_coder::bytecode_program_t::load(options.protocol_path);
+    }
+
+    // All fibers of this thread sleep in virtual time from now on.
+    boost::fibers::use_scheduling_algorithm<simulator::virtual_time_scheduler_t>();
+    const auto start = simulator::now();
+
+    const size_t capture_queue_depth =
+        (options.capture_queue_depth > 0) ? options.capture_queue_depth
+                                          : std::max<size_t>(options.credit_window, 1);
+    auto& capture_queue_stats = telemetry::channelStats("capture", "executor", "capture", 1,
+                                                        frame_capture_card::n_boards);
+    auto capture_queues = fiber_messages::capture::makeQueues(
+        bioimage_coder::signalCapacity(capture_queue_depth), capture_queue_stats);
+    bioimage_coder::connectCaptureQueues(capture_queues);
+
+    auto& write_queue_stats =
+        telemetry::channelStats("write", "capture", "writer", frame_capture_card::n_boards, 1);
+    fiber_messages::write::queue_t write_queue{
+        bioimage_coder::signalCapacity(options.write_queue_depth), write_queue_stats};
+
+    std::array<fiber, frame_capture_card::n_boards> capture_tasks{};
+    for (uint8_t usb_id = 0; usb_id < frame_capture_card::n_boards; usb_id++) {
+        capture_tasks[usb_id] = fiber{simulatedCaptureWorker, usb_id,
+                                      std::ref(capture_queues[usb_id]),
+                                      std::ref(write_queue)};
+    }
+
+    fiber executor_task{bioimageExecutorTask, options.credit_window,
+                        program ? &*program : nullptr};
+    fiber write_task{fileWriteWorker, std::ref(write_queue)};
+
+    executor_task.join();
+    for (auto& c : capture_tasks) {
+        c.join();
+    }
+    write_task.join();
+
+    const auto elapsed = simulator::now() - start;
+    telemetry::log::flush();
+    accountWorkerTime();
+
+    const std::chrono::duration<double> seconds = elapsed;
+    fmt::print(FMT_STRING("[ ] Predicted acquisition time: {:.3f} s ({:.2f} h)\n"),
+               seconds.count(), seconds.count() / 3600);
+    simulator::printUtilizationReport(elapsed);
+    telemetry::printChannelReport();
+    telemetry::illumination::printPhotobleachingReport();
+    return 0;
+}
@@ -0,0 +1,158 @@
+#include <fmt/format.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "firmware_emulator.h"
+
+using hardware_drivers::ack_mode_t;
+using hardware_drivers::firmware_config_t;
+using hardware_drivers::FirmwareEmulator;
+
+namespace {
+
+struct options_t {
+    firmware_config_t firmware{};
+
+    /** Symbolic link to the serial port, e.g. /tmp/ttyACM0. Empty to print
+     * the path only. */
+    std::string link_path{};
+
+    /** Exit once the host closes the serial port. */
+    bool once{false};
+
+    /** Print each command and its response. */
+    bool verbose{false};
+};
+
+std::chrono::nanoseconds
+milliseconds(const char* arg) {
+    return std::chrono::microseconds{static_cast<int64_t>(std::stod(arg) * 1e3)};
+}
+
+ack_mode_t
+parseAckMode(std::string_view arg) {
+    if (arg == "none") {
+        return ack_mode_t::NONE;
+    } else if (arg == "receipt") {
+        return ack_mode_t::ON_RECEIPT;
+    } else if (arg == "completion") {
+        return ack_mode_t::ON_COMPLETION;
+    }
+    throw std::invalid_argument(fmt::format(FMT_STRING("Unknown ack mode: {:s}"), arg));
+}
+
+/** Parse the command line options:
+ *
+ *   --latency MS      Time to parse each command
+ *   --z-velocity UM_PER_S
+ *                     Travel speed of the z-stage
+ *   --z-settle MS     Time for the z-stage to settle after each move
+ *   --laser-switch MS Time to switch the laser excitation channel
+ *   --led-update MS   Time to update the LED matrix
+ *   --ack MODE        Reply `OK` to each command on `receipt`, on `completion`,
+ *                     or `none` as the firmware of the instrument
+ *   --reject-every N  Reply `ERR` to every N-th command
+ *   --link PATH       Link PATH to the serial port, e.g. for
+ *                     `capture-images --serial PATH`
+ *   --once            Exit once the host closes the serial port
+ *   --verbose         Print each command and its response
+ *
+ * The timings default to those of the dry run.
+ */
+options_t
+parseArguments(int argc, char* argv[]) {
+    options_t options{};
+    auto& firmware = options.firmware;
+    for (int i = 1; i < argc; i++) {
+        const std::string_view arg{argv[i]};
+        if (arg == "--latency" && i + 1 < argc) {
+            firmware.command_latency = milliseconds(argv[++i]);
+        } else if (arg == "--z-velocity" && i + 1 < argc) {
+            firmware.z_velocity = std::stod(argv[++i]);
+            if (firmware.z_velocity <= 0) {
+                throw std::invalid_argument("--z-velocity must be positive");
+            }
+        } else if (arg == "--z-settle" && i + 1 < argc) {
+            firmware.z_settle = milliseconds(argv[++i]);
+        } else if (arg == "--laser-switch" && i + 1 < argc) {
+            firmware.laser_switch = milliseconds(argv[++i]);
+        } else if (arg == "--led-update" && i + 1 < argc) {
+            firmware.led_update = milliseconds(argv[++i]);
+        } else if (arg == "--ack" && i + 1 < argc) {
+            firmware.ack = parseAckMode(argv[++i]);
+        } else if (arg == "--reject-every" && i + 1 < argc) {
+            firmware.reject_every = std::stoul(argv[++i]);
+        } else if (arg == "--link" && i + 1 < argc) {
+            options.link_path = argv[++i];
+        } else if (arg == "--once") {
+            options.once = true;
+        } else if (arg == "--verbose") {
+            options.verbose = true;
+        } else {
+            throw std::invalid_argument(fmt::format(FMT_STRING("Unknown option: {:s}"), arg));
+        }
+    }
+    return options;
+}
+
+FirmwareEmulator* emulator = nullptr;
+
+void
+stopOnSignal(int) {
+    emulator->stop();
+}
+
+}  // namespace
+
+/** The ATmega2560 firmware of the 96-eyes instrument, emulated on a
+ * pseudo-terminal, to run capture-images without the instrument. */
+int
+main(int argc, char* argv[]) {
+    const auto options = parseArguments(argc, argv);
+
+    FirmwareEmulator firmware{options.firmware};
+    emulator = &firmware;
+    std::signal(SIGINT, stopOnSignal);
+    std::signal(SIGTERM, stopOnSignal);
+
+    if (!options.link_path.empty()) {
+        ::unlink(options.link_path.c_str());
+        if (::symlink(firmware.path().c_str(), options.link_path.c_str()) != 0) {
+            throw std::runtime_error(
+                fmt::format(FMT_STRING("Cannot link {:s}"), options.link_path));
+        }
+    }
+    fmt::print(FMT_STRING("Serial port: {:s}\n"), firmware.path());
+    std::fflush(stdout);
+
+    using ms = std::chrono::duration<double, std::milli>;
+    const auto start = std::chrono::steady_clock::now();
+    std::function<void(std::string_view, const FirmwareEmulator::response_t&)> log{};
+    if (options.verbose) {
+        log = [&](std::string_view command, const FirmwareEmulator::response_t& r) {
+            const ms t = std::chrono::steady_clock::now() - start;
+            fmt::print(FMT_STRING("{:12.3f} ms  {:<12s} {:8.3f} ms  {:s}"), t.count(), command,
+                       ms{r.work}.count(), r.reply);
+        };
+    }
+
+    while (firmware.serve(log) && !options.once) {
+    }
+
+    if (!options.link_path.empty()) {
+        ::unlink(options.link_path.c_str());
+    }
+
+    const auto& stats = firmware.stats();
+    const std::chrono::duration<double> busy = stats.busy;
+    fmt::print(FMT_STRING("{:d} commands, {:d} rejected, busy for {:.3f} s\n"), stats.commands,
+               stats.rejected, busy.count());
+    return 0;
+}
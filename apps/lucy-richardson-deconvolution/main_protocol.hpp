@@ -19,6 +19,7 @@ using fiber_messages::capture::dark_frame_t;
 using fiber_messages::capture::fluorescence_frame_t;
 using message::CloseAllCameraWorkers;
 using message::SleepFor;
+using message::WaitSettled;
 using led_at = message::led_matrix::switch_to;
 
 #define Steps std::tuple
@@ -32,7 +33,7 @@ constexpr auto
 fluorescenceImagingProtocol(const int16_t z) {
     return Steps{
         move_to_z{z},                    // Move to stage position
-        SleepFor{100ms},                 // Wait for the z-stage to settle
+        WaitSettled::atLeast(100ms),     // Wait for the z-stage to settle
         laser{1s, 16, EGFP},             // Turn on laser EGFP
         fluorescence_frame_t{z, TXRED},  // Capture fluorescence images
         laser{1s, 16, EGFP},             // Turn on laser TXRED
@@ -55,8 +56,8 @@ mainProtocol() {
         },
 
         Steps{
-            move_to_z{-z_range},  // Move to the start of the z range
-            SleepFor{500ms}       // Wait for the z-stage to settle
+            move_to_z{-z_range},         // Move to the start of the z range
+            WaitSettled::atLeast(500ms)  // Wait for the z-stage to settle
         },
 
         repeat_for(Range<'z', int16_t>{-z_range, +z_range, 2_um}, fluorescenceImagingProtocol),  //
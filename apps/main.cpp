@@ -1,56 +1,376 @@
 #include <fmt/format.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <array>
 #include <asio/io_service.hpp>
 #include <asio/serial_port.hpp>
+#include <climits>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
 
+#include "alloc-tracker.h"
+#include "asio-scheduler.h"
+#include "bioimage-coder/bytecode.hpp"
+#include "bioimage-coder/executor.hpp"
+#include "board-supervisor.h"
 #include "file_write_worker.h"
 #include "image_capture_worker.h"
 #include "master_task.h"
+#include "hot-log.h"
+#include "illumination.h"
+#include "instrumented-channel.h"
+#include "metrics.h"
+#include "preview-tap.h"
+#include "trace.h"
 
 using boost::fibers::barrier;
 using boost::fibers::fiber;
 
 // Dependency injection of the serial port happens at the link-time of the
-// binary.
+// binary. The commands are pipelined to the firmware, and the fibers wake up on
+// the acknowledgements.
 asio::io_service io;
-asio::serial_port serial_port{io};
+message_router::AsyncSerialTransport<asio::serial_port> serial_port{io};
+
+// Channel capacities. Note that a buffered_channel holds one item less than
+// its capacity.
+constexpr size_t capture_queue_capacity = 2;
+constexpr size_t write_queue_capacity = 4;
 
 // Dependency injection of the camera capture message router happens at the
-// link-time of the binary.
+// link-time of the binary. The queues are created in main(), at the capacity
+// of the options.
 using capture_queue_t = fiber_messages::capture::queue_t;
-std::array image_capture_handlers{capture_queue_t{2}, capture_queue_t{2}, capture_queue_t{2},
-                                  capture_queue_t{2}};
+std::array<capture_queue_t*, frame_capture_card::n_boards> image_capture_handlers{};
+
+namespace {
+
+/** Where the capture workers stream the USB bulk transfers from. */
+struct usb_source_t {
+    enum mode_t { MOCK, RECORD, REPLAY } mode{MOCK};
+    std::string capture_dir{};
+    bool realtime{false};
+
+    std::string capturePath(uint8_t usb_id) const {
+        return fmt::format(FMT_STRING("{:s}/usb{:d}.cap"), capture_dir, usb_id);
+    }
+};
+
+struct options_t {
+    usb_source_t usb_source{};
+
+    /** Prometheus textfile to export the pipeline metrics to. Empty to disable. */
+    std::string metrics_path{};
+
+    /** Chrome trace event file to dump the fiber timeline to. Empty to disable. */
+    std::string trace_path{};
+
+    /** Capture commands in flight per board. Zero for the boards in lockstep. */
+    size_t credit_window{0};
+
+    /** Protocol bytecode to run. Empty for the protocol compiled in. */
+    std::string protocol_path{};
+
+    /** Serial commands awaiting acknowledgement at once. Zero to not read the
+     * acknowledgements. */
+    size_t ack_window{0};
+
+    /** Serial port to the ATmega2560, or to its emulator. */
+    std::string serial_device{"/dev/ttyACM0"};
+
+    /** Shared memory of the live preview, e.g. "/bioimage-preview". Empty to
+     * disable. */
+    std::string preview_name{};
+    int32_t preview_binning{8};
+
+    /** Run the capture worker and the file writer of each board in processes
+     * of their own. */
+    bool is_multi_process{false};
+    std::string board_worker_path{};
+
+    /** CPU of the processes of each board, by the USB ID. Empty for any. */
+    std::vector<int32_t> board_cpus{};
+};
+
+/** The board-worker next to this executable. */
+std::string
+defaultBoardWorkerPath() {
+    std::array<char, PATH_MAX> path{};
+    const auto n = ::readlink("/proc/self/exe", path.data(), path.size() - 1);
+    const std::string self{path.data(), n > 0 ? size_t(n) : 0};
+    return self.substr(0, self.rfind('/') + 1) + "board-worker";
+}
+
+std::vector<int32_t>
+parseCpuList(const std::string& list) {
+    std::vector<int32_t> cpus{};
+    size_t start = 0;
+    while (start < list.size()) {
+        const auto end = std::min(list.find(',', start), list.size());
+        cpus.push_back(std::stoi(list.substr(start, end - start)));
+        start = end + 1;
+    }
+    if (cpus.size() != frame_capture_card::n_boards) {
+        throw std::invalid_argument(
+            fmt::format(FMT_STRING("--board-cpus needs {:d} CPUs, one per board"),
+                        frame_capture_card::n_boards));
+    }
+    return cpus;
+}
+
+/** Parse the command line options:
+ *
+ *   --record DIR    Record the bulk transfers of each board to DIR/usbN.cap
+ *   --replay DIR    Replay the bulk transfers from DIR/usbN.cap
+ *   --realtime      Replay at the recorded timing instead of as fast as possible
+ *   --metrics FILE  Export the pipeline metrics to FILE every 5 seconds
+ *   --trace FILE    Dump the fiber timeline to FILE at the end of the run.
+ *                   Requires the build option -Dtracing=true.
+ *   --credit-window N
+ *                   Let each board run up to N capture commands ahead of the
+ *                   slowest one, instead of the boards in lockstep
+ *   --protocol FILE Run the protocol bytecode of FILE, from compile-protocol-*,
+ *                   instead of the protocol compiled in
+ *   --ack-window N  Wait for the firmware to acknowledge each serial command,
+ *                   with up to N commands in flight
+ *   --serial DEVICE Serial port to the ATmega2560, instead of /dev/ttyACM0,
+ *                   e.g. the pseudo-terminal of firmware-emulator
+ *   --preview NAME  Publish binned previews of the cameras to the POSIX shared
+ *                   memory NAME, e.g. /bioimage-preview, for preview-monitor
+ *   --preview-binning N
+ *                   Downsample the previews by 4 or 8, the default
+ *   --processes     Run the capture worker and the file writer of each board in
+ *                   processes of their own, restarting the crashed ones
+ *   --board-worker PATH
+ *                   Executable of the board processes, instead of the
+ *                   board-worker next to this one
+ *   --board-cpus LIST
+ *                   Pin the processes of each board to a CPU, e.g. 0,8,16,24
+ */
+options_t
+parseArguments(int argc, char* argv[]) {
+    options_t options{};
+    auto& source = options.usb_source;
+    for (int i = 1; i < argc; i++) {
+        const std::string_view arg{argv[i]};
+        if ((arg == "--record" || arg == "--replay") && i + 1 < argc) {
+            source.mode = (arg == "--record") ? usb_source_t::RECORD : usb_source_t::REPLAY;
+            source.capture_dir = argv[++i];
+        } else if (arg == "--realtime") {
+            source.realtime = true;
+        } else if (arg == "--metrics" && i + 1 < argc) {
+            options.metrics_path = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            if (!telemetry::trace::is_enabled) {
+                throw std::invalid_argument("--trace requires the build option -Dtracing=true");
+            }
+            options.trace_path = argv[++i];
+        } else if (arg == "--credit-window" && i + 1 < argc) {
+            options.credit_window = std::stoul(argv[++i]);
+        } else if (arg == "--protocol" && i + 1 < argc) {
+            options.protocol_path = argv[++i];
+        } else if (arg == "--ack-window" && i + 1 < argc) {
+            options.ack_window = std::stoul(argv[++i]);
+        } else if (arg == "--serial" && i + 1 < argc) {
+            options.serial_device = argv[++i];
+        } else if (arg == "--preview" && i + 1 < argc) {
+            options.preview_name = argv[++i];
+        } else if (arg == "--preview-binning" && i + 1 < argc) {
+            options.preview_binning = std::stoi(argv[++i]);
+        } else if (arg == "--processes") {
+            options.is_multi_process = true;
+        } else if (arg == "--board-worker" && i + 1 < argc) {
+            options.board_worker_path = argv[++i];
+        } else if (arg == "--board-cpus" && i + 1 < argc) {
+            options.board_cpus = parseCpuList(argv[++i]);
+        } else {
+            throw std::invalid_argument(fmt::format(FMT_STRING("Unknown option: {:s}"), arg));
+        }
+    }
+    if (options.is_multi_process && !options.preview_name.empty()) {
+        throw std::invalid_argument("--preview is not supported with --processes");
+    }
+    if (options.board_worker_path.empty()) {
+        options.board_worker_path = defaultBoardWorkerPath();
+    }
+    return options;
+}
+
+/** Start the capture or writer process of the board with the options of
+ * this run. */
+pid_t
+spawnBoardWorker(const options_t& options, const board_process_t role, const uint8_t usb_id,
+                 const std::string& link_name) {
+    std::vector<std::string> argv{options.board_worker_path,
+                                  (role == board_process_t::CAPTURE) ? "--capture" : "--write",
+                                  std::to_string(usb_id), "--link", link_name};
+    const auto& source = options.usb_source;
+    if (role == board_process_t::CAPTURE && source.mode != usb_source_t::MOCK) {
+        argv.insert(argv.end(), {(source.mode == usb_source_t::RECORD) ? "--record" : "--replay",
+                                 source.capture_dir});
+        if (source.realtime) {
+            argv.emplace_back("--realtime");
+        }
+    }
+    if (!options.board_cpus.empty()) {
+        argv.insert(argv.end(), {"--cpu", std::to_string(options.board_cpus.at(usb_id))});
+    }
+    return spawnProcess(argv);
+}
+
+fiber
+launchCaptureWorker(const usb_source_t& source, uint8_t usb_id, capture_queue_t& capture_queue,
+                    fiber_messages::write::queue_t& write_queue,
+                    const std::vector<board_supervisor_t*>& board_supervisors) {
+    if (!board_supervisors.empty()) {
+        return fiber{superviseBoard, std::ref(*board_supervisors.at(usb_id)),
+                     std::ref(capture_queue), std::cref(board_supervisors)};
+    }
+    switch (source.mode) {
+        case usb_source_t::RECORD:
+            return fiber{recordingCaptureWorker, usb_id, source.capturePath(usb_id),
+                         std::ref(capture_queue), std::ref(write_queue)};
+        case usb_source_t::REPLAY:
+            return fiber{replayCaptureWorker, usb_id, source.capturePath(usb_id),
+                         source.realtime, std::ref(capture_queue), std::ref(write_queue)};
+        default:
+            return fiber{imageCaptureWorker, usb_id, std::ref(capture_queue),
+                         std::ref(write_queue)};
+    }
+}
+
+}  // namespace
 
 int
-main() {
+main(int argc, char* argv[]) {
+    const auto options = parseArguments(argc, argv);
+    const auto& usb_source = options.usb_source;
+    boost::fibers::use_scheduling_algorithm<message_router::asio_scheduler_t>(io);
+
+    // Reject a malformed protocol before touching the instrument.
+    std::optional<bioimage_coder::bytecode_program_t> program{};
+    if (!options.protocol_path.empty()) {
+        program = bioimage_coder::bytecode_program_t::load(options.protocol_path);
+    }
+
+    std::unique_ptr<preview::preview_tap_t> preview_tap{};
+    if (!options.preview_name.empty()) {
+        preview::preview_config_t config{};
+        config.binning = options.preview_binning;
+        preview_tap = std::make_unique<preview::preview_tap_t>(options.preview_name, config);
+    }
+
+    std::unique_ptr<telemetry::PrometheusExporter> metrics_exporter{};
+    if (!options.metrics_path.empty()) {
+        metrics_exporter = std::make_unique<telemetry::PrometheusExporter>(options.metrics_path);
+    }
+
+    // Deep enough to hold the capture commands in flight.
+    auto& capture_queue_stats = telemetry::channelStats("capture", "executor", "capture", 1,
+                                                        frame_capture_card::n_boards);
+    auto capture_queues = fiber_messages::capture::makeQueues(
+        (options.credit_window > 0) ? bioimage_coder::signalCapacity(options.credit_window)
+                                    : capture_queue_capacity,
+        capture_queue_stats);
+    bioimage_coder::connectCaptureQueues(capture_queues);
+
     // 96-eyes instrument's illumination/motion control is dispatched through
     // the Atmel ATMeta2560 AVR microcontroller.
-    serial_port.open("/dev/ttyACM0");
-    serial_port.set_option(asio::serial_port::baud_rate{115200U});
+    serial_port.setAckWindow(options.ack_window);
+    serial_port.next_layer().open(options.serial_device);
+    serial_port.next_layer().set_option(asio::serial_port::baud_rate{115200U});
 
-    fiber_messages::write::queue_t write_queue{4};
+    auto& write_queue_stats =
+        telemetry::channelStats("write", "capture", "writer", frame_capture_card::n_boards, 1);
+    fiber_messages::write::queue_t write_queue{write_queue_capacity, write_queue_stats};
 
-    std::array capture_tasks{
-        fiber{imageCaptureWorker, 0, std::ref(image_capture_handlers[0]), std::ref(write_queue)},
-        fiber{imageCaptureWorker, 1, std::ref(image_capture_handlers[1]), std::ref(write_queue)},
-        fiber{imageCaptureWorker, 2, std::ref(image_capture_handlers[2]), std::ref(write_queue)},
-        fiber{imageCaptureWorker, 3, std::ref(image_capture_handlers[3]), std::ref(write_queue)}};
+    // Each board in a capture process and a writer process of its own. The
+    // capture workers of this process are stand-ins forwarding to them.
+    std::array<std::unique_ptr<board_supervisor_t>, frame_capture_card::n_boards>
+        board_supervisors{};
+    std::vector<board_supervisor_t*> boards{};
+    if (options.is_multi_process) {
+        for (uint8_t usb_id = 0; usb_id < frame_capture_card::n_boards; usb_id++) {
+            board_supervisors[usb_id] = std::make_unique<board_supervisor_t>(
+                usb_id, [&](board_process_t role, uint8_t id, const std::string& link_name,
+                            uint32_t) { return spawnBoardWorker(options, role, id, link_name); });
+            boards.push_back(board_supervisors[usb_id].get());
+        }
 
-    fiber executor_task{bioimageExecutorTask};
-    fiber write_task{fileWriteWorker, std::ref(write_queue)};
+        // The writer processes write the frames.
+        write_queue.close();
+    }
 
-    // Not required if we never calls async_read or async_write.
-    // io.run();
-    executor_task.join();
+    std::array capture_tasks{
+        launchCaptureWorker(usb_source, 0, capture_queues[0], write_queue, boards),
+        launchCaptureWorker(usb_source, 1, capture_queues[1], write_queue, boards),
+        launchCaptureWorker(usb_source, 2, capture_queues[2], write_queue, boards),
+        launchCaptureWorker(usb_source, 3, capture_queues[3], write_queue, boards)};
 
-    // Stop the asio event loop. Redundant call.
-    // io.stop();
+    fiber executor_task{bioimageExecutorTask, options.credit_window,
+                        program ? &*program : nullptr};
+    fiber write_task = preview_tap
+                           ? fiber{previewingFileWriteWorker, std::ref(write_queue),
+                                   std::ref(*preview_tap)}
+                           : fiber{fileWriteWorker, std::ref(write_queue)};
 
+    // The laser is on from the laser command to the last frame. Run the
+    // executor and the capture workers ahead of the writer, which catches up
+    // while they wait for the hardware, or else blocks them on a full queue.
+    using message_router::fiber_priority_t;
+    using message_router::priority_props_t;
+    executor_task.properties<priority_props_t>().setPriority(fiber_priority_t::CRITICAL);
     for (auto& c : capture_tasks) {
-        c.join();
+        c.properties<priority_props_t>().setPriority(fiber_priority_t::CRITICAL);
+    }
+    write_task.properties<priority_props_t>().setPriority(fiber_priority_t::BACKGROUND);
+
+    fiber shutdown_task{[&]() {
+        executor_task.join();
+        for (auto& c : capture_tasks) {
+            c.join();
+        }
+        write_task.join();
+        io.stop();
+    }};
+
+    // The main fiber runs the asio event loop of the serial port whenever the
+    // other fibers are idle, until they all finish.
+    io.run();
+    shutdown_task.join();
+
+    telemetry::log::flush();
+    telemetry::printChannelReport();
+    telemetry::illumination::printPhotobleachingReport();
+    for (const auto* board : boards) {
+        const auto& link = board->header();
+        fmt::print(FMT_STRING("[{:d}] Board processes: {:d} frames written, {:d} restarts\n"),
+                   link.usb_id, link.frames_written.load(), board->restarts());
+    }
+    if (preview_tap) {
+        const auto& writer_metrics = telemetry::metrics().writer;
+        fmt::print(FMT_STRING("[ ] Live preview: {:d} frames published, {:d} dropped\n"),
+                   writer_metrics.previews.load(), writer_metrics.previews_dropped.load());
+    }
+    if (telemetry::alloc::isTracking()) {
+        telemetry::alloc::printAllocationReport();
     }
 
-    write_task.join();
+    if (!options.trace_path.empty()) {
+        telemetry::trace::dump(options.trace_path);
+    }
 
+    // The supervisors unlink the shared memory of the boards on the way out.
+    if (std::any_of(boards.begin(), boards.end(),
+                    [](const auto* board) { return board->failed(); })) {
+        return EXIT_FAILURE;
+    }
     return 0;
 }
\ No newline at end of file
@@ -2,22 +2,48 @@
 
 #include <fmt/format.h>
 
+#include <stdexcept>
+
+#include "alloc-tracker.h"
 #include "bioimage-coder/executor.hpp"
+#include "bioimage-coder/interpreter.hpp"
+#include "bioimage-coder/optimizer.hpp"
+#include "bioimage-coder/run-ahead.hpp"
 #include "fiber-messages.h"
 #include "main_protocol.hpp"
+#include "trace.h"
 
 void
-bioimageExecutorTask() {
+bioimageExecutorTask(const size_t credit_window,
+                     const bioimage_coder::bytecode_program_t* program) {
+    TRACE_LANE_NAME("executor");
+    telemetry::alloc::stage_scope alloc_stage{"executor"};
     try {
-        bioimage_coder::execute(mainProtocol());
+        // Without the redundant serial commands. See optimization-report-*.
+        constexpr auto optimized = bioimage_coder::optimizedTable<mainProtocol>;
+        if (program != nullptr && credit_window > 0) {
+            bioimage_coder::interpretRunAhead(*program, credit_window);
+        } else if (program != nullptr) {
+            bioimage_coder::interpret(*program);
+        } else if (credit_window > 0) {
+            bioimage_coder::executeScheduleRunAhead<mainProtocol, optimized>(credit_window);
+        } else {
+            bioimage_coder::executeSchedule<mainProtocol, optimized>();
+        }
 
         // Close serial port.
         serial_port.close();
 
     } catch (const asio::system_error& e) {
         fmt::print(stderr, FMT_STRING("ASIO error: {:s}\n"), e.what());
-        for (auto& port : image_capture_handlers) {
-            port.close();
+        for (auto* port : image_capture_handlers) {
+            port->close();
+        }
+    } catch (const std::runtime_error& e) {
+        // E.g. a serial command rejected by the firmware.
+        fmt::print(stderr, FMT_STRING("Serial error: {:s}\n"), e.what());
+        for (auto* port : image_capture_handlers) {
+            port->close();
         }
     }
 }
\ No newline at end of file
@@ -1,2 +1,15 @@
 #pragma once
-void bioimageExecutorTask();
\ No newline at end of file
+#include <cstddef>
+
+namespace bioimage_coder {
+class bytecode_program_t;
+}
+
+/** Execute the protocol.
+ *
+ * @param[in] credit_window Capture commands in flight per board, in the
+ * run-ahead mode of the executor. Zero for the boards in lockstep.
+ * @param[in] program Protocol bytecode to interpret, e.g. from
+ * compile-protocol. Null to execute the main protocol compiled in.
+ */
+void bioimageExecutorTask(size_t credit_window, const bioimage_coder::bytecode_program_t* program);
@@ -0,0 +1,167 @@
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "constants.h"
+#include "preview-tap.h"
+
+using preview::frame_kind_t;
+using preview::preview_reader_t;
+using preview::slot_t;
+
+namespace {
+
+struct options_t {
+    std::string ring_name{"/bioimage-preview"};
+
+    /** Time between two scans of the ring. */
+    std::chrono::milliseconds interval{1000};
+
+    /** Directory to save the latest preview of each camera to, as PGM
+     * images. Empty to print the statistics only. */
+    std::string pgm_dir{};
+};
+
+/** Parse the command line options:
+ *
+ *   --ring NAME     Shared memory of capture-images --preview, instead of
+ *                   /bioimage-preview
+ *   --interval MS   Time between two scans of the ring
+ *   --pgm DIR       Save the latest preview of each camera to DIR/wellNN.pgm
+ */
+options_t
+parseArguments(int argc, char* argv[]) {
+    options_t options{};
+    for (int i = 1; i < argc; i++) {
+        const std::string_view arg{argv[i]};
+        if (arg == "--ring" && i + 1 < argc) {
+            options.ring_name = argv[++i];
+        } else if (arg == "--interval" && i + 1 < argc) {
+            options.interval = std::chrono::milliseconds{std::stoul(argv[++i])};
+        } else if (arg == "--pgm" && i + 1 < argc) {
+            options.pgm_dir = argv[++i];
+        } else {
+            throw std::invalid_argument(fmt::format(FMT_STRING("Unknown option: {:s}"), arg));
+        }
+    }
+    return options;
+}
+
+std::string
+describe(const slot_t& slot) {
+    switch (slot.kind) {
+        case frame_kind_t::DARK:
+            return "dark frame";
+        case frame_kind_t::FPM:
+            return fmt::format(FMT_STRING("FPM LED {:d}"), slot.led_id);
+        case frame_kind_t::FLUORESCENCE:
+            return fmt::format(FMT_STRING("{:s} z={:d}"), toString(slot.ch), slot.zpos);
+    }
+    return "unknown";
+}
+
+/** Stretch the preview from the minimum to the maximum of the frame, to 8-bit
+ * gray levels. */
+void
+renderGray(const slot_t& slot, std::vector<uint8_t>& gray) {
+    const double lo = slot.stats.min;
+    const double range = std::max(1.0, slot.stats.max - lo);
+    gray.resize(size_t(slot.width) * slot.height);
+    const uint16_t* pixels = slot.pixels();
+    for (size_t i = 0; i < gray.size(); i++) {
+        gray[i] = static_cast<uint8_t>(std::clamp((pixels[i] - lo) * 255.0 / range, 0.0, 255.0));
+    }
+}
+
+void
+writePgm(const std::string& path, uint16_t width, uint16_t height,
+         const std::vector<uint8_t>& gray) {
+    std::FILE* out = std::fopen(path.c_str(), "wb");
+    if (out == nullptr) {
+        throw std::runtime_error(fmt::format(FMT_STRING("Cannot write {:s}"), path));
+    }
+    fmt::print(out, FMT_STRING("P5\n{:d} {:d}\n255\n"), width, height);
+    std::fwrite(gray.data(), 1, gray.size(), out);
+    std::fclose(out);
+}
+
+volatile std::sig_atomic_t is_stopping = 0;
+
+void
+stopOnSignal(int) {
+    is_stopping = 1;
+}
+
+}  // namespace
+
+/** Viewer of the live preview of capture-images --preview.
+ *
+ * Maps the preview ring read-only, and reports the latest preview of each
+ * camera once per interval. The capture never waits for the viewer: the
+ * previews overwritten while being read are skipped.
+ */
+int
+main(int argc, char* argv[]) {
+    const auto options = parseArguments(argc, argv);
+    std::signal(SIGINT, stopOnSignal);
+    std::signal(SIGTERM, stopOnSignal);
+
+    const preview_reader_t reader{options.ring_name};
+    std::array<uint64_t, well_plate::n_wells> last_shown{};
+    std::vector<uint8_t> gray{};
+    uint64_t n_shown = 0;
+    uint64_t n_torn = 0;
+
+    while (is_stopping == 0) {
+        for (size_t well = 0; well < well_plate::n_wells; well++) {
+            std::string line{};
+            uint64_t frame_number{};
+            uint16_t width{};
+            uint16_t height{};
+            const bool is_valid = reader.readLatest(well, [&](const slot_t& slot) {
+                frame_number = slot.frame_number;
+                if (frame_number == last_shown[well]) {
+                    return;
+                }
+                line = fmt::format(
+                    FMT_STRING("[{:d}] camera {:2d}: {:<14s} min {:5d}, max {:5d}, mean {:8.2f}"),
+                    slot.board_id, slot.cam_id, describe(slot), slot.stats.min, slot.stats.max,
+                    slot.stats.mean);
+                if (!options.pgm_dir.empty()) {
+                    width = slot.width;
+                    height = slot.height;
+                    renderGray(slot, gray);
+                }
+            });
+            if (!is_valid) {
+                // Torn, if the writer overwrote the preview while we read it.
+                n_torn += line.empty() ? 0 : 1;
+                continue;
+            }
+            if (!line.empty()) {
+                last_shown[well] = frame_number;
+                n_shown++;
+                fmt::print(FMT_STRING("{:s}\n"), line);
+                if (!options.pgm_dir.empty()) {
+                    writePgm(fmt::format(FMT_STRING("{:s}/well{:02d}.pgm"), options.pgm_dir, well),
+                             width, height, gray);
+                }
+            }
+        }
+        std::fflush(stdout);
+        std::this_thread::sleep_for(options.interval);
+    }
+
+    fmt::print(FMT_STRING("{:d} previews of {:d} published, {:d} torn\n"), n_shown,
+               reader.header().n_published.load(), n_torn);
+    return 0;
+}
@@ -0,0 +1,262 @@
+#include <fmt/format.h>
+#include <spawn.h>
+#include <unistd.h>
+
+#include <boost/fiber/all.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "board-supervisor.h"
+#include "hot-log.h"
+#include "instrumented-channel.h"
+#include "metrics.h"
+
+using fiber_messages::capture::completions_signal_t;
+using fiber_messages::capture::dark_frame_t;
+using fiber_messages::capture::fluorescence_frame_t;
+using fiber_messages::capture::fpm_frame_t;
+using fiber_messages::capture::camera::exposure_gain_t;
+
+extern char** environ;
+
+namespace {
+
+using namespace std::chrono_literals;
+
+constexpr size_t n_cameras = frame_capture_card::n_cameras_per_board;
+
+/** Start the board-worker of the build, with its log records off the TAP
+ * output. */
+pid_t
+spawnBoardWorker(const board_process_t role, const uint8_t usb_id, const std::string& link_name,
+                 const std::vector<std::string>& extra_args = {}) {
+    const char* path = std::getenv("BOARD_WORKER");
+    REQUIRE(path != nullptr);
+    std::vector<std::string> argv{path,
+                                  (role == board_process_t::CAPTURE) ? "--capture" : "--write",
+                                  std::to_string(usb_id), "--link", link_name};
+    argv.insert(argv.end(), extra_args.begin(), extra_args.end());
+
+    std::vector<char*> args{};
+    for (auto& arg : argv) {
+        args.push_back(arg.data());
+    }
+    args.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, STDERR_FILENO, STDOUT_FILENO);
+    pid_t pid{};
+    const int error = ::posix_spawn(&pid, path, &actions, nullptr, args.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (error != 0) {
+        throw std::runtime_error(std::strerror(error));
+    }
+    return pid;
+}
+
+supervisor_config_t
+testConfig(const size_t max_restarts = 3) {
+    supervisor_config_t config{};
+    config.link_prefix = fmt::format(FMT_STRING("/bioimage-board-test-{:d}-"), ::getpid());
+    config.n_slots = 4;
+    config.max_restarts = max_restarts;
+    return config;
+}
+
+/** Capture commands of one well plate step, queued up front. The executor
+ * waits on the signals instead. */
+struct commands_t {
+    telemetry::channel_stats_t& stats{telemetry::channelStats("test", "test", "test")};
+    fiber_messages::capture::queue_t capture_queue{16, stats};
+    completions_signal_t completion{16, stats};
+    completions_signal_t exposure{16, stats};
+
+    /** Three capture commands of 24 frames each. */
+    commands_t() {
+        capture_queue.push(exposure_gain_t::setExposureGain<1>(10ms));
+        capture_queue.push(fpm_frame_t{1, &completion, &exposure});
+        capture_queue.push(fluorescence_frame_t{5, EGFP, &completion});
+        capture_queue.push(dark_frame_t{&completion});
+        capture_queue.close();
+    }
+
+    /** Signals received, once the run is over. */
+    static size_t received(completions_signal_t& signal) {
+        signal.close();
+        size_t n = 0;
+        for ([[maybe_unused]] auto&& time : signal) {
+            n++;
+        }
+        return n;
+    }
+};
+
+}  // namespace
+
+TEST_CASE("Hand the frames over from the capture process to the writer process",
+          "[multi-process]") {
+    // Keep the log records off the TAP output.
+    telemetry::log::setOutput(stderr);
+
+    board_supervisor_t supervisor{
+        1,
+        [](board_process_t role, uint8_t usb_id, const std::string& link_name, uint32_t) {
+            return spawnBoardWorker(role, usb_id, link_name);
+        },
+        testConfig()};
+
+    commands_t commands{};
+    const auto n_written = telemetry::metrics().writer.frames.load();
+    supervisor.run(commands.capture_queue);
+
+    CHECK(commands.received(commands.completion) == 3);
+    CHECK(commands.received(commands.exposure) == 1);
+    CHECK(supervisor.restarts() == 0);
+    CHECK(supervisor.header().frames_captured.load() == 3 * n_cameras);
+    CHECK(supervisor.header().frames_written.load() == 3 * n_cameras);
+    CHECK(telemetry::metrics().writer.frames.load() == n_written + 3 * n_cameras);
+}
+
+TEST_CASE("Restart the crashed capture process without aborting the plate", "[multi-process]") {
+    telemetry::log::setOutput(stderr);
+
+    // The first capture process crashes in the fluorescence frames, i.e. in
+    // the second capture command.
+    board_supervisor_t supervisor{
+        2,
+        [](board_process_t role, uint8_t usb_id, const std::string& link_name,
+           uint32_t generation) {
+            if (role == board_process_t::CAPTURE && generation == 0) {
+                return spawnBoardWorker(role, usb_id, link_name, {"--crash-after-frames", "30"});
+            }
+            return spawnBoardWorker(role, usb_id, link_name);
+        },
+        testConfig()};
+
+    commands_t commands{};
+    supervisor.run(commands.capture_queue);
+
+    // Each signal once, as if nothing happened.
+    CHECK(commands.received(commands.completion) == 3);
+    CHECK(commands.received(commands.exposure) == 1);
+    CHECK(supervisor.restarts() == 1);
+    CHECK(telemetry::metrics().boards.at(2).restarts.load() == 1);
+
+    // The fluorescence frames handed over before the crash are not handed
+    // over again.
+    const auto& header = supervisor.header();
+    CHECK(header.frames_captured.load() == 3 * n_cameras);
+    CHECK(header.frames_written.load() == 3 * n_cameras);
+}
+
+TEST_CASE("Give up the plate on a board crashing again and again", "[multi-process]") {
+    telemetry::log::setOutput(stderr);
+
+    board_supervisor_t supervisor{
+        3,
+        [](board_process_t role, uint8_t usb_id, const std::string& link_name, uint32_t) {
+            if (role == board_process_t::CAPTURE) {
+                return spawnBoardWorker(role, usb_id, link_name, {"--crash-after-frames", "1"});
+            }
+            return spawnBoardWorker(role, usb_id, link_name);
+        },
+        testConfig(1)};
+
+    commands_t commands{};
+    CHECK_THROWS_AS(supervisor.run(commands.capture_queue), std::runtime_error);
+    CHECK(supervisor.restarts() == 2);
+    CHECK(supervisor.failed());
+
+    // The executor does not wait on the board given up.
+    CHECK(commands.received(commands.completion) == 3);
+    CHECK(commands.received(commands.exposure) == 1);
+}
+
+TEST_CASE("Give up the plate in the fiber of the board, as capture-images does",
+          "[multi-process]") {
+    telemetry::log::setOutput(stderr);
+
+    // Board 3 crashes again and again, board 1 captures fine.
+    const auto spawn = [](board_process_t role, uint8_t usb_id, const std::string& link_name,
+                          uint32_t) {
+        if (role == board_process_t::CAPTURE && usb_id == 3) {
+            return spawnBoardWorker(role, usb_id, link_name, {"--crash-after-frames", "1"});
+        }
+        return spawnBoardWorker(role, usb_id, link_name);
+    };
+    board_supervisor_t healthy{1, spawn, testConfig(1)};
+    board_supervisor_t crashing{3, spawn, testConfig(1)};
+    const std::vector<board_supervisor_t*> boards{&healthy, &crashing};
+
+    auto& stats = telemetry::channelStats("test", "test", "test");
+    fiber_messages::capture::queue_t healthy_queue{16, stats};
+    fiber_messages::capture::queue_t crashing_queue{16, stats};
+
+    // As dispatch() does: each capture command to all boards, then wait for
+    // all of them.
+    constexpr size_t n_steps = 3;
+    size_t n_completed = 0;
+    boost::fibers::fiber executor_task{[&]() {
+        completions_signal_t completion{2, stats};
+        for (size_t step = 0; step < n_steps; step++) {
+            healthy_queue.push(dark_frame_t{&completion});
+            crashing_queue.push(dark_frame_t{&completion});
+            for (size_t i = 0; i < boards.size(); i++) {
+                completions_signal_t::value_type time;
+                completion.pop(time);
+                n_completed++;
+            }
+        }
+        healthy_queue.close();
+        crashing_queue.close();
+    }};
+    boost::fibers::fiber healthy_task{superviseBoard, std::ref(healthy), std::ref(healthy_queue),
+                                      std::cref(boards)};
+    boost::fibers::fiber crashing_task{superviseBoard, std::ref(crashing),
+                                       std::ref(crashing_queue), std::cref(boards)};
+    executor_task.join();
+    healthy_task.join();
+    crashing_task.join();
+
+    CHECK(n_completed == n_steps * boards.size());
+    CHECK(crashing.failed());
+    CHECK(crashing.restarts() == 2);
+
+    // Given up too, though it never crashed.
+    CHECK_FALSE(healthy.failed());
+    CHECK(healthy.restarts() == 0);
+    CHECK(healthy.header().frames_captured.load() < n_steps * n_cameras);
+}
+
+TEST_CASE("Count the restarts of the writer process against the limit", "[multi-process]") {
+    telemetry::log::setOutput(stderr);
+    const auto n_restarts = telemetry::metrics().boards.at(0).restarts.load();
+
+    // The writer process fails as it starts.
+    board_supervisor_t supervisor{
+        0,
+        [](board_process_t role, uint8_t usb_id, const std::string& link_name, uint32_t) {
+            if (role == board_process_t::WRITER) {
+                return spawnProcess({"/bin/false"});
+            }
+            return spawnBoardWorker(role, usb_id, link_name);
+        },
+        testConfig(1)};
+
+    commands_t commands{};
+    CHECK_THROWS_AS(supervisor.run(commands.capture_queue), std::runtime_error);
+    CHECK(supervisor.restarts() == 2);
+    CHECK(telemetry::metrics().boards.at(0).restarts.load() == n_restarts + 2);
+    CHECK(commands.received(commands.completion) == 3);
+}
+
+TEST_CASE("Reject a link of too many frame slots", "[multi-process]") {
+    CHECK_THROWS_AS((board_link::board_link_t{"/bioimage-board-test", 0, 65}),
+                    std::invalid_argument);
+    CHECK_THROWS_AS(board_link::board_link_t{"/bioimage-board-missing"}, std::runtime_error);
+}
@@ -19,6 +19,7 @@ using fiber_messages::capture::dark_frame_t;
 using fiber_messages::capture::fluorescence_frame_t;
 using message::CloseAllCameraWorkers;
 using message::SleepFor;
+using message::WaitSettled;
 using led_at = message::led_matrix::switch_to;
 
 #define Steps std::tuple
@@ -30,7 +31,7 @@ constexpr auto
 brightfieldImagingProtocol(const int16_t z) {
     return Steps{
         move_to_z{z},                                         // Move to stage position
-        SleepFor{500ms},                                      // Wait for the z-stage to settle
+        WaitSettled::atLeast(500ms),                          // Wait for the z-stage to settle
         fluorescence_frame_t{static_cast<uint8_t>(z + 128)},  // Capture frames
     };
 }
@@ -0,0 +1,345 @@
+/** End-to-end acquisition throughput of the executor, capture worker and file
+ * writer pipeline, against the mock USB driver and a pseudo-terminal in place
+ * of the serial port.
+ *
+ * Usage:
+ *   bench-acquisition [--boards N] [--protocol NAME] [--capture-depth N]
+ *                     [--write-depth N] [--credit-window N]
+ *
+ * With --credit-window, the boards run ahead of one another by up to N capture
+ * commands, instead of in lockstep. The capture depth should then hold N
+ * commands.
+ *
+ * The results are printed to stdout as one JSON object, so that the runs of
+ * two builds can be compared. The log records go to stderr.
+ */
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <asio/io_service.hpp>
+#include <asio/serial_port.hpp>
+#include <boost/fiber/all.hpp>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "alloc-tracker.h"
+#include "bioimage-coder/executor.hpp"
+#include "file_write_worker.h"
+#include "hot-log.h"
+#include "image_capture_worker.h"
+#include "instrumented-channel.h"
+#include "metrics.h"
+#include "protocols.h"
+
+using boost::fibers::fiber;
+using frame_capture_card::n_boards;
+
+// Dependency injection of the serial port and the capture queues, as in
+// apps/main.cpp.
+asio::io_service io;
+asio::serial_port serial_port{io};
+
+using capture_queue_t = fiber_messages::capture::queue_t;
+auto& capture_queue_stats =
+    telemetry::channelStats("capture", "executor", "capture", 1, n_boards);
+std::array<capture_queue_t*, n_boards> image_capture_handlers{};
+
+namespace {
+
+constexpr std::string_view usage =
+    "Usage: bench-acquisition [--boards N] [--protocol NAME] [--capture-depth N]\n"
+    "                         [--write-depth N] [--credit-window N]\n";
+
+struct options_t {
+    size_t n_active_boards{n_boards};
+    bench::protocol_entry_t protocol{bench::protocols[1]};
+    size_t capture_queue_capacity{2};
+    size_t write_queue_capacity{4};
+
+    /** Zero for the boards in lockstep. */
+    size_t credit_window{0};
+};
+
+size_t
+parseCount(std::string_view option, const char* value) {
+    char* end = nullptr;
+    errno = 0;
+    const auto n = std::strtoul(value, &end, 10);
+    if (!std::isdigit(static_cast<unsigned char>(value[0])) || *end != '\0' || errno == ERANGE ||
+        n == 0) {
+        throw std::invalid_argument(
+            fmt::format(FMT_STRING("{:s} must be a positive integer, not {:s}"), option, value));
+    }
+    return n;
+}
+
+options_t
+parseArguments(int argc, char* argv[]) {
+    options_t options{};
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string_view arg{argv[i]};
+        const char* value = argv[i + 1];
+        if (arg == "--boards") {
+            options.n_active_boards = std::min<size_t>(parseCount(arg, value), n_boards);
+        } else if (arg == "--capture-depth") {
+            options.capture_queue_capacity = parseCount(arg, value);
+        } else if (arg == "--write-depth") {
+            options.write_queue_capacity = parseCount(arg, value);
+        } else if (arg == "--credit-window") {
+            options.credit_window = parseCount(arg, value);
+        } else if (arg == "--protocol") {
+            const auto it = std::find_if(std::begin(bench::protocols), std::end(bench::protocols),
+                                         [&](const auto& p) { return p.name == value; });
+            if (it == std::end(bench::protocols)) {
+                throw std::invalid_argument(
+                    fmt::format(FMT_STRING("Unknown protocol: {:s}"), value));
+            }
+            options.protocol = *it;
+        } else {
+            throw std::invalid_argument(fmt::format(FMT_STRING("Unknown option: {:s}"), arg));
+        }
+    }
+    if (argc % 2 == 0) {
+        throw std::invalid_argument("Missing option value");
+    }
+    return options;
+}
+
+/** Pseudo-terminal standing in for the AVR microcontroller. Discards all
+ * commands sent over the serial port. */
+class NullSerialDevice {
+   public:
+    NullSerialDevice() : master{posix_openpt(O_RDWR | O_NOCTTY)} {
+        if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+            throw std::runtime_error("Cannot open pseudo-terminal");
+        }
+        path = ptsname(master);
+
+        // read() fails with EIO once the serial port is closed.
+        drain = std::thread{[fd = master]() {
+            std::array<char, 256> buffer;
+            while (::read(fd, buffer.data(), buffer.size()) > 0) {
+            }
+        }};
+    }
+
+    ~NullSerialDevice() {
+        drain.join();
+        ::close(master);
+    }
+
+    std::string path{};
+
+   private:
+    int master;
+    std::thread drain{};
+};
+
+/** Stand-in for the capture worker of an inactive board. */
+void
+nullCaptureWorker(capture_queue_t& capture_queue) {
+    for (auto&& cmd : capture_queue) {
+        std::visit(
+            [](auto&& capture_command) {
+                if constexpr (bioimage_coder::has_completion_channel<
+                                  std::decay_t<decltype(capture_command)>>::value) {
+                    if (capture_command.exposure != nullptr) {
+                        capture_command.exposure->push(std::chrono::steady_clock::now());
+                    }
+                    capture_command.completion->push(std::chrono::steady_clock::now());
+                }
+            },
+            cmd);
+    }
+}
+
+/** Sum of the histograms of all boards. */
+struct merged_histogram_t {
+    std::array<uint64_t, telemetry::histogram_t::n_buckets + 1> counts{};
+    uint64_t n{};
+
+    void add(const telemetry::histogram_t& h) {
+        for (size_t i = 0; i < counts.size(); i++) {
+            counts[i] += h.bucket(i);
+        }
+        n += h.count();
+    }
+
+    /** Percentile in microseconds, interpolated linearly within the power-of-two
+     * bucket. */
+    double percentile(double p) const {
+        if (n == 0) return 0.0;
+        const double rank = p * 1e-2 * n;
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < counts.size(); i++) {
+            if (counts[i] > 0 && cumulative + counts[i] >= rank) {
+                const double lower = (i == 0) ? 0.0 : telemetry::histogram_t::upperBound(i - 1);
+                const double upper = telemetry::histogram_t::upperBound(i);
+                return lower + (upper - lower) * (rank - cumulative) / counts[i];
+            }
+            cumulative += counts[i];
+        }
+        return telemetry::histogram_t::upperBound(counts.size() - 1);
+    }
+};
+
+void
+writeLatency(fmt::memory_buffer& out, std::string_view stage, const merged_histogram_t& h) {
+    fmt::format_to(std::back_inserter(out),
+                   FMT_STRING("    \"{:s}\": {{\"count\": {:d}, \"p50\": {:.1f}, \"p90\": {:.1f}, "
+                              "\"p99\": {:.1f}}}"),
+                   stage, h.n, h.percentile(50), h.percentile(90), h.percentile(99));
+}
+
+}  // namespace
+
+int
+main(int argc, char* argv[]) {
+    options_t options{};
+    try {
+        options = parseArguments(argc, argv);
+    } catch (const std::invalid_argument& e) {
+        fmt::print(stderr, FMT_STRING("{:s}\n{:s}"), e.what(), usage);
+        return EXIT_FAILURE;
+    }
+    telemetry::log::setOutput(stderr);
+
+    auto capture_queues =
+        fiber_messages::capture::makeQueues(options.capture_queue_capacity, capture_queue_stats);
+    bioimage_coder::connectCaptureQueues(capture_queues);
+
+    NullSerialDevice serial_device{};
+    serial_port.open(serial_device.path);
+    serial_port.set_option(asio::serial_port::baud_rate{115200U});
+
+    auto& write_queue_stats = telemetry::channelStats("write", "capture", "writer",
+                                                      options.n_active_boards, 1);
+    fiber_messages::write::queue_t write_queue{options.write_queue_capacity, write_queue_stats};
+
+    const auto start = std::chrono::steady_clock::now();
+
+    std::vector<fiber> capture_tasks;
+    for (uint8_t usb_id = 0; usb_id < n_boards; usb_id++) {
+        auto& capture_queue = capture_queues[usb_id];
+        if (usb_id < options.n_active_boards) {
+            capture_tasks.emplace_back(imageCaptureWorker, usb_id, std::ref(capture_queue),
+                                       std::ref(write_queue));
+        } else {
+            capture_tasks.emplace_back(nullCaptureWorker, std::ref(capture_queue));
+        }
+    }
+
+    fiber executor_task{[&]() {
+        telemetry::alloc::stage_scope alloc_stage{"executor"};
+        options.protocol.run(options.credit_window);
+        serial_port.close();
+    }};
+    fiber write_task{fileWriteWorker, std::ref(write_queue)};
+
+    executor_task.join();
+    for (auto& c : capture_tasks) {
+        c.join();
+    }
+    write_task.join();
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    telemetry::log::flush();
+    if (telemetry::alloc::isTracking()) {
+        telemetry::alloc::printAllocationReport(stderr);
+    }
+
+    // Summarize.
+    const auto& m = telemetry::metrics();
+    uint64_t usb_frames = 0;
+    uint64_t usb_bytes = 0;
+    merged_histogram_t command_time{};
+    merged_histogram_t integration_time{};
+    merged_histogram_t skew{};
+    for (const auto& board : m.boards) {
+        for (const auto& c : board.frames_per_camera) {
+            usb_frames += c.load();
+        }
+        usb_frames += board.retries.load();
+        usb_bytes += board.bytes.load();
+        command_time.add(board.command_time);
+        integration_time.add(board.integration_time);
+        skew.add(board.completion_skew);
+    }
+    merged_histogram_t write_time{};
+    write_time.add(m.writer.write_latency);
+
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+
+    const auto seconds = elapsed.count();
+    fmt::memory_buffer out;
+    auto it = std::back_inserter(out);
+    fmt::format_to(it,
+                   FMT_STRING("{{\n  \"protocol\": \"{:s}\",\n  \"boards\": {:d},\n"
+                              "  \"capture_depth\": {:d},\n  \"write_depth\": {:d},\n"
+                              "  \"credit_window\": {:d},\n  \"elapsed_s\": {:.6f},\n"),
+                   options.protocol.name, options.n_active_boards, options.capture_queue_capacity,
+                   options.write_queue_capacity, options.credit_window, seconds);
+    fmt::format_to(it,
+                   FMT_STRING("  \"usb_frames_per_s\": {:.1f},\n  \"usb_gb_per_s\": {:.4f},\n"
+                              "  \"written_frames_per_s\": {:.1f},\n"
+                              "  \"written_gb_per_s\": {:.4f},\n"),
+                   usb_frames / seconds, usb_bytes / seconds * 1e-9,
+                   m.writer.frames.load() / seconds, m.writer.bytes.load() / seconds * 1e-9);
+
+    fmt::format_to(it, "  \"latency_us\": {{\n");
+    writeLatency(out, "capture_command", command_time);
+    fmt::format_to(it, ",\n");
+    writeLatency(out, "integration", integration_time);
+    fmt::format_to(it, ",\n");
+    writeLatency(out, "write", write_time);
+    fmt::format_to(it, ",\n");
+    writeLatency(out, "completion_skew", skew);
+    fmt::format_to(it, "\n  }},\n");
+
+    // The skew of each board, to spot the slow USB controller.
+    fmt::format_to(it, "  \"completion_skew_p90_us\": [");
+    for (size_t b = 0; b < n_boards; b++) {
+        merged_histogram_t board_skew{};
+        board_skew.add(m.boards[b].completion_skew);
+        fmt::format_to(it, FMT_STRING("{:s}{:.1f}"), (b == 0) ? "" : ", ",
+                       board_skew.percentile(90));
+    }
+    fmt::format_to(it, "],\n");
+
+    fmt::format_to(it, "  \"channel_blocked_s\": {{\n");
+    bool is_first = true;
+    for (const auto* stats :
+         {&capture_queue_stats, &write_queue_stats, &bioimage_coder::completionStats()}) {
+        std::chrono::nanoseconds push_blocked{};
+        std::chrono::nanoseconds pop_blocked{};
+        for (const auto& phase : stats->phases()) {
+            push_blocked += phase.push_blocked;
+            pop_blocked += phase.pop_blocked;
+        }
+        fmt::format_to(it, FMT_STRING("{:s}    \"{:s}\": {{\"push\": {:.6f}, \"pop\": {:.6f}}}"),
+                       is_first ? "" : ",\n", stats->name,
+                       std::chrono::duration<double>(push_blocked).count(),
+                       std::chrono::duration<double>(pop_blocked).count());
+        is_first = false;
+    }
+    fmt::format_to(it, "\n  }},\n");
+
+    // ru_maxrss is in kilobytes on Linux.
+    fmt::format_to(it, FMT_STRING("  \"peak_rss_mb\": {:.1f}\n}}\n"), usage.ru_maxrss / 1024.0);
+    std::fwrite(out.data(), 1, out.size(), stdout);
+
+    return 0;
+}
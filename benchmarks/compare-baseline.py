@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""Run the Catch2 microbenchmarks, and compare the mean timings to a baseline.
+
+Usage:
+    compare-baseline.py BENCH_EXE --baseline FILE [--tolerance 0.15]
+                        [--repetitions 3] [--output FILE] [--update]
+
+The results are stored as JSON, one entry per benchmark name with the mean and
+the standard deviation in nanoseconds, along with the host CPU model. Timings
+are comparable only between runs on the same host; the comparison warns when
+the CPU model differs from the one of the baseline. The executable runs
+several times, and the fastest mean of each benchmark is kept, to suppress the
+noise of other processes on the host.
+
+Exits with status 1 if any benchmark is slower than the baseline by more than
+the tolerance, or is missing from the results.
+"""
+
+import argparse
+import json
+import platform
+import subprocess
+import sys
+import xml.etree.ElementTree as ET
+
+
+def cpu_model():
+    try:
+        with open("/proc/cpuinfo") as f:
+            for line in f:
+                if line.startswith("model name"):
+                    return line.split(":", 1)[1].strip()
+    except OSError:
+        pass
+    return platform.processor() or platform.machine()
+
+
+def run_benchmarks(exe, repetitions):
+    """Run the Catch2 executable with the XML reporter, and keep the fastest
+    mean of each benchmark."""
+    results = {}
+    for _ in range(repetitions):
+        xml = subprocess.run([exe, "-r", "xml"], check=True, capture_output=True,
+                             text=True).stdout
+        for bench in ET.fromstring(xml).iter("BenchmarkResults"):
+            result = {
+                "mean_ns": float(bench.find("mean").get("value")),
+                "std_dev_ns": float(bench.find("standardDeviation").get("value")),
+            }
+            name = bench.get("name")
+            if name not in results or result["mean_ns"] < results[name]["mean_ns"]:
+                results[name] = result
+    return results
+
+
+def save(path, results):
+    with open(path, "w") as f:
+        json.dump({"cpu": cpu_model(), "benchmarks": results}, f, indent=2,
+                  sort_keys=True)
+        f.write("\n")
+
+
+def compare(baseline, results, tolerance):
+    if baseline["cpu"] != cpu_model():
+        print(f"Warning: baseline recorded on {baseline['cpu']}, "
+              f"running on {cpu_model()}")
+
+    n_regressions = 0
+    print(f"{'Benchmark':60s} {'baseline':>12s} {'current':>12s} {'change':>8s}")
+    for name, expected in sorted(baseline["benchmarks"].items()):
+        if name not in results:
+            print(f"{name:60s} {'missing':>12s}")
+            n_regressions += 1
+            continue
+
+        before = expected["mean_ns"]
+        after = results[name]["mean_ns"]
+        change = after / before - 1.0
+        is_regression = change > tolerance
+        n_regressions += is_regression
+        print(f"{name:60s} {before:10.1f}ns {after:10.1f}ns {change:+8.1%}"
+              f"{'  REGRESSION' if is_regression else ''}")
+
+    for name in sorted(results.keys() - baseline["benchmarks"].keys()):
+        print(f"{name:60s} {'new':>12s} {results[name]['mean_ns']:10.1f}ns")
+
+    return n_regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("exe", help="Catch2 benchmark executable")
+    parser.add_argument("--baseline", required=True, help="Baseline results in JSON")
+    parser.add_argument("--tolerance", type=float, default=0.15,
+                        help="Relative slowdown tolerated before failing")
+    parser.add_argument("--repetitions", type=int, default=3,
+                        help="Runs of the executable, keeping the fastest")
+    parser.add_argument("--output", help="Also save the current results in JSON")
+    parser.add_argument("--update", action="store_true",
+                        help="Overwrite the baseline with the current results")
+    args = parser.parse_args()
+
+    results = run_benchmarks(args.exe, args.repetitions)
+    if args.output:
+        save(args.output, results)
+    if args.update:
+        save(args.baseline, results)
+        print(f"Saved {len(results)} benchmarks to {args.baseline}")
+        return 0
+
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+    n_regressions = compare(baseline, results, args.tolerance)
+    if n_regressions > 0:
+        print(f"{n_regressions} benchmark(s) regressed beyond {args.tolerance:.0%}")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+"""Compare the compile time and the object size of the recursive executor, of
+the flat schedule and of the bytecode interpreter.
+
+Usage:
+    compare-schedule-build.py --source FILE [--build-dir DIR] [--repetitions 3]
+
+Recompiles each variant of micro/schedule-variant.cpp with the exact command
+line of compile_commands.json, i.e. with the flags of the build directory, and
+keeps the fastest wall-clock time. The object sizes are reported per ELF
+section with binutils `size`.
+"""
+
+import argparse
+import json
+import os
+import shlex
+import subprocess
+import sys
+import time
+
+
+def compile_commands(build_dir, source):
+    with open(os.path.join(build_dir, "compile_commands.json")) as f:
+        entries = json.load(f)
+    source = os.path.realpath(source)
+    return [e for e in entries
+            if os.path.realpath(os.path.join(e["directory"], e["file"])) == source]
+
+
+def variant_of(entry):
+    """E.g. "flat, instrument" for the flat schedule with the instrument
+    dispatcher."""
+    args = shlex.split(entry["command"])
+    dispatcher = "instrument" if "-DSCHEDULE_ON_INSTRUMENT" in args else "counting"
+    for arg in args:
+        if arg.startswith("-DSCHEDULE_VARIANT="):
+            return f"{arg.split('=', 1)[1]}, {dispatcher}"
+    return entry["output"]
+
+
+def compile_time(entry, repetitions):
+    fastest = float("inf")
+    for _ in range(repetitions):
+        begin = time.perf_counter()
+        subprocess.run(entry["command"], shell=True, check=True, cwd=entry["directory"])
+        fastest = min(fastest, time.perf_counter() - begin)
+    return fastest
+
+
+def section_sizes(obj):
+    """Sizes in bytes of the text, data and bss sections, in Berkeley format."""
+    out = subprocess.run(["size", obj], check=True, capture_output=True, text=True).stdout
+    text, data, bss = out.splitlines()[1].split()[:3]
+    return int(text), int(data), int(bss)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--source", required=True, help="schedule-variant.cpp")
+    parser.add_argument("--build-dir", default=os.environ.get("MESON_BUILD_ROOT", "."),
+                        help="Meson build directory with compile_commands.json")
+    parser.add_argument("--repetitions", type=int, default=3,
+                        help="Compilations of each variant, keeping the fastest")
+    args = parser.parse_args()
+
+    entries = compile_commands(args.build_dir, args.source)
+    if not entries:
+        print(f"{args.source} not found in {args.build_dir}/compile_commands.json")
+        return 1
+
+    print(f"{'Variant':24s} {'compile':>10s} {'text':>10s} {'data':>10s} {'object':>10s}")
+    for entry in sorted(entries, key=variant_of):
+        seconds = compile_time(entry, args.repetitions)
+        obj = os.path.join(entry["directory"], entry["output"])
+        text, data, _ = section_sizes(obj)
+        print(f"{variant_of(entry):24s} {seconds:9.2f}s {text:9d}B {data:9d}B "
+              f"{os.path.getsize(obj):9d}B")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
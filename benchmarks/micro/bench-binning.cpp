@@ -0,0 +1,29 @@
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <numeric>
+#include <vector>
+
+#include "binning-variants.h"
+#include "constants.h"
+
+TEST_CASE("Live preview binning of one frame", "[binning]") {
+    std::vector<uint8_t> frame(camera::n_pixels);
+    std::iota(frame.begin(), frame.end(), uint8_t{0});
+    std::vector<uint32_t> row_sums(camera::width);
+    std::vector<uint16_t> preview(camera::n_pixels / 64);
+
+    // Both variants must agree before their timings are compared.
+    std::vector<uint16_t> expected(preview.size());
+    const auto expected_stats = bench::generic::binFrame8(frame, row_sums, expected);
+    const auto stats = bench::native::binFrame8(frame, row_sums, preview);
+    REQUIRE(preview == expected);
+    REQUIRE(stats.mean == expected_stats.mean);
+
+    BENCHMARK("binFrame<8>, default flags") {
+        return bench::generic::binFrame8(frame, row_sums, preview).max;
+    };
+
+    BENCHMARK("binFrame<8>, workers_lib flags") {
+        return bench::native::binFrame8(frame, row_sums, preview).max;
+    };
+}
@@ -0,0 +1,76 @@
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <vector>
+
+#include "constants.h"
+#include "frame-capture-card.h"
+#include "frame-header.h"
+#include "mock_usb.h"
+
+using hardware_drivers::MockUSB;
+using message_router::FrameCaptureCard;
+using std::chrono::milliseconds;
+using namespace std::chrono_literals;
+
+namespace {
+
+/** Mock USB interface sending `n_garbage` bulk transfers without the frame
+ * signature ahead of every frame, to exercise the header search. */
+class ResyncUSB : public MockUSB {
+   public:
+    static constexpr int n_garbage = 16;
+
+    ResyncUSB(uint8_t usb_id) : MockUSB{usb_id} {}
+
+    [[nodiscard]] int bulk_read(milliseconds timeout = 400ms,
+                                std::optional<nonstd::span<uint8_t>> dst_buffer = std::nullopt) {
+        if (dst_buffer == std::nullopt && n_remaining > 0) {
+            n_remaining--;
+            std::fill_n(buffer.begin(), sizeof(uint32_t), uint8_t{0xFF});
+            return buffer.size();
+        }
+        if (dst_buffer != std::nullopt) {
+            n_remaining = n_garbage;
+        }
+        return MockUSB::bulk_read(timeout, dst_buffer);
+    }
+
+   private:
+    int n_remaining{n_garbage};
+};
+
+}  // namespace
+
+TEST_CASE("Capture one frame over mock USB", "[capture]") {
+    std::vector<uint8_t> raw_pixels(camera::n_pixels);
+
+    FrameCaptureCard<MockUSB> capture_card{0};
+    BENCHMARK("captureSingleFrame, MockUSB") {
+        return capture_card.captureSingleFrame<false>(raw_pixels);
+    };
+
+    FrameCaptureCard<ResyncUSB> resync_card{0};
+    const auto resyncs_before = resync_card.stats().header_resyncs;
+    resync_card.captureSingleFrame<false>(raw_pixels);
+    REQUIRE(resync_card.stats().header_resyncs - resyncs_before == ResyncUSB::n_garbage);
+
+    BENCHMARK("captureSingleFrame, 16 header resyncs") {
+        return resync_card.captureSingleFrame<false>(raw_pixels);
+    };
+}
+
+TEST_CASE("Decode the frame header", "[capture]") {
+    using namespace frame_capture_card::frame_header;
+
+    MockUSB usb{0};
+    REQUIRE(usb.bulk_read() > 0);
+
+    BENCHMARK("Signature check") {
+        return (usb.decode<uint32_t>() & 0xffffff00) == frame_capture_card::constants::signature;
+    };
+
+    BENCHMARK("Runway and header decode") {
+        const header_t header = usb.decode<header_t>(headerOffset(usb.decode<runway_t>()));
+        return header.cam_id + header.led_id;
+    };
+}
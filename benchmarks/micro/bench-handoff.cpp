@@ -0,0 +1,46 @@
+#include <boost/fiber/buffered_channel.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <utility>
+#include <vector>
+
+#include "constants.h"
+#include "fiber-messages.h"
+#include "instrumented-channel.h"
+
+using boost::fibers::channel_op_status;
+using fiber_messages::write::fpm_frame_t;
+
+TEST_CASE("Hand off one frame to the file writer", "[handoff]") {
+    constexpr size_t capacity = 4;
+
+    // Push and pop from the same fiber, so that neither operation blocks. The
+    // cost is the channel itself, plus moving the frame in and out of it.
+    std::vector<uint8_t> frame(camera::n_pixels);
+
+    boost::fibers::buffered_channel<std::vector<uint8_t>> raw_channel{capacity};
+    BENCHMARK("buffered_channel push and pop") {
+        raw_channel.push(std::move(frame));
+        raw_channel.pop(frame);
+        return frame.size();
+    };
+
+    auto& stats = telemetry::channelStats("bench", "bench", "bench");
+    telemetry::instrumented_channel<std::vector<uint8_t>> channel{capacity, stats};
+    BENCHMARK("instrumented_channel push and pop") {
+        channel.push(std::move(frame));
+        channel.pop(frame);
+        return frame.size();
+    };
+
+    // The message type of the write queue, as constructed by the capture worker.
+    fiber_messages::write::queue_t write_queue{capacity, stats};
+    fiber_messages::write::command_t message{};
+    BENCHMARK("write::queue_t push and pop of fpm_frame_t") {
+        write_queue.push(fpm_frame_t{0, {4, 0xEE}, std::move(frame)});
+        write_queue.pop(message);
+        frame = std::move(std::get<fpm_frame_t>(message).image_frame);
+        return frame.size();
+    };
+    REQUIRE(frame.size() == camera::n_pixels);
+}
@@ -0,0 +1,24 @@
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include "schedule-protocol.h"
+
+namespace schedule = bench::schedule;
+
+TEST_CASE("Dispatch the steps of a long protocol", "[schedule]") {
+    const auto recursive = schedule::recursive::run();
+    const auto flat = schedule::flat::run();
+    const auto bytecode = schedule::bytecode::run();
+    REQUIRE(recursive.n_commands == schedule::n_commands);
+    REQUIRE(flat.n_commands == recursive.n_commands);
+    REQUIRE(flat.checksum == recursive.checksum);
+    REQUIRE(bytecode.n_commands == recursive.n_commands);
+    REQUIRE(bytecode.checksum == recursive.checksum);
+
+    BENCHMARK("Recursive executor, 10.9k steps") { return schedule::recursive::run(); };
+
+    BENCHMARK("Flat schedule, 10.9k steps") { return schedule::flat::run(); };
+
+    // Including the decoding of the operands. The protocol sleeps for 36 s.
+    BENCHMARK("Bytecode interpreter, 10.9k steps") { return schedule::bytecode::run(); };
+}
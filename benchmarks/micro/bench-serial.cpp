@@ -0,0 +1,23 @@
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include "message_router.h"
+#include "mock_serial.h"
+
+using hardware_drivers::MockSerial;
+using message_router::MessageOverSerial;
+
+TEST_CASE("Encode the serial commands", "[serial]") {
+    MockSerial serial{};
+    MessageOverSerial encoder{serial};
+
+    BENCHMARK("MessageOverSerial, led_matrix::switch_to") {
+        encoder.sendCommand(message::led_matrix::switch_to{3, 14});
+        return serial.last_command_length;
+    };
+
+    BENCHMARK("MessageOverSerial, motion::move_to_z") {
+        encoder.sendCommand(message::motion::move_to_z{-4});
+        return serial.last_command_length;
+    };
+}
@@ -0,0 +1,29 @@
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <numeric>
+#include <vector>
+
+#include "constants.h"
+#include "time-integration-variants.h"
+
+TEST_CASE("Time integration of one frame", "[time_integration]") {
+    std::vector<uint8_t> raw_pixels(camera::n_pixels);
+    std::iota(raw_pixels.begin(), raw_pixels.end(), uint8_t{0});
+    std::vector<uint16_t> accumulated(camera::n_pixels);
+
+    // Both variants must agree before their timings are compared.
+    std::vector<uint16_t> expected(camera::n_pixels);
+    bench::generic::accumulateFrame(raw_pixels, expected);
+    bench::native::accumulateFrame(raw_pixels, accumulated);
+    REQUIRE(accumulated == expected);
+
+    BENCHMARK("accumulateFrame, default flags") {
+        bench::generic::accumulateFrame(raw_pixels, accumulated);
+        return accumulated[0];
+    };
+
+    BENCHMARK("accumulateFrame, workers_lib flags") {
+        bench::native::accumulateFrame(raw_pixels, accumulated);
+        return accumulated[0];
+    };
+}
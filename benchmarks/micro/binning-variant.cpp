@@ -0,0 +1,18 @@
+/** Instantiated twice by meson.build, with and without the vectorization flags. */
+#include "binning-variants.h"
+
+#include "constants.h"
+
+#ifndef TIME_INTEGRATION_VARIANT
+#error "Define TIME_INTEGRATION_VARIANT as either native or generic."
+#endif
+
+namespace bench::TIME_INTEGRATION_VARIANT {
+
+frame_stats_t
+binFrame8(nonstd::span<const uint8_t> frame, nonstd::span<uint32_t> row_sums,
+          nonstd::span<uint16_t> preview) {
+    return ::binFrame<8>(frame, camera::width, camera::height, row_sums, preview);
+}
+
+}  // namespace bench::TIME_INTEGRATION_VARIANT
@@ -0,0 +1,21 @@
+#pragma once
+#include <cstdint>
+#include <nonstd/span.hpp>
+
+#include "binning.h"
+
+/** The 8x binning kernel of workers/inc/binning.h, compiled as the time
+ * integration kernel of time-integration-variants.h. */
+namespace bench {
+
+namespace native {
+frame_stats_t binFrame8(nonstd::span<const uint8_t> frame, nonstd::span<uint32_t> row_sums,
+                        nonstd::span<uint16_t> preview);
+}  // namespace native
+
+namespace generic {
+frame_stats_t binFrame8(nonstd::span<const uint8_t> frame, nonstd::span<uint32_t> row_sums,
+                        nonstd::span<uint16_t> preview);
+}  // namespace generic
+
+}  // namespace bench
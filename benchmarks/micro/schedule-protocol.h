@@ -0,0 +1,95 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <tuple>
+#include <utility>
+
+#include "bioimage-coder/repeat-for.hpp"
+#include "fiber-messages.h"
+#include "messages.h"
+
+/** Synthetic protocol, one order of magnitude longer than the amgen protocol,
+ * for comparing the recursive executor, the flat schedule and the bytecode
+ * interpreter.
+ *
+ * Each of the z-planes is a separate protocol phase, with one FPM frame per LED
+ * of the 15 x 15 matrix, and one fluorescence frame per excitation channel.
+ */
+namespace bench::schedule {
+
+using namespace std::chrono_literals;
+
+constexpr uint8_t n_leds = 225;
+constexpr int16_t n_z_planes = 16;
+constexpr int16_t n_channels = 2;
+
+struct counters_t {
+    uint64_t n_commands{};
+    uint64_t checksum{};
+};
+
+/** Replaces the instrument. Cheap enough for the dispatch itself to dominate. */
+struct counting_dispatcher_t {
+    counters_t counters{};
+
+    template <typename T>
+    void operator()(const T&) {
+        counters.n_commands++;
+        counters.checksum += sizeof(T);
+    }
+};
+
+constexpr auto
+fpmStep(const uint8_t led_id) {
+    return std::tuple{message::SleepFor{10ms}, fiber_messages::capture::fpm_frame_t{led_id},
+                      message::led_matrix::next{}};
+}
+
+/** @param[in] k z-plane index times the number of channels, plus the channel. */
+constexpr auto
+fluorescenceStep(const int16_t k) {
+    const int16_t z = k / n_channels;
+    const auto channel = (k % n_channels == 0) ? EGFP : TXRED;
+    return std::tuple{message::excitation::laser{1s, 16, channel},
+                      fiber_messages::capture::fluorescence_frame_t{z, channel}};
+}
+
+template <int16_t z>
+constexpr auto
+zPlane() {
+    return std::tuple{
+        std::tuple{message::motion::move_to_z{z}, message::led_matrix::switch_to{0, 0}},
+        bioimage_coder::repeat_for(bioimage_coder::Range<'i', uint8_t>{0, n_leds}, fpmStep),
+        bioimage_coder::repeat_for(
+            bioimage_coder::Range<'c', int16_t>{z * n_channels, (z + 1) * n_channels},
+            fluorescenceStep),
+    };
+}
+
+template <int16_t... z>
+constexpr auto
+zStack(std::integer_sequence<int16_t, z...>) {
+    return std::tuple_cat(zPlane<z>()...);
+}
+
+constexpr auto
+largeProtocol() {
+    return zStack(std::make_integer_sequence<int16_t, n_z_planes>{});
+}
+
+constexpr uint64_t n_commands = n_z_planes * (2 + 3 * n_leds + 2 * n_channels);
+
+/** Execute largeProtocol() once, with the variants of schedule-variant.cpp. */
+namespace recursive {
+counters_t run();
+}  // namespace recursive
+
+namespace flat {
+counters_t run();
+}  // namespace flat
+
+namespace bytecode {
+counters_t run();
+}  // namespace bytecode
+
+}  // namespace bench::schedule
@@ -0,0 +1,56 @@
+/** Instantiated six times by meson.build, with the recursive executor, with
+ * the flat schedule and with the bytecode interpreter, each with the counting
+ * dispatcher of the benchmarks and with the instrument dispatcher of the apps.
+ * compare-schedule-build.py measures the compile time and the object size of
+ * each separately. */
+#include "bioimage-coder/executor.hpp"
+#include "schedule-protocol.h"
+
+#ifdef SCHEDULE_VARIANT_BYTECODE
+#include "bioimage-coder/interpreter.hpp"
+#endif
+
+#ifndef SCHEDULE_VARIANT
+#error "Define SCHEDULE_VARIANT as either recursive, flat or bytecode."
+#endif
+
+namespace bench::schedule::SCHEDULE_VARIANT {
+
+#ifdef SCHEDULE_VARIANT_BYTECODE
+/** Validated once, as capture-images does at startup. */
+const bioimage_coder::bytecode_program_t&
+program() {
+    static constexpr auto code = bioimage_coder::compileBytecode<largeProtocol>();
+    static const bioimage_coder::bytecode_program_t validated{{code.begin(), code.end()}};
+    return validated;
+}
+#endif
+
+#ifdef SCHEDULE_ON_INSTRUMENT
+/** Compiled, but not linked, since the instrument is injected at link-time. */
+void
+runOnInstrument() {
+#ifdef SCHEDULE_VARIANT_FLAT
+    bioimage_coder::executeSchedule<largeProtocol>();
+#elif defined(SCHEDULE_VARIANT_BYTECODE)
+    bioimage_coder::interpret(program());
+#else
+    bioimage_coder::execute(largeProtocol());
+#endif
+}
+#else
+counters_t
+run() {
+    counting_dispatcher_t dispatcher{};
+#ifdef SCHEDULE_VARIANT_FLAT
+    bioimage_coder::schedule_t<largeProtocol>::run(dispatcher);
+#elif defined(SCHEDULE_VARIANT_BYTECODE)
+    bioimage_coder::interpret(program(), dispatcher);
+#else
+    bioimage_coder::execute(largeProtocol(), dispatcher);
+#endif
+    return dispatcher.counters;
+}
+#endif
+
+}  // namespace bench::schedule::SCHEDULE_VARIANT
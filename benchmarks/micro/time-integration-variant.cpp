@@ -0,0 +1,17 @@
+/** Instantiated twice by meson.build, with and without the vectorization flags. */
+#include "time-integration-variants.h"
+
+#include "time-integration.h"
+
+#ifndef TIME_INTEGRATION_VARIANT
+#error "Define TIME_INTEGRATION_VARIANT as either native or generic."
+#endif
+
+namespace bench::TIME_INTEGRATION_VARIANT {
+
+void
+accumulateFrame(nonstd::span<const uint8_t> raw_pixels, nonstd::span<uint16_t> accumulated) {
+    ::accumulateFrame(raw_pixels, accumulated);
+}
+
+}  // namespace bench::TIME_INTEGRATION_VARIANT
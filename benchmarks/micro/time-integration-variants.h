@@ -0,0 +1,18 @@
+#pragma once
+#include <cstdint>
+#include <nonstd/span.hpp>
+
+/** The time integration kernel of workers/inc/time-integration.h, compiled
+ * both with the vectorization flags of the workers library and with the
+ * default flags, so that the two can be compared in the same binary. */
+namespace bench {
+
+namespace native {
+void accumulateFrame(nonstd::span<const uint8_t> raw_pixels, nonstd::span<uint16_t> accumulated);
+}  // namespace native
+
+namespace generic {
+void accumulateFrame(nonstd::span<const uint8_t> raw_pixels, nonstd::span<uint16_t> accumulated);
+}  // namespace generic
+
+}  // namespace bench
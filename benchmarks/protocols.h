@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+#include <utility>
+
+#include "bioimage-coder/run-ahead.hpp"
+
+/** Protocols to benchmark. Each one is compiled in its own translation unit,
+ * because the protocol headers of the apps are not meant to be mixed. */
+namespace bench {
+
+/** The full Amgen 2019 protocol of apps/amgen2019-full, including the 500 ms
+ * settling time of the z-stage. */
+void runAmgen2019Full(size_t credit_window);
+
+/** FPM frames at 49 LED positions, back-to-back. Bound by the frame capture. */
+void runFpmBurst(size_t credit_window);
+
+/** Fluorescence frames at 8 z-positions, back-to-back. Bound by the digital
+ * time integration. */
+void runFluorescenceBurst(size_t credit_window);
+
+/** Execute the protocol with the boards in lockstep, or in the run-ahead mode
+ * for a positive credit window. */
+template <typename Protocol>
+void
+run(Protocol&& protocol, const size_t credit_window) {
+    if (credit_window > 0) {
+        bioimage_coder::executeRunAhead(std::forward<Protocol>(protocol), credit_window);
+    } else {
+        bioimage_coder::execute(std::forward<Protocol>(protocol));
+    }
+}
+
+using protocol_fn = void (*)(size_t credit_window);
+
+struct protocol_entry_t {
+    std::string_view name;
+    protocol_fn run;
+};
+
+constexpr protocol_entry_t protocols[] = {
+    {"amgen2019-full", runAmgen2019Full},
+    {"fpm-burst", runFpmBurst},
+    {"fluorescence-burst", runFluorescenceBurst},
+};
+
+}  // namespace bench
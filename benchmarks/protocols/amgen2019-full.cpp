@@ -0,0 +1,8 @@
+#include "bioimage-coder/executor.hpp"
+#include "main_protocol.hpp"
+#include "protocols.h"
+
+void
+bench::runAmgen2019Full(const size_t credit_window) {
+    run(mainProtocol(), credit_window);
+}
@@ -0,0 +1,46 @@
+#include <chrono>
+#include <tuple>
+
+#include "bioimage-coder/executor.hpp"
+#include "bioimage-coder/repeat-for.hpp"
+#include "fiber-messages.h"
+#include "messages.h"
+#include "protocols.h"
+
+#define Steps std::tuple
+
+namespace {
+
+using namespace std::chrono_literals;
+using bioimage_coder::Range;
+using bioimage_coder::repeat_for;
+using fiber_messages::capture::fluorescence_frame_t;
+using message::CloseAllCameraWorkers;
+using message::excitation::laser;
+using message::excitation::laser_off;
+
+constexpr auto
+fluorescenceBurst(const int16_t z) {
+    return Steps{
+        laser{1s, 16, EGFP},            // Turn on laser EGFP
+        fluorescence_frame_t{z, EGFP},  // Capture fluorescence images
+    };
+}
+
+constexpr auto
+mainProtocol() {
+    return Steps{
+        repeat_for(Range<'z', int16_t>{0, 8}, fluorescenceBurst),  //
+        Steps{
+            CloseAllCameraWorkers{},  // Closes all file writers
+            laser_off                 //
+        }  //
+    };
+}
+
+}  // namespace
+
+void
+bench::runFluorescenceBurst(const size_t credit_window) {
+    run(mainProtocol(), credit_window);
+}
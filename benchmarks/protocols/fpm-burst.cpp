@@ -0,0 +1,44 @@
+#include <tuple>
+
+#include "bioimage-coder/executor.hpp"
+#include "bioimage-coder/repeat-for.hpp"
+#include "fiber-messages.h"
+#include "messages.h"
+#include "protocols.h"
+
+#define Steps std::tuple
+
+namespace {
+
+using bioimage_coder::Range;
+using bioimage_coder::repeat_for;
+using fiber_messages::capture::fpm_frame_t;
+using message::CloseAllCameraWorkers;
+using message::led_matrix::blank;
+using message::led_matrix::next;
+
+constexpr auto
+fpmBurst(const uint8_t led_id) {
+    return Steps{
+        fpm_frame_t{led_id},  // Capture frames
+        next{}                // Move to the next LED
+    };
+}
+
+constexpr auto
+mainProtocol() {
+    return Steps{
+        repeat_for(Range<'i', uint8_t>{0, 49}, fpmBurst),  //
+        Steps{
+            blank{},                 // Turn off LED.
+            CloseAllCameraWorkers{}  // Closes all file writers
+        }  //
+    };
+}
+
+}  // namespace
+
+void
+bench::runFpmBurst(const size_t credit_window) {
+    run(mainProtocol(), credit_window);
+}
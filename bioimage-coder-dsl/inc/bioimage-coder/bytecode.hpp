@@ -0,0 +1,669 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "bioimage-coder/concurrently.hpp"
+#include "bioimage-coder/schedule.hpp"
+#include "constants.h"
+#include "fiber-messages.h"
+#include "messages.h"
+
+namespace bioimage_coder {
+
+/** Compact binary format of the flat schedule, for running protocols without
+ * recompiling capture-images.
+ *
+ * All integers are little-endian. The file starts with the header
+ *
+ *     "BIOC"   magic
+ *     u8       format version
+ *     u8       reserved, zero
+ *     u16      number of protocol phases, N
+ *     u32[N+1] byte offset of each phase in the code, then of the code end
+ *
+ * followed by the code: one opcode byte per command, then its operands, as
+ * encoded by the encode() overloads below. A concurrently() block is encoded
+ * as the number of captures, the size of its code in bytes, then the code of
+ * its steps.
+ *
+ * The opcode values are part of the format. Append new commands at the end,
+ * and bump `version` on any other change.
+ */
+namespace bytecode {
+
+constexpr std::array<uint8_t, 4> magic{'B', 'I', 'O', 'C'};
+constexpr uint8_t version = 3;
+
+enum class opcode_t : uint8_t {
+    dark_frame,
+    fpm_frame,
+    fluorescence_frame,
+    init_sequence,
+    exposure_gain,
+    close_all_camera_workers,
+    sleep_for,
+    switch_to,
+    blank,
+    next,
+    color,
+    move_to_z,
+    laser,
+    concurrently,
+    wait_settled,
+    n_opcodes,
+};
+
+constexpr size_t n_opcodes = size_t(opcode_t::n_opcodes);
+
+/** concurrently() block of the bytecode. The steps are decoded on the fly by
+ * forEach(), so that dispatchConcurrently() runs it as it runs a
+ * concurrently_t. */
+struct block_t {
+    size_t n_captures{};
+    const uint8_t* code{nullptr};
+    size_t n_bytes{};
+
+    template <class Visitor>
+    void forEach(Visitor&& visit) const;
+};
+
+/** Command type of each opcode, in opcode order. */
+using command_types_t =
+    std::tuple<fiber_messages::capture::dark_frame_t, fiber_messages::capture::fpm_frame_t,
+               fiber_messages::capture::fluorescence_frame_t,
+               fiber_messages::capture::camera::init_sequence_t,
+               fiber_messages::capture::camera::exposure_gain_t, message::CloseAllCameraWorkers,
+               message::SleepFor, message::led_matrix::switch_to, message::led_matrix::blank,
+               message::led_matrix::next, message::led_matrix::color_t,
+               message::motion::move_to_z, message::excitation::laser, block_t,
+               message::WaitSettled>;
+static_assert(std::tuple_size_v<command_types_t> == n_opcodes);
+
+template <typename T, size_t op = 0>
+constexpr opcode_t
+opcodeOf() {
+    if constexpr (op == n_opcodes) {
+        static_assert(op < n_opcodes, "Command not supported by the bytecode.");
+        return opcode_t::n_opcodes;
+    } else if constexpr (std::is_same_v<T, std::tuple_element_t<op, command_types_t>>) {
+        return opcode_t(op);
+    } else {
+        return opcodeOf<T, op + 1>();
+    }
+}
+
+/** Commands to the capture workers, through the capture queues. */
+constexpr bool
+isCaptureCommand(const opcode_t op) {
+    switch (op) {
+        case opcode_t::dark_frame:
+        case opcode_t::fpm_frame:
+        case opcode_t::fluorescence_frame:
+        case opcode_t::init_sequence:
+        case opcode_t::exposure_gain:
+        case opcode_t::concurrently:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/** Steps allowed in a concurrently() block, as by checkConcurrentStep(). */
+constexpr bool
+isConcurrentStep(const opcode_t op) {
+    switch (op) {
+        case opcode_t::dark_frame:
+        case opcode_t::fpm_frame:
+        case opcode_t::fluorescence_frame:
+        case opcode_t::sleep_for:
+        case opcode_t::switch_to:
+        case opcode_t::blank:
+        case opcode_t::next:
+        case opcode_t::color:
+        case opcode_t::move_to_z:
+        case opcode_t::wait_settled:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/** Appends little-endian integers to the buffer, or only counts the bytes if
+ * the buffer is null. */
+struct writer_t {
+    uint8_t* data{nullptr};
+    size_t size{0};
+
+    constexpr void u8(const uint8_t v) {
+        if (data != nullptr) {
+            data[size] = v;
+        }
+        size++;
+    }
+    constexpr void u16(const uint16_t v) {
+        u8(uint8_t(v & 0xff));
+        u8(uint8_t(v >> 8));
+    }
+    constexpr void u32(const uint32_t v) {
+        u16(uint16_t(v & 0xffff));
+        u16(uint16_t(v >> 16));
+    }
+
+    /** Overwrite the u32 at the given offset. */
+    constexpr void patchU32(const size_t offset, const uint32_t v) {
+        writer_t patch{data, offset};
+        patch.u32(v);
+    }
+};
+
+/** Reads little-endian integers. Bounds are checked once, by bytecode_program_t. */
+struct reader_t {
+    const uint8_t* pc;
+
+    constexpr uint8_t u8() { return *pc++; }
+    constexpr uint16_t u16() {
+        const uint16_t lo = u8();
+        return uint16_t(lo | (uint16_t{u8()} << 8));
+    }
+    constexpr uint32_t u32() {
+        const uint32_t lo = u16();
+        return lo | (uint32_t{u16()} << 16);
+    }
+};
+
+constexpr void
+encode(writer_t&, const fiber_messages::capture::dark_frame_t&) {}
+
+constexpr void
+encode(writer_t& out, const fiber_messages::capture::fpm_frame_t& c) {
+    out.u8(c.led_id);
+}
+
+constexpr void
+encode(writer_t& out, const fiber_messages::capture::fluorescence_frame_t& c) {
+    out.u16(uint16_t(c.zpos));
+    out.u8(c.ch);
+}
+
+constexpr void
+encode(writer_t& out, const fiber_messages::capture::camera::init_sequence_t& c) {
+    out.u8(uint8_t(c.count));
+    for (size_t i = 0; i < c.count; i++) {
+        out.u16(c.commands[i].addr);
+        out.u8(c.commands[i].value);
+    }
+}
+
+constexpr void
+encode(writer_t& out, const fiber_messages::capture::camera::exposure_gain_t& c) {
+    for (const auto& i2c : {c.exposure_lb, c.exposure_ub, c.log2_analog_gain}) {
+        out.u16(i2c.addr);
+        out.u8(i2c.value);
+    }
+}
+
+constexpr void
+encode(writer_t&, const message::CloseAllCameraWorkers&) {}
+
+constexpr void
+encode(writer_t& out, const message::SleepFor& c) {
+    out.u32(uint32_t(c.duration.count()));
+}
+
+constexpr void
+encode(writer_t& out, const message::led_matrix::switch_to& c) {
+    out.u8(c.x);
+    out.u8(c.y);
+}
+
+constexpr void
+encode(writer_t&, const message::led_matrix::blank&) {}
+
+constexpr void
+encode(writer_t&, const message::led_matrix::next&) {}
+
+constexpr void
+encode(writer_t& out, const message::led_matrix::color_t& c) {
+    out.u8(uint8_t(c));
+}
+
+constexpr void
+encode(writer_t& out, const message::motion::move_to_z& c) {
+    out.u16(uint16_t(c.value));
+}
+
+constexpr void
+encode(writer_t& out, const message::excitation::laser& c) {
+    out.u16(uint16_t(c.time.count()));
+    out.u8(c.power);
+    out.u8(c.ch);
+}
+
+constexpr void
+encode(writer_t& out, const message::WaitSettled& c) {
+    out.u32(uint32_t(c.timeout.count()));
+    out.u32(uint32_t(c.min_settle.count()));
+}
+
+template <typename T>
+constexpr void
+encodeCommand(writer_t& out, const T& command) {
+    out.u8(uint8_t(opcodeOf<T>()));
+    encode(out, command);
+}
+
+template <typename... Commands>
+constexpr void
+encode(writer_t& out, const concurrently_t<Commands...>& block) {
+    static_assert(concurrently_t<Commands...>::n_captures <= UINT8_MAX,
+                  "Too many captures in the concurrently() block for the bytecode.");
+    writer_t counter{};
+    block.forEach([&](const auto& step) { encodeCommand(counter, step); });
+    if (counter.size > UINT16_MAX) {
+        throw std::length_error("concurrently() block too long for the bytecode");
+    }
+
+    out.u8(uint8_t(block.n_captures));
+    out.u16(uint16_t(counter.size));
+    block.forEach([&](const auto& step) { encodeCommand(out, step); });
+}
+
+template <typename... Commands>
+constexpr void
+encodeCommand(writer_t& out, const concurrently_t<Commands...>& block) {
+    out.u8(uint8_t(opcode_t::concurrently));
+    encode(out, block);
+}
+
+constexpr void
+decode(reader_t&, fiber_messages::capture::dark_frame_t&) {}
+
+constexpr void
+decode(reader_t& in, fiber_messages::capture::fpm_frame_t& c) {
+    c.led_id = in.u8();
+}
+
+constexpr void
+decode(reader_t& in, fiber_messages::capture::fluorescence_frame_t& c) {
+    c.zpos = int16_t(in.u16());
+    c.ch = channel_t(in.u8());
+}
+
+constexpr void
+decode(reader_t& in, fiber_messages::capture::camera::init_sequence_t& c) {
+    c.count = in.u8();
+    for (size_t i = 0; i < c.count; i++) {
+        c.commands[i].addr = in.u16();
+        c.commands[i].value = in.u8();
+    }
+}
+
+constexpr void
+decode(reader_t& in, fiber_messages::capture::camera::exposure_gain_t& c) {
+    for (auto* i2c : {&c.exposure_lb, &c.exposure_ub, &c.log2_analog_gain}) {
+        i2c->addr = in.u16();
+        i2c->value = in.u8();
+    }
+}
+
+constexpr void
+decode(reader_t&, message::CloseAllCameraWorkers&) {}
+
+constexpr void
+decode(reader_t& in, message::SleepFor& c) {
+    c.duration = std::chrono::milliseconds{in.u32()};
+}
+
+constexpr void
+decode(reader_t& in, message::led_matrix::switch_to& c) {
+    c.x = in.u8();
+    c.y = in.u8();
+}
+
+constexpr void
+decode(reader_t&, message::led_matrix::blank&) {}
+
+constexpr void
+decode(reader_t&, message::led_matrix::next&) {}
+
+constexpr void
+decode(reader_t& in, message::led_matrix::color_t& c) {
+    c = message::led_matrix::color_t(in.u8());
+}
+
+constexpr void
+decode(reader_t& in, message::motion::move_to_z& c) {
+    c.value = int16_t(in.u16());
+}
+
+constexpr void
+decode(reader_t& in, message::excitation::laser& c) {
+    c.time = std::chrono::seconds{in.u16()};
+    c.power = in.u8();
+    c.ch = channel_t(in.u8());
+}
+
+constexpr void
+decode(reader_t& in, message::WaitSettled& c) {
+    c.timeout = std::chrono::milliseconds{in.u32()};
+    c.min_settle = std::chrono::milliseconds{in.u32()};
+}
+
+inline void
+decode(reader_t& in, block_t& c) {
+    c.n_captures = in.u8();
+    c.n_bytes = in.u16();
+    c.code = in.pc;
+    in.pc += c.n_bytes;
+}
+
+/** Decode the command with the given opcode, and call visit() on it. */
+template <class Visitor, size_t... op>
+void
+visitCommand(const opcode_t opcode, reader_t& in, Visitor&& visit, std::index_sequence<op...>) {
+    ((size_t(opcode) == op && ([&]() {
+          std::tuple_element_t<op, command_types_t> command{};
+          decode(in, command);
+          visit(command);
+      }(),
+      true)) ||
+     ...);
+}
+
+/** Only the steps allowed in a concurrently() block are instantiated. */
+template <class Visitor>
+void
+block_t::forEach(Visitor&& visit) const {
+    using step_opcodes_t =
+        std::index_sequence<size_t(opcode_t::dark_frame), size_t(opcode_t::fpm_frame),
+                            size_t(opcode_t::fluorescence_frame), size_t(opcode_t::sleep_for),
+                            size_t(opcode_t::switch_to), size_t(opcode_t::blank),
+                            size_t(opcode_t::next), size_t(opcode_t::color),
+                            size_t(opcode_t::move_to_z), size_t(opcode_t::wait_settled)>;
+    reader_t in{code};
+    while (in.pc < code + n_bytes) {
+        const auto op = opcode_t(in.u8());
+        visitCommand(op, in, visit, step_opcodes_t{});
+    }
+}
+
+constexpr size_t header_bytes = magic.size() + 2 + sizeof(uint16_t);
+
+/** Encode the flat schedule, or only count its bytes with a null writer. */
+template <auto protocol_fn, auto table_fn>
+constexpr void
+encodeSchedule(writer_t& out) {
+    using schedule = schedule_t<protocol_fn, table_fn>;
+    static_assert(schedule::n_phases <= UINT16_MAX, "Too many protocol phases for the bytecode.");
+    constexpr auto& table = schedule::table;
+
+    for (const auto m : magic) {
+        out.u8(m);
+    }
+    out.u8(version);
+    out.u8(0);
+    out.u16(uint16_t(schedule::n_phases));
+
+    const size_t phase_table = out.size;
+    for (size_t p = 0; p <= schedule::n_phases; p++) {
+        out.u32(0);
+    }
+
+    const size_t code_begin = out.size;
+    for (size_t p = 0; p < schedule::n_phases; p++) {
+        out.patchU32(phase_table + p * sizeof(uint32_t), uint32_t(out.size - code_begin));
+        for (auto k = table.phase_begin[p]; k < table.phase_begin[p + 1]; k++) {
+            schedule_detail::visitRecord(table, table.records[k],
+                                         [&](const auto& command) { encodeCommand(out, command); });
+        }
+    }
+    out.patchU32(phase_table + schedule::n_phases * sizeof(uint32_t),
+                 uint32_t(out.size - code_begin));
+}
+
+template <auto protocol_fn, auto table_fn>
+constexpr size_t
+encodedSize() {
+    writer_t counter{};
+    encodeSchedule<protocol_fn, table_fn>(counter);
+    return counter.size;
+}
+
+}  // namespace bytecode
+
+template <>
+struct is_concurrently_t<bytecode::block_t> : std::true_type {};
+
+/** Compile the flat schedule of the protocol to bytecode, at compile time.
+ *
+ * @tparam table_fn constexpr function returning the table, as in schedule_t.
+ */
+template <auto protocol_fn, auto table_fn = schedule_detail::buildTable<protocol_fn>>
+constexpr auto
+compileBytecode() {
+    std::array<uint8_t, bytecode::encodedSize<protocol_fn, table_fn>()> code{};
+    bytecode::writer_t out{code.data()};
+    bytecode::encodeSchedule<protocol_fn, table_fn>(out);
+    return code;
+}
+
+/** Bytecode validated once at load time, so that the interpreter decodes it
+ * without bounds checks.
+ *
+ * @throws std::invalid_argument on a truncated or malformed bytecode, on an
+ * unsupported format version, or on a program that does not close the camera
+ * workers once, after its last capture.
+ */
+class bytecode_program_t {
+   public:
+    explicit bytecode_program_t(std::vector<uint8_t> bytecode) : bytes{std::move(bytecode)} {
+        validate();
+    }
+
+    /** @throws std::runtime_error if the file cannot be read. */
+    static bytecode_program_t load(const std::string& path) {
+        std::ifstream file{path, std::ios::binary};
+        if (!file) {
+            throw std::runtime_error("Cannot open the protocol bytecode " + path);
+        }
+        return bytecode_program_t{
+            std::vector<uint8_t>(std::istreambuf_iterator<char>{file}, {})};
+    }
+
+    size_t phases() const { return n_phases; }
+
+    /** Code of the phase, as [begin, end). */
+    const uint8_t* phaseBegin(const size_t phase) const { return code + offset(phase); }
+    const uint8_t* phaseEnd(const size_t phase) const { return code + offset(phase + 1); }
+
+    const std::vector<uint8_t>& data() const { return bytes; }
+
+   private:
+    std::vector<uint8_t> bytes;
+    size_t n_phases{};
+    const uint8_t* code{nullptr};
+
+    uint32_t offset(const size_t phase) const {
+        bytecode::reader_t in{bytes.data() + bytecode::header_bytes + phase * sizeof(uint32_t)};
+        return in.u32();
+    }
+
+    [[noreturn]] static void fail(const std::string& what) {
+        throw std::invalid_argument("Bytecode: " + what);
+    }
+
+    static void checkChannel(const uint8_t ch) {
+        if (ch != EGFP && ch != TXRED) {
+            fail("unknown laser channel " + std::to_string(ch));
+        }
+    }
+
+    void validate() {
+        using bytecode::header_bytes;
+        if (bytes.size() < header_bytes ||
+            !std::equal(bytecode::magic.begin(), bytecode::magic.end(), bytes.begin())) {
+            fail("not a protocol bytecode");
+        }
+        bytecode::reader_t in{bytes.data() + bytecode::magic.size()};
+        if (const auto v = in.u8(); v != bytecode::version) {
+            fail("unsupported format version " + std::to_string(v));
+        }
+        in.u8();
+        n_phases = in.u16();
+
+        const size_t code_begin = header_bytes + (n_phases + 1) * sizeof(uint32_t);
+        if (bytes.size() < code_begin) {
+            fail("truncated phase table");
+        }
+        code = bytes.data() + code_begin;
+        if (offset(0) != 0 || offset(n_phases) != bytes.size() - code_begin) {
+            fail("the phases do not span the code");
+        }
+        // All phases within the code, before decoding any of them.
+        for (size_t p = 0; p < n_phases; p++) {
+            if (offset(p) > offset(p + 1)) {
+                fail("phase " + std::to_string(p) + " out of order");
+            }
+        }
+        for (size_t p = 0; p < n_phases; p++) {
+            // The phases end on command boundaries.
+            validateCode(phaseBegin(p), phaseEnd(p), false);
+        }
+
+        // Without the close of the camera workers, or with a capture after
+        // it, the executor waits for the captures forever. The serial commands
+        // may follow it, e.g. to switch the laser off.
+        using bytecode::opcode_t;
+        const uint8_t* const end = bytes.data() + bytes.size();
+        size_t n_closes = 0;
+        for (const uint8_t* pc = code; pc < end;) {
+            const auto op = opcode_t(*pc);
+            if (op == opcode_t::close_all_camera_workers) {
+                n_closes++;
+            } else if (n_closes > 0 && bytecode::isCaptureCommand(op)) {
+                fail("capture command " + std::to_string(*pc) +
+                     " after the close of the camera workers");
+            }
+            pc += 1 + operandBytes(op, pc + 1, end);
+        }
+        if (n_closes != 1) {
+            fail("the camera workers are closed " + std::to_string(n_closes) +
+                 " times, not once");
+        }
+    }
+
+    /** @returns the number of captures of the code. */
+    static size_t validateCode(const uint8_t* pc, const uint8_t* end, const bool in_block) {
+        using bytecode::opcode_t;
+        size_t n_captures = 0;
+        while (pc < end) {
+            const auto op = opcode_t(*pc);
+            if (size_t(op) >= bytecode::n_opcodes) {
+                fail("unknown opcode " + std::to_string(*pc));
+            }
+            if (in_block && !bytecode::isConcurrentStep(op)) {
+                fail("command " + std::to_string(*pc) + " not allowed in concurrently()");
+            }
+
+            const auto* operands = pc + 1;
+            const auto n_bytes = operandBytes(op, operands, end);
+            if (n_bytes > size_t(end - operands)) {
+                fail("truncated command");
+            }
+            pc = operands + n_bytes;
+
+            bytecode::reader_t in{operands};
+            switch (op) {
+                case opcode_t::dark_frame:
+                case opcode_t::fpm_frame:
+                    n_captures++;
+                    break;
+                case opcode_t::fluorescence_frame:
+                    n_captures++;
+                    in.u16();
+                    checkChannel(in.u8());
+                    break;
+                case opcode_t::laser:
+                    in.u16();
+                    in.u8();
+                    checkChannel(in.u8());
+                    break;
+                case opcode_t::color: {
+                    const auto c = in.u8();
+                    if (c != 'g' && c != 'r' && c != 'b') {
+                        fail("unknown LED color " + std::to_string(c));
+                    }
+                    break;
+                }
+                case opcode_t::concurrently: {
+                    const size_t declared = in.u8();
+                    in.u16();
+                    if (validateCode(in.pc, pc, true) != declared) {
+                        fail("wrong number of captures in concurrently()");
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+        return n_captures;
+    }
+
+    /** Bytes of the operands, or past `end` if they are truncated. */
+    static size_t operandBytes(const bytecode::opcode_t op, const uint8_t* operands,
+                               const uint8_t* end) {
+        using bytecode::opcode_t;
+        const size_t available = end - operands;
+        switch (op) {
+            case opcode_t::init_sequence: {
+                if (available < 1) {
+                    return 1;
+                }
+                const size_t count = operands[0];
+                if (count > fiber_messages::capture::camera::init_sequence_t::max_count) {
+                    fail("too many i2c commands in the CMOS initialization sequence");
+                }
+                return 1 + count * 3;
+            }
+            case opcode_t::concurrently:
+                if (available < 3) {
+                    return 3;
+                }
+                return 3 + (operands[1] | (size_t{operands[2]} << 8));
+            default:
+                return fixedOperandBytes(op, std::make_index_sequence<bytecode::n_opcodes>{});
+        }
+    }
+
+    /** Bytes of the operands of the fixed-size commands, by encoding one. */
+    template <size_t... op>
+    static constexpr size_t fixedOperandBytes(const bytecode::opcode_t opcode,
+                                              std::index_sequence<op...>) {
+        size_t n = 0;
+        ((size_t(opcode) == op && ([&]() {
+              using T = std::tuple_element_t<op, bytecode::command_types_t>;
+              if constexpr (!std::is_same_v<T, bytecode::block_t>) {
+                  bytecode::writer_t counter{};
+                  bytecode::encode(counter, T{});
+                  n = counter.size;
+              }
+          }(),
+          true)) ||
+         ...);
+        return n;
+    }
+};
+
+}  // namespace bioimage_coder
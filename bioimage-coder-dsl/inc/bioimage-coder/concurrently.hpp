@@ -0,0 +1,115 @@
+#pragma once
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "bioimage-coder/repeat-for.hpp"
+#include "fiber-messages.h"
+#include "messages.h"
+
+namespace bioimage_coder {
+
+/** Frame captures, issued to the capture workers without waiting for the
+ * frames to arrive. */
+template <typename T>
+constexpr bool is_async_capture_v =
+    std::is_same_v<T, fiber_messages::capture::dark_frame_t> ||
+    std::is_same_v<T, fiber_messages::capture::fpm_frame_t> ||
+    std::is_same_v<T, fiber_messages::capture::fluorescence_frame_t>;
+
+/** Serial commands altering the illumination or the field of view, held back
+ * until the exposure of the frames captured before them has elapsed. */
+template <typename T>
+constexpr bool is_exposure_ordered_v =
+    std::is_same_v<T, message::led_matrix::switch_to> ||
+    std::is_same_v<T, message::led_matrix::blank> ||
+    std::is_same_v<T, message::led_matrix::next> ||
+    std::is_same_v<T, message::led_matrix::color_t> ||
+    std::is_same_v<T, message::motion::move_to_z>;
+
+/** Intermediate representation (IR) for the steps allowed to overlap. */
+template <typename... Commands>
+struct concurrently_t {
+    std::tuple<Commands...> steps;
+
+    static constexpr size_t n_captures = (size_t{0} + ... + size_t{is_async_capture_v<Commands>});
+
+    /** Call visit() on each step in order. */
+    template <class Visitor>
+    constexpr void forEach(Visitor&& visit) const {
+        std::apply([&](const auto&... step) { (visit(step), ...); }, steps);
+    }
+
+    /** The assignment of std::tuple is constexpr only from C++20 onwards, but
+     * the flat schedule assigns the commands at compile time. */
+    constexpr concurrently_t& operator=(const concurrently_t& other) {
+        assign(other, std::index_sequence_for<Commands...>{});
+        return *this;
+    }
+
+   private:
+    template <size_t... I>
+    constexpr void assign(const concurrently_t& other, std::index_sequence<I...>) {
+        ((std::get<I>(steps) = std::get<I>(other.steps)), ...);
+    }
+};
+
+template <typename T>
+struct is_concurrently_t : std::false_type {};
+
+template <typename... Commands>
+struct is_concurrently_t<concurrently_t<Commands...>> : std::true_type {};
+
+template <typename T>
+constexpr bool is_concurrently_v = is_concurrently_t<std::decay_t<T>>::value;
+
+template <typename T>
+constexpr void
+checkConcurrentStep() {
+    namespace camera = fiber_messages::capture::camera;
+    static_assert(!std::is_same_v<T, message::excitation::laser>,
+                  "The laser must not toggle while frames are in flight. Keep it out of "
+                  "concurrently().");
+    static_assert(!std::is_same_v<T, camera::exposure_gain_t> &&
+                      !std::is_same_v<T, camera::init_sequence_t>,
+                  "Reconfiguring the cameras while frames are in flight. Keep it out of "
+                  "concurrently().");
+    static_assert(!std::is_same_v<T, message::CloseAllCameraWorkers>,
+                  "Closing the cameras while frames are in flight. Keep it out of "
+                  "concurrently().");
+    static_assert(!is_concurrently_v<T> && !is_repeat_for_v<T>,
+                  "concurrently() takes individual commands only.");
+    static_assert(is_async_capture_v<T> || is_exposure_ordered_v<T> ||
+                      std::is_same_v<T, message::SleepFor> ||
+                      std::is_same_v<T, message::WaitSettled>,
+                  "Command not allowed in concurrently().");
+}
+
+/** A hint for the 96-eyes instrument to overlap the steps with one another.
+ *
+ * The frame captures are issued to the capture workers at once, and the
+ * executor moves on to the next step without waiting for the frames to arrive
+ * over USB. LED and z-stage commands still wait for the exposure of the frames
+ * captured before them, so that the illumination never changes mid-exposure.
+ * Sleeps and settle waits overlap with everything.
+ *
+ * The end of the block is the join point: the executor waits for all frames
+ * and all sleeps of the block before the next step.
+ *
+ * For example, switch to the next LED as soon as the exposure has elapsed, and
+ * let it settle while the frames drain:
+ *
+ *     concurrently(fpm_frame_t{i}, next{}, WaitSettled{})
+ *
+ * The laser, the camera configuration and CloseAllCameraWorkers are rejected
+ * at compile time.
+ */
+template <typename... Commands>
+constexpr concurrently_t<std::decay_t<Commands>...>
+concurrently(Commands&&... steps) {
+    (checkConcurrentStep<std::decay_t<Commands>>(), ...);
+    return {{std::forward<Commands>(steps)...}};
+}
+
+}  // namespace bioimage_coder
@@ -0,0 +1,191 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+
+#include "bioimage-coder/concurrently.hpp"
+#include "bioimage-coder/repeat-for.hpp"
+#include "bioimage-coder/settle-model.hpp"
+#include "constants.h"
+#include "fiber-messages.h"
+#include "messages.h"
+
+namespace bioimage_coder {
+
+/** Resources consumed by a protocol, or by one of its steps.
+ *
+ * Evaluated entirely at compile time, so that protocol authors can
+ * static_assert the disk capacity, the disk bandwidth and the acquisition time
+ * budgets before the first well plate is loaded.
+ */
+struct protocol_cost_t {
+    /** Frames written to disk by each frame capture card. */
+    uint64_t frames_per_board{};
+
+    /** Bytes written to disk by each frame capture card. */
+    uint64_t bytes_per_board{};
+
+    /** Lower bound of the wall-clock time, from the sleeps, the exposures
+     * and the time integration counts, and the settle waits by the settle
+     * model. USB and serial transfers are not modelled. */
+    std::chrono::milliseconds min_duration{};
+
+    /** Frame buffers held by all capture workers at once, excluding the
+     * frames waiting in the write queue. */
+    uint64_t peak_buffer_bytes{};
+
+    constexpr uint64_t frames() const { return frames_per_board * frame_capture_card::n_boards; }
+    constexpr uint64_t bytes() const { return bytes_per_board * frame_capture_card::n_boards; }
+
+    /** Disk bandwidth, in bytes per second, needed to keep up with the
+     * protocol at its fastest. */
+    constexpr double minWriteBandwidth() const {
+        return (min_duration.count() > 0) ? bytes() * 1e3 / min_duration.count() : 0.0;
+    }
+
+    constexpr protocol_cost_t& operator+=(const protocol_cost_t& other) {
+        frames_per_board += other.frames_per_board;
+        bytes_per_board += other.bytes_per_board;
+        min_duration += other.min_duration;
+        peak_buffer_bytes = std::max(peak_buffer_bytes, other.peak_buffer_bytes);
+        return *this;
+    }
+};
+
+namespace cost_model {
+
+using fiber_messages::capture::dark_frame_t;
+using fiber_messages::capture::fluorescence_frame_t;
+using fiber_messages::capture::fpm_frame_t;
+using fiber_messages::capture::camera::exposure_gain_t;
+
+constexpr uint64_t raw_frame_bytes = camera::n_pixels * sizeof(uint8_t);
+constexpr uint64_t integrated_frame_bytes = camera::n_pixels * sizeof(uint16_t);
+
+/** Instrument state carried from one step to the next. */
+struct state_t {
+    /** Zero until the protocol sets it, i.e. the lower bound. */
+    std::chrono::milliseconds exposure{};
+
+    protocol_cost_t cost{};
+
+    settle_model_t settle{};
+
+    /** Settle time of the LED and z-stage commands since the last settle
+     * wait. The sleeps count towards it, the captures do not. */
+    std::chrono::milliseconds unsettled{};
+};
+
+template <typename T>
+struct is_tuple : std::false_type {};
+
+template <typename... Ts>
+struct is_tuple<std::tuple<Ts...>> : std::true_type {};
+
+/** One frame from every camera of the board, in 8-bit. */
+constexpr protocol_cost_t
+rawFramesCost(const state_t& state) {
+    using frame_capture_card::n_boards;
+    using frame_capture_card::n_cameras_per_board;
+
+    // The frame being captured, and the one being handed to the write queue.
+    return {n_cameras_per_board, n_cameras_per_board * raw_frame_bytes, state.exposure,
+            2 * raw_frame_bytes * n_boards};
+}
+
+template <typename Step>
+constexpr void
+accumulate(state_t& state, const Step& step) {
+    using T = std::decay_t<Step>;
+    using frame_capture_card::n_boards;
+    using frame_capture_card::n_cameras_per_board;
+
+    if constexpr (is_tuple<T>::value) {
+        std::apply([&](const auto&... s) { (accumulate(state, s), ...); }, step);
+    } else if constexpr (is_repeat_for_v<T>) {
+        forEachIteration(step, [&](const auto& steps) { accumulate(state, steps); });
+    } else if constexpr (is_concurrently_v<T>) {
+        // The captures run on the boards back to back. The executor sleeps, or
+        // holds back the LED and z-stage commands until the exposures before
+        // them have elapsed.
+        std::chrono::milliseconds capture_time{};
+        std::chrono::milliseconds executor_time{};
+        std::apply(
+            [&](const auto&... s) {
+                ([&](const auto& command) {
+                    using C = std::decay_t<decltype(command)>;
+                    state_t sub{state.exposure, {}, state.settle, state.unsettled};
+                    accumulate(sub, command);
+                    state.settle = sub.settle;
+                    state.unsettled = sub.unsettled;
+                    if constexpr (is_async_capture_v<C>) {
+                        capture_time += sub.cost.min_duration;
+                    } else if constexpr (is_exposure_ordered_v<C>) {
+                        executor_time = std::max(executor_time, capture_time);
+                    } else {
+                        executor_time += sub.cost.min_duration;
+                    }
+                    sub.cost.min_duration = {};
+                    state.cost += sub.cost;
+                }(s),
+                 ...);
+            },
+            step.steps);
+        state.cost.min_duration += std::max(capture_time, executor_time);
+    } else if constexpr (std::is_same_v<T, exposure_gain_t>) {
+        state.exposure = step.exposure();
+    } else if constexpr (std::is_same_v<T, message::SleepFor>) {
+        state.cost.min_duration += step.duration;
+        state.unsettled = std::max(state.unsettled - step.duration, std::chrono::milliseconds{0});
+    } else if constexpr (std::is_same_v<T, message::WaitSettled>) {
+        state.cost.min_duration += state.unsettled;
+        state.unsettled = {};
+    } else if constexpr (std::is_same_v<T, dark_frame_t> || std::is_same_v<T, fpm_frame_t>) {
+        state.cost += rawFramesCost(state);
+    } else if constexpr (std::is_same_v<T, fluorescence_frame_t>) {
+        // One raw frame, plus the accumulated frames of all 24 cameras.
+        state.cost += protocol_cost_t{
+            n_cameras_per_board, n_cameras_per_board * integrated_frame_bytes,
+            state.exposure * camera::n_integration_frames,
+            (raw_frame_bytes + n_cameras_per_board * integrated_frame_bytes) * n_boards};
+    } else {
+        // The LED and z-stage commands take effect by the next settle wait.
+        // Other steps, e.g. the laser, are not modelled.
+        state.unsettled += state.settle.settleTime(step);
+    }
+}
+
+}  // namespace cost_model
+
+/** Cost of the entire protocol. */
+template <typename Protocol>
+constexpr protocol_cost_t
+protocolCost(const Protocol& protocol) {
+    cost_model::state_t state{};
+    cost_model::accumulate(state, protocol);
+    return state.cost;
+}
+
+/** Cost of each top-level step of the protocol, given the exposure set by the
+ * steps before it. */
+template <typename Protocol>
+constexpr auto
+stepCosts(const Protocol& protocol) {
+    constexpr size_t n_steps = std::tuple_size_v<Protocol>;
+    std::array<protocol_cost_t, n_steps> costs{};
+
+    cost_model::state_t state{};
+    size_t index = 0;
+    std::apply(
+        [&](const auto&... step) {
+            ((state.cost = {}, cost_model::accumulate(state, step), costs[index++] = state.cost),
+             ...);
+        },
+        protocol);
+    return costs;
+}
+
+}  // namespace bioimage_coder
@@ -1,31 +1,58 @@
 #pragma once
+#include <algorithm>
 #include <array>
 #include <asio/io_service.hpp>
 #include <asio/serial_port.hpp>
 #include <boost/fiber/all.hpp>
 
+#include "bioimage-coder/concurrently.hpp"
 #include "bioimage-coder/repeat-for.hpp"
+#include "bioimage-coder/schedule.hpp"
+#include "bioimage-coder/settle-model.hpp"
 
 #ifndef USING_FIBER
 #include <thread>
 #endif
 
+#ifdef SIMULATED_SERIAL
+#include "simulated_serial.h"
+#endif
+
+#ifdef ASYNC_SERIAL
+#include "async-serial-transport.h"
+#endif
+
 #include "constants.h"
 #include "fiber-messages.h"
+#include "illumination.h"
 #include "message_router.h"
 #include "messages.h"
+#include "metrics.h"
+#include "trace.h"
+#include "virtual-clock.h"
 
-/** Dependency injection (DI) of the serial port at link-time.
+/** Dependency injection (DI) of the serial port at link-time. With
+ * -DSIMULATED_SERIAL, e.g. in the dry run, the firmware is simulated in
+ * virtual time instead. With -DASYNC_SERIAL, the commands are pipelined to the
+ * firmware.
  *
  * @todo to be refactored into compile-time DI via C++ template metaprogramming.
  */
+#if defined(SIMULATED_SERIAL)
+extern hardware_drivers::SimulatedSerial serial_port;
+#elif defined(ASYNC_SERIAL)
+extern message_router::AsyncSerialTransport<asio::serial_port> serial_port;
+#else
 extern asio::serial_port serial_port;
+#endif
 
-/** Dependency injection (DI) of the capture command queue at link-time.
+/** Dependency injection (DI) of the capture command queues at link-time. The
+ * application creates the queues once their capacity is known, and connects
+ * them with bioimage_coder::connectCaptureQueues() before executing.
  *
  * @todo to be refactored into compile-time DI via C++ template metaprogramming.
  */
-extern std::array<fiber_messages::capture::queue_t, frame_capture_card::n_boards>
+extern std::array<fiber_messages::capture::queue_t*, frame_capture_card::n_boards>
     image_capture_handlers;
 
 namespace bioimage_coder {
@@ -36,12 +63,201 @@ constexpr bool is_in_variant = false;
 template <typename T, typename... Ts>
 constexpr bool is_in_variant<T, std::variant<Ts...>> = (std::is_same_v<T, Ts> || ...);
 
+/** Route the capture commands of the executor to the queues of the capture
+ * workers. The queues outlive the execution. */
+inline void
+connectCaptureQueues(fiber_messages::capture::queues_t& queues) {
+    for (size_t b = 0; b < queues.size(); b++) {
+        image_capture_handlers[b] = &queues[b];
+    }
+}
+
+/** Statistics shared by the completion channels of all capture commands. */
+inline telemetry::channel_stats_t&
+completionStats() {
+    static auto& stats = telemetry::channelStats("completion", "capture", "executor",
+                                                 frame_capture_card::n_boards, 1);
+    return stats;
+}
+
 template <typename T, typename = void>
 struct has_completion_channel : std::false_type {};
 
 template <typename T>
 struct has_completion_channel<T, std::void_t<decltype(T{}.completion)>> : std::true_type {};
 
+/** Smallest channel capacity to hold n signals without blocking the sender.
+ * A boost::fibers::buffered_channel holds one less than its capacity, a power
+ * of two. */
+constexpr size_t
+signalCapacity(const size_t n) {
+    size_t capacity = 2;
+    while (capacity < n + 1) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+/** Wait for the firmware to complete the serial commands sent so far, so that
+ * the LED matrix, the laser and the z-stage are in place before the next
+ * exposure. The blocking serial ports are complete on return already.
+ */
+inline void
+awaitSerialCommands() {
+#ifdef ASYNC_SERIAL
+    TRACE_SCOPE("dsl", "wait for serial");
+    serial_port.awaitAll();
+#endif
+}
+
+/** When the serial commands sent so far take effect, by the settle model. */
+struct settle_tracker_t {
+    settle_model_t model{};
+    simulator::time_point settled_at{};
+
+    /** When the last LED or z-stage command was sent. */
+    simulator::time_point moved_at{};
+
+    /** The firmware runs the commands one after another. */
+    template <typename T>
+    void observe(const T& command) {
+        const auto settle_time = model.settleTime(command);
+        if (settle_time.count() > 0) {
+            const auto now = simulator::now();
+            settled_at = std::max(settled_at, now) + settle_time;
+            moved_at = now;
+        }
+    }
+
+    /** Earliest end of the settle wait of the step, without a report from the
+     * firmware. */
+    simulator::time_point minSettledAt(const message::WaitSettled& step) const {
+        return moved_at + step.min_settle;
+    }
+};
+
+inline settle_tracker_t&
+settleTracker() {
+    static settle_tracker_t tracker{};
+    return tracker;
+}
+
+/** Wait for the LED matrix and the z-stage to settle, as reported by the
+ * firmware within the timeout of the step, or else, e.g. on a rejected settle
+ * query, as by the settle model, but no earlier than min_settle of the step
+ * after the last move.
+ *
+ * The simulated firmware of the dry run settles at its idle time, with the
+ * same lower bound. Over a blocking serial port, or without acknowledgements,
+ * the model is all there is.
+ */
+inline void
+waitSettled(const message::WaitSettled& step) {
+    TRACE_SCOPE("dsl", "wait settled");
+    auto& metrics = telemetry::metrics().executor;
+    const auto start = simulator::now();
+#if defined(SIMULATED_SERIAL)
+    message_router::MessageOverSerial{serial_port}.sendCommand(step);
+    simulator::sleep_until(std::max(serial_port.idleAt(), settleTracker().minSettledAt(step)));
+#else
+    bool is_reported = false;
+#ifdef ASYNC_SERIAL
+    if (serial_port.ackWindow() > 0) {
+        // A firmware that cannot tell rejects the query. The model tells
+        // instead.
+        message_router::MessageOverSerial{serial_port}.sendCommand(step);
+        serial_port.allowRejection();
+        const auto settled = serial_port.lastAck();
+        is_reported = settled.waitFor(step.timeout) && !settled.isRejected();
+        if (!is_reported) {
+            metrics.settle_timeouts.add(1);
+        }
+    }
+#endif
+    if (!is_reported) {
+        const auto& tracker = settleTracker();
+        simulator::sleep_until(std::max(tracker.settled_at, tracker.minSettledAt(step)));
+    }
+#endif
+    metrics.settle_wait.observe(simulator::now() - start);
+}
+
+/** The laser pulse of the fluorescence captures, for the photobleaching
+ * budget of telemetry::illumination. */
+struct illumination_window_t {
+    bool is_on{false};
+    channel_t ch{EGFP};
+    std::chrono::nanoseconds budget{};
+    simulator::time_point laser_on{};
+
+    /** Record the last frame of one board, exposed in this pulse. */
+    void observeLastFrame(const simulator::time_point t) const {
+        if (is_on) {
+            telemetry::illumination::observe(ch, budget, laser_on, t);
+        }
+    }
+};
+
+inline illumination_window_t&
+illuminationWindow() {
+    static illumination_window_t window{};
+    return window;
+}
+
+/** Open the pulse of the laser command sent last. The laser turns on once the
+ * firmware is done with the commands before it, as reported by the simulated
+ * firmware, or else as by the settle model.
+ */
+inline void
+observeLaser(const message::excitation::laser& command) {
+    auto& window = illuminationWindow();
+    window.is_on = command.power > 0;
+    window.ch = command.ch;
+    window.budget = command.time;
+#if defined(SIMULATED_SERIAL)
+    window.laser_on = serial_port.idleAt();
+#else
+    window.laser_on = std::max(simulator::now(), settleTracker().settled_at);
+#endif
+}
+
+/** Push the capture command to all boards, to report on the given channels. */
+template <typename T>
+void
+issueCapture(const T& command, fiber_messages::capture::completions_signal_t& completion,
+             fiber_messages::capture::completions_signal_t* exposure = nullptr) {
+    awaitSerialCommands();
+    T new_capture_command{command};
+    new_capture_command.completion = &completion;
+    new_capture_command.exposure = exposure;
+    for (uint8_t usb_id = 0; usb_id < frame_capture_card::n_boards; usb_id++) {
+        telemetry::metrics().boards[usb_id].capture_queue_depth.add(1);
+        image_capture_handlers[usb_id]->push(new_capture_command);
+    }
+}
+
+/** Suspend the master loop until n signals have arrived, and pass the time
+ * of each to on_signal. */
+template <class Callback>
+void
+awaitSignals(fiber_messages::capture::completions_signal_t& signal, const size_t n,
+             Callback&& on_signal) {
+    fiber_messages::capture::completions_signal_t::value_type time;
+    for (size_t i = 0; i < n; i++) {
+        signal.pop(time);
+        on_signal(time);
+    }
+}
+
+/** Suspend the master loop until n signals have arrived. */
+inline void
+awaitSignals(fiber_messages::capture::completions_signal_t& signal, const size_t n) {
+    awaitSignals(signal, n, [](auto) {});
+}
+
+template <class Block>
+void dispatchConcurrently(const Block& block);
+
 /** Dispatch the steps in Bioimage Coder DSL to the corresponding message
  * handlers.
  *
@@ -74,64 +290,156 @@ dispatch(const T& command) {
     using Type = std::remove_reference_t<T>;
 
     if constexpr (std::is_same_v<Type, CloseAllCameraWorkers>) {
-        for (auto& capture_port : image_capture_handlers) {
-            capture_port.close();
+        for (auto* capture_port : image_capture_handlers) {
+            capture_port->close();
         }
     } else if constexpr (is_in_variant<Type, fiber_messages::capture::command_t>) {
         if constexpr (has_completion_channel<Type>::value) {
             using frame_capture_card::n_boards;
-            fiber_messages::capture::completions_signal_t completion{n_boards};
-
-            Type new_capture_command{command};
-            new_capture_command.completion = &completion;
-            for (auto& capture_port : image_capture_handlers) {
-                capture_port.push(new_capture_command);
-            }
+            fiber_messages::capture::completions_signal_t completion{n_boards, completionStats()};
+            issueCapture(command, completion);
 
             // Suspend master loop until all capture workers report capture complete.
-            for (uint8_t i = 0; i < n_boards; i++) {
-                bool ack;
-                completion.pop(ack);
+            TRACE_SCOPE("dsl", "wait for capture");
+            if constexpr (std::is_same_v<Type, fiber_messages::capture::fluorescence_frame_t>) {
+                const auto& window = illuminationWindow();
+                awaitSignals(completion, n_boards,
+                             [&](const auto time) { window.observeLastFrame(time); });
+            } else {
+                awaitSignals(completion, n_boards);
             }
         } else {
-            for (auto& capture_port : image_capture_handlers) {
-                capture_port.push(command);
+            for (uint8_t usb_id = 0; usb_id < frame_capture_card::n_boards; usb_id++) {
+                telemetry::metrics().boards[usb_id].capture_queue_depth.add(1);
+                image_capture_handlers[usb_id]->push(command);
             }
         }
+    } else if constexpr (is_concurrently_v<Type>) {
+        dispatchConcurrently(command);
+    } else if constexpr (std::is_same_v<Type, WaitSettled>) {
+        waitSettled(command);
     } else if constexpr (std::is_same_v<Type, SleepFor>) {
+        awaitSerialCommands();
+        TRACE_SCOPE("dsl", "sleep");
 #ifdef USING_FIBER
-        boost::this_fiber::sleep_for(command.duration);
+        simulator::sleep_for(command.duration);
 #else
         std::this_thread::sleep_for(command.duration);
 #endif
     } else {
         message_router::MessageOverSerial{serial_port}.sendCommand(command);
+        settleTracker().observe(command);
+        if constexpr (std::is_same_v<Type, excitation::laser>) {
+            observeLaser(command);
+        }
     }
 }
 
-/** Black magic to dispatch commands in the tuple structure. */
-template <typename Protocol, size_t index = 0>
+/** Issue the steps of a concurrently() block in order, without waiting for the
+ * frames, then join.
+ *
+ * The capture workers report the end of the exposure and the arrival of the
+ * frames on two channels, sized to never block them. LED and z-stage commands
+ * wait for the exposure signals of the captures issued so far.
+ *
+ * @tparam Block concurrently_t, or a block decoded from the bytecode, with
+ * n_captures and forEach().
+ */
+template <class Block>
+void
+dispatchConcurrently(const Block& block) {
+    using fiber_messages::capture::completions_signal_t;
+    using frame_capture_card::n_boards;
+
+    const size_t n_signals = n_boards * block.n_captures;
+    completions_signal_t completion{signalCapacity(n_signals), completionStats()};
+    completions_signal_t exposure{signalCapacity(n_signals), completionStats()};
+    size_t n_issued = 0;
+    size_t n_exposed = 0;
+
+    TRACE_SCOPE("dsl", "concurrently");
+    block.forEach([&](const auto& command) {
+        using T = std::decay_t<decltype(command)>;
+        if constexpr (is_async_capture_v<T>) {
+            issueCapture(command, completion, &exposure);
+            n_issued += n_boards;
+        } else {
+            if constexpr (is_exposure_ordered_v<T>) {
+                TRACE_SCOPE("dsl", "wait for exposure");
+                awaitSignals(exposure, n_issued - n_exposed);
+                n_exposed = n_issued;
+            }
+            dispatch(command);
+        }
+    });
+
+    TRACE_SCOPE("dsl", "join");
+    awaitSignals(completion, n_issued);
+}
+
+/** Route each command to the instrument, with dispatch(). */
+struct instrument_dispatcher_t {
+    template <typename T>
+    void operator()(const T& command) const {
+        dispatch(command);
+    }
+};
+
+/** Black magic to dispatch commands in the tuple structure.
+ *
+ * @param[in] dispatcher Replaces the instrument, e.g. in benchmarks.
+ */
+template <typename Protocol, size_t index = 0, class Dispatcher = instrument_dispatcher_t>
 constexpr void
-execute(Protocol&& p) {
+execute(Protocol&& p, Dispatcher&& dispatcher = {}) {
     if constexpr (index < std::tuple_size_v<std::remove_reference_t<Protocol>>) {
-        // Retrieve the current step
-        auto&& sub_protocol = std::get<index>(std::forward<Protocol>(p));
-
-        // If the step contains a loop, repeat the steps in the loop N times.
-        using T = std::decay_t<decltype(sub_protocol)>;
-        if constexpr (is_repeat_for_v<T>) {
-            for (auto i = sub_protocol.range.begin; i < sub_protocol.range.end;
-                 i += sub_protocol.range.step) {
-                std::apply([](auto&&... command) { (dispatch(command), ...); },
-                           sub_protocol.steps(i));
+        // The trace scope of the step ends before the next step, so that the
+        // steps follow one another on the timeline.
+        {
+            TRACE_SCOPE_ARG("dsl", "step", "index", index);
+            telemetry::beginPhase(index);
+
+            // Retrieve the current step
+            auto&& sub_protocol = std::get<index>(std::forward<Protocol>(p));
+
+            // If the step contains a loop, repeat the steps in the loop N times.
+            using T = std::decay_t<decltype(sub_protocol)>;
+            if constexpr (is_repeat_for_v<T>) {
+                [[maybe_unused]] size_t i = 0;
+                forEachIteration(sub_protocol, [&](auto&& steps) {
+                    TRACE_SCOPE_ARG("dsl", "iteration", "i", i);
+                    std::apply([&](auto&&... command) { (dispatcher(command), ...); }, steps);
+                    i++;
+                });
+            } else {
+                // Otherwise, dispatch the commands once.
+                std::apply([&](auto&&... command) { (dispatcher(command), ...); }, sub_protocol);
             }
-        } else {
-        // Otherwise, dispatch the commands once.
-            std::apply([](auto&&... command) { (dispatch(command), ...); }, sub_protocol);
         }
 
         // Compile the next step.
-        execute<Protocol, index + 1>(std::forward<Protocol>(p));
+        execute<Protocol, index + 1>(std::forward<Protocol>(p),
+                                     std::forward<Dispatcher>(dispatcher));
     }
 }
+
+/** Execute the protocol from its flat schedule, expanded at compile time.
+ *
+ * Same order of commands and the same protocol phases as execute(), without
+ * evaluating the protocol structure at runtime.
+ *
+ * @tparam protocol_fn constexpr function returning the protocol.
+ * @tparam table_fn constexpr function returning the table, as in schedule_t.
+ * @param[in] dispatcher Replaces the instrument, as in execute().
+ */
+template <auto protocol_fn, auto table_fn = schedule_detail::buildTable<protocol_fn>,
+          class Dispatcher = instrument_dispatcher_t>
+void
+executeSchedule(Dispatcher&& dispatcher = {}) {
+    schedule_t<protocol_fn, table_fn>::run(dispatcher, [](const size_t phase, auto&& body) {
+        TRACE_SCOPE_ARG("dsl", "step", "index", phase);
+        telemetry::beginPhase(phase);
+        body();
+    });
+}
 }
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "bioimage-coder/bytecode.hpp"
+#include "bioimage-coder/executor.hpp"
+#include "metrics.h"
+#include "trace.h"
+
+namespace bioimage_coder {
+
+namespace interpreter_detail {
+
+/** One handler per opcode, in a table indexed by the opcode byte.
+ *
+ * Each handler decodes the operands into a command on the stack, and hands it
+ * to the same dispatcher as the template executor. Nothing is allocated per
+ * command by the interpreter itself.
+ */
+template <class Dispatcher>
+struct handlers_t {
+    using handler_t = const uint8_t* (*)(const uint8_t* operands, Dispatcher& dispatcher);
+
+    template <size_t op>
+    static const uint8_t* handle(const uint8_t* operands, Dispatcher& dispatcher) {
+        std::tuple_element_t<op, bytecode::command_types_t> command{};
+        bytecode::reader_t in{operands};
+        bytecode::decode(in, command);
+        dispatcher(command);
+        return in.pc;
+    }
+
+    template <size_t... op>
+    static constexpr std::array<handler_t, sizeof...(op)> makeTable(std::index_sequence<op...>) {
+        return {{&handle<op>...}};
+    }
+
+    static constexpr auto table = makeTable(std::make_index_sequence<bytecode::n_opcodes>{});
+};
+
+}  // namespace interpreter_detail
+
+/** Execute the protocol from its bytecode, e.g. compiled by compile-protocol.
+ *
+ * Same commands, in the same order and protocol phases, as executeSchedule()
+ * on the schedule the bytecode was compiled from. The bytecode is decoded with
+ * one indirect call per command through a table of handlers.
+ *
+ * @param[in] dispatcher Replaces the instrument, as in execute(). Besides the
+ * commands, it receives the concurrently() blocks as bytecode::block_t.
+ */
+template <class Dispatcher = instrument_dispatcher_t>
+void
+interpret(const bytecode_program_t& program, Dispatcher&& dispatcher = {}) {
+    using handlers = interpreter_detail::handlers_t<std::remove_reference_t<Dispatcher>>;
+
+    for (size_t phase = 0; phase < program.phases(); phase++) {
+        TRACE_SCOPE_ARG("dsl", "step", "index", phase);
+        telemetry::beginPhase(phase);
+
+        const auto* end = program.phaseEnd(phase);
+        for (const auto* pc = program.phaseBegin(phase); pc < end;) {
+            pc = handlers::table[*pc](pc + 1, dispatcher);
+        }
+    }
+}
+
+}  // namespace bioimage_coder
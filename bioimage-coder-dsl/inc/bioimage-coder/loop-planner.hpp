@@ -0,0 +1,156 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+
+#include "bioimage-coder/concurrently.hpp"
+#include "bioimage-coder/repeat-for.hpp"
+#include "constants.h"
+#include "messages.h"
+#include "time-model.h"
+
+namespace bioimage_coder {
+
+/** Dead time of the instrument between the frames, as modelled by the loop
+ * planner. The figures are those of the dry run, in simulator::time_model. */
+namespace loop_planner {
+
+using namespace std::chrono_literals;
+using simulator::time_model::laser_switch;
+using simulator::time_model::z_settle;
+using simulator::time_model::z_travel_per_um;
+
+/** Instrument state, as far as the loop body sets it. */
+struct state_t {
+    bool is_z_known{false};
+    int16_t z{};
+
+    bool is_channel_known{false};
+    channel_t channel{};
+
+    std::chrono::milliseconds dead_time{};
+};
+
+template <typename T>
+struct is_tuple : std::false_type {};
+
+template <typename... Ts>
+struct is_tuple<std::tuple<Ts...>> : std::true_type {};
+
+template <typename Step>
+constexpr void
+simulate(state_t& state, const Step& step) {
+    using T = std::decay_t<Step>;
+    if constexpr (is_tuple<T>::value) {
+        std::apply([&](const auto&... s) { (simulate(state, s), ...); }, step);
+    } else if constexpr (is_concurrently_v<T>) {
+        simulate(state, step.steps);
+    } else if constexpr (std::is_same_v<T, message::motion::move_to_z>) {
+        if (state.is_z_known && state.z != step.value) {
+            const auto distance = (step.value > state.z) ? step.value - state.z
+                                                         : state.z - step.value;
+            state.dead_time += distance * z_travel_per_um + z_settle;
+        }
+        state.is_z_known = true;
+        state.z = step.value;
+    } else if constexpr (std::is_same_v<T, message::excitation::laser>) {
+        // Turning the laser off leaves the channel selected.
+        if (step.power == 0) {
+            return;
+        }
+        if (state.is_channel_known && state.channel != step.ch) {
+            state.dead_time += laser_switch;
+        }
+        state.is_channel_known = true;
+        state.channel = step.ch;
+    }
+}
+
+/** Advance to the next lexicographic permutation, like
+ * std::next_permutation, which is constexpr from C++20 onwards only.
+ *
+ * @returns false once the permutation wraps around to the sorted order.
+ */
+template <size_t N>
+constexpr bool
+nextPermutation(std::array<uint8_t, N>& order) {
+    if (N < 2) {
+        return false;
+    }
+    size_t i = N - 1;
+    while (i > 0 && order[i - 1] >= order[i]) {
+        i--;
+    }
+    auto swap = [&](const size_t a, const size_t b) {
+        const auto tmp = order[a];
+        order[a] = order[b];
+        order[b] = tmp;
+    };
+    if (i == 0) {
+        for (size_t a = 0, b = N - 1; a < b; a++, b--) {
+            swap(a, b);
+        }
+        return false;
+    }
+    size_t j = N - 1;
+    while (order[j] <= order[i - 1]) {
+        j--;
+    }
+    swap(i - 1, j);
+    for (size_t a = i, b = N - 1; a < b; a++, b--) {
+        swap(a, b);
+    }
+    return true;
+}
+
+}  // namespace loop_planner
+
+/** Modelled dead time of the z-stage moves and laser channel switches of the
+ * loop, in its current loop order. The first move and the first switch are
+ * free, since the state before the loop is unknown. */
+template <class Callable, typename... Ranges>
+constexpr std::chrono::milliseconds
+deadTime(const repeat_for_nd_t<Callable, Ranges...>& loop) {
+    loop_planner::state_t state{};
+    forEachIteration(loop, [&](const auto& steps) { loop_planner::simulate(state, steps); });
+    return state.dead_time;
+}
+
+/** The loop with the loop order of the least modelled dead time, e.g. all
+ * z-positions of one laser channel before the next channel:
+ *
+ *     plan(repeat_for(Range<'z', int16_t>{-4, 4, 2}, Range<'c', uint8_t>{0, 2},
+ *                     fluorescenceImagingProtocol))
+ *
+ * Every order is tried, so keep it to a few dimensions. By calling plan(), the
+ * protocol author asserts that the iterations are independent of one another,
+ * so that any order captures the same frames. The frames are written to disk
+ * in the new order. Ties keep the declared order.
+ */
+template <class Callable, typename... Ranges>
+constexpr repeat_for_nd_t<Callable, Ranges...>
+plan(const repeat_for_nd_t<Callable, Ranges...>& loop) {
+    auto candidate = loop;
+    auto best_order = loop.order;
+    auto best_time = deadTime(loop);
+
+    auto order = loop.order;
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = uint8_t(i);
+    }
+    do {
+        candidate.order = order;
+        const auto time = deadTime(candidate);
+        if (time < best_time) {
+            best_time = time;
+            best_order = order;
+        }
+    } while (loop_planner::nextPermutation(order));
+
+    candidate.order = best_order;
+    return candidate;
+}
+
+}  // namespace bioimage_coder
@@ -0,0 +1,306 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#include "bioimage-coder/concurrently.hpp"
+#include "bioimage-coder/schedule.hpp"
+#include "messages.h"
+
+namespace bioimage_coder {
+
+/** Why the optimizer removed a command from the schedule. */
+enum class removal_t : uint8_t {
+    /** The command sets the state the instrument is already in. */
+    in_effect,
+
+    /** A later command overwrites the state before anything uses it. */
+    superseded,
+
+    /** The sleep is added to the sleep right before it. */
+    merged,
+};
+
+constexpr const char*
+toString(const removal_t reason) {
+    switch (reason) {
+        case removal_t::in_effect:
+            return "already in effect";
+        case removal_t::superseded:
+            return "overwritten before use";
+        default:
+            return "merged into the previous sleep";
+    }
+}
+
+/** Command removed from the schedule, at `position` in the unoptimized
+ * table. */
+struct removed_command_t {
+    uint32_t position;
+    command_record_t record;
+    removal_t reason;
+};
+
+namespace optimizer_detail {
+
+/** State of the instrument, as far as the commands issued so far tell. */
+template <typename T>
+struct known_t {
+    bool is_known{false};
+    T value{};
+
+    constexpr bool is(const T& v) const { return is_known && value == v; }
+    constexpr void set(const T& v) {
+        is_known = true;
+        value = v;
+    }
+};
+
+/** Only the state set over the serial port is tracked. At the start of the
+ * protocol, the state left by the previous run is unknown. */
+struct instrument_state_t {
+    known_t<bool> is_led_on{};
+
+    /** (x << 8) | y of the LED switched on last. */
+    known_t<uint16_t> led_position{};
+
+    known_t<message::led_matrix::color_t> color{};
+    known_t<int16_t> z{};
+
+    /** No LED or z-stage command since the last WaitSettled. */
+    known_t<bool> is_settled{};
+};
+
+enum class kind_t : uint8_t { other, switch_to, blank, next, color, move_to_z, sleep, settle };
+
+template <typename T>
+constexpr kind_t
+kindOf() {
+    using namespace message;
+    if constexpr (std::is_same_v<T, led_matrix::switch_to>) return kind_t::switch_to;
+    if constexpr (std::is_same_v<T, led_matrix::blank>) return kind_t::blank;
+    if constexpr (std::is_same_v<T, led_matrix::next>) return kind_t::next;
+    if constexpr (std::is_same_v<T, led_matrix::color_t>) return kind_t::color;
+    if constexpr (std::is_same_v<T, motion::move_to_z>) return kind_t::move_to_z;
+    if constexpr (std::is_same_v<T, SleepFor>) return kind_t::sleep;
+    if constexpr (std::is_same_v<T, WaitSettled>) return kind_t::settle;
+    return kind_t::other;
+}
+
+using schedule_detail::visitRecord;
+
+template <class Table>
+constexpr kind_t
+kindOf(Table& table, const command_record_t record) {
+    kind_t kind{};
+    visitRecord(table, record,
+                [&](const auto& command) { kind = kindOf<std::decay_t<decltype(command)>>(); });
+    return kind;
+}
+
+/** Whether the later command overwrites all the state set by the earlier one,
+ * with no command in between. The LED matrix keeps the position through
+ * blank{}, for next{} to advance from. */
+constexpr bool
+supersedes(const kind_t later, const kind_t earlier) {
+    switch (earlier) {
+        case kind_t::switch_to:
+            return later == kind_t::switch_to;
+        case kind_t::blank:
+            return later == kind_t::switch_to || later == kind_t::next;
+        case kind_t::color:
+            return later == kind_t::color;
+        case kind_t::move_to_z:
+            return later == kind_t::move_to_z;
+        default:
+            return false;
+    }
+}
+
+/** Update the state with the command, or tell why the command is redundant.
+ *
+ * @returns true to keep the command.
+ */
+template <typename T>
+constexpr bool
+apply(instrument_state_t& state, const T& command, removal_t& reason) {
+    using namespace message;
+    if constexpr (std::is_same_v<T, led_matrix::switch_to>) {
+        const uint16_t position = (uint16_t{command.x} << 8) | command.y;
+        if (state.is_led_on.is(true) && state.led_position.is(position)) {
+            reason = removal_t::in_effect;
+            return false;
+        }
+        state.is_led_on.set(true);
+        state.led_position.set(position);
+        state.is_settled.set(false);
+    } else if constexpr (std::is_same_v<T, led_matrix::blank>) {
+        if (state.is_led_on.is(false)) {
+            reason = removal_t::in_effect;
+            return false;
+        }
+        state.is_led_on.set(false);
+        state.is_settled.set(false);
+    } else if constexpr (std::is_same_v<T, led_matrix::next>) {
+        state.is_led_on.set(true);
+        state.led_position = {};
+        state.is_settled.set(false);
+    } else if constexpr (std::is_same_v<T, led_matrix::color_t>) {
+        if (state.color.is(command)) {
+            reason = removal_t::in_effect;
+            return false;
+        }
+        state.color.set(command);
+        state.is_settled.set(false);
+    } else if constexpr (std::is_same_v<T, motion::move_to_z>) {
+        if (state.z.is(command.value)) {
+            reason = removal_t::in_effect;
+            return false;
+        }
+        state.z.set(command.value);
+        state.is_settled.set(false);
+    } else if constexpr (std::is_same_v<T, SleepFor>) {
+        if (command.duration.count() == 0) {
+            reason = removal_t::in_effect;
+            return false;
+        }
+    } else if constexpr (std::is_same_v<T, WaitSettled>) {
+        // Nothing moved since the instrument last settled.
+        if (state.is_settled.is(true)) {
+            reason = removal_t::in_effect;
+            return false;
+        }
+        state.is_settled.set(true);
+    } else if constexpr (is_concurrently_v<T>) {
+        // Not optimized within the block. Forget the LED and the z-stage.
+        state = {};
+    }
+    // The laser fires for the given time on every command, so that no laser
+    // command is ever redundant.
+    return true;
+}
+
+/** Optimized table, and the commands removed from it in schedule order. */
+template <class Table>
+struct optimization_t {
+    Table table;
+    std::array<removed_command_t, Table::n_commands> removed{};
+    size_t n_removed{0};
+};
+
+/** Remove the redundant serial commands from the table, and merge the
+ * consecutive sleeps of each phase.
+ *
+ * Single pass over the records in schedule order, tracking the instrument
+ * state. The kept records are compacted in place, in the same order.
+ */
+template <class Table>
+constexpr optimization_t<Table>
+optimize(const Table& unoptimized) {
+    using records_t = decltype(unoptimized.records);
+    optimization_t<Table> out{unoptimized};
+    auto& t = out.table;
+
+    // Unoptimized position of each kept record.
+    std::array<uint32_t, std::tuple_size_v<records_t>> position{};
+    instrument_state_t state{};
+    uint32_t n = 0;
+
+    auto remove = [&](const uint32_t at, const command_record_t record, const removal_t reason) {
+        out.removed[out.n_removed++] = {at, record, reason};
+    };
+
+    for (size_t p = 0; p < Table::n_phases; p++) {
+        t.phase_begin[p] = n;
+        for (auto k = unoptimized.phase_begin[p]; k < unoptimized.phase_begin[p + 1]; k++) {
+            const auto record = unoptimized.records[k];
+            const auto kind = kindOf(t, record);
+
+            bool is_kept = true;
+            removal_t reason{};
+            visitRecord(t, record, [&](const auto& command) {
+                is_kept = apply(state, command, reason);
+            });
+
+            if (is_kept && kind == kind_t::sleep && n > t.phase_begin[p] &&
+                kindOf(t, t.records[n - 1]) == kind_t::sleep) {
+                message::SleepFor sleep{};
+                visitRecord(t, record, [&](const auto& command) {
+                    if constexpr (std::is_same_v<std::decay_t<decltype(command)>,
+                                                 message::SleepFor>) {
+                        sleep = command;
+                    }
+                });
+                visitRecord(t, t.records[n - 1], [&](auto& command) {
+                    if constexpr (std::is_same_v<std::decay_t<decltype(command)>,
+                                                 message::SleepFor>) {
+                        command.duration += sleep.duration;
+                    }
+                });
+                is_kept = false;
+                reason = removal_t::merged;
+            }
+
+            if (!is_kept) {
+                remove(k, record, reason);
+                continue;
+            }
+
+            // Peephole, possibly across the phases: nothing runs in between.
+            while (n > 0 && supersedes(kind, kindOf(t, t.records[n - 1]))) {
+                n--;
+                remove(position[n], t.records[n], removal_t::superseded);
+                for (size_t q = 0; q <= p; q++) {
+                    t.phase_begin[q] = std::min(t.phase_begin[q], n);
+                }
+            }
+
+            position[n] = k;
+            t.records[n++] = record;
+        }
+    }
+    t.phase_begin[Table::n_phases] = n;
+
+    // Sort the report in schedule order.
+    for (size_t i = 1; i < out.n_removed; i++) {
+        for (size_t j = i; j > 0 && out.removed[j - 1].position > out.removed[j].position; j--) {
+            const auto swapped = out.removed[j];
+            out.removed[j] = out.removed[j - 1];
+            out.removed[j - 1] = swapped;
+        }
+    }
+    return out;
+}
+
+}  // namespace optimizer_detail
+
+/** The protocol schedule with the redundant commands removed, evaluated at
+ * compile time. */
+template <auto protocol_fn>
+constexpr auto optimization =
+    optimizer_detail::optimize(schedule_detail::buildTable<protocol_fn>());
+
+template <auto protocol_fn>
+constexpr schedule_detail::table_t<protocol_fn>
+optimizedTable() {
+    return optimization<protocol_fn>.table;
+}
+
+/** Flat schedule of the protocol after the optimization pass:
+ *
+ * - LED, color and z-stage commands setting the state already in effect are
+ *   removed. The state is unknown at the start of the protocol, and after
+ *   next{} and concurrently() blocks as far as the LED position goes.
+ * - Serial commands overwritten by the very next command are removed, e.g.
+ *   move_to_z{0} right before move_to_z{-4}.
+ * - Consecutive sleeps within a protocol phase are merged.
+ *
+ * Laser commands are never removed, since each one fires the laser anew.
+ * optimization<protocol_fn> lists the commands removed, for the diff report.
+ */
+template <auto protocol_fn>
+using optimized_schedule_t = schedule_t<protocol_fn, optimizedTable<protocol_fn>>;
+
+}  // namespace bioimage_coder
@@ -1,4 +1,10 @@
 #pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 /** Domain specific language (DSL) for 96-eyes instrument control. */
 namespace bioimage_coder{
@@ -35,13 +41,134 @@ repeat_for(Range<Symbol, Integer>&& r, Callable&& steps) {
     return {r, steps};
 }
 
+/** Number of iterations of the range. */
+template <char Symbol, typename Integer>
+constexpr size_t
+iterations(const Range<Symbol, Integer>& r) {
+    return (r.end > r.begin) ? (size_t(r.end - r.begin) + r.step - 1) / r.step : 0;
+}
+
+/** Intermediate representation (IR) for the steps repeated over several
+ * ranges.
+ *
+ * @tparam Ranges One Range per loop variable, in the order of the arguments of
+ * the callable.
+ */
+template <class Callable, typename... Ranges>
+struct repeat_for_nd_t {
+    static constexpr size_t n_dimensions = sizeof...(Ranges);
+
+    std::tuple<Ranges...> ranges;
+    Callable steps;
+
+    /** Loop order, from the outermost to the innermost loop, as indices into
+     * `ranges`. */
+    std::array<uint8_t, n_dimensions> order;
+};
+
+/** A hint for the 96-eyes instrument to repeat the steps over every
+ * combination of the loop variables, e.g. z-position by laser channel:
+ *
+ *     repeat_for(Range<'z', int16_t>{-4, 4, 2}, Range<'c', uint8_t>{0, 2},
+ *                [](int16_t z, uint8_t c) { return Steps{...}; })
+ *
+ * The first range is the outermost loop. plan() of loop-planner.hpp may
+ * reorder the loops.
+ */
+template <char S0, typename I0, char S1, typename I1, class Callable>
+constexpr repeat_for_nd_t<Callable, Range<S0, I0>, Range<S1, I1>>
+repeat_for(Range<S0, I0>&& r0, Range<S1, I1>&& r1, Callable&& steps) {
+    static_assert(S0 != S1, "Loop variables must have distinct symbols.");
+    return {{r0, r1}, steps, {0, 1}};
+}
+
+template <char S0, typename I0, char S1, typename I1, char S2, typename I2, class Callable>
+constexpr repeat_for_nd_t<Callable, Range<S0, I0>, Range<S1, I1>, Range<S2, I2>>
+repeat_for(Range<S0, I0>&& r0, Range<S1, I1>&& r1, Range<S2, I2>&& r2, Callable&& steps) {
+    static_assert(S0 != S1 && S0 != S2 && S1 != S2,
+                  "Loop variables must have distinct symbols.");
+    return {{r0, r1, r2}, steps, {0, 1, 2}};
+}
+
 template <typename T>
 struct is_repeat_for_t : std::false_type {};
 
 template <char Symbol, typename... Args>
 struct is_repeat_for_t<repeat_for_t<Symbol, Args...>> : std::true_type {};
 
+template <class Callable, typename... Ranges>
+struct is_repeat_for_t<repeat_for_nd_t<Callable, Ranges...>> : std::true_type {};
+
 template <typename T>
 constexpr bool is_repeat_for_v = is_repeat_for_t<std::decay_t<T>>::value;
 
+/** Steps of one iteration of the loop. */
+template <typename Loop>
+struct loop_body;
+
+template <char Symbol, typename Integer, class Callable>
+struct loop_body<repeat_for_t<Symbol, Integer, Callable>> {
+    using type = std::decay_t<std::invoke_result_t<Callable, Integer>>;
+};
+
+template <class Callable, char... Symbols, typename... Integers>
+struct loop_body<repeat_for_nd_t<Callable, Range<Symbols, Integers>...>> {
+    using type = std::decay_t<std::invoke_result_t<Callable, Integers...>>;
+};
+
+template <typename Loop>
+using loop_body_t = typename loop_body<std::decay_t<Loop>>::type;
+
+template <char Symbol, typename Integer, class Callable, class Visitor>
+constexpr void
+forEachIteration(const repeat_for_t<Symbol, Integer, Callable>& loop, Visitor&& visit) {
+    for (auto i = loop.range.begin; i < loop.range.end; i += loop.range.step) {
+        visit(loop.steps(i));
+    }
+}
+
+namespace repeat_for_detail {
+
+/** Value of the loop variable at the given iteration count. */
+template <char Symbol, typename Integer>
+constexpr Integer
+valueAt(const Range<Symbol, Integer>& r, const size_t count) {
+    return static_cast<Integer>(r.begin + static_cast<Integer>(count) * r.step);
+}
+
+template <class Callable, typename... Ranges, size_t... I>
+constexpr auto
+stepsAt(const repeat_for_nd_t<Callable, Ranges...>& loop,
+        const std::array<size_t, sizeof...(Ranges)>& count, std::index_sequence<I...>) {
+    return loop.steps(valueAt(std::get<I>(loop.ranges), count[I])...);
+}
+
+}  // namespace repeat_for_detail
+
+/** Call visit() on the steps of each iteration, in the loop order. */
+template <class Callable, typename... Ranges, class Visitor>
+constexpr void
+forEachIteration(const repeat_for_nd_t<Callable, Ranges...>& loop, Visitor&& visit) {
+    constexpr size_t n = sizeof...(Ranges);
+    std::array<size_t, n> extent{};
+    std::apply([&](const auto&... r) { extent = {iterations(r)...}; }, loop.ranges);
+
+    size_t n_iterations = 1;
+    for (const auto e : extent) {
+        n_iterations *= e;
+    }
+
+    for (size_t t = 0; t < n_iterations; t++) {
+        // Decompose the iteration number, the innermost loop first.
+        std::array<size_t, n> count{};
+        size_t rest = t;
+        for (size_t d = n; d-- > 0;) {
+            const auto dimension = loop.order[d];
+            count[dimension] = rest % extent[dimension];
+            rest /= extent[dimension];
+        }
+        visit(repeat_for_detail::stepsAt(loop, count, std::make_index_sequence<n>{}));
+    }
+}
+
 }  // namespace bioimage_coder_dsl
\ No newline at end of file
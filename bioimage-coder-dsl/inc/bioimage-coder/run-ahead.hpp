@@ -0,0 +1,224 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "bioimage-coder/concurrently.hpp"
+#include "bioimage-coder/executor.hpp"
+#include "bioimage-coder/interpreter.hpp"
+#include "constants.h"
+#include "fiber-messages.h"
+#include "messages.h"
+#include "metrics.h"
+#include "trace.h"
+
+namespace bioimage_coder {
+
+/** Dispatch the commands with the boards running ahead of one another.
+ *
+ * In the lockstep mode of dispatch(), every capture command waits for the
+ * frames of all four boards, so that the slowest USB controller gates the
+ * other boards at every step. Here, each board consumes the capture commands
+ * at its own pace, with up to `credit_window` commands in flight. Each
+ * completion signal returns one credit to its board, and the executor blocks
+ * only on a board out of credits.
+ *
+ * Global barriers remain where the instrument changes under the cameras: the
+ * LED, laser, z-stage and other serial commands wait for the end of the
+ * exposure on all boards, but not for the frames to drain over USB.
+ * CloseAllCameraWorkers and concurrently() blocks wait for all frames.
+ *
+ * The time from the first board completing a capture command to each of the
+ * other boards completing it is reported in
+ * telemetry::board_metrics_t::completion_skew.
+ *
+ * The capture queues should hold `credit_window` commands. Otherwise, the
+ * executor blocks on the full queue of the slowest board instead.
+ */
+class run_ahead_dispatcher_t {
+    using signal_t = fiber_messages::capture::completions_signal_t;
+    using time_point = signal_t::value_type;
+    static constexpr size_t n_boards = frame_capture_card::n_boards;
+
+   public:
+    explicit run_ahead_dispatcher_t(const size_t window)
+        : credit_window{window},
+          completions{makeSignals(signalCapacity(window), std::make_index_sequence<n_boards>{})},
+          exposures{makeSignals(signalCapacity(window), std::make_index_sequence<n_boards>{})},
+          // The boards are at most one issue and credit_window completions
+          // apart.
+          pending(window + 1) {
+        if (window == 0) {
+            throw std::invalid_argument("The credit window must be positive");
+        }
+    }
+
+    run_ahead_dispatcher_t(const run_ahead_dispatcher_t&) = delete;
+    run_ahead_dispatcher_t& operator=(const run_ahead_dispatcher_t&) = delete;
+
+    template <typename T>
+    void operator()(const T& command) {
+        using namespace message;
+
+        if constexpr (has_completion_channel<T>::value) {
+            issue(command);
+        } else if constexpr (std::is_same_v<T, CloseAllCameraWorkers> || is_concurrently_v<T>) {
+            finish();
+            dispatch(command);
+        } else if constexpr (is_in_variant<T, fiber_messages::capture::command_t> ||
+                             std::is_same_v<T, SleepFor> || std::is_same_v<T, WaitSettled>) {
+            // The camera configuration queues up behind the captures of each
+            // board.
+            dispatch(command);
+        } else {
+            awaitExposures();
+            dispatch(command);
+        }
+    }
+
+    /** Wait for the frames of all capture commands issued so far. */
+    void finish() {
+        TRACE_SCOPE("dsl", "wait for capture");
+        for (size_t b = 0; b < n_boards; b++) {
+            while (n_completed[b] < n_issued[b]) {
+                awaitCompletion(b);
+            }
+        }
+    }
+
+   private:
+    /** Per-step completion times of the boards, to compute the skew. */
+    struct step_completion_t {
+        std::array<time_point, n_boards> time{};
+        size_t n_reported{0};
+
+        /** Laser pulse of a fluorescence capture, for the photobleaching
+         * budget. Off for the other captures. */
+        illumination_window_t illumination{};
+    };
+
+    const size_t credit_window;
+
+    std::array<signal_t, n_boards> completions;
+    std::array<signal_t, n_boards> exposures;
+
+    std::array<uint64_t, n_boards> n_issued{};
+    std::array<uint64_t, n_boards> n_exposed{};
+    std::array<uint64_t, n_boards> n_completed{};
+
+    /** Capture commands not yet completed by all boards, indexed by the
+     * sequence number modulo the size. */
+    std::vector<step_completion_t> pending;
+
+    template <size_t... I>
+    static std::array<signal_t, n_boards> makeSignals(const size_t capacity,
+                                                      std::index_sequence<I...>) {
+        auto make = [capacity](size_t) { return signal_t{capacity, completionStats()}; };
+        return {{make(I)...}};
+    }
+
+    /** Push the capture command to every board with credits left, and wait
+     * for credits from the others. */
+    template <typename T>
+    void issue(const T& command) {
+        awaitSerialCommands();
+        std::array<bool, n_boards> is_issued{};
+        for (size_t n_left = n_boards; n_left > 0;) {
+            for (size_t b = 0; b < n_boards; b++) {
+                if (!is_issued[b] && n_issued[b] - n_completed[b] < credit_window) {
+                    T new_capture_command{command};
+                    new_capture_command.completion = &completions[b];
+                    new_capture_command.exposure = &exposures[b];
+                    pending[n_issued[b] % pending.size()].illumination =
+                        std::is_same_v<T, fiber_messages::capture::fluorescence_frame_t>
+                            ? illuminationWindow()
+                            : illumination_window_t{};
+                    telemetry::metrics().boards[b].capture_queue_depth.add(1);
+                    image_capture_handlers[b]->push(new_capture_command);
+                    n_issued[b]++;
+                    is_issued[b] = true;
+                    n_left--;
+                }
+            }
+
+            const auto out_of_credits = std::find(is_issued.begin(), is_issued.end(), false);
+            if (out_of_credits != is_issued.end()) {
+                TRACE_SCOPE("dsl", "wait for credit");
+                awaitCompletion(out_of_credits - is_issued.begin());
+            }
+        }
+    }
+
+    /** Global barrier on the end of the exposure of all boards. */
+    void awaitExposures() {
+        TRACE_SCOPE("dsl", "wait for exposure");
+        for (size_t b = 0; b < n_boards; b++) {
+            while (n_exposed[b] < n_issued[b]) {
+                awaitExposure(b);
+            }
+        }
+    }
+
+    void awaitExposure(const size_t b) {
+        time_point time;
+        exposures[b].pop(time);
+        n_exposed[b]++;
+    }
+
+    void awaitCompletion(const size_t b) {
+        // The exposure signal comes first. Collect it too, so that the capture
+        // worker never blocks on a full exposure channel.
+        if (n_exposed[b] == n_completed[b]) {
+            awaitExposure(b);
+        }
+
+        time_point time;
+        completions[b].pop(time);
+
+        auto& step = pending[n_completed[b]++ % pending.size()];
+        step.time[b] = time;
+        step.illumination.observeLastFrame(time);
+        if (++step.n_reported == n_boards) {
+            const auto first = *std::min_element(step.time.begin(), step.time.end());
+            for (size_t i = 0; i < n_boards; i++) {
+                telemetry::metrics().boards[i].completion_skew.observe(step.time[i] - first);
+            }
+            step.n_reported = 0;
+        }
+    }
+};
+
+/** Execute the protocol in the run-ahead mode of run_ahead_dispatcher_t.
+ *
+ * @param[in] credit_window Capture commands in flight per board.
+ */
+template <typename Protocol>
+void
+executeRunAhead(Protocol&& p, const size_t credit_window) {
+    run_ahead_dispatcher_t dispatcher{credit_window};
+    execute(std::forward<Protocol>(p), dispatcher);
+    dispatcher.finish();
+}
+
+/** Execute the flat schedule of the protocol in the run-ahead mode. */
+template <auto protocol_fn, auto table_fn = schedule_detail::buildTable<protocol_fn>>
+void
+executeScheduleRunAhead(const size_t credit_window) {
+    run_ahead_dispatcher_t dispatcher{credit_window};
+    executeSchedule<protocol_fn, table_fn>(dispatcher);
+    dispatcher.finish();
+}
+
+/** Interpret the protocol bytecode in the run-ahead mode. */
+inline void
+interpretRunAhead(const bytecode_program_t& program, const size_t credit_window) {
+    run_ahead_dispatcher_t dispatcher{credit_window};
+    interpret(program, dispatcher);
+    dispatcher.finish();
+}
+
+}  // namespace bioimage_coder
@@ -0,0 +1,260 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "bioimage-coder/repeat-for.hpp"
+
+namespace bioimage_coder {
+
+/** Compact command record of the flat schedule.
+ *
+ * `op` selects the command type in the dispatch table, and `index` the
+ * command parameters in the per-type parameter array.
+ */
+struct command_record_t {
+    uint16_t op;
+    uint16_t index;
+};
+static_assert(sizeof(command_record_t) == sizeof(uint32_t));
+
+namespace schedule_detail {
+
+template <typename T, typename Tuple>
+struct contains;
+
+template <typename T, typename... Ts>
+struct contains<T, std::tuple<Ts...>> : std::bool_constant<(std::is_same_v<T, Ts> || ...)> {};
+
+template <typename Unique, typename T>
+struct append_unique;
+
+template <typename... Us, typename T>
+struct append_unique<std::tuple<Us...>, T> {
+    using type = std::conditional_t<contains<T, std::tuple<Us...>>::value, std::tuple<Us...>,
+                                    std::tuple<Us..., T>>;
+};
+
+/** Append the command types of the step to the type list Unique, in order of
+ * first appearance, skipping the ones already in the list.
+ *
+ * The list grows one step at a time, so that long protocols with few distinct
+ * command types stay linear in compile time.
+ */
+template <typename Unique, typename Step>
+struct add_commands : append_unique<Unique, Step> {};
+
+template <typename Unique, typename Steps>
+struct add_all_commands;
+
+template <typename Unique>
+struct add_all_commands<Unique, std::tuple<>> {
+    using type = Unique;
+};
+
+template <typename Unique, typename Step, typename... Steps>
+struct add_all_commands<Unique, std::tuple<Step, Steps...>>
+    : add_all_commands<typename add_commands<Unique, std::decay_t<Step>>::type,
+                       std::tuple<Steps...>> {};
+
+template <typename Unique, typename... Steps>
+struct add_commands<Unique, std::tuple<Steps...>>
+    : add_all_commands<Unique, std::tuple<Steps...>> {};
+
+template <typename Unique, char Symbol, typename Integer, class Callable>
+struct add_commands<Unique, repeat_for_t<Symbol, Integer, Callable>>
+    : add_commands<Unique, loop_body_t<repeat_for_t<Symbol, Integer, Callable>>> {};
+
+template <typename Unique, class Callable, typename... Ranges>
+struct add_commands<Unique, repeat_for_nd_t<Callable, Ranges...>>
+    : add_commands<Unique, loop_body_t<repeat_for_nd_t<Callable, Ranges...>>> {};
+
+template <typename T, typename Tuple>
+struct index_of;
+
+template <typename T, typename... Ts>
+struct index_of<T, std::tuple<T, Ts...>> : std::integral_constant<size_t, 0> {};
+
+template <typename T, typename U, typename... Ts>
+struct index_of<T, std::tuple<U, Ts...>>
+    : std::integral_constant<size_t, 1 + index_of<T, std::tuple<Ts...>>::value> {};
+
+template <typename T>
+struct is_tuple : std::false_type {};
+
+template <typename... Ts>
+struct is_tuple<std::tuple<Ts...>> : std::true_type {};
+
+/** Visit the commands of the step in execution order, expanding the loops. */
+template <typename Step, typename Visitor>
+constexpr void
+forEachCommand(const Step& step, Visitor&& visit) {
+    using T = std::decay_t<Step>;
+    if constexpr (is_repeat_for_v<T>) {
+        forEachIteration(step, [&](const auto& steps) { forEachCommand(steps, visit); });
+    } else if constexpr (is_tuple<T>::value) {
+        std::apply([&](const auto&... s) { (forEachCommand(s, visit), ...); }, step);
+    } else {
+        visit(step);
+    }
+}
+
+template <auto protocol_fn>
+using protocol_t = std::decay_t<decltype(protocol_fn())>;
+
+/** Distinct command types of the protocol. */
+template <auto protocol_fn>
+using command_types_t = typename add_commands<std::tuple<>, protocol_t<protocol_fn>>::type;
+
+template <auto protocol_fn, typename T>
+constexpr size_t type_index = index_of<T, command_types_t<protocol_fn>>::value;
+
+/** Number of commands of each type, followed by the total. */
+template <auto protocol_fn>
+constexpr auto
+countCommands() {
+    constexpr size_t n_types = std::tuple_size_v<command_types_t<protocol_fn>>;
+    std::array<size_t, n_types + 1> n{};
+    forEachCommand(protocol_fn(), [&](const auto& command) {
+        n[type_index<protocol_fn, std::decay_t<decltype(command)>>]++;
+        n[n_types]++;
+    });
+    return n;
+}
+
+template <auto protocol_fn>
+constexpr auto command_counts = countCommands<protocol_fn>();
+
+template <auto protocol_fn, size_t... I>
+constexpr auto
+parameterArrays(std::index_sequence<I...>) {
+    using types_t = command_types_t<protocol_fn>;
+    return std::tuple<
+        std::array<std::tuple_element_t<I, types_t>, command_counts<protocol_fn>[I]>...>{};
+}
+
+template <auto protocol_fn>
+struct table_t {
+    static constexpr size_t n_types = std::tuple_size_v<command_types_t<protocol_fn>>;
+    static constexpr size_t n_phases = std::tuple_size_v<protocol_t<protocol_fn>>;
+    static constexpr size_t n_commands = command_counts<protocol_fn>[n_types];
+    static_assert(n_commands <= std::numeric_limits<uint16_t>::max(),
+                  "Protocol too long for 16-bit command records.");
+
+    std::array<command_record_t, n_commands> records{};
+
+    /** Records [phase_begin[p], phase_begin[p + 1]) belong to phase p. The
+     * records past phase_begin[n_phases] are unused. */
+    std::array<uint32_t, n_phases + 1> phase_begin{};
+
+    /** Parameters of the commands, one array per command type. */
+    decltype(parameterArrays<protocol_fn>(std::make_index_sequence<n_types>{})) parameters{};
+};
+
+/** Call visit() on the parameters of the record, by reference. */
+template <class Table, class Visitor, size_t... op>
+constexpr void
+visitRecord(Table& table, const command_record_t record, Visitor&& visit,
+            std::index_sequence<op...>) {
+    ((record.op == op && (visit(std::get<op>(table.parameters)[record.index]), true)) || ...);
+}
+
+template <class Table, class Visitor>
+constexpr void
+visitRecord(Table& table, const command_record_t record, Visitor&& visit) {
+    visitRecord(table, record, visit, std::make_index_sequence<Table::n_types>{});
+}
+
+template <auto protocol_fn>
+constexpr table_t<protocol_fn>
+buildTable() {
+    using table = table_t<protocol_fn>;
+    table t{};
+    std::array<uint16_t, table::n_types> n_per_type{};
+    uint32_t n = 0;
+    size_t phase = 0;
+
+    auto append = [&](const auto& command) {
+        constexpr auto op = type_index<protocol_fn, std::decay_t<decltype(command)>>;
+        const auto index = n_per_type[op]++;
+        std::get<op>(t.parameters)[index] = command;
+        t.records[n++] = {static_cast<uint16_t>(op), index};
+    };
+
+    std::apply(
+        [&](const auto&... step) {
+            ((t.phase_begin[phase++] = n, forEachCommand(step, append)), ...);
+        },
+        protocol_fn());
+    t.phase_begin[table::n_phases] = n;
+    return t;
+}
+
+}  // namespace schedule_detail
+
+/** Protocol expanded at compile time into a flat array of command records,
+ * one per command in execution order, plus the command parameters grouped by
+ * type.
+ *
+ * The runtime loop reads one record at a time and branches on its command
+ * type, which the compiler lowers to a dense jump table. Unlike the recursive
+ * execute(), neither the loop bodies of repeat_for nor the tuple structure
+ * are evaluated at runtime.
+ *
+ * @tparam protocol_fn constexpr function returning the protocol, e.g.
+ * mainProtocol.
+ * @tparam table_fn constexpr function returning the table, e.g. after the
+ * optimization pass of optimizer.hpp.
+ */
+template <auto protocol_fn, auto table_fn = schedule_detail::buildTable<protocol_fn>>
+class schedule_t {
+    using table_t = schedule_detail::table_t<protocol_fn>;
+
+   public:
+    using command_types_t = schedule_detail::command_types_t<protocol_fn>;
+    static constexpr size_t n_types = table_t::n_types;
+    static constexpr size_t n_phases = table_t::n_phases;
+
+    static constexpr table_t table = table_fn();
+
+    /** Commands left in the table, at most table_t::n_commands. */
+    static constexpr size_t n_commands = table.phase_begin[n_phases];
+
+    /** Dispatch every command of the protocol in order.
+     *
+     * @param[in] dispatcher Callable on each command type.
+     * @param[in] in_phase Called as in_phase(phase, body) per protocol phase,
+     * to wrap the dispatch of the phase's commands by body().
+     */
+    template <class Dispatcher, class PhaseWrapper>
+    static void run(Dispatcher& dispatcher, PhaseWrapper&& in_phase) {
+        for (size_t phase = 0; phase < n_phases; phase++) {
+            in_phase(phase, [&]() {
+                for (auto k = table.phase_begin[phase]; k < table.phase_begin[phase + 1]; k++) {
+                    dispatchRecord(dispatcher, table.records[k],
+                                   std::make_index_sequence<n_types>{});
+                }
+            });
+        }
+    }
+
+    template <class Dispatcher>
+    static void run(Dispatcher& dispatcher) {
+        run(dispatcher, [](size_t, auto&& body) { body(); });
+    }
+
+   private:
+    /** Branch on the command type, so that the compiler can emit a jump table
+     * and inline the dispatcher into each case. */
+    template <class Dispatcher, size_t... op>
+    static void dispatchRecord(Dispatcher& dispatcher, const command_record_t record,
+                               std::index_sequence<op...>) {
+        ((record.op == op && (dispatcher(std::get<op>(table.parameters)[record.index]), true)) ||
+         ...);
+    }
+};
+
+}  // namespace bioimage_coder
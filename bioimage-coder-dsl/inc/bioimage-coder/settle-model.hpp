@@ -0,0 +1,50 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <type_traits>
+
+#include "messages.h"
+#include "time-model.h"
+
+namespace bioimage_coder {
+
+/** Distance-based settle model of the LED matrix and the z-stage, for
+ * WaitSettled when the firmware does not report the end of the motion, and for
+ * the cost model.
+ *
+ * A z-stage move takes the travel time of its distance, then the settle time.
+ * An LED matrix update takes a fixed time. The figures are those of the dry
+ * run, in simulator::time_model. The z-stage starts at the neutral position,
+ * where the protocols leave it.
+ */
+struct settle_model_t {
+    /** Position of the z-stage, once the moves so far complete. */
+    int16_t z{0};
+
+    /** Time for the command to take effect on the instrument, or zero for
+     * the commands that do not move anything. */
+    template <typename T>
+    constexpr std::chrono::milliseconds settleTime(const T& command) {
+        using namespace message;
+        using std::chrono::milliseconds;
+        if constexpr (std::is_same_v<T, motion::move_to_z>) {
+            const auto time = simulator::time_model::zMove(command.value - z);
+            z = command.value;
+            return std::chrono::ceil<milliseconds>(time);
+        } else if constexpr (std::is_same_v<T, led_matrix::switch_to> ||
+                             std::is_same_v<T, led_matrix::blank> ||
+                             std::is_same_v<T, led_matrix::next> ||
+                             std::is_same_v<T, led_matrix::color_t>) {
+            return simulator::time_model::led_update;
+        } else {
+            return milliseconds{0};
+        }
+    }
+};
+
+static_assert(settle_model_t{}.settleTime(message::motion::move_to_z{-2}) ==
+              std::chrono::milliseconds{120});
+static_assert(settle_model_t{}.settleTime(message::led_matrix::next{}) ==
+              std::chrono::milliseconds{2});
+
+}  // namespace bioimage_coder
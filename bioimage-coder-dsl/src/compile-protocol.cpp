@@ -0,0 +1,39 @@
+/** Compile the protocol of main_protocol.hpp to bytecode, for
+ * `capture-images --protocol FILE`.
+ *
+ * The schedule is optimized as in capture-images. This tool is built without
+ * -march=native, so that protocols can be compiled off the instrument PC.
+ */
+#include <fmt/format.h>
+
+#include <cstdio>
+#include <fstream>
+#include <string_view>
+
+#include "bioimage-coder/bytecode.hpp"
+#include "bioimage-coder/optimizer.hpp"
+#include "main_protocol.hpp"
+
+int
+main(int argc, char* argv[]) {
+    if (argc != 2 || std::string_view{argv[1]} == "--help") {
+        fmt::print(stderr, FMT_STRING("Usage: {:s} OUTPUT.bioc\n"), argv[0]);
+        return 1;
+    }
+
+    constexpr auto optimized = bioimage_coder::optimizedTable<mainProtocol>;
+    static constexpr auto code = bioimage_coder::compileBytecode<mainProtocol, optimized>();
+    using schedule = bioimage_coder::schedule_t<mainProtocol, optimized>;
+
+    std::ofstream file{argv[1], std::ios::binary};
+    file.write(reinterpret_cast<const char*>(code.data()), code.size());
+    file.close();
+    if (!file) {
+        fmt::print(stderr, FMT_STRING("Cannot write {:s}\n"), argv[1]);
+        return 1;
+    }
+
+    fmt::print(FMT_STRING("{:s}: {:d} phases, {:d} commands, {:d} bytes\n"), argv[1],
+               schedule::n_phases, schedule::n_commands, code.size());
+    return 0;
+}
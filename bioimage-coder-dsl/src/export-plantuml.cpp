@@ -5,11 +5,17 @@
 #include <chrono>
 #include <tuple>
 
+#include "bioimage-coder/cost-model.hpp"
 #include "main_protocol.hpp"
 
+using bioimage_coder::concurrently_t;
+using bioimage_coder::is_async_capture_v;
 using bioimage_coder::is_repeat_for_v;
+using bioimage_coder::protocol_cost_t;
 using bioimage_coder::Range;
 using bioimage_coder::repeat_for;
+using bioimage_coder::repeat_for_nd_t;
+using bioimage_coder::repeat_for_t;
 using fiber_messages::capture::dark_frame_t;
 using fiber_messages::capture::fluorescence_frame_t;
 using fiber_messages::capture::fpm_frame_t;
@@ -17,6 +23,7 @@ using fiber_messages::capture::camera::exposure_gain_t;
 using fiber_messages::capture::camera::init_sequence_t;
 using message::CloseAllCameraWorkers;
 using message::SleepFor;
+using message::WaitSettled;
 using led_at = message::led_matrix::switch_to;
 
 namespace {
@@ -56,6 +63,13 @@ drawActivity(const SleepFor& s) {
     fmt::print(FMT_STRING(":Wait for {:d} milliseconds;\n"), s.duration.count());
 }
 
+void
+drawActivity(const WaitSettled& w) {
+    fmt::print(FMT_STRING(":Wait for the LED and the z-stage to settle, at least {:d} ms, up to "
+                          "{:d} ms;\n"),
+               w.min_settle.count(), w.timeout.count());
+}
+
 void
 drawActivity(const move_to_z& m) {
     fmt::print(FMT_STRING(":Move to z = {:d} um;\n"), m.value);
@@ -90,33 +104,111 @@ void
 drawActivity(const color_t& c) {
     fmt::print(FMT_STRING(":Set LED color = {:c};\n"), char(c));
 }
+
+/** Captures on one branch, and the LED, z-stage commands and sleeps on the
+ * other, joined at the end of the block. */
+template <typename... Commands>
+void
+drawActivity(const concurrently_t<Commands...>& block) {
+    fmt::print("fork\n");
+    std::apply(
+        [](const auto&... command) {
+            ((is_async_capture_v<std::decay_t<decltype(command)>> ? drawActivity(command) : void()),
+             ...);
+        },
+        block.steps);
+    fmt::print("fork again\n");
+    std::apply(
+        [](const auto&... command) {
+            ((is_async_capture_v<std::decay_t<decltype(command)>> ? void() : drawActivity(command)),
+             ...);
+        },
+        block.steps);
+    fmt::print("end fork\n");
+}
+/** Annotate the step with its frames, bytes and minimum duration. */
+void
+drawCost(const protocol_cost_t& cost) {
+    if (cost.frames_per_board == 0 && cost.min_duration.count() == 0) {
+        return;
+    }
+    fmt::print(FMT_STRING("floating note right\n"
+                          "{:d} frames/board, {:.1f} MB/board\n"
+                          "at least {:.3f} s, peak buffers {:.1f} MB\n"
+                          "end note\n"),
+               cost.frames_per_board, cost.bytes_per_board * 1e-6,
+               std::chrono::duration<double>(cost.min_duration).count(),
+               cost.peak_buffer_bytes * 1e-6);
+}
+
+template <char Symbol, typename Integer>
+void
+beginRepeat(const Range<Symbol, Integer>& range) {
+    fmt::print(FMT_STRING(":{:c} = {:d};\nrepeat\n"), Symbol, range.begin);
+}
+
+template <char Symbol, typename Integer>
+void
+endRepeat(const Range<Symbol, Integer>& range) {
+    using namespace fmt::literals;
+    fmt::print(R"(backward:{symbol:c} += {step:d};
+repeat while ({symbol:c} < {end:d}?) is (yes)
+->(no);
+)",
+               "symbol"_a = Symbol, "step"_a = range.step, "end"_a = range.end);
+}
+
+template <char Symbol, typename Integer, class Callable>
+void
+drawLoop(const repeat_for_t<Symbol, Integer, Callable>& loop) {
+    beginRepeat(loop.range);
+    std::apply([](auto&&... command) { (drawActivity(command), ...); }, loop.steps(123));
+    endRepeat(loop.range);
+}
+
+/** Nested loops, from the outermost in the loop order. */
+template <class Callable, typename... Ranges>
+void
+drawLoop(const repeat_for_nd_t<Callable, Ranges...>& loop) {
+    auto visitRange = [&](const size_t d, auto&& draw) {
+        std::apply(
+            [&](const auto&... range) {
+                size_t i = 0;
+                ((i++ == d ? draw(range) : void()), ...);
+            },
+            loop.ranges);
+    };
+
+    for (const auto d : loop.order) {
+        visitRange(d, [](const auto& range) { beginRepeat(range); });
+    }
+    std::apply(
+        [&](const auto&... range) {
+            std::apply([](auto&&... command) { (drawActivity(command), ...); },
+                       loop.steps(range.begin...));
+        },
+        loop.ranges);
+    for (auto d = loop.order.rbegin(); d != loop.order.rend(); d++) {
+        visitRange(*d, [](const auto& range) { endRepeat(range); });
+    }
+}
+
 /** Black magic to dispatch commands in the tuple structure. */
-template <typename Protocol, size_t index = 0>
+template <typename Protocol, size_t index = 0, size_t n_steps>
 constexpr void
-drawPlantuml(Protocol&& p) {
+drawPlantuml(Protocol&& p, const std::array<protocol_cost_t, n_steps>& costs) {
     if constexpr (index < std::tuple_size_v<std::remove_reference_t<Protocol>>) {
         auto&& sub_protocol = std::get<index>(std::forward<Protocol>(p));
 
         using T = std::decay_t<decltype(sub_protocol)>;
         if constexpr (is_repeat_for_v<T>) {
-            fmt::print(FMT_STRING(":{:c} = {:d};\nrepeat\n"), decltype(sub_protocol.range)::symbol,
-                       sub_protocol.range.begin);
-
-            std::apply([](auto&&... command) { (drawActivity(command), ...); },
-                       sub_protocol.steps(123));
-
-            using namespace fmt::literals;
-            fmt::print(R"(backward:{symbol:c} += {step:d};
-repeat while ({symbol:c} < {end:d}?) is (yes)
-->(no);
-)",
-                       "symbol"_a = decltype(sub_protocol.range)::symbol,
-                       "step"_a = sub_protocol.range.step, "end"_a = sub_protocol.range.end);
+            drawLoop(sub_protocol);
         } else {
             std::apply([](auto&&... command) { (drawActivity(command), ...); }, sub_protocol);
         }
+        drawCost(costs[index]);
 
-        drawPlantuml<Protocol, index + 1>(std::forward<Protocol>(p));
+        drawPlantuml<Protocol, index + 1>(std::forward<Protocol>(p), costs);
     }
 }
 
@@ -124,8 +216,18 @@ repeat while ({symbol:c} < {end:d}?) is (yes)
 
 int
 main() {
+    const auto costs = bioimage_coder::stepCosts(mainProtocol());
+    const auto total = bioimage_coder::protocolCost(mainProtocol());
+
     fmt::print("start\n");
-    drawPlantuml(mainProtocol());
+    drawPlantuml(mainProtocol(), costs);
+    fmt::print(FMT_STRING("floating note left\n"
+                          "Total: {:d} frames, {:.2f} GB, at least {:.1f} s\n"
+                          "Disk bandwidth at least {:.1f} MB/s\n"
+                          "end note\n"),
+               total.frames(), total.bytes() * 1e-9,
+               std::chrono::duration<double>(total.min_duration).count(),
+               total.minWriteBandwidth() * 1e-6);
     fmt::print("stop\n");
     return 0;
 }
\ No newline at end of file
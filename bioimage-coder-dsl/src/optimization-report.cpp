@@ -0,0 +1,160 @@
+/** Print the commands the optimizer removes from the protocol of
+ * main_protocol.hpp, as a diff of the flat schedule. */
+#include <fmt/chrono.h>
+#include <fmt/format.h>
+
+#include <string>
+#include <tuple>
+#include <type_traits>
+
+#include "bioimage-coder/optimizer.hpp"
+#include "main_protocol.hpp"
+
+using bioimage_coder::command_record_t;
+using bioimage_coder::concurrently_t;
+using bioimage_coder::optimization;
+using bioimage_coder::schedule_t;
+using fiber_messages::capture::dark_frame_t;
+using fiber_messages::capture::fluorescence_frame_t;
+using fiber_messages::capture::fpm_frame_t;
+using fiber_messages::capture::camera::exposure_gain_t;
+using fiber_messages::capture::camera::init_sequence_t;
+using message::CloseAllCameraWorkers;
+using message::SleepFor;
+using message::WaitSettled;
+using led_at = message::led_matrix::switch_to;
+
+namespace {
+
+std::string
+describe(const dark_frame_t&) {
+    return "Capture dark frame";
+}
+
+std::string
+describe(const fpm_frame_t& c) {
+    return fmt::format(FMT_STRING("Capture FPM images, LED {:d}"), c.led_id);
+}
+
+std::string
+describe(const fluorescence_frame_t& c) {
+    return fmt::format(FMT_STRING("Capture fluorescence images, z = {:d}, channel={:s}"), c.zpos,
+                       toString(c.ch));
+}
+
+std::string
+describe(const exposure_gain_t& c) {
+    return fmt::format(FMT_STRING("Set exposure={}; gain={:d}x"), c.exposure(), c.gain());
+}
+
+std::string
+describe(const init_sequence_t&) {
+    return "Initialize CMOS sensors";
+}
+
+std::string
+describe(const CloseAllCameraWorkers&) {
+    return "Close cameras";
+}
+
+std::string
+describe(const SleepFor& s) {
+    return fmt::format(FMT_STRING("Wait for {:d} milliseconds"), s.duration.count());
+}
+
+std::string
+describe(const WaitSettled& w) {
+    return fmt::format(FMT_STRING("Wait for the LED and the z-stage to settle, at least {:d} ms"),
+                       w.min_settle.count());
+}
+
+std::string
+describe(const move_to_z& m) {
+    return fmt::format(FMT_STRING("Move to z = {:d} um"), m.value);
+}
+
+std::string
+describe(const laser& l) {
+    if (l.power <= 0) {
+        return "Laser off";
+    }
+    return fmt::format(FMT_STRING("Laser {:s} at power {:d} for {:d} seconds"), toString(l.ch),
+                       l.power, l.time.count());
+}
+
+std::string
+describe(const blank&) {
+    return "Turn off LED matrix";
+}
+
+std::string
+describe(const led_at& l) {
+    return fmt::format(FMT_STRING("Turn on LED at (x, y) = ({:d}, {:d})"), l.x, l.y);
+}
+
+std::string
+describe(const next&) {
+    return "Toggle the next LED";
+}
+
+std::string
+describe(const color_t& c) {
+    return fmt::format(FMT_STRING("Set LED color = {:c}"), char(c));
+}
+
+template <typename... Commands>
+std::string
+describe(const concurrently_t<Commands...>& block) {
+    std::string text{"Concurrently"};
+    std::apply([&](const auto&... command) { ((text += ", " + describe(command)), ...); },
+               block.steps);
+    return text;
+}
+
+template <class Table>
+std::string
+describe(const Table& table, const command_record_t record) {
+    std::string text{};
+    bioimage_coder::optimizer_detail::visitRecord(
+        table, record, [&](const auto& command) { text = describe(command); });
+    return text;
+}
+
+}  // namespace
+
+int
+main() {
+    using schedule = schedule_t<mainProtocol>;
+    constexpr auto& report = optimization<mainProtocol>;
+    const auto& before = schedule::table;
+    const auto& after = report.table;
+
+    fmt::print(FMT_STRING("--- schedule, {:d} commands\n+++ optimized, {:d} commands\n"),
+               schedule::n_commands, schedule::n_commands - report.n_removed);
+
+    // Walk the unoptimized schedule and the report side by side. The kept
+    // records have the same parameter index in both tables, so a merged sleep
+    // shows up as a changed line.
+    size_t r = 0;
+    for (size_t phase = 0; phase < schedule::n_phases; phase++) {
+        fmt::print(FMT_STRING("@@ phase {:d} @@\n"), phase);
+        for (auto k = before.phase_begin[phase]; k < before.phase_begin[phase + 1]; k++) {
+            const auto record = before.records[k];
+            const auto original = describe(before, record);
+            if (r < report.n_removed && report.removed[r].position == k) {
+                fmt::print(FMT_STRING("-{:s}  # {:s}\n"), original,
+                           toString(report.removed[r].reason));
+                r++;
+                continue;
+            }
+
+            const auto optimized = describe(after, record);
+            if (optimized != original) {
+                fmt::print(FMT_STRING("-{:s}\n+{:s}\n"), original, optimized);
+            } else {
+                fmt::print(FMT_STRING(" {:s}\n"), original);
+            }
+        }
+    }
+    return 0;
+}
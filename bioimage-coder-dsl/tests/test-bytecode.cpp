@@ -0,0 +1,224 @@
+#include <array>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+#include "bioimage-coder/bytecode.hpp"
+#include "bioimage-coder/concurrently.hpp"
+#include "bioimage-coder/interpreter.hpp"
+#include "bioimage-coder/repeat-for.hpp"
+#include "bioimage-coder/schedule.hpp"
+#include "fiber-messages.h"
+#include "messages.h"
+
+using namespace std::chrono_literals;
+using bioimage_coder::bytecode_program_t;
+using bioimage_coder::compileBytecode;
+using bioimage_coder::concurrently;
+using bioimage_coder::Range;
+using bioimage_coder::repeat_for;
+using bioimage_coder::schedule_t;
+using bioimage_coder::bytecode::opcode_t;
+using fiber_messages::capture::dark_frame_t;
+using fiber_messages::capture::fluorescence_frame_t;
+using fiber_messages::capture::fpm_frame_t;
+using fiber_messages::capture::camera::exposure_gain_t;
+using fiber_messages::capture::camera::init_sequence_t;
+using frame_capture_card::commands::i2c_cmd_t;
+using message::CloseAllCameraWorkers;
+using message::SleepFor;
+using message::WaitSettled;
+using message::excitation::laser;
+using message::led_matrix::blank;
+using message::led_matrix::color_t;
+using message::led_matrix::next;
+using message::led_matrix::switch_to;
+using message::motion::move_to_z;
+
+namespace {
+
+constexpr auto
+fpmStep(const uint8_t i) {
+    return std::tuple{concurrently(fpm_frame_t{i}, next{}, SleepFor{50ms})};
+}
+
+constexpr auto
+fluorescenceStep(const int16_t z) {
+    return std::tuple{move_to_z{z}, WaitSettled{250ms, 100ms}, laser{2s, 16, TXRED},
+                      fluorescence_frame_t{z, TXRED}};
+}
+
+constexpr auto
+testProtocol() {
+    return std::tuple{
+        std::tuple{init_sequence_t{{i2c_cmd_t{0x0001, 0xff}, i2c_cmd_t{0x0002, 0xfe}}, 2},
+                   switch_to{3, 4}, color_t::R, dark_frame_t{},
+                   exposure_gain_t::setExposureGain<4>(300ms)},
+        repeat_for(Range<'i', uint8_t>{0, 3}, fpmStep),
+        std::tuple{blank{}, SleepFor{1'500ms}},
+        repeat_for(Range<'z', int16_t>{-300, 300, 200}, fluorescenceStep),
+        std::tuple{CloseAllCameraWorkers{}},
+    };
+}
+
+constexpr auto code = compileBytecode<testProtocol>();
+
+// Header, then the phase table from byte 8. Phase 0 takes one opcode byte per
+// command, and 1 + 2 * 3, 2, 1, 0 and 3 * 3 bytes of operands.
+static_assert(code[8] == 0 && code[12] == 5 + 7 + 2 + 1 + 0 + 9);
+
+// The settle times take 32 bits, as the sleeps do.
+constexpr auto long_settle = [] {
+    std::array<uint8_t, 8> buffer{};
+    bioimage_coder::bytecode::writer_t out{buffer.data()};
+    bioimage_coder::bytecode::encode(out, WaitSettled{90s, 70s});
+    bioimage_coder::bytecode::reader_t in{buffer.data()};
+    WaitSettled decoded{};
+    bioimage_coder::bytecode::decode(in, decoded);
+    return decoded;
+}();
+static_assert(long_settle.timeout == 90s && long_settle.min_settle == 70s);
+
+/** Record each command in its bytecode encoding, and the blocks as the
+ * concurrently opcode followed by their steps. */
+struct recording_dispatcher_t {
+    std::vector<std::vector<uint8_t>> commands{};
+
+    template <typename T>
+    void operator()(const T& command) {
+        namespace bytecode = bioimage_coder::bytecode;
+        if constexpr (bioimage_coder::is_concurrently_v<T>) {
+            commands.push_back({uint8_t(opcode_t::concurrently), uint8_t(command.n_captures)});
+            command.forEach([&](const auto& step) { (*this)(step); });
+        } else {
+            bytecode::writer_t counter{};
+            bytecode::encodeCommand(counter, command);
+            std::vector<uint8_t> encoded(counter.size);
+            bytecode::writer_t out{encoded.data()};
+            bytecode::encodeCommand(out, command);
+            commands.push_back(encoded);
+        }
+    }
+};
+
+std::vector<uint8_t>
+bytes() {
+    return {code.begin(), code.end()};
+}
+
+/** Bytecode of one phase of the given code. */
+std::vector<uint8_t>
+onePhase(const std::vector<uint8_t>& phase) {
+    const auto size = uint8_t(phase.size());
+    std::vector<uint8_t> b{'B', 'I', 'O', 'C', bioimage_coder::bytecode::version, 0, 1, 0,
+                           0,   0,   0,   0,   size,                              0, 0, 0};
+    b.insert(b.end(), phase.begin(), phase.end());
+    return b;
+}
+
+}  // namespace
+
+TEST_CASE("Interpret the same commands as the flat schedule", "[bytecode]") {
+    recording_dispatcher_t compiled{};
+    schedule_t<testProtocol>::run(compiled);
+
+    const bytecode_program_t program{bytes()};
+    REQUIRE(program.phases() == 5);
+
+    recording_dispatcher_t interpreted{};
+    bioimage_coder::interpret(program, interpreted);
+
+    // 5 commands, 3 blocks of 3 steps, 2 commands, 3 times 4 commands, 1 command.
+    REQUIRE(compiled.commands.size() == 5 + 3 * 4 + 2 + 3 * 4 + 1);
+    CHECK(interpreted.commands == compiled.commands);
+}
+
+TEST_CASE("Load the bytecode from a file", "[bytecode]") {
+    CHECK_THROWS_AS(bytecode_program_t::load("/nonexistent/protocol.bioc"), std::runtime_error);
+}
+
+TEST_CASE("Reject malformed bytecode at load time", "[bytecode]") {
+    constexpr size_t code_begin = 8 + 6 * 4;
+
+    SECTION("Wrong magic") {
+        auto b = bytes();
+        b[0] = 'X';
+        CHECK_THROWS_AS(bytecode_program_t{b}, std::invalid_argument);
+    }
+
+    SECTION("Newer format version") {
+        auto b = bytes();
+        b[4]++;
+        CHECK_THROWS_AS(bytecode_program_t{b}, std::invalid_argument);
+    }
+
+    SECTION("Truncated code") {
+        auto b = bytes();
+        b.pop_back();
+        CHECK_THROWS_AS(bytecode_program_t{b}, std::invalid_argument);
+    }
+
+    SECTION("Phase beyond the code") {
+        // Phase 1 starts 1 MiB into the code. Phase 0 is not decoded up to
+        // there.
+        auto b = bytes();
+        b[14] = 0x10;
+        CHECK_THROWS_AS(bytecode_program_t{b}, std::invalid_argument);
+    }
+
+    SECTION("Unknown opcode") {
+        auto b = bytes();
+        b[code_begin] = uint8_t(opcode_t::n_opcodes);
+        CHECK_THROWS_AS(bytecode_program_t{b}, std::invalid_argument);
+    }
+
+    SECTION("Too many i2c commands") {
+        auto b = bytes();
+        REQUIRE(b[code_begin] == uint8_t(opcode_t::init_sequence));
+        b[code_begin + 1] = init_sequence_t::max_count + 1;
+        CHECK_THROWS_AS(bytecode_program_t{b}, std::invalid_argument);
+    }
+
+    SECTION("Laser in a concurrently() block") {
+        // The first step of the first block, in phase 1.
+        auto b = bytes();
+        const size_t block = code_begin + (b[12] | (b[13] << 8));
+        REQUIRE(b[block] == uint8_t(opcode_t::concurrently));
+        REQUIRE(b[block + 4] == uint8_t(opcode_t::fpm_frame));
+        b[block + 4] = uint8_t(opcode_t::laser);
+        CHECK_THROWS_AS(bytecode_program_t{b}, std::invalid_argument);
+    }
+
+    SECTION("Wrong number of captures in a concurrently() block") {
+        auto b = bytes();
+        const size_t block = code_begin + (b[12] | (b[13] << 8));
+        b[block + 1]++;
+        CHECK_THROWS_AS(bytecode_program_t{b}, std::invalid_argument);
+    }
+}
+
+TEST_CASE("Reject the programs that leave the camera workers open", "[bytecode]") {
+    constexpr auto sleep_for = uint8_t(opcode_t::sleep_for);
+    constexpr auto close = uint8_t(opcode_t::close_all_camera_workers);
+    constexpr auto dark_frame = uint8_t(opcode_t::dark_frame);
+
+    // The serial commands may follow the close.
+    REQUIRE_NOTHROW(bytecode_program_t{onePhase({close, sleep_for, 10, 0, 0, 0})});
+
+    SECTION("No close") {
+        CHECK_THROWS_AS(bytecode_program_t{onePhase({sleep_for, 10, 0, 0, 0})},
+                        std::invalid_argument);
+    }
+
+    SECTION("Capture after the close") {
+        CHECK_THROWS_AS(bytecode_program_t{onePhase({close, dark_frame})},
+                        std::invalid_argument);
+    }
+
+    SECTION("Closed twice") {
+        CHECK_THROWS_AS(bytecode_program_t{onePhase({close, close})}, std::invalid_argument);
+    }
+}
@@ -0,0 +1,255 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <array>
+#include <asio/io_service.hpp>
+#include <asio/serial_port.hpp>
+#include <boost/fiber/all.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "bioimage-coder/concurrently.hpp"
+#include "bioimage-coder/cost-model.hpp"
+#include "bioimage-coder/executor.hpp"
+
+using namespace std::chrono_literals;
+using bioimage_coder::concurrently;
+using boost::fibers::fiber;
+using fiber_messages::capture::fluorescence_frame_t;
+using fiber_messages::capture::fpm_frame_t;
+using frame_capture_card::n_boards;
+using message::SleepFor;
+using message::WaitSettled;
+using message::excitation::laser;
+using message::led_matrix::next;
+using message::motion::move_to_z;
+using std::chrono::steady_clock;
+
+using capture_queue_t = fiber_messages::capture::queue_t;
+auto& capture_queue_stats = telemetry::channelStats("capture", "test", "test", 1, n_boards);
+
+asio::io_service io;
+asio::serial_port serial_port{io};
+std::array<capture_queue_t*, n_boards> image_capture_handlers{};
+
+namespace {
+
+constexpr auto exposure_time = 50ms;
+constexpr auto drain_time = 200ms;
+constexpr auto settle_time = 150ms;
+
+// Static rules, and the cost of the block: the settle time is hidden behind
+// the frame capture.
+constexpr auto block = concurrently(fpm_frame_t{1}, next{}, SleepFor{settle_time});
+static_assert(decltype(block)::n_captures == 1);
+
+constexpr auto block_cost = bioimage_coder::protocolCost(std::tuple{
+    fiber_messages::capture::camera::exposure_gain_t::setExposureGain<1>(30ms), block});
+static_assert(block_cost.frames_per_board == frame_capture_card::n_cameras_per_board);
+static_assert(block_cost.min_duration == 30ms + settle_time);
+
+/** Serial commands received on a pseudo-terminal, with the arrival time. */
+class RecordingSerialDevice {
+   public:
+    RecordingSerialDevice() : master{posix_openpt(O_RDWR | O_NOCTTY)} {
+        if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+            throw std::runtime_error("Cannot open pseudo-terminal");
+        }
+        path = ptsname(master);
+
+        // read() fails with EIO once the serial port is closed.
+        reader = std::thread{[this]() {
+            std::array<char, 256> buffer;
+            ssize_t n;
+            while ((n = ::read(master, buffer.data(), buffer.size())) > 0) {
+                std::lock_guard lock{mutex};
+                for (ssize_t i = 0; i < n; i++) {
+                    line.push_back(buffer[i]);
+                    if (buffer[i] == '\n') {
+                        commands.emplace_back(steady_clock::now(), line);
+                        line.clear();
+                    }
+                }
+            }
+        }};
+    }
+
+    ~RecordingSerialDevice() {
+        if (reader.joinable()) {
+            reader.join();
+        }
+        ::close(master);
+    }
+
+    std::vector<std::pair<steady_clock::time_point, std::string>> received() {
+        reader.join();
+        return commands;
+    }
+
+    std::string path{};
+
+   private:
+    int master;
+    std::mutex mutex{};
+    std::string line{};
+    std::vector<std::pair<steady_clock::time_point, std::string>> commands{};
+    std::thread reader{};
+};
+
+/** Expose, then drain the frames, in fixed time. */
+void
+fakeCaptureWorker(capture_queue_t& capture_queue, std::vector<steady_clock::time_point>& exposed) {
+    for (auto&& cmd : capture_queue) {
+        std::visit(
+            [&](auto&& capture_command) {
+                if constexpr (bioimage_coder::has_completion_channel<
+                                  std::decay_t<decltype(capture_command)>>::value) {
+                    boost::this_fiber::sleep_for(exposure_time);
+                    exposed.push_back(steady_clock::now());
+                    if (capture_command.exposure != nullptr) {
+                        capture_command.exposure->push(steady_clock::now());
+                    }
+                    boost::this_fiber::sleep_for(drain_time - exposure_time);
+                    capture_command.completion->push(steady_clock::now());
+                }
+            },
+            cmd);
+    }
+}
+
+}  // namespace
+
+TEST_CASE("Overlap the LED switching and settling with the frame drain", "[concurrently]") {
+    RecordingSerialDevice serial_device{};
+    serial_port.open(serial_device.path);
+
+    auto capture_queues = fiber_messages::capture::makeQueues(2, capture_queue_stats);
+    bioimage_coder::connectCaptureQueues(capture_queues);
+    std::array<std::vector<steady_clock::time_point>, n_boards> exposed{};
+    std::vector<fiber> capture_tasks;
+    for (uint8_t usb_id = 0; usb_id < n_boards; usb_id++) {
+        capture_tasks.emplace_back(fakeCaptureWorker, std::ref(capture_queues[usb_id]),
+                                   std::ref(exposed[usb_id]));
+    }
+
+    const auto start = steady_clock::now();
+    bioimage_coder::execute(std::tuple{std::tuple{block}, std::tuple{next{}}});
+    const auto elapsed = steady_clock::now() - start;
+
+    for (auto& queue : capture_queues) {
+        queue.close();
+    }
+    for (auto& task : capture_tasks) {
+        task.join();
+    }
+    serial_port.close();
+
+    const auto commands = serial_device.received();
+    REQUIRE(commands.size() == 2);
+    REQUIRE(commands[0].second == "n\n");
+
+    // The LED switches after the exposure of all boards, and before the
+    // frames have drained.
+    for (const auto& times : exposed) {
+        REQUIRE(times.size() == 1);
+        CHECK(commands[0].first >= times[0]);
+    }
+    CHECK(commands[0].first - start < drain_time);
+
+    // The next step waits for the frames and for the LED to settle. The two
+    // overlap.
+    CHECK(commands[1].first - start >= drain_time);
+    CHECK(commands[1].first - start >= exposure_time + settle_time);
+    CHECK(elapsed < drain_time + settle_time);
+}
+
+TEST_CASE("Wait for the z-stage to settle by the distance moved", "[concurrently]") {
+    RecordingSerialDevice serial_device{};
+    serial_port.open(serial_device.path);
+    auto& settle_wait = telemetry::metrics().executor.settle_wait;
+    const auto n_waits = settle_wait.count();
+
+    bioimage_coder::execute(std::make_tuple(std::make_tuple(move_to_z{4}, WaitSettled{}, next{})));
+    serial_port.close();
+
+    // The blocking serial port reports nothing. The settle model takes 4 um
+    // of travel, then the settle time.
+    const auto commands = serial_device.received();
+    REQUIRE(commands.size() == 2);
+    REQUIRE(commands[0].second == "z 4\n");
+    const auto settle_time = commands[1].first - commands[0].first;
+    CHECK(settle_time >= 140ms);
+    CHECK(settle_time < 140ms + 50ms);
+    CHECK(settle_wait.count() == n_waits + 1);
+}
+
+TEST_CASE("Wait at least the minimum settle time of the step", "[concurrently]") {
+    RecordingSerialDevice serial_device{};
+    serial_port.open(serial_device.path);
+
+    bioimage_coder::execute(std::make_tuple(
+        std::make_tuple(move_to_z{4}, WaitSettled::atLeast(300ms), next{})));
+    serial_port.close();
+
+    // The settle model alone takes 140 ms.
+    const auto commands = serial_device.received();
+    REQUIRE(commands.size() == 2);
+    const auto settle_time = commands[1].first - commands[0].first;
+    CHECK(settle_time >= 300ms);
+    CHECK(settle_time < 300ms + 50ms);
+}
+
+TEST_CASE("Measure the laser to the last frame of each board", "[concurrently]") {
+    RecordingSerialDevice serial_device{};
+    serial_port.open(serial_device.path);
+
+    auto capture_queues = fiber_messages::capture::makeQueues(2, capture_queue_stats);
+    bioimage_coder::connectCaptureQueues(capture_queues);
+    std::array<std::vector<steady_clock::time_point>, n_boards> exposed{};
+    std::vector<fiber> capture_tasks;
+    for (uint8_t usb_id = 0; usb_id < n_boards; usb_id++) {
+        capture_tasks.emplace_back(fakeCaptureWorker, std::ref(capture_queues[usb_id]),
+                                   std::ref(exposed[usb_id]));
+    }
+
+    // Within the laser time, then past it. The frames without the laser are
+    // not accounted for. The laser turns on once the LED of the tests before
+    // has settled.
+    const auto& illuminations = telemetry::illumination::illuminations();
+    const size_t n_illuminations = illuminations.size();
+    bioimage_coder::execute(std::make_tuple(std::make_tuple(
+        WaitSettled{}, laser{1s, 16, EGFP}, fluorescence_frame_t{0, EGFP}, SleepFor{900ms},
+        fluorescence_frame_t{0, EGFP}, laser{1s, 0, EGFP}, fluorescence_frame_t{0, EGFP})));
+
+    for (auto& queue : capture_queues) {
+        queue.close();
+    }
+    for (auto& task : capture_tasks) {
+        task.join();
+    }
+    serial_port.close();
+    REQUIRE(serial_device.received().size() == 2);
+
+    REQUIRE(illuminations.size() == n_illuminations + 2 * n_boards);
+    for (size_t i = n_illuminations; i < illuminations.size(); i++) {
+        CHECK(illuminations[i].ch == EGFP);
+        CHECK(illuminations[i].budget == 1s);
+    }
+    for (size_t i = 0; i < n_boards; i++) {
+        const auto& first = illuminations[n_illuminations + i];
+        CHECK(first.latency >= drain_time);
+        CHECK(first.latency < drain_time + 50ms);
+        CHECK_FALSE(first.isOverrun());
+
+        const auto& second = illuminations[n_illuminations + n_boards + i];
+        CHECK(second.latency >= 2 * drain_time + 900ms);
+        CHECK(second.isOverrun());
+    }
+}
@@ -0,0 +1,97 @@
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <tuple>
+
+#include "bioimage-coder/concurrently.hpp"
+#include "bioimage-coder/cost-model.hpp"
+
+using namespace std::chrono_literals;
+using bioimage_coder::concurrently;
+using bioimage_coder::protocolCost;
+using bioimage_coder::Range;
+using bioimage_coder::repeat_for;
+using bioimage_coder::stepCosts;
+using fiber_messages::capture::dark_frame_t;
+using fiber_messages::capture::fluorescence_frame_t;
+using fiber_messages::capture::fpm_frame_t;
+using EG = fiber_messages::capture::camera::exposure_gain_t;
+using message::SleepFor;
+using message::WaitSettled;
+using message::led_matrix::next;
+using message::motion::move_to_z;
+
+namespace {
+
+constexpr auto
+fpmStep(const uint8_t led_id) {
+    return std::tuple{SleepFor{100ms}, fpm_frame_t{led_id}};
+}
+
+constexpr auto
+testProtocol() {
+    return std::tuple{
+        std::tuple{dark_frame_t{}, EG::setExposureGain<1>(30ms)},
+        repeat_for(Range<'i', uint8_t>{0, 4}, fpmStep),
+        std::tuple{EG::setExposureGain<4>(200ms), move_to_z{2}, fluorescence_frame_t{2, EGFP}},
+    };
+}
+
+constexpr uint64_t raw_bytes = camera::n_pixels;
+constexpr uint64_t integrated_bytes = camera::n_pixels * 2;
+
+constexpr auto cost = protocolCost(testProtocol());
+
+// Evaluated at compile time.
+static_assert(cost.frames_per_board == 24 * (1 + 4 + 1));
+static_assert(cost.bytes_per_board == 24 * (5 * raw_bytes + integrated_bytes));
+static_assert(cost.bytes() == 4 * cost.bytes_per_board);
+
+// Dark frame before the exposure is set, 4 sleeps and FPM exposures, and 8
+// integrated fluorescence exposures.
+static_assert(cost.min_duration == 4 * (100ms + 30ms) + 8 * 200ms);
+
+constexpr auto
+settleProtocol() {
+    return std::tuple{
+        std::tuple{move_to_z{4}, WaitSettled{}},
+        std::tuple{move_to_z{2}, SleepFor{50ms}, WaitSettled{}},
+        std::tuple{EG::setExposureGain<1>(30ms),
+                   concurrently(fpm_frame_t{0}, next{}, WaitSettled{})},
+    };
+}
+
+}  // namespace
+
+TEST_CASE("Cost of each protocol step", "[cost_model]") {
+    constexpr auto costs = stepCosts(testProtocol());
+    STATIC_REQUIRE(costs.size() == 3);
+
+    REQUIRE(costs[0].frames_per_board == 24);
+    REQUIRE(costs[0].min_duration == 0ms);
+    REQUIRE(costs[1].frames_per_board == 4 * 24);
+    REQUIRE(costs[1].min_duration == 4 * 130ms);
+    REQUIRE(costs[2].bytes_per_board == 24 * integrated_bytes);
+    REQUIRE(costs[2].min_duration == 1600ms);
+
+    // The fluorescence step holds the accumulated frames of all cameras.
+    REQUIRE(costs[2].peak_buffer_bytes == 4 * (raw_bytes + 24 * integrated_bytes));
+    REQUIRE(cost.peak_buffer_bytes == costs[2].peak_buffer_bytes);
+}
+
+TEST_CASE("Settle time of the LED and the z-stage by the distance moved", "[cost_model]") {
+    constexpr auto costs = stepCosts(settleProtocol());
+
+    // 4 um of travel, then the settle time.
+    REQUIRE(costs[0].min_duration == 40ms + 100ms);
+
+    // The sleep counts towards the settle time.
+    REQUIRE(costs[1].min_duration == 120ms);
+
+    // The LED switches after the exposure, and settles while the frames drain.
+    REQUIRE(costs[2].min_duration == 30ms + 2ms);
+}
+
+TEST_CASE("Disk bandwidth to keep up with the protocol", "[cost_model]") {
+    const double expected = cost.bytes() / std::chrono::duration<double>(cost.min_duration).count();
+    REQUIRE(cost.minWriteBandwidth() == expected);
+}
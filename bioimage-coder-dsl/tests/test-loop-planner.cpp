@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstdint>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "bioimage-coder/loop-planner.hpp"
+#include "bioimage-coder/schedule.hpp"
+#include "fiber-messages.h"
+#include "messages.h"
+
+using namespace std::chrono_literals;
+using bioimage_coder::deadTime;
+using bioimage_coder::forEachIteration;
+using bioimage_coder::plan;
+using bioimage_coder::Range;
+using bioimage_coder::repeat_for;
+using bioimage_coder::schedule_t;
+using fiber_messages::capture::fluorescence_frame_t;
+using message::excitation::laser;
+using message::motion::move_to_z;
+
+namespace {
+
+constexpr channel_t channels[] = {EGFP, TXRED};
+
+constexpr auto
+fluorescenceStep(const int16_t z, const uint8_t c) {
+    return std::tuple{move_to_z{z}, laser{1s, 16, channels[c]},
+                      fluorescence_frame_t{z, channels[c]}};
+}
+
+constexpr auto stack =
+    repeat_for(Range<'z', int16_t>{-4, 4, 2}, Range<'c', uint8_t>{0, 2}, fluorescenceStep);
+
+// Declared order: 3 moves of 2 um, and 7 laser switches.
+static_assert(deadTime(stack) == 3 * 120ms + 7 * 500ms);
+
+// Planned order: the channel is the outer loop. 3 moves of 2 um per channel, 1
+// move of 6 um back, and 1 laser switch.
+constexpr auto planned = plan(stack);
+static_assert(planned.order[0] == 1 && planned.order[1] == 0);
+static_assert(deadTime(planned) == 6 * 120ms + 160ms + 500ms);
+
+constexpr auto
+testProtocol() {
+    return std::make_tuple(plan(stack));
+}
+
+// The 8 iterations of 3 commands each, in one phase.
+static_assert(schedule_t<testProtocol>::n_commands == 24);
+
+constexpr auto
+collect(int16_t z, uint8_t c, uint8_t i) {
+    return std::tuple{z, c, i};
+}
+
+}  // namespace
+
+TEST_CASE("Iterate over the ranges in the loop order", "[loop-planner]") {
+    auto loop = repeat_for(Range<'z', int16_t>{-2, 2, 2}, Range<'c', uint8_t>{0, 3},
+                           Range<'i', uint8_t>{5, 7}, collect);
+
+    std::vector<std::tuple<int16_t, uint8_t, uint8_t>> iterations;
+    auto record = [&](const auto& values) { iterations.push_back(values); };
+
+    forEachIteration(loop, record);
+    REQUIRE(iterations.size() == 2 * 3 * 2);
+    CHECK(iterations[0] == std::tuple{int16_t{-2}, uint8_t{0}, uint8_t{5}});
+    CHECK(iterations[1] == std::tuple{int16_t{-2}, uint8_t{0}, uint8_t{6}});
+    CHECK(iterations[2] == std::tuple{int16_t{-2}, uint8_t{1}, uint8_t{5}});
+    CHECK(iterations[11] == std::tuple{int16_t{0}, uint8_t{2}, uint8_t{6}});
+
+    // The innermost loop first.
+    iterations.clear();
+    loop.order = {2, 1, 0};
+    forEachIteration(loop, record);
+    REQUIRE(iterations.size() == 2 * 3 * 2);
+    CHECK(iterations[0] == std::tuple{int16_t{-2}, uint8_t{0}, uint8_t{5}});
+    CHECK(iterations[1] == std::tuple{int16_t{0}, uint8_t{0}, uint8_t{5}});
+    CHECK(iterations[2] == std::tuple{int16_t{-2}, uint8_t{1}, uint8_t{5}});
+    CHECK(iterations[11] == std::tuple{int16_t{0}, uint8_t{2}, uint8_t{6}});
+}
+
+TEST_CASE("Capture the same frames in the planned loop order", "[loop-planner]") {
+    auto frames = [](const auto& loop) {
+        std::vector<std::pair<int16_t, channel_t>> captured;
+        forEachIteration(loop, [&](const auto& steps) {
+            const auto& frame = std::get<fluorescence_frame_t>(steps);
+            captured.emplace_back(frame.zpos, frame.ch);
+        });
+        return captured;
+    };
+
+    const auto declared = frames(stack);
+    const auto reordered = frames(planned);
+    REQUIRE(reordered.size() == declared.size());
+    CHECK(std::is_permutation(reordered.begin(), reordered.end(), declared.begin()));
+
+    // All z-positions of EGFP, then of TXRED.
+    CHECK(reordered[0] == std::pair{int16_t{-4}, EGFP});
+    CHECK(reordered[3] == std::pair{int16_t{2}, EGFP});
+    CHECK(reordered[4] == std::pair{int16_t{-4}, TXRED});
+}
+
+TEST_CASE("Keep the declared order when no other order is cheaper", "[loop-planner]") {
+    // The laser channel is the same for all iterations.
+    constexpr auto loop = repeat_for(Range<'c', uint8_t>{0, 1}, Range<'z', int16_t>{0, 6, 2},
+                                     [](uint8_t c, int16_t z) {
+                                         return std::tuple{move_to_z{z},
+                                                           laser{1s, 16, channels[c]}};
+                                     });
+    constexpr auto unchanged = plan(loop);
+    STATIC_REQUIRE(unchanged.order[0] == 0);
+    STATIC_REQUIRE(deadTime(unchanged) == deadTime(loop));
+}
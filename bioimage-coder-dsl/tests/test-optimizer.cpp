@@ -0,0 +1,143 @@
+#include <fmt/format.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "bioimage-coder/optimizer.hpp"
+#include "bioimage-coder/repeat-for.hpp"
+#include "fiber-messages.h"
+#include "messages.h"
+
+using namespace std::chrono_literals;
+using bioimage_coder::optimization;
+using bioimage_coder::optimized_schedule_t;
+using bioimage_coder::Range;
+using bioimage_coder::removal_t;
+using bioimage_coder::repeat_for;
+using bioimage_coder::schedule_t;
+using fiber_messages::capture::dark_frame_t;
+using fiber_messages::capture::fluorescence_frame_t;
+using message::SleepFor;
+using message::WaitSettled;
+using message::excitation::laser;
+using message::led_matrix::blank;
+using message::led_matrix::color_t;
+using message::led_matrix::switch_to;
+using message::motion::move_to_z;
+
+namespace {
+
+constexpr auto
+fluorescenceStep(const int16_t z) {
+    return std::tuple{move_to_z{z}, laser{1s, 16, EGFP}, laser{1s, 16, EGFP},
+                      fluorescence_frame_t{z, EGFP}};
+}
+
+constexpr auto
+testProtocol() {
+    return std::tuple{
+        std::tuple{switch_to{0, 0}, color_t::G, blank{}, dark_frame_t{}, switch_to{0, 0},
+                   move_to_z{0}, color_t::G, SleepFor{100ms}, SleepFor{200ms}},
+        std::tuple{blank{}, switch_to{1, 1}, move_to_z{2}, move_to_z{-4}},
+        repeat_for(Range<'z', int16_t>{-4, 0, 2}, fluorescenceStep),
+        std::tuple{move_to_z{0}, SleepFor{0ms}},
+    };
+}
+
+using unoptimized = schedule_t<testProtocol>;
+using optimized = optimized_schedule_t<testProtocol>;
+constexpr auto& report = optimization<testProtocol>;
+
+static_assert(unoptimized::n_commands == 23);
+static_assert(optimized::n_commands == 17);
+static_assert(report.n_removed == unoptimized::n_commands - optimized::n_commands);
+
+// The superseded blank{} and move_to_z{2} of phase 1 leave it with two commands.
+static_assert(optimized::table.phase_begin[1] == 7);
+static_assert(optimized::table.phase_begin[2] == 9);
+
+constexpr auto
+settleProtocol() {
+    return std::tuple{std::tuple{move_to_z{2}, WaitSettled{}, WaitSettled{}, laser{1s, 16, EGFP},
+                                 WaitSettled{}, switch_to{1, 1}, WaitSettled{}}};
+}
+
+/** Record each command as a string. */
+struct recording_dispatcher_t {
+    std::vector<std::string> commands{};
+
+    void operator()(const dark_frame_t&) { commands.emplace_back("dark"); }
+    void operator()(const switch_to& c) {
+        commands.push_back(fmt::format("led {:d} {:d}", c.x, c.y));
+    }
+    void operator()(const blank&) { commands.emplace_back("blank"); }
+    void operator()(const color_t& c) { commands.push_back(fmt::format("color {:c}", char(c))); }
+    void operator()(const SleepFor& c) {
+        commands.push_back(fmt::format("sleep {:d}", c.duration.count()));
+    }
+    void operator()(const move_to_z& c) { commands.push_back(fmt::format("z {:d}", c.value)); }
+    void operator()(const laser& c) { commands.push_back(fmt::format("laser {:d}", c.power)); }
+    void operator()(const fluorescence_frame_t& c) {
+        commands.push_back(fmt::format("fluorescence {:d}", c.zpos));
+    }
+};
+
+}  // namespace
+
+TEST_CASE("Remove the commands setting the state already in effect", "[optimizer]") {
+    recording_dispatcher_t dispatcher{};
+    optimized::run(dispatcher);
+
+    // The LED is off after blank{}, so the second switch_to{0, 0} stays. The
+    // initial z-position is unknown, so the first move_to_z{0} stays.
+    const std::vector<std::string> expected{
+        // Phase 0
+        "led 0 0", "color g", "blank", "dark", "led 0 0", "z 0", "sleep 300",
+        // Phase 1
+        "led 1 1", "z -4",
+        // Phase 2
+        "laser 16", "laser 16", "fluorescence -4", "z -2", "laser 16", "laser 16",
+        "fluorescence -2",
+        // Phase 3
+        "z 0",
+    };
+    REQUIRE(dispatcher.commands == expected);
+}
+
+TEST_CASE("Remove the settle waits with nothing to settle", "[optimizer]") {
+    constexpr auto& settle_report = optimization<settleProtocol>;
+    STATIC_REQUIRE(optimized_schedule_t<settleProtocol>::n_commands == 5);
+    REQUIRE(settle_report.n_removed == 2);
+    for (size_t i = 0; i < settle_report.n_removed; i++) {
+        CHECK(settle_report.removed[i].reason == removal_t::in_effect);
+    }
+
+    // The laser moves nothing.
+    CHECK(settle_report.removed[0].position == 2);
+    CHECK(settle_report.removed[1].position == 4);
+}
+
+TEST_CASE("Report the removed commands in schedule order", "[optimizer]") {
+    struct expected_t {
+        uint32_t position;
+        removal_t reason;
+    };
+    const std::vector<expected_t> expected{
+        {6, removal_t::in_effect},    // color_t::G
+        {8, removal_t::merged},       // SleepFor{200ms}
+        {9, removal_t::superseded},   // blank{}
+        {11, removal_t::superseded},  // move_to_z{2}
+        {13, removal_t::in_effect},   // move_to_z{-4}
+        {22, removal_t::in_effect},   // SleepFor{0ms}
+    };
+
+    REQUIRE(report.n_removed == expected.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        CHECK(report.removed[i].position == expected[i].position);
+        CHECK(report.removed[i].reason == expected[i].reason);
+        CHECK(report.removed[i].record.op == unoptimized::table.records[expected[i].position].op);
+    }
+}
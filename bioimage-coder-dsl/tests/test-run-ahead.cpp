@@ -0,0 +1,201 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <array>
+#include <asio/io_service.hpp>
+#include <asio/serial_port.hpp>
+#include <boost/fiber/all.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "bioimage-coder/run-ahead.hpp"
+
+using namespace std::chrono_literals;
+using boost::fibers::fiber;
+using fiber_messages::capture::dark_frame_t;
+using fiber_messages::capture::fpm_frame_t;
+using frame_capture_card::n_boards;
+using message::led_matrix::next;
+using std::chrono::steady_clock;
+
+using capture_queue_t = fiber_messages::capture::queue_t;
+auto& capture_queue_stats = telemetry::channelStats("capture", "test", "test", 1, n_boards);
+
+asio::io_service io;
+asio::serial_port serial_port{io};
+auto capture_queues = fiber_messages::capture::makeQueues(8, capture_queue_stats);
+std::array<capture_queue_t*, n_boards> image_capture_handlers{
+    &capture_queues[0], &capture_queues[1], &capture_queues[2], &capture_queues[3]};
+
+namespace {
+
+constexpr size_t credit_window = 4;
+constexpr auto exposure_time = 10ms;
+
+/** Serial commands received on a pseudo-terminal, with the arrival time. */
+class RecordingSerialDevice {
+   public:
+    RecordingSerialDevice() : master{posix_openpt(O_RDWR | O_NOCTTY)} {
+        if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+            throw std::runtime_error("Cannot open pseudo-terminal");
+        }
+        path = ptsname(master);
+
+        // read() fails with EIO once the serial port is closed.
+        reader = std::thread{[this]() {
+            std::array<char, 256> buffer;
+            ssize_t n;
+            while ((n = ::read(master, buffer.data(), buffer.size())) > 0) {
+                std::lock_guard lock{mutex};
+                for (ssize_t i = 0; i < n; i++) {
+                    line.push_back(buffer[i]);
+                    if (buffer[i] == '\n') {
+                        commands.emplace_back(steady_clock::now(), line);
+                        line.clear();
+                    }
+                }
+            }
+        }};
+    }
+
+    ~RecordingSerialDevice() {
+        if (reader.joinable()) {
+            reader.join();
+        }
+        ::close(master);
+    }
+
+    std::vector<std::pair<steady_clock::time_point, std::string>> received() {
+        reader.join();
+        return commands;
+    }
+
+    std::string path{};
+
+   private:
+    int master;
+    std::mutex mutex{};
+    std::string line{};
+    std::vector<std::pair<steady_clock::time_point, std::string>> commands{};
+    std::thread reader{};
+};
+
+/** Expose, then drain the frames of n capture commands. The USB transfer of
+ * the board is slow on every capture command k with k % period == usb_id. */
+void
+fakeCaptureWorker(const uint8_t usb_id, const size_t n, const size_t period,
+                  std::vector<steady_clock::time_point>& exposed) {
+    for (size_t k = 0; k < n; k++) {
+        fiber_messages::capture::command_t cmd;
+        image_capture_handlers[usb_id]->pop(cmd);
+        std::visit(
+            [&](auto&& capture_command) {
+                if constexpr (bioimage_coder::has_completion_channel<
+                                  std::decay_t<decltype(capture_command)>>::value) {
+                    boost::this_fiber::sleep_for(exposure_time);
+                    exposed.push_back(steady_clock::now());
+                    if (capture_command.exposure != nullptr) {
+                        capture_command.exposure->push(steady_clock::now());
+                    }
+                    boost::this_fiber::sleep_for((k % period == usb_id) ? 120ms : 20ms);
+                    capture_command.completion->push(steady_clock::now());
+                }
+            },
+            cmd);
+    }
+}
+
+/** Run the protocol against boards taking turns at being slow. */
+template <class Execute>
+steady_clock::duration
+timeWithJitteryBoards(Execute&& execute, const size_t n_captures) {
+    std::array<std::vector<steady_clock::time_point>, n_boards> exposed{};
+    std::vector<fiber> capture_tasks;
+    for (uint8_t usb_id = 0; usb_id < n_boards; usb_id++) {
+        capture_tasks.emplace_back(fakeCaptureWorker, usb_id, n_captures, n_boards,
+                                   std::ref(exposed[usb_id]));
+    }
+
+    const auto start = steady_clock::now();
+    execute();
+    const auto elapsed = steady_clock::now() - start;
+
+    for (auto& task : capture_tasks) {
+        task.join();
+    }
+    return elapsed;
+}
+
+constexpr auto
+darkFrames() {
+    return std::make_tuple(std::tuple{dark_frame_t{}, dark_frame_t{}, dark_frame_t{},
+                                      dark_frame_t{}, dark_frame_t{}, dark_frame_t{},
+                                      dark_frame_t{}, dark_frame_t{}});
+}
+
+}  // namespace
+
+TEST_CASE("Boards run ahead of the slowest board within the credit window", "[run-ahead]") {
+    constexpr size_t n_captures = 8;
+
+    const auto lockstep =
+        timeWithJitteryBoards([]() { bioimage_coder::execute(darkFrames()); }, n_captures);
+
+    auto& skew = telemetry::metrics().boards[0].completion_skew;
+    const auto n_skew_observations = skew.count();
+    const auto run_ahead = timeWithJitteryBoards(
+        []() { bioimage_coder::executeRunAhead(darkFrames(), credit_window); }, n_captures);
+
+    // Lockstep: every step waits for the slow board. Run-ahead: each board is
+    // slow on a quarter of the steps only.
+    CHECK(lockstep >= n_captures * 130ms);
+    CHECK(run_ahead < lockstep * 6 / 10);
+
+    // One skew observation per capture command and board.
+    CHECK(skew.count() == n_skew_observations + n_captures);
+}
+
+TEST_CASE("Hold back the illumination until all boards are exposed", "[run-ahead]") {
+    RecordingSerialDevice serial_device{};
+    serial_port.open(serial_device.path);
+
+    std::array<std::vector<steady_clock::time_point>, n_boards> exposed{};
+    std::vector<fiber> capture_tasks;
+    // Board 0 is slow on every capture command.
+    for (uint8_t usb_id = 0; usb_id < n_boards; usb_id++) {
+        capture_tasks.emplace_back(fakeCaptureWorker, usb_id, 2, 1, std::ref(exposed[usb_id]));
+    }
+
+    const auto start = steady_clock::now();
+    bioimage_coder::executeRunAhead(
+        std::make_tuple(std::tuple{fpm_frame_t{1}, next{}, fpm_frame_t{2}, next{}}),
+        credit_window);
+    const auto elapsed = steady_clock::now() - start;
+
+    for (auto& task : capture_tasks) {
+        task.join();
+    }
+    serial_port.close();
+
+    const auto commands = serial_device.received();
+    REQUIRE(commands.size() == 2);
+
+    // The LED switches after the exposure of all boards, without waiting for
+    // the frames of the slow board.
+    for (const auto& times : exposed) {
+        REQUIRE(times.size() == 2);
+        CHECK(commands[0].first >= times[0]);
+        CHECK(commands[1].first >= times[1]);
+    }
+    CHECK(commands[0].first - start < 120ms);
+
+    // The slow board exposes the second frame once the first has drained.
+    CHECK(commands[1].first - start >= 130ms);
+    CHECK(elapsed >= 2 * 130ms);
+}
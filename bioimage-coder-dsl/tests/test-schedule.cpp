@@ -0,0 +1,94 @@
+#include <fmt/format.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "bioimage-coder/repeat-for.hpp"
+#include "bioimage-coder/schedule.hpp"
+#include "fiber-messages.h"
+#include "messages.h"
+
+using namespace std::chrono_literals;
+using bioimage_coder::Range;
+using bioimage_coder::repeat_for;
+using bioimage_coder::schedule_t;
+using fiber_messages::capture::dark_frame_t;
+using fiber_messages::capture::fluorescence_frame_t;
+using fiber_messages::capture::fpm_frame_t;
+using message::SleepFor;
+using message::excitation::laser;
+using message::led_matrix::next;
+using message::motion::move_to_z;
+
+namespace {
+
+constexpr auto
+fpmStep(const uint8_t led_id) {
+    return std::tuple{SleepFor{100ms}, fpm_frame_t{led_id}, next{}};
+}
+
+constexpr auto
+fluorescenceStep(const int16_t z) {
+    return std::tuple{move_to_z{z}, laser{1s, 16, EGFP}, fluorescence_frame_t{z, EGFP}};
+}
+
+constexpr auto
+testProtocol() {
+    return std::tuple{
+        std::tuple{dark_frame_t{}},
+        repeat_for(Range<'i', uint8_t>{0, 5}, fpmStep),
+        repeat_for(Range<'z', int16_t>{-4, 4, 2}, fluorescenceStep),
+        std::tuple{move_to_z{0}},
+    };
+}
+
+using schedule = schedule_t<testProtocol>;
+
+static_assert(schedule::n_phases == 4);
+static_assert(schedule::n_commands == 1 + 5 * 3 + 4 * 3 + 1);
+static_assert(schedule::n_types == 7, "Duplicated command types share one parameter array");
+static_assert(schedule::table.phase_begin[2] == 16);
+
+/** Record each command as a string. */
+struct recording_dispatcher_t {
+    std::vector<std::string> commands{};
+
+    void operator()(const dark_frame_t&) { commands.emplace_back("dark"); }
+    void operator()(const fpm_frame_t& c) { commands.push_back(fmt::format("fpm {:d}", c.led_id)); }
+    void operator()(const next&) { commands.emplace_back("next"); }
+    void operator()(const SleepFor& c) {
+        commands.push_back(fmt::format("sleep {:d}", c.duration.count()));
+    }
+    void operator()(const move_to_z& c) { commands.push_back(fmt::format("z {:d}", c.value)); }
+    void operator()(const laser& c) { commands.push_back(fmt::format("laser {:d}", c.power)); }
+    void operator()(const fluorescence_frame_t& c) {
+        commands.push_back(fmt::format("fluorescence {:d} {:s}", c.zpos, toString(c.ch)));
+    }
+};
+
+}  // namespace
+
+TEST_CASE("Flat schedule dispatches the commands in protocol order", "[schedule]") {
+    recording_dispatcher_t flat{};
+    std::vector<size_t> phases{};
+    schedule::run(flat, [&](const size_t phase, auto&& body) {
+        phases.push_back(phase);
+        body();
+    });
+
+    REQUIRE(phases == std::vector<size_t>{0, 1, 2, 3});
+
+    std::vector<std::string> expected{"dark"};
+    for (int i = 0; i < 5; i++) {
+        expected.insert(expected.end(), {"sleep 100", fmt::format("fpm {:d}", i), "next"});
+    }
+    for (int z = -4; z < 4; z += 2) {
+        expected.insert(expected.end(), {fmt::format("z {:d}", z), "laser 16",
+                                         fmt::format("fluorescence {:d} EGFP", z)});
+    }
+    expected.emplace_back("z 0");
+    REQUIRE(flat.commands == expected);
+}
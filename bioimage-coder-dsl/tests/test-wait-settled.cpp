@@ -0,0 +1,50 @@
+#include <asio/io_context.hpp>
+#include <asio/serial_port.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <thread>
+#include <tuple>
+
+#include "async-serial-transport.h"
+#include "bioimage-coder/executor.hpp"
+#include "firmware_emulator.h"
+
+using namespace std::chrono_literals;
+using frame_capture_card::n_boards;
+using hardware_drivers::firmware_config_t;
+using hardware_drivers::FirmwareEmulator;
+using message::WaitSettled;
+using message::led_matrix::next;
+using message::motion::move_to_z;
+using std::chrono::steady_clock;
+
+asio::io_context io;
+message_router::AsyncSerialTransport<asio::serial_port> serial_port{io};
+std::array<fiber_messages::capture::queue_t*, n_boards> image_capture_handlers{};
+
+TEST_CASE("Wait by the settle model when the firmware rejects the settle query",
+          "[wait_settled]") {
+    // The firmware rejects the second command, i.e. the settle query.
+    firmware_config_t config{};
+    config.reject_every = 2;
+    FirmwareEmulator firmware{config};
+    std::thread device{[&]() { firmware.serve(); }};
+
+    serial_port.next_layer().open(firmware.path());
+    serial_port.setAckWindow(4);
+    auto& metrics = telemetry::metrics().executor;
+    const auto n_timeouts = metrics.settle_timeouts.load();
+
+    const auto start = steady_clock::now();
+    REQUIRE_NOTHROW(bioimage_coder::execute(
+        std::make_tuple(std::make_tuple(move_to_z{4}, WaitSettled{}, next{}))));
+    const auto elapsed = steady_clock::now() - start;
+    serial_port.close();
+    device.join();
+
+    // The settle model takes 4 um of travel, then the settle time.
+    CHECK(elapsed >= 140ms);
+    CHECK(metrics.settle_timeouts.load() == n_timeouts + 1);
+    CHECK(serial_port.stats().rejected == 1);
+    CHECK(firmware.stats().rejected == 1);
+}
@@ -6,6 +6,9 @@ namespace camera {
 constexpr int32_t width = 2592;
 constexpr int32_t height = 1944;
 constexpr auto n_pixels = width * height;
+
+/** Frames time-integrated per fluorescence image. */
+constexpr uint8_t n_integration_frames = 8;
 }  // namespace camera
 
 namespace well_plate {
@@ -0,0 +1,135 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include "time-model.h"
+
+namespace hardware_drivers {
+
+/** Reply of the emulated firmware to each serial command. */
+enum class ack_mode_t : uint8_t {
+    /** No reply, as the firmware of the instrument. */
+    NONE,
+
+    /** `OK` once the command is parsed, before it takes effect. */
+    ON_RECEIPT,
+
+    /** `OK` once the command takes effect, e.g. once the z-stage settles. */
+    ON_COMPLETION,
+};
+
+/** Timing and acknowledgement of the emulated firmware. The defaults are those
+ * of the dry run, in simulator::time_model. */
+struct firmware_config_t {
+    /** Time to parse each command. */
+    std::chrono::nanoseconds command_latency{simulator::time_model::serial_parse};
+
+    /** Travel speed of the z-stage, in micrometres per second. */
+    double z_velocity{1e3 / simulator::time_model::z_travel_per_um.count()};
+
+    /** Time for the z-stage to settle after each move. */
+    std::chrono::nanoseconds z_settle{simulator::time_model::z_settle};
+
+    /** Time to switch the laser from one excitation channel to another. */
+    std::chrono::nanoseconds laser_switch{simulator::time_model::laser_switch};
+
+    /** Time to update the LED matrix. */
+    std::chrono::nanoseconds led_update{simulator::time_model::led_update};
+
+    ack_mode_t ack{ack_mode_t::ON_COMPLETION};
+
+    /** Reject every N-th command with `ERR`, to exercise the error path of the
+     * host. Zero to reject none. */
+    uint32_t reject_every{0};
+};
+
+/** Counters of the emulated firmware, over all sessions. */
+struct firmware_stats_t {
+    uint64_t commands{};
+
+    /** Commands replied with `ERR`, i.e. malformed or rejected on purpose. */
+    uint64_t rejected{};
+
+    /** Time spent executing the commands. */
+    std::chrono::nanoseconds busy{};
+};
+
+/** The ATmega2560 firmware of the 96-eyes instrument, emulated in real time on
+ * a pseudo-terminal.
+ *
+ * Opens a pseudo-terminal in raw mode, to stand in for /dev/ttyACM0 on any
+ * Linux box, e.g. `capture-images --serial <path()>`. The firmware executes the
+ * ASCII commands of message_router one after another, as SimulatedSerial does
+ * in virtual time. A z-stage move, a laser channel switch and an LED matrix
+ * update each keep the firmware busy, so that the commands queue up in the
+ * serial port as on the instrument. The `s` command completes once the
+ * commands before it take effect, for WaitSettled.
+ *
+ * The firmware state persists across sessions, i.e. from one opening of the
+ * serial port to the next.
+ */
+class FirmwareEmulator {
+   public:
+    /** Reply to one command, and the time it keeps the firmware busy. */
+    struct response_t {
+        std::string reply;
+        std::chrono::nanoseconds work;
+    };
+
+    explicit FirmwareEmulator(firmware_config_t config = {});
+    ~FirmwareEmulator();
+
+    FirmwareEmulator(const FirmwareEmulator&) = delete;
+    FirmwareEmulator& operator=(const FirmwareEmulator&) = delete;
+
+    /** Path of the serial port, i.e. the slave side of the pseudo-terminal. */
+    const std::string& path() const { return slave_path; }
+
+    /** Wait for the host to open the serial port, then execute its commands
+     * until it closes the port.
+     *
+     * @param on_command called with each command and its response, e.g. to
+     *     log them, before the firmware executes the command.
+     * @returns false if stopped before the end of the session.
+     */
+    bool serve(const std::function<void(std::string_view, const response_t&)>& on_command = {});
+
+    /** Make serve() return within 100ms. Safe to call from a signal handler. */
+    void stop() { is_stopping = true; }
+
+    /** Parse the newline-stripped command, and update the firmware state as if
+     * the command took effect. */
+    response_t execute(std::string_view command);
+
+    /** Position of the z-stage, once the moves so far complete. */
+    int16_t z() const { return z_position; }
+
+    const firmware_stats_t& stats() const { return statistics; }
+
+   private:
+    firmware_config_t config;
+    int master{-1};
+    std::string slave_path{};
+    std::atomic<bool> is_stopping{false};
+
+    /** Bytes from the host, up to the end of the last command read. */
+    std::string input{};
+
+    int16_t z_position{0};
+    int32_t laser_channel{-1};
+    firmware_stats_t statistics{};
+
+    /** Read the next newline-terminated command from the host.
+     *
+     * @returns false once the host closes the serial port, or on stop().
+     */
+    bool readCommand(std::string& line, bool& is_session_started);
+
+    void reply(std::string_view text);
+};
+
+}  // namespace hardware_drivers
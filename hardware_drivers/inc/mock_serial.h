@@ -0,0 +1,34 @@
+#pragma once
+#include <array>
+#include <asio.hpp>
+#include <cstddef>
+#include <string_view>
+
+namespace hardware_drivers {
+
+/** A mock serial port, as asio::serial_port, that keeps the last command sent. */
+class MockSerial {
+   public:
+    std::array<char, 64> last_command{};
+    size_t last_command_length{};
+    size_t bytes_written{};
+
+    /** Models the SyncWriteStream concept of asio::write(). */
+    template <typename ConstBufferSequence>
+    size_t write_some(const ConstBufferSequence& buffers, asio::error_code& ec) {
+        ec = {};
+        last_command_length = asio::buffer_copy(asio::buffer(last_command), buffers);
+        bytes_written += last_command_length;
+        return last_command_length;
+    }
+
+    template <typename ConstBufferSequence>
+    size_t write_some(const ConstBufferSequence& buffers) {
+        asio::error_code ec;
+        return write_some(buffers, ec);
+    }
+
+    std::string_view lastCommand() const { return {last_command.data(), last_command_length}; }
+};
+
+}  // namespace hardware_drivers
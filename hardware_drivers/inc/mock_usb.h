@@ -4,10 +4,13 @@
 #include <cstdint>
 #include <stdexcept>
 #include <optional>
+#include <type_traits>
 
 // Include this after stdexcept
 #include <nonstd/span.hpp>
 
+#include "frame-commands.h"
+
 namespace hardware_drivers {
 
 using std::chrono::milliseconds;
@@ -25,6 +28,11 @@ class MockUSB {
     uint8_t cam_id{0x04};
     uint8_t led_id{0xEE};
 
+    /** Mock i2c acknowledgement of the CMOS sensors, for fault injection. The
+     * i-th bit is set to simulate the i-th command in the batch not acknowledged.
+     */
+    uint64_t i2c_nack_mask{0};
+
     constexpr MockUSB(uint8_t usb_id) : id{usb_id} {}
 
     template <typename T>
@@ -47,6 +55,10 @@ class MockUSB {
         Query query{};
         mock_control_transfer(Query::dev_addr, Query::reg_addr, reinterpret_cast<uint8_t*>(&query),
                               sizeof(query));
+        if constexpr (std::is_same_v<Query,
+                                     frame_capture_card::commands::read_i2c_batch_status_t>) {
+            query.nack_mask = i2c_nack_mask;
+        }
         return query;
     }
 
@@ -58,7 +70,15 @@ class MockUSB {
             // Do nothing.
         };
 
-        if constexpr (Command::dev_addr == 0) {
+        if constexpr (std::is_same_v<Command, frame_capture_card::commands::i2c_batch_write_t>) {
+            // Batched i2c commands, unpacked by the FPGA. Transmit the first
+            // `count` commands only.
+            if (cmd.count > Command::max_count) {
+                return false;
+            }
+            mock_control_transfer(Command::dev_addr, Command::reg_addr,
+                                  reinterpret_cast<uint8_t*>(&cmd), cmd.length());
+        } else if constexpr (Command::dev_addr == 0) {
             // FPGA native commands
             mock_control_transfer(Command::dev_addr, Command::reg_addr,
                                   reinterpret_cast<uint8_t*>(&cmd), sizeof(Command));
@@ -0,0 +1,46 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+
+// Include this after stdexcept
+#include <nonstd/span.hpp>
+
+#include "usb_capture_file.h"
+
+namespace hardware_drivers {
+
+using namespace std::chrono_literals;
+
+/** Recording tap of the USB bulk transfers.
+ *
+ * Wraps any USB interface, e.g. the vendor driver or MockUSB, and logs the
+ * raw payload and the completion time of each bulk transfer to the capture
+ * file. The capture file can later be replayed by ReplayUSB.
+ *
+ * @tparam USBInterface the USB driver to be recorded.
+ */
+template <class USBInterface>
+class RecordingUSB : public USBInterface {
+   public:
+    template <typename... Args>
+    RecordingUSB(uint8_t usb_id, const char* capture_path, Args&&... args)
+        : USBInterface{usb_id, std::forward<Args>(args)...}, recorder{capture_path, usb_id} {}
+
+    [[nodiscard]] int bulk_read(std::chrono::milliseconds timeout = 400ms,
+                                std::optional<nonstd::span<uint8_t>> dst_buffer = std::nullopt) {
+        const int byte_transferred = USBInterface::bulk_read(timeout, dst_buffer);
+        if (byte_transferred > 0) {
+            const uint8_t* payload =
+                dst_buffer.has_value() ? dst_buffer->data() : USBInterface::buffer.data();
+            recorder.append(payload, byte_transferred);
+        }
+        return byte_transferred;
+    }
+
+   private:
+    CaptureFileWriter recorder;
+};
+
+}  // namespace hardware_drivers
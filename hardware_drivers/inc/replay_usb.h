@@ -0,0 +1,107 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+
+// Include this after stdexcept
+#include <nonstd/span.hpp>
+
+#include "frame-commands.h"
+#include "usb_capture_file.h"
+
+namespace hardware_drivers {
+
+using std::chrono::milliseconds;
+using namespace std::chrono_literals;
+
+/** Replay the USB bulk transfers recorded by RecordingUSB.
+ *
+ * The capture file is memory-mapped. Bulk reads into the internal buffer are
+ * zero-copy: ReplayUSB::buffer points directly at the recorded payload in the
+ * mapped file. Bulk reads into the user-specified buffer are copied, as the
+ * vendor driver would do.
+ *
+ * Satisfies the same interface as MockUSB, so that the recorded byte stream
+ * of a real well plate can be replayed through FrameCaptureCard and the
+ * capture workers.
+ */
+class ReplayUSB {
+   public:
+    static constexpr bool is_mock = false;
+
+    enum class pacing_t : uint8_t {
+        /** Replay the bulk transfers as fast as possible. */
+        AS_FAST_AS_POSSIBLE,
+
+        /** Delay the bulk transfers to match the recorded timestamps. */
+        ORIGINAL_TIMING,
+    };
+
+    const uint8_t id{};
+
+    /** Payload of the last bulk transfer, mapped from the capture file. */
+    nonstd::span<uint8_t> buffer{};
+
+    ReplayUSB(uint8_t usb_id, const char* capture_path,
+              pacing_t pacing = pacing_t::AS_FAST_AS_POSSIBLE);
+    ~ReplayUSB();
+
+    ReplayUSB(const ReplayUSB&) = delete;
+    ReplayUSB& operator=(const ReplayUSB&) = delete;
+
+    template <typename T>
+    inline const T& decode(size_t offset = 0) const {
+        // Assume little-endian
+        return *reinterpret_cast<const T*>(buffer.data() + offset);
+    }
+
+    /** Simulates libusb_control_transfer().
+     *
+     * The capture file records the bulk transfers only. Report the board ID
+     * from the capture file, and report the FPGA buffer as always full.
+     */
+    template <class Query>
+    [[nodiscard]] Query control_read() const {
+        using namespace frame_capture_card::commands;
+        static_assert(Query::dev_addr == 0);
+        static_assert(Query::reg_addr > 0);
+
+        Query query{};
+        if constexpr (std::is_same_v<Query, read_board_id_t>) {
+            query.value = recorded_usb_id;
+        } else if constexpr (std::is_same_v<Query, read_pixel_count_t>) {
+            query.value = std::numeric_limits<decltype(query.value)>::max();
+        }
+        return query;
+    }
+
+    /** Commands to the FPGA have no effect on the recorded byte stream. */
+    template <class Command>
+    [[nodiscard]] bool control_write(Command) const {
+        return true;
+    }
+
+    /** Replay the next recorded bulk transfer.
+     *
+     * @throw std::runtime_error when all recorded transfers are consumed.
+     */
+    [[nodiscard]] int bulk_read(milliseconds timeout = 400ms,
+                                std::optional<nonstd::span<uint8_t>> dst_buffer = std::nullopt);
+
+    /** Number of recorded bulk transfers replayed so far. */
+    size_t replayed() const { return replay_count; }
+
+   private:
+    uint8_t* mapped{nullptr};
+    size_t mapped_size{};
+    size_t read_offset{sizeof(usb_capture::file_header_t)};
+    size_t replay_count{};
+    uint8_t recorded_usb_id{};
+
+    const pacing_t pacing;
+    std::optional<std::chrono::steady_clock::time_point> start{};
+};
+}  // namespace hardware_drivers
@@ -0,0 +1,135 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <asio.hpp>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "time-model.h"
+#include "utilization.h"
+#include "virtual-clock.h"
+
+namespace hardware_drivers {
+
+/** The serial port to the ATmega2560 of the 96-eyes instrument, simulated in
+ * virtual time for dry runs.
+ *
+ * Models the SyncWriteStream concept of asio::write(), as MockSerial. Each
+ * command takes its transmission time at the baud rate. The firmware sends no
+ * acknowledgement, so the executor waits for the transmission only. The
+ * instrument settles at idleAt(), for WaitSettled.
+ *
+ * The firmware then executes the ASCII commands of message_router one after
+ * another. A z-stage move, a laser channel switch and an LED matrix update
+ * each keep the firmware busy, for the time in simulator::time_model. The
+ * laser illuminates in the background for the duration of the command.
+ */
+class SimulatedSerial {
+   public:
+    /** Models the SyncWriteStream concept of asio::write(). */
+    template <typename ConstBufferSequence>
+    size_t write_some(const ConstBufferSequence& buffers, asio::error_code& ec) {
+        ec = {};
+        std::array<char, 64> command{};
+        const size_t length = asio::buffer_copy(asio::buffer(command), buffers);
+        execute({command.data(), length});
+        return length;
+    }
+
+    template <typename ConstBufferSequence>
+    size_t write_some(const ConstBufferSequence& buffers) {
+        asio::error_code ec;
+        return write_some(buffers, ec);
+    }
+
+    /** As asio::serial_port::close(). */
+    void close() {}
+
+    /** Time the firmware completes the commands received so far. */
+    simulator::time_point idleAt() const { return firmware_idle_at; }
+
+    /** Position of the z-stage, once the moves received so far complete. */
+    int16_t z() const { return z_position; }
+
+   private:
+    simulator::busy_time_t& serial_link{simulator::busyTime("serial link")};
+    simulator::busy_time_t& z_stage{simulator::busyTime("z-stage")};
+    simulator::busy_time_t& laser{simulator::busyTime("laser")};
+    simulator::busy_time_t& led_matrix{simulator::busyTime("LED matrix")};
+
+    simulator::time_point firmware_idle_at{};
+    simulator::time_point laser_off_at{};
+    int16_t z_position{0};
+    int32_t laser_channel{-1};
+
+    /** Parse the space-separated integer operands of the command. */
+    template <size_t N>
+    static std::array<int32_t, N> operands(std::string_view command) {
+        std::array<int32_t, N> values{};
+        const char* p = command.data() + 1;
+        const char* end = command.data() + command.size();
+        for (auto& v : values) {
+            while (p < end && *p == ' ') {
+                p++;
+            }
+            p = std::from_chars(p, end, v).ptr;
+        }
+        return values;
+    }
+
+    void execute(std::string_view command) {
+        using namespace simulator::time_model;
+        using std::chrono::nanoseconds;
+
+        const auto transmit = serialTransmit(command.size());
+        serial_link.add(transmit);
+        simulator::sleep_for(transmit);
+
+        const auto start = std::max(simulator::now(), firmware_idle_at);
+        nanoseconds work = serial_parse;
+        switch (command.empty() ? '\0' : command.front()) {
+            case 'z': {
+                const auto [z] = operands<1>(command);
+                const nanoseconds move = zMove(z - z_position);
+                z_stage.add(move);
+                work += move;
+                z_position = z;
+                break;
+            }
+            case 'B': {
+                const auto [seconds, power, channel] = operands<3>(command);
+                if (power > 0 && channel != laser_channel) {
+                    work += laser_switch;
+                    laser_channel = channel;
+                }
+
+                // A new laser command cuts the illumination short.
+                const auto on_at = start + work;
+                if (laser_off_at > on_at) {
+                    laser.add(on_at - laser_off_at);
+                }
+                laser_off_at = on_at;
+                if (power > 0) {
+                    laser_off_at += std::chrono::seconds{seconds};
+                    laser.add(std::chrono::seconds{seconds});
+                }
+                break;
+            }
+            case 'm':
+            case 'n':
+            case 'f':
+            case 'c':
+                led_matrix.add(led_update);
+                work += led_update;
+                break;
+            default:
+                break;
+        }
+        firmware_idle_at = start + work;
+    }
+};
+
+}  // namespace hardware_drivers
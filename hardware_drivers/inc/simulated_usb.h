@@ -0,0 +1,120 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+// Include this after stdexcept
+#include <nonstd/span.hpp>
+
+#include "constants.h"
+#include "frame-commands.h"
+#include "time-model.h"
+#include "utilization.h"
+#include "virtual-clock.h"
+
+namespace hardware_drivers {
+
+using namespace std::chrono_literals;
+
+/** Frame capture card simulated in virtual time, for dry runs.
+ *
+ * Wraps a mock USB interface, e.g. MockUSB, and keeps track of the exposure
+ * time in the CMOS registers. On the trigger, i.e. write_led_id_t, all 24
+ * cameras of the board expose at once, and then stream one frame each per
+ * exposure time. The frame is ready to stream once exposed, and its bulk
+ * transfers take the time of the USB 3.0 link in simulator::time_model.
+ *
+ * Only the frame headers are read from the mock. The pixels are left as they
+ * are in the destination buffer, so that a dry run of hours takes seconds.
+ *
+ * @tparam USBInterface the mock USB interface to be timed.
+ */
+template <class USBInterface>
+class SimulatedUSB : public USBInterface {
+   public:
+    static constexpr bool is_virtual_time = true;
+
+    template <typename... Args>
+    SimulatedUSB(uint8_t usb_id, Args&&... args)
+        : USBInterface{usb_id, std::forward<Args>(args)...},
+          link{simulator::busyTime("usb" + std::to_string(usb_id))} {}
+
+    template <class Command>
+    [[nodiscard]] bool control_write(Command cmd) {
+        using namespace frame_capture_card::commands;
+        if constexpr (std::is_same_v<Command, write_led_id_t>) {
+            triggered_at = simulator::now();
+            n_frames = 0;
+        } else if constexpr (std::is_same_v<Command, i2c_batch_write_t>) {
+            for (uint16_t i = 0; i < cmd.count && i < cmd.max_count; i++) {
+                watchRegister(cmd.commands[i]);
+            }
+        } else if constexpr (std::is_same_v<Command, i2c_cmd_t>) {
+            watchRegister(cmd);
+        }
+        return USBInterface::control_write(cmd);
+    }
+
+    [[nodiscard]] int bulk_read(std::chrono::milliseconds timeout = 400ms,
+                                std::optional<nonstd::span<uint8_t>> dst_buffer = std::nullopt) {
+        using namespace simulator::time_model;
+
+        std::chrono::nanoseconds transfer{};
+        if (!dst_buffer.has_value()) {
+            // Seek the header of the next frame, in the order of exposure.
+            const auto round = n_frames++ / frame_capture_card::n_cameras_per_board;
+            simulator::sleep_until(triggered_at + exposure() * (round + 1));
+            transfer = usb_frame_latency;
+        }
+
+        // The pixel values do not matter to the timing. Transfer the rest of
+        // the frame at once, without copying.
+        const int byte_transferred = dst_buffer.has_value()
+                                         ? static_cast<int>(dst_buffer->size())
+                                         : USBInterface::bulk_read(timeout, dst_buffer);
+        transfer += usbTransfer(byte_transferred);
+        link.add(transfer);
+        simulator::sleep_for(transfer);
+        return byte_transferred;
+    }
+
+    /** Exposure time in the CMOS registers. */
+    std::chrono::milliseconds exposure() const {
+        return std::chrono::milliseconds{exposure_lb | (uint16_t{exposure_ub} << 8)};
+    }
+
+   private:
+    /** CMOS registers of the exposure time, as set by
+     * exposure_gain_t::setExposureGain(). */
+    static constexpr uint16_t exposure_lb_addr = 0x1234;
+    static constexpr uint16_t exposure_ub_addr = 0x1235;
+
+    simulator::busy_time_t& link;
+
+    simulator::time_point triggered_at{};
+    uint32_t n_frames{0};
+    uint8_t exposure_lb{0};
+    uint8_t exposure_ub{0};
+
+    void watchRegister(const frame_capture_card::commands::i2c_cmd_t cmd) {
+        if (cmd.addr == exposure_lb_addr) {
+            exposure_lb = cmd.value;
+        } else if (cmd.addr == exposure_ub_addr) {
+            exposure_ub = cmd.value;
+        }
+    }
+};
+
+template <class USBInterface, typename = void>
+constexpr bool is_virtual_time_v = false;
+
+/** Whether the USB interface runs in virtual time, e.g. SimulatedUSB. */
+template <class USBInterface>
+constexpr bool
+    is_virtual_time_v<USBInterface, std::void_t<decltype(USBInterface::is_virtual_time)>> =
+        USBInterface::is_virtual_time;
+
+}  // namespace hardware_drivers
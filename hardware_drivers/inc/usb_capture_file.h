@@ -0,0 +1,76 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace hardware_drivers {
+
+/** On-disk format of the recorded USB bulk transfers.
+ *
+ * A capture file starts with a file_header_t, followed by one record per
+ * bulk transfer. Each record is a record_header_t and the raw payload, padded
+ * to 8-byte boundary so that the next record header can be read in-place from
+ * a memory-mapped file.
+ */
+namespace usb_capture {
+
+/** Magic number "96EYEUSB", in little-endian. */
+constexpr uint64_t magic = 0x4253554559453639;
+constexpr uint16_t version = 1;
+
+#pragma pack(push, 1)
+struct file_header_t {
+    uint64_t magic{usb_capture::magic};
+    uint16_t version{usb_capture::version};
+    uint8_t usb_id{};
+    uint8_t reserved[5]{};
+};
+static_assert(sizeof(file_header_t) == 16);
+
+struct record_header_t {
+    /** Completion time of the bulk transfer, relative to the first record. */
+    uint64_t timestamp_ns{};
+    uint32_t length{};
+    uint32_t reserved{};
+};
+static_assert(sizeof(record_header_t) == 16);
+#pragma pack(pop)
+
+constexpr size_t
+paddedLength(size_t length) {
+    return (length + 7) & ~size_t{7};
+}
+
+}  // namespace usb_capture
+
+/** Append the bulk transfer payloads to the capture file.
+ *
+ * Writes are buffered by stdio, so that the recording tap does not add a
+ * syscall to each bulk transfer. A failed write, e.g. on a full disk, fails
+ * the recording rather than leave a truncated capture file to replay.
+ */
+class CaptureFileWriter {
+   public:
+    /** @throws std::runtime_error if the file cannot be created or written. */
+    CaptureFileWriter(const char* path, uint8_t usb_id);
+
+    /** Flush the buffered records. A failure is reported on stderr. */
+    ~CaptureFileWriter();
+
+    CaptureFileWriter(const CaptureFileWriter&) = delete;
+    CaptureFileWriter& operator=(const CaptureFileWriter&) = delete;
+
+    /** @throws std::runtime_error if the record cannot be written. */
+    void append(const uint8_t* payload, size_t length);
+
+   private:
+    const std::string path;
+    std::FILE* file{nullptr};
+    std::chrono::steady_clock::time_point start{};
+    bool is_first_record{true};
+
+    void write(const void* data, size_t length);
+};
+
+}  // namespace hardware_drivers
@@ -0,0 +1,238 @@
+#include "firmware_emulator.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+namespace hardware_drivers {
+
+using namespace std::chrono_literals;
+using std::chrono::nanoseconds;
+
+namespace {
+
+/** Parse exactly N space-separated integer operands after the command letter.
+ *
+ * @returns nullopt on a missing, malformed or extra operand.
+ */
+template <size_t N>
+std::optional<std::array<int32_t, N>>
+operands(std::string_view command) {
+    std::array<int32_t, N> values{};
+    const char* p = command.data() + 1;
+    const char* end = command.data() + command.size();
+    for (auto& v : values) {
+        if (p == end || *p != ' ') {
+            return std::nullopt;
+        }
+        while (p < end && *p == ' ') {
+            p++;
+        }
+        const auto [next, ec] = std::from_chars(p, end, v);
+        if (ec != std::errc{}) {
+            return std::nullopt;
+        }
+        p = next;
+    }
+    if (p != end) {
+        return std::nullopt;
+    }
+    return values;
+}
+
+constexpr bool
+isWithin(int32_t value, int32_t lower, int32_t upper) {
+    return lower <= value && value <= upper;
+}
+
+}  // namespace
+
+FirmwareEmulator::FirmwareEmulator(firmware_config_t c)
+    : config{c}, master{posix_openpt(O_RDWR | O_NOCTTY)} {
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        const std::string error{std::strerror(errno)};
+        ::close(master);
+        throw std::runtime_error("Cannot open a pseudo-terminal: " + error);
+    }
+    slave_path = ptsname(master);
+
+    // Raw mode from the start, for the hosts that do not set it, e.g.
+    // `echo n > /dev/pts/N`. The mode persists while the master is open.
+    const int slave = ::open(slave_path.c_str(), O_RDWR | O_NOCTTY);
+    termios tty{};
+    if (slave < 0 || ::tcgetattr(slave, &tty) != 0) {
+        const std::string error{std::strerror(errno)};
+        ::close(slave);
+        ::close(master);
+        throw std::runtime_error("Cannot set the pseudo-terminal to raw mode: " + error);
+    }
+    ::cfmakeraw(&tty);
+    ::tcsetattr(slave, TCSANOW, &tty);
+    ::close(slave);
+}
+
+FirmwareEmulator::~FirmwareEmulator() { ::close(master); }
+
+bool
+FirmwareEmulator::serve(
+    const std::function<void(std::string_view, const response_t&)>& on_command) {
+    std::string line{};
+    bool is_session_started = false;
+    while (readCommand(line, is_session_started)) {
+        // The firmware is busy from the end of the command on.
+        const auto start = std::chrono::steady_clock::now();
+        const auto response = execute(line);
+        if (on_command) {
+            on_command(line, response);
+        }
+
+        if (config.ack == ack_mode_t::ON_RECEIPT) {
+            reply(response.reply);
+        }
+        std::this_thread::sleep_until(start + response.work);
+        if (config.ack == ack_mode_t::ON_COMPLETION) {
+            reply(response.reply);
+        }
+        statistics.busy += response.work;
+    }
+    return !is_stopping;
+}
+
+FirmwareEmulator::response_t
+FirmwareEmulator::execute(std::string_view command) {
+    statistics.commands++;
+    nanoseconds work = config.command_latency;
+    const auto reject = [&](const char* reason) {
+        statistics.rejected++;
+        return response_t{std::string{"ERR "} + reason + "\n", work};
+    };
+
+    if (config.reject_every > 0 && statistics.commands % config.reject_every == 0) {
+        return reject("injected fault");
+    }
+
+    switch (command.empty() ? '\0' : command.front()) {
+        case 'z': {
+            const auto values = operands<1>(command);
+            if (!values || !isWithin((*values)[0], INT16_MIN, INT16_MAX)) {
+                return reject("malformed z-stage move");
+            }
+            const int32_t z = (*values)[0];
+            const double distance = std::abs(z - z_position);
+            work += nanoseconds{static_cast<int64_t>(distance * 1e9 / config.z_velocity)} +
+                    config.z_settle;
+            z_position = static_cast<int16_t>(z);
+            break;
+        }
+        case 'B': {
+            const auto values = operands<3>(command);
+            if (!values || (*values)[0] < 0 || !isWithin((*values)[1], 0, UINT8_MAX) ||
+                !isWithin((*values)[2], 0, 1)) {
+                return reject("malformed laser command");
+            }
+            // The laser illuminates in the background for the duration.
+            const auto [seconds, power, channel] = *values;
+            if (power > 0 && channel != laser_channel) {
+                work += config.laser_switch;
+                laser_channel = channel;
+            }
+            break;
+        }
+        case 'm': {
+            const auto values = operands<2>(command);
+            if (!values || !isWithin((*values)[0], 0, UINT8_MAX) ||
+                !isWithin((*values)[1], 0, UINT8_MAX)) {
+                return reject("malformed LED position");
+            }
+            work += config.led_update;
+            break;
+        }
+        case 'c': {
+            const auto values = operands<3>(command);
+            if (!values || !isWithin((*values)[0], 0, 1) || !isWithin((*values)[1], 0, 1) ||
+                !isWithin((*values)[2], 0, 1)) {
+                return reject("malformed LED color");
+            }
+            work += config.led_update;
+            break;
+        }
+        case 'n':
+        case 'f':
+            if (!operands<0>(command)) {
+                return reject("unexpected operand");
+            }
+            work += config.led_update;
+            break;
+        case 's':
+            // The commands before it have taken effect by now.
+            if (!operands<0>(command)) {
+                return reject("unexpected operand");
+            }
+            break;
+        default:
+            return reject("unknown command");
+    }
+    return {"OK\n", work};
+}
+
+bool
+FirmwareEmulator::readCommand(std::string& line, bool& is_session_started) {
+    while (true) {
+        const auto newline = input.find('\n');
+        if (newline != std::string::npos) {
+            line.assign(input, 0, newline);
+            input.erase(0, newline + 1);
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (!line.empty()) {
+                return true;
+            }
+            continue;
+        }
+        if (is_stopping) {
+            return false;
+        }
+
+        pollfd fd{master, POLLIN, 0};
+        if (::poll(&fd, 1, 100) <= 0) {
+            continue;
+        }
+        if (fd.revents & POLLIN) {
+            std::array<char, 256> buffer;
+            const ssize_t n = ::read(master, buffer.data(), buffer.size());
+            if (n > 0) {
+                input.append(buffer.data(), n);
+                is_session_started = true;
+                continue;
+            }
+        }
+
+        // Hung up, i.e. no host has the serial port open, and read() fails
+        // with EIO. Wait for the host to open it, or end the session.
+        if (is_session_started) {
+            input.clear();
+            return false;
+        }
+        std::this_thread::sleep_for(10ms);
+    }
+}
+
+void
+FirmwareEmulator::reply(std::string_view text) {
+    // The host may have closed the serial port already. Drop the reply then.
+    [[maybe_unused]] const ssize_t n = ::write(master, text.data(), text.size());
+}
+
+}  // namespace hardware_drivers
@@ -0,0 +1,94 @@
+#include "replay_usb.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include "virtual-clock.h"
+
+using nonstd::span;
+
+namespace hardware_drivers {
+
+using namespace usb_capture;
+
+ReplayUSB::ReplayUSB(uint8_t usb_id, const char* capture_path, pacing_t p)
+    : id{usb_id}, pacing{p} {
+    const int fd = ::open(capture_path, O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("Cannot open USB capture file: ") + capture_path);
+    }
+
+    struct stat file_stat {};
+    if (::fstat(fd, &file_stat) != 0) {
+        ::close(fd);
+        throw std::runtime_error(std::string("Cannot stat USB capture file: ") + capture_path);
+    }
+    mapped_size = file_stat.st_size;
+
+    // Private, copy-on-write mapping, so that ReplayUSB::buffer can be exposed
+    // as a mutable span without altering the capture file.
+    void* addr = mapped_size >= sizeof(file_header_t)
+                     ? ::mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)
+                     : MAP_FAILED;
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        throw std::runtime_error(std::string("Cannot map USB capture file: ") + capture_path);
+    }
+    mapped = static_cast<uint8_t*>(addr);
+    ::madvise(mapped, mapped_size, MADV_SEQUENTIAL);
+
+    file_header_t header;
+    std::memcpy(&header, mapped, sizeof(header));
+    if (header.magic != magic || header.version != version) {
+        ::munmap(mapped, mapped_size);
+        throw std::runtime_error(std::string("Not a USB capture file: ") + capture_path);
+    }
+    recorded_usb_id = header.usb_id;
+}
+
+ReplayUSB::~ReplayUSB() { ::munmap(mapped, mapped_size); }
+
+int
+ReplayUSB::bulk_read(milliseconds, std::optional<span<uint8_t>> dst_buffer) {
+    if (read_offset + sizeof(record_header_t) > mapped_size) {
+        throw std::runtime_error("USB capture file exhausted");
+    }
+
+    record_header_t record;
+    std::memcpy(&record, mapped + read_offset, sizeof(record));
+    read_offset += sizeof(record);
+    if (read_offset + record.length > mapped_size) {
+        throw std::runtime_error("USB capture file truncated");
+    }
+
+    if (pacing == pacing_t::ORIGINAL_TIMING) {
+        if (!start.has_value()) {
+            start = simulator::now();
+        }
+
+        // Suspend the calling fiber only, so that the other boards can still
+        // stream their recorded transfers.
+        simulator::sleep_until(*start + std::chrono::nanoseconds{record.timestamp_ns});
+    }
+
+    buffer = span<uint8_t>{mapped + read_offset, record.length};
+    read_offset += paddedLength(record.length);
+    replay_count++;
+
+    if (dst_buffer == std::nullopt) {
+        return buffer.size();
+    }
+
+    // Simulate data transfer from USB to destination buffer, up to the buffer
+    // capacity.
+    const auto payload_length = std::min(dst_buffer->size(), buffer.size());
+    std::copy_n(buffer.begin(), payload_length, dst_buffer->begin());
+    return payload_length;
+}
+}  // namespace hardware_drivers
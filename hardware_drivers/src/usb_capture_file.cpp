@@ -0,0 +1,58 @@
+#include "usb_capture_file.h"
+
+#include <array>
+#include <stdexcept>
+#include <string>
+
+namespace hardware_drivers {
+
+using namespace usb_capture;
+
+CaptureFileWriter::CaptureFileWriter(const char* capture_path, uint8_t usb_id)
+    : path{capture_path}, file{std::fopen(capture_path, "wb")} {
+    if (file == nullptr) {
+        throw std::runtime_error("Cannot create USB capture file: " + path);
+    }
+
+    const file_header_t header{magic, version, usb_id};
+    try {
+        write(&header, sizeof(header));
+    } catch (...) {
+        std::fclose(file);
+        throw;
+    }
+}
+
+CaptureFileWriter::~CaptureFileWriter() {
+    if (std::fclose(file) != 0) {
+        std::fprintf(stderr, "Cannot write USB capture file: %s\n", path.c_str());
+    }
+}
+
+void
+CaptureFileWriter::write(const void* data, const size_t length) {
+    if (std::fwrite(data, 1, length, file) != length || std::ferror(file) != 0) {
+        throw std::runtime_error("Cannot write USB capture file: " + path);
+    }
+}
+
+void
+CaptureFileWriter::append(const uint8_t* payload, size_t length) {
+    using std::chrono::steady_clock;
+
+    const auto now = steady_clock::now();
+    if (is_first_record) {
+        start = now;
+        is_first_record = false;
+    }
+
+    const record_header_t record{
+        static_cast<uint64_t>(std::chrono::nanoseconds{now - start}.count()),
+        static_cast<uint32_t>(length)};
+    write(&record, sizeof(record));
+    write(payload, length);
+
+    constexpr std::array<uint8_t, 8> padding{};
+    write(padding.data(), paddedLength(length) - length);
+}
+}  // namespace hardware_drivers
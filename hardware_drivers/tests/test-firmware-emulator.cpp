@@ -0,0 +1,142 @@
+#include <asio.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "firmware_emulator.h"
+#include "time-model.h"
+
+using hardware_drivers::ack_mode_t;
+using hardware_drivers::firmware_config_t;
+using hardware_drivers::FirmwareEmulator;
+using namespace std::chrono_literals;
+using std::chrono::steady_clock;
+
+namespace {
+
+/** Fast z-stage: 30um take 30ms to travel, then 20ms to settle. */
+firmware_config_t
+fastStage(ack_mode_t ack) {
+    firmware_config_t config{};
+    config.command_latency = 1ms;
+    config.z_velocity = 1000.0;
+    config.z_settle = 20ms;
+    config.ack = ack;
+    return config;
+}
+
+/** The host side of the serial port, as capture-images. */
+class Host {
+   public:
+    explicit Host(const std::string& path) : serial{io} { serial.open(path); }
+
+    void write(std::string_view command) { asio::write(serial, asio::buffer(command)); }
+
+    std::string readLine() {
+        const size_t n = asio::read_until(serial, asio::dynamic_buffer(buffer), '\n');
+        std::string line = buffer.substr(0, n);
+        buffer.erase(0, n);
+        return line;
+    }
+
+    void close() { serial.close(); }
+
+   private:
+    asio::io_context io;
+    asio::serial_port serial;
+    std::string buffer{};
+};
+
+}  // namespace
+
+TEST_CASE("Time the serial commands of the firmware", "[firmware_emulator]") {
+    using namespace simulator::time_model;
+    FirmwareEmulator firmware{};
+
+    const auto move = firmware.execute("z -2");
+    CHECK(move.reply == "OK\n");
+    CHECK(move.work == serial_parse + zMove(-2));
+    CHECK(firmware.z() == -2);
+
+    CHECK(firmware.execute("m 3 14").work == serial_parse + led_update);
+    CHECK(firmware.execute("c 0 1 0").work == serial_parse + led_update);
+    CHECK(firmware.execute("s").work == serial_parse);
+
+    // Only a change of the excitation channel switches the laser.
+    CHECK(firmware.execute("B 2 255 1").work == serial_parse + laser_switch);
+    CHECK(firmware.execute("B 2 255 1").work == serial_parse);
+    CHECK(firmware.execute("B 1 0 0").work == serial_parse);
+
+    CHECK(firmware.stats().commands == 7);
+    CHECK(firmware.stats().rejected == 0);
+}
+
+TEST_CASE("Reject the malformed serial commands", "[firmware_emulator]") {
+    FirmwareEmulator firmware{};
+    for (const auto command : {"q", "z", "z abc", "z 99999", "m 3", "m 3 14 15", "m 256 0",
+                               "c 1 2 0", "B 1 100 2", "n 1", "s now"}) {
+        INFO(command);
+        CHECK(firmware.execute(command).reply.substr(0, 4) == "ERR ");
+    }
+    CHECK(firmware.z() == 0);
+    CHECK(firmware.stats().rejected == 11);
+}
+
+TEST_CASE("Inject a fault into every N-th serial command", "[firmware_emulator]") {
+    firmware_config_t config{};
+    config.reject_every = 2;
+    FirmwareEmulator firmware{config};
+
+    CHECK(firmware.execute("n").reply == "OK\n");
+    CHECK(firmware.execute("n").reply == "ERR injected fault\n");
+    CHECK(firmware.execute("n").reply == "OK\n");
+}
+
+TEST_CASE("Acknowledge each command once it takes effect", "[firmware_emulator]") {
+    FirmwareEmulator firmware{fastStage(ack_mode_t::ON_COMPLETION)};
+    std::thread device{[&]() { firmware.serve(); }};
+
+    Host host{firmware.path()};
+    const auto start = steady_clock::now();
+    host.write("z 30\n");
+    CHECK(host.readLine() == "OK\n");
+    CHECK(steady_clock::now() - start >= 51ms);
+
+    host.write("m 3 14\nz 31\n");
+    CHECK(host.readLine() == "OK\n");
+    CHECK(host.readLine() == "OK\n");
+
+    // The session ends once the host closes the serial port.
+    host.close();
+    device.join();
+    CHECK(firmware.z() == 31);
+    CHECK(firmware.stats().commands == 3);
+}
+
+TEST_CASE("Acknowledge on receipt, and report the settling on request", "[firmware_emulator]") {
+    FirmwareEmulator firmware{fastStage(ack_mode_t::ON_RECEIPT)};
+    std::thread device{[&]() { firmware.serve(); }};
+
+    Host host{firmware.path()};
+    const auto start = steady_clock::now();
+    host.write("z 30\ns\n");
+    CHECK(host.readLine() == "OK\n");
+    CHECK(steady_clock::now() - start < 30ms);
+
+    // The settle query waits for the move before it.
+    CHECK(host.readLine() == "OK\n");
+    CHECK(steady_clock::now() - start >= 51ms);
+
+    host.close();
+    device.join();
+}
+
+TEST_CASE("Stop serving before the host opens the serial port", "[firmware_emulator]") {
+    FirmwareEmulator firmware{};
+    std::thread device{[&]() { CHECK_FALSE(firmware.serve()); }};
+    std::this_thread::sleep_for(20ms);
+    firmware.stop();
+    device.join();
+}
@@ -10,4 +10,21 @@ TEST_CASE("Bulk read from mock USB", "[mock_usb]") {
 
     const uint32_t header = mock_usb.decode<uint32_t>();
     REQUIRE(header == 0x123abc00);
-}
\ No newline at end of file
+}
+
+TEST_CASE("Batched i2c commands to mock USB", "[mock_usb]") {
+    using frame_capture_card::commands::i2c_batch_write_t;
+    using frame_capture_card::commands::read_i2c_batch_status_t;
+
+    hardware_drivers::MockUSB mock_usb(0);
+    i2c_batch_write_t batch{};
+    REQUIRE(batch.push_back({0x1234, 0x01}));
+    REQUIRE(batch.push_back({0x1235, 0x02}));
+    REQUIRE(batch.length() == sizeof(uint16_t) + 2 * sizeof(batch.commands[0]));
+    REQUIRE(mock_usb.control_write(batch));
+    REQUIRE(mock_usb.control_read<read_i2c_batch_status_t>().nack_mask == 0);
+
+    // Inject a failure on the 2nd command.
+    mock_usb.i2c_nack_mask = 0b10;
+    REQUIRE(mock_usb.control_read<read_i2c_batch_status_t>().nack_mask == 0b10);
+}
@@ -0,0 +1,56 @@
+#include <array>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+#include "mock_usb.h"
+#include "recording_usb.h"
+#include "replay_usb.h"
+
+using hardware_drivers::MockUSB;
+using hardware_drivers::RecordingUSB;
+using hardware_drivers::ReplayUSB;
+using namespace std::chrono_literals;
+
+TEST_CASE("Replay the recorded bulk transfers", "[replay_usb]") {
+    const char* capture_path = "test-replay-usb.cap";
+    constexpr size_t n_chunks = 8;
+    std::vector<uint8_t> recorded(n_chunks * 512);
+
+    {
+        RecordingUSB<MockUSB> recording_usb(2, capture_path);
+        REQUIRE(recording_usb.bulk_read() == 1024);
+        for (size_t i = 0; i < n_chunks; i++) {
+            const auto chunk = nonstd::span<uint8_t>{recorded}.subspan(i * 512, 512);
+            REQUIRE(recording_usb.bulk_read(400ms, chunk) == 512);
+        }
+    }
+
+    ReplayUSB replay_usb(0, capture_path);
+    REQUIRE(replay_usb.control_read<frame_capture_card::commands::read_board_id_t>().value == 2);
+
+    // Zero-copy replay to the internal buffer.
+    REQUIRE(replay_usb.bulk_read() == 1024);
+    REQUIRE(replay_usb.decode<uint32_t>() == 0x123abc00);
+
+    std::vector<uint8_t> replayed(recorded.size());
+    for (size_t i = 0; i < n_chunks; i++) {
+        const auto chunk = nonstd::span<uint8_t>{replayed}.subspan(i * 512, 512);
+        REQUIRE(replay_usb.bulk_read(400ms, chunk) == 512);
+    }
+    REQUIRE(replayed == recorded);
+    REQUIRE(replay_usb.replayed() == n_chunks + 1);
+
+    REQUIRE_THROWS_AS(replay_usb.bulk_read(), std::runtime_error);
+    std::remove(capture_path);
+}
+
+TEST_CASE("Fail the recording on a full disk", "[replay_usb]") {
+    hardware_drivers::CaptureFileWriter writer{"/dev/full", 2};
+
+    // Larger than the stdio buffer, so that it reaches the device.
+    const std::vector<uint8_t> payload(1 << 16);
+    REQUIRE_THROWS_AS(writer.append(payload.data(), payload.size()), std::runtime_error);
+}
@@ -0,0 +1,104 @@
+#include <asio.hpp>
+#include <boost/fiber/all.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <string_view>
+#include <thread>
+
+#include "mock_usb.h"
+#include "simulated_serial.h"
+#include "simulated_usb.h"
+#include "time-model.h"
+#include "utilization.h"
+#include "virtual-clock.h"
+#include "virtual-time-scheduler.h"
+
+using hardware_drivers::MockUSB;
+using hardware_drivers::SimulatedSerial;
+using hardware_drivers::SimulatedUSB;
+using namespace std::chrono_literals;
+using namespace simulator::time_model;
+using frame_capture_card::commands::i2c_cmd_t;
+using frame_capture_card::commands::write_led_id_t;
+
+namespace {
+
+/** Run the fibers in virtual time, on a thread of their own. */
+template <typename Function>
+void
+inVirtualTime(Function&& f) {
+    std::thread t{[&]() {
+        boost::fibers::use_scheduling_algorithm<simulator::virtual_time_scheduler_t>();
+        f();
+    }};
+    t.join();
+}
+
+void
+send(SimulatedSerial& serial, std::string_view command) {
+    asio::write(serial, asio::buffer(command));
+}
+
+}  // namespace
+
+TEST_CASE("Wait for the transmission of the serial commands only", "[simulated_serial]") {
+    inVirtualTime([]() {
+        SimulatedSerial serial{};
+        auto& z_stage = simulator::busyTime("z-stage");
+        auto& laser = simulator::busyTime("laser");
+        const auto start = simulator::now();
+
+        send(serial, "z 100\n");
+        CHECK(simulator::now() - start == serialTransmit(6));
+        CHECK(serial.z() == 100);
+        CHECK(serial.idleAt() - start == serialTransmit(6) + serial_parse + zMove(100));
+        CHECK(z_stage.busy() == zMove(100));
+
+        // Queued behind the stage move, then the laser switches channel and
+        // illuminates in the background.
+        const auto stage_idle = serial.idleAt();
+        send(serial, "B 2 16 0\n");
+        CHECK(simulator::now() - start == serialTransmit(6) + serialTransmit(9));
+        CHECK(serial.idleAt() == stage_idle + serial_parse + laser_switch);
+        CHECK(laser.busy() == 2s);
+
+        // Turning the laser off 1 s after it came on cuts the illumination
+        // short.
+        simulator::sleep_until(serial.idleAt() + 1s);
+        send(serial, "B 0 0 0\n");
+        CHECK(laser.busy() > 1s);
+        CHECK(laser.busy() < 1s + serialTransmit(8) + serial_parse + 1ms);
+    });
+}
+
+TEST_CASE("Stream the frames once exposed, at the USB bandwidth", "[simulated_usb]") {
+    inVirtualTime([]() {
+        SimulatedUSB<MockUSB> usb{1};
+        REQUIRE(usb.control_write(i2c_cmd_t{0x1234, 0x2c}));
+        REQUIRE(usb.control_write(i2c_cmd_t{0x1235, 0x01}));
+        REQUIRE(usb.exposure() == 300ms);
+
+        const auto start = simulator::now();
+        REQUIRE(usb.control_write(write_led_id_t{7}));
+
+        // The header of the first frame arrives after the exposure.
+        const int n_bytes = usb.bulk_read();
+        const auto header = usb_frame_latency + usbTransfer(n_bytes);
+        CHECK(simulator::now() - start == 300ms + header);
+
+        // The payload streams at the bandwidth of the link.
+        std::array<uint8_t, 512> payload{};
+        REQUIRE(usb.bulk_read(400ms, nonstd::span<uint8_t>{payload}) == 512);
+        CHECK(simulator::now() - start == 300ms + header + usbTransfer(512));
+
+        // All 24 cameras exposed at once. The 25th frame takes another exposure.
+        for (int i = 1; i < frame_capture_card::n_cameras_per_board; i++) {
+            REQUIRE(usb.bulk_read() == n_bytes);
+        }
+        CHECK(simulator::now() - start < 600ms);
+        REQUIRE(usb.bulk_read() == n_bytes);
+        CHECK(simulator::now() - start == 600ms + header);
+
+        CHECK(simulator::busyTime("usb1").busy() == 25 * header + usbTransfer(512));
+    });
+}
@@ -0,0 +1,239 @@
+#pragma once
+#include <asio/execution_context.hpp>
+#include <asio/io_context.hpp>
+#include <asio/read_until.hpp>
+#include <asio/steady_timer.hpp>
+#include <asio/write.hpp>
+#include <array>
+#include <atomic>
+#include <boost/fiber/algo/algorithm.hpp>
+#include <boost/fiber/condition_variable.hpp>
+#include <boost/fiber/mutex.hpp>
+#include <boost/fiber/properties.hpp>
+#include <boost/fiber/scheduler.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+
+namespace message_router {
+
+/** Scheduling priority of a fiber under asio_scheduler_t. */
+enum class fiber_priority_t : uint8_t {
+    /** Runs only while no other fiber is ready, e.g. the file writer. */
+    BACKGROUND,
+    NORMAL,
+    /** On the path from the laser to the last frame, i.e. the executor and the
+     * capture workers. Also the event loop, for their serial commands. */
+    CRITICAL,
+};
+
+/** Fiber properties of the asio_scheduler_t. */
+class priority_props_t : public boost::fibers::fiber_properties {
+   public:
+    using boost::fibers::fiber_properties::fiber_properties;
+
+    fiber_priority_t priority() const noexcept { return value; }
+
+    /** Move the fiber, if ready, behind the ready fibers of the same
+     * priority. */
+    void setPriority(const fiber_priority_t p) noexcept {
+        if (p != value) {
+            value = p;
+            notify();
+        }
+    }
+
+   private:
+    fiber_priority_t value{fiber_priority_t::NORMAL};
+};
+
+/** Boost.Fiber scheduler running the asio event loop whenever the fibers of
+ * the thread are idle.
+ *
+ * The fibers ready to run are picked by priority, and in FIFO order within
+ * the same priority, as by boost::fibers::algo::round_robin:
+ *
+ *     fiber capture_task{...};
+ *     capture_task.properties<message_router::priority_props_t>().setPriority(
+ *         message_router::fiber_priority_t::CRITICAL);
+ *
+ * The event loop runs in the fiber calling io.run(), e.g. the main fiber,
+ * until io.stop():
+ *
+ *     boost::fibers::use_scheduling_algorithm<message_router::asio_scheduler_t>(io);
+ *     // Launch the fibers. The last one to finish calls io.stop().
+ *     io.run();
+ *
+ * While other fibers are ready, the loop completes the I/O ready so far every
+ * poll_interval, or as soon as they all suspend. Once no fiber is ready, the loop blocks the
+ * thread in the reactor, until an I/O completes, or until the earliest fiber in
+ * sleep_for() or in a timed wait is due. The completion handlers wake the
+ * fibers waiting for the I/O at once, as in fiber_io::readUntil().
+ *
+ * Before io.run() and after io.stop(), the idle thread waits as by
+ * round_robin.
+ */
+class asio_scheduler_t : public boost::fibers::algo::algorithm_with_properties<priority_props_t> {
+   public:
+    /** Time between two polls of the reactor while fibers are ready. Bounds
+     * the I/O latency of the fibers waiting for I/O, while the others keep the
+     * thread busy. */
+    static constexpr std::chrono::microseconds poll_interval{50};
+
+    explicit asio_scheduler_t(asio::io_context& io);
+
+    asio_scheduler_t(const asio_scheduler_t&) = delete;
+    asio_scheduler_t& operator=(const asio_scheduler_t&) = delete;
+
+    void awakened(boost::fibers::context* ctx, priority_props_t& props) noexcept override;
+    void property_change(boost::fibers::context* ctx, priority_props_t& props) noexcept override;
+    boost::fibers::context* pick_next() noexcept override;
+    bool has_ready_fibers() const noexcept override;
+    void suspend_until(const std::chrono::steady_clock::time_point& t) noexcept override;
+    void notify() noexcept override;
+
+    /** The event loop run by the scheduler of the calling thread, or nullptr
+     * outside of io.run(). */
+    static asio::execution_context* running();
+
+   private:
+    asio::io_context& io;
+
+    /** Ready fibers in FIFO order, indexed by the priority. */
+    std::array<boost::fibers::scheduler::ready_queue_type,
+               static_cast<size_t>(fiber_priority_t::CRITICAL) + 1>
+        ready{};
+
+    /** The dispatcher of the fiber manager, and the priority it is ready at. */
+    boost::fibers::context* dispatcher{nullptr};
+    fiber_priority_t dispatcher_priority{fiber_priority_t::BACKGROUND};
+
+    /** Fibers ready to run, not counting the dispatcher of the fiber manager,
+     * which stays in the ready queue while any fiber runs. */
+    size_t n_ready_fibers{0};
+
+    /** Timer of the earliest fiber due, to return from the reactor. Lives
+     * in the event loop, so that the scheduler may outlive the io_context. */
+    asio::steady_timer* wake_timer{nullptr};
+    std::chrono::steady_clock::time_point wake_at{std::chrono::steady_clock::time_point::max()};
+
+    /** The event loop waits here for the next poll, or for suspend_until(). */
+    boost::fibers::mutex loop_mutex{};
+    boost::fibers::condition_variable loop_idle{};
+    std::atomic<bool> is_loop_running{false};
+
+    /** The fiber running the event loop, ready at the critical priority. */
+    boost::fibers::context* loop_context{nullptr};
+
+    std::mutex mutex{};
+    std::condition_variable notified{};
+    bool is_notified{false};
+
+    void runLoop();
+
+    /** Priority of the fiber, or of the event loop. Normal for the fibers
+     * without properties yet. */
+    fiber_priority_t priorityOf(boost::fibers::context* ctx,
+                                const boost::fibers::fiber_properties* props) const noexcept;
+};
+
+/** Fiber-blocking I/O on the asio event loop of asio_scheduler_t.
+ *
+ * Each call suspends the calling fiber until the asynchronous operation
+ * completes, leaving the thread to the other fibers, and throws
+ * asio::system_error on failure. Without asio_scheduler_t running the event
+ * loop of the I/O object, the call runs the loop itself, blocking the thread
+ * as the synchronous asio calls do.
+ */
+namespace fiber_io {
+
+namespace detail {
+
+/** Completion of one asynchronous operation, awaited by one fiber. */
+class completion_t {
+   public:
+    explicit completion_t(asio::execution_context& context) : context{context} {}
+
+    void complete(const asio::error_code& ec, size_t n = 0) {
+        std::lock_guard<boost::fibers::mutex> lock{mutex};
+        error = ec;
+        n_transferred = n;
+        is_done = true;
+        done.notify_one();
+    }
+
+    /** @returns the bytes transferred. */
+    size_t await() {
+        if (asio_scheduler_t::running() == &context) {
+            std::unique_lock<boost::fibers::mutex> lock{mutex};
+            done.wait(lock, [this]() { return is_done; });
+        } else {
+            auto& io = static_cast<asio::io_context&>(context);
+            if (io.stopped()) {
+                io.restart();
+            }
+            while (!is_done && io.run_one() > 0) {
+            }
+        }
+        if (error) {
+            throw asio::system_error{error};
+        }
+        return n_transferred;
+    }
+
+   private:
+    asio::execution_context& context;
+    boost::fibers::mutex mutex{};
+    boost::fibers::condition_variable done{};
+    bool is_done{false};
+    asio::error_code error{};
+    size_t n_transferred{};
+};
+
+/** The execution context of the I/O object, i.e. its io_context. */
+template <class IoObject>
+asio::execution_context&
+contextOf(IoObject& object) {
+    return asio::query(object.get_executor(), asio::execution::context);
+}
+
+}  // namespace detail
+
+/** As asio::write(), suspending the fiber instead of the thread. */
+template <class AsyncWriteStream, class ConstBufferSequence>
+size_t
+write(AsyncWriteStream& stream, const ConstBufferSequence& buffers) {
+    detail::completion_t completion{detail::contextOf(stream)};
+    asio::async_write(stream, buffers, [&](const asio::error_code& ec, size_t n) {
+        completion.complete(ec, n);
+    });
+    return completion.await();
+}
+
+/** As asio::read_until(), suspending the fiber instead of the thread. */
+template <class AsyncReadStream, class DynamicBuffer>
+size_t
+readUntil(AsyncReadStream& stream, DynamicBuffer&& buffer, char delimiter) {
+    detail::completion_t completion{detail::contextOf(stream)};
+    asio::async_read_until(stream, std::forward<DynamicBuffer>(buffer), delimiter,
+                           [&](const asio::error_code& ec, size_t n) {
+                               completion.complete(ec, n);
+                           });
+    return completion.await();
+}
+
+/** As asio::steady_timer::wait(), suspending the fiber instead of the
+ * thread. */
+inline void
+wait(asio::steady_timer& timer) {
+    detail::completion_t completion{detail::contextOf(timer)};
+    timer.async_wait([&](const asio::error_code& ec) { completion.complete(ec); });
+    completion.await();
+}
+
+}  // namespace fiber_io
+
+}  // namespace message_router
@@ -0,0 +1,420 @@
+#pragma once
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <array>
+#include <asio/io_context.hpp>
+#include <asio/read_until.hpp>
+#include <asio/write.hpp>
+#include <boost/fiber/condition_variable.hpp>
+#include <boost/fiber/mutex.hpp>
+#include <boost/fiber/operations.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "asio-scheduler.h"
+#include "trace.h"
+
+namespace message_router {
+
+using namespace std::chrono_literals;
+
+/** Counters of the serial transport, for the run report. */
+struct serial_stats_t {
+    /** Writes issued to the serial port. */
+    uint64_t writes{};
+
+    /** Commands sent, i.e. newline-terminated lines. */
+    uint64_t commands{};
+
+    /** Commands acknowledged by the firmware. */
+    uint64_t acks{};
+
+    /** Lines from the firmware without a command to acknowledge. */
+    uint64_t unsolicited{};
+
+    /** Commands rejected by the firmware, of those allowed to be. */
+    uint64_t rejected{};
+
+    /** Peak number of commands awaiting acknowledgement. */
+    size_t max_outstanding{};
+};
+
+/** Pipelined serial port to the ATmega2560 firmware.
+ *
+ * Models the SyncWriteStream concept of asio::write(), so that
+ * MessageOverSerial encodes commands into it as into asio::serial_port. Instead
+ * of blocking on each write, the commands are queued and written
+ * asynchronously: the commands sent while a write is in flight are coalesced
+ * into the next write.
+ *
+ * With an ack window of N, the firmware acknowledges each command with one
+ * newline-terminated line, in order. Up to N commands await acknowledgement at
+ * once. Sending one more waits for the oldest acknowledgement. A reply starting
+ * with `ERR` rejects the command, and fails the transport, unless the command
+ * is allowed to be rejected, e.g. a query the firmware may not answer. With an
+ * ack window of 0, the replies are not read, and a command completes once
+ * written.
+ *
+ * Under asio_scheduler_t, the waiting fiber suspends until the completion
+ * handlers wake it. Otherwise, the asio event loop is driven by the waiting
+ * fiber, which polls the io_context and yields to the other fibers in between.
+ * Waits throw
+ * asio::system_error on a silent firmware, and std::runtime_error on a write
+ * error or a rejected command. The transport never allocates after
+ * construction.
+ *
+ * @tparam AsyncStream the serial port, e.g. asio::serial_port.
+ * @tparam max_window largest ack window.
+ */
+template <class AsyncStream, size_t max_window = 16>
+class AsyncSerialTransport {
+   public:
+    /** Longest command kept for the error messages, as encoded by
+     * MessageOverSerial. */
+    static constexpr size_t max_command_length = 16;
+
+    /** Completion of one command. */
+    class ack_t {
+       public:
+        bool isReady() const { return transport.isCompleted(sequence); }
+
+        /** Suspend the fiber until the command completes. */
+        void wait() const { transport.wait(sequence); }
+
+        /** As wait(), up to the timeout.
+         *
+         * @returns false if the command is still incomplete.
+         */
+        bool waitFor(std::chrono::milliseconds timeout) const {
+            return transport.waitFor(sequence, timeout);
+        }
+
+        /** Whether the firmware rejected the command, once complete. Only for
+         * the last command allowed to be rejected. */
+        bool isRejected() const { return transport.last_rejected == sequence; }
+
+       private:
+        friend AsyncSerialTransport;
+        ack_t(AsyncSerialTransport& t, uint64_t s) : transport{t}, sequence{s} {}
+
+        AsyncSerialTransport& transport;
+        uint64_t sequence;
+    };
+
+    explicit AsyncSerialTransport(asio::io_context& io_context, size_t window = 0,
+                                  std::chrono::milliseconds timeout = 1s)
+        : io{io_context}, stream{io_context}, ack_timeout{timeout} {
+        setAckWindow(window);
+        pending.reserve(write_capacity);
+        in_flight.reserve(write_capacity);
+        line_buffer.reserve(line_capacity);
+    }
+
+    AsyncSerialTransport(const AsyncSerialTransport&) = delete;
+    AsyncSerialTransport& operator=(const AsyncSerialTransport&) = delete;
+
+    /** The serial port, e.g. to open it and set the baud rate. */
+    AsyncStream& next_layer() { return stream; }
+
+    /** Set the number of commands awaiting acknowledgement at once, before
+     * sending the first command. Zero to not wait for acknowledgements. */
+    void setAckWindow(const size_t window) {
+        if (window > max_window) {
+            throw std::invalid_argument(
+                fmt::format(FMT_STRING("The ack window holds up to {:d} commands"), max_window));
+        }
+        ack_window = window;
+    }
+
+    void setAckTimeout(const std::chrono::milliseconds timeout) { ack_timeout = timeout; }
+
+    size_t ackWindow() const { return ack_window; }
+
+    /** Queue the bytes to write. Waits for a slot in the ack window at the
+     * start of each command. */
+    template <typename ConstBufferSequence>
+    size_t write_some(const ConstBufferSequence& buffers) {
+        size_t n_queued = 0;
+        for (auto it = asio::buffer_sequence_begin(buffers);
+             it != asio::buffer_sequence_end(buffers); ++it) {
+            const asio::const_buffer buffer{*it};
+            queue({static_cast<const char*>(buffer.data()), buffer.size()});
+            n_queued += buffer.size();
+        }
+        flush();
+        return n_queued;
+    }
+
+    template <typename ConstBufferSequence>
+    size_t write_some(const ConstBufferSequence& buffers, asio::error_code& ec) {
+        ec = {};
+        return write_some(buffers);
+    }
+
+    /** Send one newline-terminated command. */
+    ack_t send(std::string_view command) {
+        write_some(asio::buffer(command.data(), command.size()));
+        return lastAck();
+    }
+
+    /** Completion of the last command sent, e.g. by MessageOverSerial. */
+    ack_t lastAck() { return {*this, n_sent}; }
+
+    /** Let the firmware reject the last command sent, without failing the
+     * transport. Before waiting for it: the reply is read while waiting. */
+    void allowRejection() {
+        if (ack_window > 0 && n_acked < n_sent) {
+            outstanding[(n_sent - 1) % max_window].is_rejection_allowed = true;
+        }
+    }
+
+    bool isCompleted(const uint64_t sequence) const {
+        return (ack_window > 0 ? n_acked : n_written) >= sequence;
+    }
+
+    /** Suspend the fiber until the command of the sequence number completes. */
+    void wait(const uint64_t sequence) {
+        TRACE_SCOPE("serial", "wait for ack");
+        pumpUntil([&]() { return isCompleted(sequence); });
+    }
+
+    /** As wait(), up to the timeout instead of the ack timeout.
+     *
+     * @returns false if the command is still incomplete.
+     */
+    bool waitFor(const uint64_t sequence, const std::chrono::milliseconds timeout) {
+        TRACE_SCOPE("serial", "wait for ack");
+        return pumpUntil([&]() { return isCompleted(sequence); },
+                         std::chrono::steady_clock::now() + timeout);
+    }
+
+    /** Suspend the fiber until all commands sent so far complete. */
+    void awaitAll() {
+        flush();
+        wait(n_sent);
+    }
+
+    /** Complete the commands sent so far, then close the serial port. */
+    void close() {
+        awaitAll();
+        stream.close();
+    }
+
+    const serial_stats_t& stats() const { return statistics; }
+
+   private:
+    static constexpr size_t write_capacity = 2 * max_window * max_command_length + 64;
+    static constexpr size_t line_capacity = 256;
+
+    /** Command awaiting acknowledgement. */
+    struct command_t {
+        std::array<char, max_command_length> text{};
+        size_t length{};
+        bool is_rejection_allowed{false};
+
+        std::string_view view() const { return {text.data(), length}; }
+    };
+
+    asio::io_context& io;
+    AsyncStream stream;
+    size_t ack_window{};
+    std::chrono::milliseconds ack_timeout;
+
+    /** Commands sent, written to the port, and acknowledged so far. A command
+     * is identified by its sequence number, counting from one. */
+    uint64_t n_sent{};
+    uint64_t n_written{};
+    uint64_t n_acked{};
+
+    /** Sequence number of the last command rejected, of those allowed to be. */
+    uint64_t last_rejected{};
+
+    /** Bytes to write next, and the commands they complete. */
+    std::vector<char> pending{};
+    uint64_t n_pending{};
+
+    /** Bytes of the write in flight, and the commands they complete. */
+    std::vector<char> in_flight{};
+    uint64_t n_in_flight{};
+    bool is_writing{false};
+
+    std::array<command_t, max_window> outstanding{};
+    command_t partial{};
+    std::string line_buffer{};
+    bool is_reading{false};
+
+    /** First error of the serial link. The transport fails for good. */
+    std::string failure{};
+
+    /** Notified by the completion handlers, under asio_scheduler_t. */
+    boost::fibers::mutex progress_mutex{};
+    boost::fibers::condition_variable progress{};
+
+    serial_stats_t statistics{};
+
+    void queue(std::string_view bytes) {
+        for (const char c : bytes) {
+            if (partial.length == 0 && ack_window > 0 && n_sent - n_acked == ack_window) {
+                // The command enters the ack window here. Wait for a slot.
+                flush();
+                pumpUntil([&]() { return n_sent - n_acked < ack_window; });
+            }
+            if (pending.size() == write_capacity) {
+                flush();
+                pumpUntil([&]() { return pending.size() < write_capacity; });
+            }
+
+            pending.push_back(c);
+            if (partial.length < max_command_length) {
+                partial.text[partial.length] = c;
+            }
+            partial.length++;
+            if (c == '\n') {
+                completeCommand();
+            }
+        }
+    }
+
+    void completeCommand() {
+        partial.length = std::min(partial.length - 1, max_command_length);
+        if (ack_window > 0) {
+            outstanding[n_sent % max_window] = partial;
+        }
+        partial.length = 0;
+        n_sent++;
+        n_pending++;
+        statistics.commands++;
+        statistics.max_outstanding =
+            std::max<size_t>(statistics.max_outstanding, n_sent - n_acked);
+        read();
+    }
+
+    /** Write the pending bytes, unless a write is in flight already. */
+    void flush() {
+        if (is_writing || pending.empty() || !failure.empty()) {
+            return;
+        }
+        std::swap(pending, in_flight);
+        n_in_flight = n_pending;
+        n_pending = 0;
+        is_writing = true;
+        statistics.writes++;
+        asio::async_write(stream, asio::buffer(in_flight),
+                          [this](const asio::error_code& ec, size_t) {
+                              is_writing = false;
+                              if (ec) {
+                                  fail(fmt::format(FMT_STRING("Serial write failed: {:s}"),
+                                                   ec.message()));
+                                  return;
+                              }
+                              n_written += n_in_flight;
+                              in_flight.clear();
+                              flush();
+                              progress.notify_all();
+                          });
+    }
+
+    /** Read the next acknowledgement, if any command awaits one. */
+    void read() {
+        if (ack_window == 0 || is_reading || n_acked == n_sent || !failure.empty()) {
+            return;
+        }
+        is_reading = true;
+        asio::async_read_until(
+            stream, asio::dynamic_buffer(line_buffer, line_capacity), '\n',
+            [this](const asio::error_code& ec, size_t n) {
+                is_reading = false;
+                if (ec) {
+                    fail(fmt::format(FMT_STRING("Serial read failed: {:s}"), ec.message()));
+                    return;
+                }
+                std::string_view line{line_buffer.data(), n - 1};
+                if (!line.empty() && line.back() == '\r') {
+                    line.remove_suffix(1);
+                }
+                acknowledge(line);
+                line_buffer.erase(0, n);
+                read();
+                progress.notify_all();
+            });
+    }
+
+    /** Match the reply to the oldest command awaiting acknowledgement. */
+    void acknowledge(std::string_view reply) {
+        if (n_acked == n_sent) {
+            statistics.unsolicited++;
+            return;
+        }
+        const auto& command = outstanding[n_acked % max_window];
+        if (reply.substr(0, 3) == "ERR") {
+            if (command.is_rejection_allowed) {
+                last_rejected = n_acked + 1;
+                statistics.rejected++;
+            } else {
+                fail(fmt::format(FMT_STRING("Serial command `{:s}` rejected: {:s}"),
+                                 command.view(), reply));
+            }
+        }
+        n_acked++;
+        statistics.acks++;
+    }
+
+    void fail(std::string message) {
+        if (failure.empty()) {
+            failure = std::move(message);
+        }
+        progress.notify_all();
+    }
+
+    /** Wait until the condition holds. Under asio_scheduler_t, suspend the
+     * fiber until a completion handler makes it hold. Otherwise, run the asio
+     * event loop, yielding to the other fibers whenever there is no I/O to
+     * complete.
+     *
+     * @returns false on the deadline.
+     */
+    template <typename Condition>
+    bool pumpUntil(Condition&& is_done, const std::chrono::steady_clock::time_point deadline) {
+        if (asio_scheduler_t::running() == &io) {
+            std::unique_lock<boost::fibers::mutex> lock{progress_mutex};
+            if (!progress.wait_until(lock, deadline,
+                                     [&]() { return !failure.empty() || is_done(); })) {
+                return false;
+            }
+        }
+        while (failure.empty() && !is_done()) {
+            if (io.stopped()) {
+                io.restart();
+            }
+            if (io.poll() > 0) {
+                continue;
+            }
+            if (std::chrono::steady_clock::now() > deadline) {
+                return false;
+            }
+            boost::this_fiber::yield();
+        }
+        if (!failure.empty()) {
+            throw std::runtime_error(failure);
+        }
+        return true;
+    }
+
+    /** As above, up to the ack timeout. */
+    template <typename Condition>
+    void pumpUntil(Condition&& is_done) {
+        if (!pumpUntil(std::forward<Condition>(is_done),
+                       std::chrono::steady_clock::now() + ack_timeout)) {
+            throw asio::system_error{asio::error::timed_out, "Serial command not acknowledged"};
+        }
+    }
+};
+
+}  // namespace message_router
@@ -10,8 +10,10 @@
 #ifdef USING_FIBER
 
 #include <boost/fiber/all.hpp>
-using boost::this_fiber::sleep_for;
+
+#include "virtual-clock.h"
 using boost::this_fiber::yield;
+using simulator::sleep_for;
 
 #else
 
@@ -73,15 +75,14 @@ FrameCaptureCard<USBInterface>::captureSingleFrame(span<uint8_t> image_buffer,
                 break;
             }
         }
+        capture_stats.header_resyncs += error_cnt;
         if (error_cnt >= error_limit) {
             throw std::runtime_error("Cannot find image header");
         }
     }
 
     // Seek the image header
-    const runway_t runway = usb.template decode<runway_t>();
-    const int32_t header_offset =
-        sizeof(full_header_t) - runway.offset * sizeof(runway_t) - sizeof(header_t);
+    const int32_t header_offset = headerOffset(usb.template decode<runway_t>());
 
     // Cast to header C-struct
     const header_t header = usb.template decode<header_t>(header_offset);
@@ -1,4 +1,6 @@
 #pragma once
+#include <array>
+#include <bitset>
 #include <chrono>
 #include <stdexcept>
 
@@ -6,28 +8,122 @@
 #include <nonstd/span.hpp>
 
 #include "frame-commands.h"
+#include "register-shadow.h"
 
 namespace message_router {
 using namespace std::chrono_literals;
+using frame_capture_card::commands::i2c_batch_write_t;
 using nonstd::span;
 
+/** Cumulative statistics of the USB byte stream. */
+struct capture_stats_t {
+    /** Bulk transfers skipped while searching for the frame header. */
+    uint64_t header_resyncs{};
+};
+
+/** Failed i2c commands of a batched transfer. */
+using i2c_failure_mask_t = std::bitset<i2c_batch_write_t::max_count>;
+
 template <class USBInterface>
 class FrameCaptureCard {
    public:
     FrameCaptureCard(uint8_t usb_id);
 
+    /** Forward the extra arguments, e.g. the capture file path of ReplayUSB,
+     * to the USB interface. */
+    template <typename... Args>
+    FrameCaptureCard(uint8_t usb_id, Args&&... args) : usb{usb_id, std::forward<Args>(args)...} {}
+
     /** Transmit the commands over the USB3.0 port. The FPGAs on the frame
      * capture cards internally routes the signals to either the 2nd stage
-     * FPGAs, or boradcasts the messages to all 96 CMOS sensors. */
-    template <class Command>
+     * FPGAs, or boradcasts the messages to all 96 CMOS sensors.
+     *
+     * i2c commands are skipped if the CMOS registers already hold the values.
+     */
+    template <class Command, typename = std::enable_if_t<
+                                 !std::is_same_v<std::decay_t<Command>, i2c_batch_write_t>>>
     [[nodiscard]] bool sendCommand(Command&& cmd) {
-        if constexpr (USBInterface::is_mock &&
-                      std::is_same_v<Command, frame_capture_card::commands::write_led_id_t>) {
+        using namespace frame_capture_card::commands;
+        using T = std::decay_t<Command>;
+
+        if constexpr (USBInterface::is_mock && std::is_same_v<T, write_led_id_t>) {
             usb.led_id = cmd.value;
         }
+
+        if constexpr (std::is_same_v<T, i2c_cmd_t>) {
+            if (register_shadow.matches(cmd.addr, cmd.value)) {
+                return true;
+            }
+            const bool is_transmitted = usb.control_write(cmd);
+            if (is_transmitted) {
+                register_shadow.update(cmd.addr, cmd.value);
+            }
+            return is_transmitted;
+        } else if constexpr (std::is_same_v<T, reset_t>) {
+            register_shadow.invalidate();
+        }
+
         return usb.control_write(std::forward<Command>(cmd));
     }
 
+    /** Transmit the batched i2c commands in a single USB control transfer, and
+     * then read back the per-command acknowledgement from the FPGA.
+     *
+     * Only the registers differing from the shadow copy are transmitted. If
+     * none differs, no control transfer takes place.
+     *
+     * @return The i-th bit is set if the i-th i2c command failed. If the
+     * control transfer itself failed, all commands in the batch are flagged.
+     */
+    [[nodiscard]] i2c_failure_mask_t sendCommand(const i2c_batch_write_t& batch) {
+        using frame_capture_card::commands::read_i2c_batch_status_t;
+
+        if (batch.count > batch.max_count) {
+            return i2c_failure_mask_t{}.set();
+        }
+
+        // Drop the commands already in effect, as of the commands before them
+        // in the batch: a register may be written twice, and the software
+        // reset restores the defaults. Remember their original position in the
+        // batch for failure reporting.
+        i2c_batch_write_t diff{};
+        std::array<uint8_t, i2c_batch_write_t::max_count> position{};
+        auto registers = register_shadow;
+        for (uint8_t i = 0; i < batch.count; i++) {
+            const auto& cmd = batch.commands[i];
+            if (!registers.matches(cmd.addr, cmd.value)) {
+                position[diff.count] = i;
+                diff.push_back(cmd);
+            }
+            registers.update(cmd.addr, cmd.value);
+        }
+
+        if (diff.count == 0) {
+            return {};
+        }
+
+        const i2c_failure_mask_t nack_mask =
+            usb.control_write(diff)
+                ? i2c_failure_mask_t{usb.template control_read<read_i2c_batch_status_t>().nack_mask}
+                : i2c_failure_mask_t{}.set();
+
+        i2c_failure_mask_t failed{};
+        for (uint8_t i = 0; i < diff.count; i++) {
+            const auto& cmd = diff.commands[i];
+            if (nack_mask[i]) {
+                failed.set(position[i]);
+            } else {
+                register_shadow.update(cmd.addr, cmd.value);
+            }
+        }
+        return failed;
+    }
+
+    /** Forget the shadow copy of the CMOS registers, e.g. after the sensors
+     * are power-cycled. The next i2c commands are transmitted unconditionally.
+     */
+    void invalidateRegisterShadow() { register_shadow.invalidate(); }
+
     /** Query the capture card's ID.
      *
      * If the USB interface is a mock class, simulate the board ID with the USB
@@ -38,7 +134,7 @@ class FrameCaptureCard {
         if constexpr (USBInterface::is_mock) {
             return usb.id;
         } else {
-            return usb.control_read(frame_capture_card::commands::read_board_id_t{});
+            return usb.template control_read<frame_capture_card::commands::read_board_id_t>().value;
         }
     }
 
@@ -54,8 +150,14 @@ class FrameCaptureCard {
     frame_capture_card::frame_metadata_t captureSingleFrame(
         span<uint8_t> image_buffer, const std::chrono::milliseconds timeout = 400ms);
 
+    const capture_stats_t& stats() const { return capture_stats; }
+
    private:
     USBInterface usb;
+    capture_stats_t capture_stats{};
+
+    /** Per-board shadow copy of the CMOS registers. */
+    RegisterShadow<> register_shadow{};
 };
 }  // namespace message_router
 
@@ -43,6 +43,9 @@ class MessageOverSerial {
 
     // Z-motion
     void sendCommand(message::motion::move_to_z);
+
+    // Query the end of the motion, acknowledged once the instrument settles
+    void sendCommand(message::WaitSettled);
 };
 
 }  // namespace message_router
\ No newline at end of file
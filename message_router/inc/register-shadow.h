@@ -0,0 +1,72 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace message_router {
+
+/** CCS-compliant CMOS sensors restore all registers to the power-on defaults
+ * on software reset. */
+constexpr uint16_t software_reset_register{0x0103};
+
+/** Shadow copy of the CMOS sensor registers, as last acknowledged by the 24
+ * cameras on the same frame capture card.
+ *
+ * The i2c commands are broadcasted to all cameras of the board, so one shadow
+ * copy per board suffices. The shadow copy is a small, fixed-capacity table
+ * with linear search. It never allocates. Registers beyond the capacity are
+ * simply not cached, i.e. always transmitted.
+ */
+template <size_t capacity = 128>
+class RegisterShadow {
+   public:
+    /** Return true if the register is known to hold the value already. */
+    constexpr bool matches(uint16_t addr, uint8_t value) const {
+        const auto* entry = find(addr);
+        return entry != nullptr && entry->value == value;
+    }
+
+    /** Record the acknowledged register value. */
+    constexpr void update(uint16_t addr, uint8_t value) {
+        if (addr == software_reset_register) {
+            // All registers are reset, and the reset register is self-clearing.
+            invalidate();
+            return;
+        }
+
+        if (auto* entry = find(addr); entry != nullptr) {
+            entry->value = value;
+        } else if (count < capacity) {
+            entries[count++] = {addr, value};
+        }
+    }
+
+    /** Forget all register values, e.g. after the FPGA or the sensors are reset. */
+    constexpr void invalidate() { count = 0; }
+
+    constexpr size_t size() const { return count; }
+
+   private:
+    struct entry_t {
+        uint16_t addr{};
+        uint8_t value{};
+    };
+
+    std::array<entry_t, capacity> entries{};
+    size_t count{};
+
+    constexpr const entry_t* find(uint16_t addr) const {
+        for (size_t i = 0; i < count; i++) {
+            if (entries[i].addr == addr) {
+                return &entries[i];
+            }
+        }
+        return nullptr;
+    }
+
+    constexpr entry_t* find(uint16_t addr) {
+        return const_cast<entry_t*>(static_cast<const RegisterShadow&>(*this).find(addr));
+    }
+};
+
+}  // namespace message_router
@@ -0,0 +1,193 @@
+#include "asio-scheduler.h"
+
+#include <algorithm>
+#include <asio/post.hpp>
+#include <boost/fiber/operations.hpp>
+
+namespace message_router {
+
+using boost::fibers::context;
+
+namespace {
+
+/** The event loop of the asio_scheduler_t of this thread, while it runs. */
+thread_local asio::execution_context* running_loop = nullptr;
+
+}  // namespace
+
+asio_scheduler_t::asio_scheduler_t(asio::io_context& io_context) : io{io_context} {
+    asio::post(io, [this]() { runLoop(); });
+}
+
+asio::execution_context*
+asio_scheduler_t::running() {
+    return running_loop;
+}
+
+void
+asio_scheduler_t::runLoop() {
+    asio::steady_timer timer{io};
+    loop_context = context::active();
+    wake_timer = &timer;
+    running_loop = &io;
+    is_loop_running = true;
+    while (!io.stopped()) {
+        if (n_ready_fibers > 0) {
+            // Complete the I/O ready so far. Then leave the thread to the
+            // ready fibers, up to the next poll or until they all suspend.
+            io.poll();
+            std::unique_lock<boost::fibers::mutex> lock{loop_mutex};
+            loop_idle.wait_for(lock, poll_interval);
+            continue;
+        }
+
+        // No other fiber is ready. Suspend, for the fiber manager to arm the
+        // wake timer with the earliest fiber due in suspend_until().
+        {
+            std::unique_lock<boost::fibers::mutex> lock{loop_mutex};
+            loop_idle.wait(lock);
+        }
+        if (n_ready_fibers == 0) {
+            // Block the thread in the reactor until an I/O completes, the
+            // wake timer expires, or a fiber of another thread is ready. The
+            // loop itself is outstanding work, so run_one() does not return
+            // for lack of work.
+            io.run_one();
+        }
+
+        // Let the fiber manager move the fibers due to the ready queue.
+        boost::this_fiber::yield();
+    }
+    is_loop_running = false;
+    loop_context = nullptr;
+    running_loop = nullptr;
+    wake_timer = nullptr;
+    wake_at = std::chrono::steady_clock::time_point::max();
+}
+
+void
+asio_scheduler_t::awakened(context* ctx, priority_props_t& props) noexcept {
+    // The dispatcher moves the fibers due to the ready queue, and the fiber
+    // yielding back to the ready queue. Rotate it with the running fiber, or
+    // with the ready fibers of a higher priority, so that those cannot starve
+    // the others of wake-ups, nor pass through it at every switch.
+    if (ctx->is_context(boost::fibers::type::dispatcher_context)) {
+        dispatcher = ctx;
+        context* running = context::active();
+        dispatcher_priority = priorityOf(running, running->get_properties());
+        for (auto p = fiber_priority_t::CRITICAL; p > dispatcher_priority;
+             p = static_cast<fiber_priority_t>(static_cast<size_t>(p) - 1)) {
+            if (!ready[static_cast<size_t>(p)].empty()) {
+                dispatcher_priority = p;
+                break;
+            }
+        }
+        ctx->ready_link(ready[static_cast<size_t>(dispatcher_priority)]);
+        return;
+    }
+
+    const auto priority = priorityOf(ctx, &props);
+    n_ready_fibers++;
+    ctx->ready_link(ready[static_cast<size_t>(priority)]);
+
+    if (dispatcher != nullptr && dispatcher->ready_is_linked() && priority > dispatcher_priority) {
+        dispatcher->ready_unlink();
+        dispatcher_priority = priority;
+        dispatcher->ready_link(ready[static_cast<size_t>(priority)]);
+    }
+}
+
+fiber_priority_t
+asio_scheduler_t::priorityOf(context* ctx,
+                             const boost::fibers::fiber_properties* props) const noexcept {
+    // The event loop polls the reactor for the serial port of the critical
+    // fibers.
+    if (ctx == loop_context) {
+        return fiber_priority_t::CRITICAL;
+    } else if (props == nullptr) {
+        return fiber_priority_t::NORMAL;
+    }
+    return static_cast<const priority_props_t*>(props)->priority();
+}
+
+void
+asio_scheduler_t::property_change(context* ctx, priority_props_t& props) noexcept {
+    if (!ctx->ready_is_linked()) {
+        return;
+    }
+    ctx->ready_unlink();
+    if (!ctx->is_context(boost::fibers::type::dispatcher_context)) {
+        n_ready_fibers--;
+    }
+    awakened(ctx, props);
+}
+
+context*
+asio_scheduler_t::pick_next() noexcept {
+    // The highest priority first.
+    for (auto queue = ready.rbegin(); queue != ready.rend(); queue++) {
+        if (!queue->empty()) {
+            context* ctx = &queue->front();
+            queue->pop_front();
+            if (!ctx->is_context(boost::fibers::type::dispatcher_context)) {
+                n_ready_fibers--;
+            }
+            return ctx;
+        }
+    }
+    return nullptr;
+}
+
+bool
+asio_scheduler_t::has_ready_fibers() const noexcept {
+    return std::any_of(ready.begin(), ready.end(),
+                       [](const auto& queue) { return !queue.empty(); });
+}
+
+void
+asio_scheduler_t::suspend_until(const std::chrono::steady_clock::time_point& t) noexcept {
+    if (is_loop_running) {
+        // No fiber is ready, and the event loop waits for the wake timer.
+        // Resume it, to block in the reactor up to the earliest fiber due.
+        // Re-arming cancels the wait in flight, which returns from the
+        // reactor at once. Arm only for a new time.
+        if (t != wake_at) {
+            wake_at = t;
+            if (t == std::chrono::steady_clock::time_point::max()) {
+                wake_timer->cancel();
+            } else {
+                wake_timer->expires_at(t);
+                wake_timer->async_wait([this](const asio::error_code& ec) {
+                    if (!ec) {
+                        wake_at = std::chrono::steady_clock::time_point::max();
+                    }
+                });
+            }
+        }
+        loop_idle.notify_one();
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock{mutex};
+    if (t == std::chrono::steady_clock::time_point::max()) {
+        notified.wait(lock, [this]() { return is_notified; });
+    } else {
+        notified.wait_until(lock, t, [this]() { return is_notified; });
+    }
+    is_notified = false;
+}
+
+void
+asio_scheduler_t::notify() noexcept {
+    // A fiber of another thread woke one of ours. Return from the reactor.
+    if (is_loop_running) {
+        asio::post(io, []() {});
+    }
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        is_notified = true;
+    }
+    notified.notify_all();
+}
+
+}  // namespace message_router
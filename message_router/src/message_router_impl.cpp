@@ -3,7 +3,18 @@
 #include <array>
 #include <asio.hpp>
 
+#ifdef ASYNC_SERIAL
+#include "async-serial-transport.h"
+#endif
+#include "hot-log.h"
 #include "message_router.h"
+#ifdef MOCK_SERIAL
+#include "mock_serial.h"
+#endif
+#ifdef SIMULATED_SERIAL
+#include "simulated_serial.h"
+#endif
+#include "trace.h"
 
 namespace message_router {
 
@@ -11,6 +22,7 @@ namespace impl {
 template <class SerialInterface>
 void
 executeCommand(SerialInterface& serial, std::string_view message) {
+    TRACE_SCOPE("serial", "command");
     asio::write(serial, asio::buffer(message));
     // asio::read_until(serial, asio::buffer(buffer.data(), buffer.size()), '\n');
 }
@@ -18,6 +30,7 @@ executeCommand(SerialInterface& serial, std::string_view message) {
 template <class SerialInterface, typename FmtString, typename... Args>
 void
 executeCommand(SerialInterface& serial, FmtString fmt_string, Args&&... args) {
+    TRACE_SCOPE("serial", "command");
     constexpr auto size = 16;
     std::array<char, size> buffer;
     const auto [_, message_length] = fmt::format_to_n(
@@ -41,7 +54,17 @@ MessageOverSerial<SerialInterface>::MessageOverSerial(SerialInterface& s) : seri
 template class message_router::MessageOverSerial<asio::serial_port>;
 
 #ifdef MOCK_SERIAL
-// Physical serial devices, e.g. Arduino UNO R3, are very checp. We don't
-// reallly need a mock serial for testing.
-template class message_router::MessageOverSerial<MockSerial>;
-#endif
\ No newline at end of file
+// The mock serial is for measuring the command encoding alone. For the serial
+// link end to end without the instrument, run capture-images against
+// firmware-emulator.
+template class message_router::MessageOverSerial<hardware_drivers::MockSerial>;
+#endif
+
+#ifdef SIMULATED_SERIAL
+template class message_router::MessageOverSerial<hardware_drivers::SimulatedSerial>;
+#endif
+
+#ifdef ASYNC_SERIAL
+template class message_router::MessageOverSerial<
+    message_router::AsyncSerialTransport<asio::serial_port>>;
+#endif
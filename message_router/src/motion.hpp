@@ -9,4 +9,10 @@ void
 MessageOverSerial<S>::sendCommand(motion::move_to_z z) {
     impl::executeCommand(serial, "z {:d}\n", z.value);
 }
+
+template <class S>
+void
+MessageOverSerial<S>::sendCommand(message::WaitSettled) {
+    impl::executeCommand(serial, "s\n");
+}
 }  // namespace message_router
@@ -0,0 +1,182 @@
+#include <time.h>
+
+#include <asio.hpp>
+#include <boost/fiber/all.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "asio-scheduler.h"
+#include "async-serial-transport.h"
+#include "firmware_emulator.h"
+
+using hardware_drivers::ack_mode_t;
+using hardware_drivers::firmware_config_t;
+using hardware_drivers::FirmwareEmulator;
+using message_router::asio_scheduler_t;
+using message_router::fiber_priority_t;
+using message_router::priority_props_t;
+using namespace std::chrono_literals;
+using std::chrono::steady_clock;
+namespace fiber_io = message_router::fiber_io;
+
+namespace {
+
+/** Firmware with a fast z-stage: 30um take 30ms to travel, then 20ms to
+ * settle. */
+firmware_config_t
+fastStage() {
+    firmware_config_t config{};
+    config.command_latency = 1ms;
+    config.z_velocity = 1000.0;
+    config.z_settle = 20ms;
+    config.ack = ack_mode_t::ON_COMPLETION;
+    return config;
+}
+
+/** Run the function in a fiber under asio_scheduler_t, on a thread of its
+ * own, with the event loop in the main fiber. */
+template <typename Function>
+void
+withAsioScheduler(asio::io_context& io, Function&& f) {
+    std::thread t{[&]() {
+        boost::fibers::use_scheduling_algorithm<asio_scheduler_t>(io);
+        boost::fibers::fiber task{[&]() {
+            f();
+            io.stop();
+        }};
+        io.run();
+        task.join();
+    }};
+    t.join();
+}
+
+std::chrono::nanoseconds
+threadCpuTime() {
+    timespec t{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return std::chrono::seconds{t.tv_sec} + std::chrono::nanoseconds{t.tv_nsec};
+}
+
+}  // namespace
+
+TEST_CASE("Run the other fibers while one waits for the serial port", "[asio_scheduler]") {
+    FirmwareEmulator firmware{fastStage()};
+    std::thread device{[&]() { firmware.serve(); }};
+
+    asio::io_context io;
+    withAsioScheduler(io, [&]() {
+        asio::serial_port serial{io, firmware.path()};
+        int n_ticks = 0;
+        bool is_done = false;
+        boost::fibers::fiber ticker{[&]() {
+            while (!is_done) {
+                boost::this_fiber::sleep_for(5ms);
+                n_ticks++;
+            }
+        }};
+
+        const auto start = steady_clock::now();
+        fiber_io::write(serial, asio::buffer(std::string{"z 30\n"}));
+        std::string reply{};
+        fiber_io::readUntil(serial, asio::dynamic_buffer(reply), '\n');
+        const auto elapsed = steady_clock::now() - start;
+        is_done = true;
+        ticker.join();
+
+        CHECK(reply == "OK\n");
+        CHECK(elapsed >= 51ms);
+
+        // Woken by the reply, not by a periodic tick.
+        CHECK(elapsed < 80ms);
+        CHECK(n_ticks >= 5);
+        serial.close();
+    });
+    device.join();
+}
+
+TEST_CASE("Wake the sleeping fibers from the reactor on time", "[asio_scheduler]") {
+    asio::io_context io;
+    withAsioScheduler(io, [&]() {
+        auto start = steady_clock::now();
+        boost::this_fiber::sleep_for(20ms);
+        CHECK(steady_clock::now() - start >= 20ms);
+        CHECK(steady_clock::now() - start < 35ms);
+
+        asio::steady_timer timer{io, 20ms};
+        start = steady_clock::now();
+        fiber_io::wait(timer);
+        CHECK(steady_clock::now() - start < 35ms);
+    });
+}
+
+TEST_CASE("Wait for the acknowledgements without spinning", "[asio_scheduler]") {
+    FirmwareEmulator firmware{fastStage()};
+    std::thread device{[&]() { firmware.serve(); }};
+
+    asio::io_context io;
+    std::chrono::nanoseconds cpu_time{};
+    steady_clock::duration elapsed{};
+    withAsioScheduler(io, [&]() {
+        message_router::AsyncSerialTransport<asio::serial_port> serial{io, 2};
+        serial.next_layer().open(firmware.path());
+
+        const auto cpu_start = threadCpuTime();
+        const auto start = steady_clock::now();
+        for (int i = 0; i < 4; i++) {
+            serial.send((i % 2 == 0) ? "z 30\n" : "z 0\n");
+        }
+        serial.awaitAll();
+        elapsed = steady_clock::now() - start;
+        cpu_time = threadCpuTime() - cpu_start;
+
+        CHECK(serial.stats().acks == 4);
+        serial.close();
+    });
+    device.join();
+
+    CHECK(elapsed >= 4 * 51ms);
+    CHECK(cpu_time < elapsed / 4);
+}
+
+TEST_CASE("Run the critical fibers ahead of the others", "[asio_scheduler]") {
+    asio::io_context io;
+    std::string order{};
+    withAsioScheduler(io, [&]() {
+        auto task = [&](char name) {
+            for (int i = 0; i < 3; i++) {
+                order.push_back(name);
+                boost::this_fiber::yield();
+            }
+        };
+
+        // Ready in the reverse order of their priorities.
+        boost::fibers::fiber writer{task, 'B'};
+        boost::fibers::fiber other{task, 'N'};
+        boost::fibers::fiber capture{task, 'C'};
+        writer.properties<priority_props_t>().setPriority(fiber_priority_t::BACKGROUND);
+        capture.properties<priority_props_t>().setPriority(fiber_priority_t::CRITICAL);
+
+        writer.join();
+        other.join();
+        capture.join();
+    });
+    CHECK(order == "CCCNNNBBB");
+}
+
+TEST_CASE("Run the event loop in the caller without the scheduler", "[asio_scheduler]") {
+    FirmwareEmulator firmware{fastStage()};
+    std::thread device{[&]() { firmware.serve(); }};
+
+    asio::io_context io;
+    asio::serial_port serial{io, firmware.path()};
+    fiber_io::write(serial, asio::buffer(std::string{"n\n"}));
+    std::string reply{};
+    CHECK(fiber_io::readUntil(serial, asio::dynamic_buffer(reply), '\n') == 3);
+    CHECK(reply == "OK\n");
+
+    serial.close();
+    device.join();
+}
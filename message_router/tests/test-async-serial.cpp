@@ -0,0 +1,215 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <array>
+#include <asio.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "async-serial-transport.h"
+#include "message_router.h"
+
+using message_router::AsyncSerialTransport;
+using message_router::MessageOverSerial;
+using namespace std::chrono_literals;
+
+namespace {
+
+using transport_t = AsyncSerialTransport<asio::serial_port>;
+
+/** Firmware on a pseudo-terminal, replying to each serial command. */
+class AckingSerialDevice {
+   public:
+    using reply_fn = std::function<std::string(const std::string&)>;
+
+    explicit AckingSerialDevice(reply_fn r = [](const std::string&) { return "OK\n"; })
+        : master{posix_openpt(O_RDWR | O_NOCTTY)}, reply{std::move(r)} {
+        if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+            throw std::runtime_error("Cannot open pseudo-terminal");
+        }
+        path = ptsname(master);
+
+        // read() fails with EIO once the serial port is closed.
+        firmware = std::thread{[this]() {
+            std::array<char, 256> buffer;
+            ssize_t n;
+            while ((n = ::read(master, buffer.data(), buffer.size())) > 0) {
+                for (ssize_t i = 0; i < n; i++) {
+                    line.push_back(buffer[i]);
+                    if (buffer[i] == '\n') {
+                        respond();
+                    }
+                }
+            }
+        }};
+    }
+
+    ~AckingSerialDevice() {
+        if (firmware.joinable()) {
+            firmware.join();
+        }
+        ::close(master);
+    }
+
+    std::vector<std::string> received() {
+        firmware.join();
+        return commands;
+    }
+
+    std::string path{};
+
+   private:
+    int master;
+    reply_fn reply;
+    std::string line{};
+    std::vector<std::string> commands{};
+    std::thread firmware{};
+
+    void respond() {
+        commands.push_back(line);
+        const auto r = reply(line);
+        line.clear();
+        if (!r.empty() && ::write(master, r.data(), r.size()) < 0) {
+            throw std::runtime_error("Cannot reply to the serial port");
+        }
+    }
+};
+
+}  // namespace
+
+TEST_CASE("Coalesce the commands sent while a write is in flight", "[async_serial]") {
+    AckingSerialDevice device{};
+    asio::io_context io;
+    transport_t serial{io};
+    serial.next_layer().open(device.path);
+    MessageOverSerial encoder{serial};
+
+    encoder.sendCommand(message::led_matrix::switch_to{3, 14});
+    encoder.sendCommand(message::led_matrix::next{});
+    encoder.sendCommand(message::motion::move_to_z{-4});
+
+    // The first command is written at once. The others wait for it, then go
+    // out together.
+    CHECK(serial.stats().writes == 1);
+    serial.close();
+    CHECK(serial.stats().writes == 2);
+    CHECK(serial.stats().commands == 3);
+    CHECK(serial.stats().acks == 0);
+
+    REQUIRE(device.received() == std::vector<std::string>{"m 3 14\n", "n\n", "z -4\n"});
+}
+
+TEST_CASE("Match the acknowledgements to the commands in order", "[async_serial]") {
+    AckingSerialDevice device{};
+    asio::io_context io;
+    transport_t serial{io, 4};
+    serial.next_layer().open(device.path);
+
+    const auto first = serial.send("m 3 14\n");
+    const auto second = serial.send("n\n");
+    CHECK_FALSE(second.isReady());
+
+    second.wait();
+    CHECK(first.isReady());
+    CHECK(serial.stats().acks == 2);
+
+    // The acknowledgement of the encoded commands.
+    MessageOverSerial encoder{serial};
+    encoder.sendCommand(message::led_matrix::next{});
+    serial.lastAck().wait();
+    CHECK(serial.stats().acks == 3);
+    CHECK(serial.stats().unsolicited == 0);
+    serial.close();
+}
+
+TEST_CASE("Bound the commands awaiting acknowledgement", "[async_serial]") {
+    AckingSerialDevice device{[](const std::string&) {
+        std::this_thread::sleep_for(5ms);
+        return "OK\n";
+    }};
+    asio::io_context io;
+    transport_t serial{io, 2};
+    serial.next_layer().open(device.path);
+
+    for (int i = 0; i < 8; i++) {
+        serial.send("n\n");
+    }
+    CHECK(serial.stats().max_outstanding == 2);
+
+    serial.close();
+    CHECK(serial.stats().acks == 8);
+    REQUIRE(device.received().size() == 8);
+}
+
+TEST_CASE("Fail the command rejected by the firmware", "[async_serial]") {
+    AckingSerialDevice device{[](const std::string& command) {
+        return (command[0] == 'z') ? "ERR out of range\n" : "OK\n";
+    }};
+    asio::io_context io;
+    transport_t serial{io, 4};
+    serial.next_layer().open(device.path);
+
+    serial.send("m 3 14\n").wait();
+    const auto move = serial.send("z 99999\n");
+    REQUIRE_THROWS_AS(move.wait(), std::runtime_error);
+}
+
+TEST_CASE("Let the firmware reject a query without failing", "[async_serial]") {
+    AckingSerialDevice device{[](const std::string& command) {
+        return (command == "s\n") ? "ERR unknown command\n" : "OK\n";
+    }};
+    asio::io_context io;
+    transport_t serial{io, 4};
+    serial.next_layer().open(device.path);
+
+    const auto settled = serial.send("s\n");
+    serial.allowRejection();
+    REQUIRE(settled.waitFor(1s));
+    CHECK(settled.isRejected());
+
+    // The transport carries on.
+    const auto next = serial.send("n\n");
+    next.wait();
+    CHECK_FALSE(next.isRejected());
+    CHECK(serial.stats().rejected == 1);
+    serial.close();
+}
+
+TEST_CASE("Time out on a silent firmware", "[async_serial]") {
+    AckingSerialDevice device{[](const std::string&) { return ""; }};
+    asio::io_context io;
+    transport_t serial{io, 4, 50ms};
+    serial.next_layer().open(device.path);
+
+    const auto start = std::chrono::steady_clock::now();
+    REQUIRE_THROWS_AS(serial.send("n\n").wait(), asio::system_error);
+    CHECK(std::chrono::steady_clock::now() - start >= 50ms);
+}
+
+TEST_CASE("Give up waiting for one command at its own timeout", "[async_serial]") {
+    AckingSerialDevice device{[](const std::string&) {
+        std::this_thread::sleep_for(100ms);
+        return "OK\n";
+    }};
+    asio::io_context io;
+    transport_t serial{io, 4};
+    serial.next_layer().open(device.path);
+
+    const auto settled = serial.send("s\n");
+    REQUIRE_FALSE(settled.waitFor(20ms));
+
+    // The late acknowledgement still completes the command.
+    REQUIRE(settled.waitFor(1s));
+    serial.close();
+}
+
+TEST_CASE("Reject an ack window beyond the capacity", "[async_serial]") {
+    asio::io_context io;
+    REQUIRE_THROWS_AS((AsyncSerialTransport<asio::serial_port, 4>{io, 5}), std::invalid_argument);
+}
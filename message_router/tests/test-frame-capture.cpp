@@ -1,9 +1,12 @@
 #include <array>
 #include <catch2/catch_test_macros.hpp>
+#include <type_traits>
 
 #include "constants.h"
 #include "frame-capture-card.h"
 #include "mock_usb.h"
+#include "recording_usb.h"
+#include "replay_usb.h"
 
 TEST_CASE("Read the entire frame", "[get_image]") {
     using hardware_drivers::MockUSB;
@@ -17,4 +20,136 @@ TEST_CASE("Read the entire frame", "[get_image]") {
         frame_capture_card.captureSingleFrame<assume_fifo_always_full>(raw_pixels);
     REQUIRE(cam_id == 0x04);
     REQUIRE(led_id == 0xEE);
-}
\ No newline at end of file
+}
+
+TEST_CASE("Replay the recorded frames", "[replay_usb]") {
+    using hardware_drivers::MockUSB;
+    using hardware_drivers::RecordingUSB;
+    using hardware_drivers::ReplayUSB;
+    using message_router::FrameCaptureCard;
+
+    const char* capture_path = "test-frame-capture.cap";
+    std::vector<uint8_t> raw_pixels(camera::n_pixels);
+    std::vector<frame_capture_card::frame_metadata_t> recorded;
+
+    {
+        FrameCaptureCard<RecordingUSB<MockUSB>> recording_card(1, capture_path);
+        for (int i = 0; i < 3; i++) {
+            recorded.push_back(recording_card.captureSingleFrame(raw_pixels));
+        }
+    }
+
+    FrameCaptureCard<ReplayUSB> replay_card(0, capture_path);
+    REQUIRE(replay_card.readBoardID() == 1);
+    for (const auto& [cam_id, led_id] : recorded) {
+        const auto replayed = replay_card.captureSingleFrame(raw_pixels);
+        REQUIRE(replayed.cam_id == cam_id);
+        REQUIRE(replayed.led_id == led_id);
+    }
+    std::remove(capture_path);
+}
+
+TEST_CASE("Send the camera init sequence in one batch", "[i2c]") {
+    using frame_capture_card::commands::i2c_batch_write_t;
+    using hardware_drivers::MockUSB;
+    message_router::FrameCaptureCard<MockUSB> frame_capture_card(0);
+
+    i2c_batch_write_t batch{};
+    for (uint16_t i = 0; i < i2c_batch_write_t::max_count; i++) {
+        REQUIRE(batch.push_back({i, 0xff}));
+    }
+    REQUIRE_FALSE(batch.push_back({0xffff, 0xff}));
+    REQUIRE(frame_capture_card.sendCommand(batch).none());
+
+    // Malformed batch is rejected as a whole.
+    batch.count = i2c_batch_write_t::max_count + 1;
+    REQUIRE(frame_capture_card.sendCommand(batch).all());
+}
+
+namespace {
+/** Mock USB counting the control transfers, and keeping the last i2c batch. */
+struct CountingUSB : hardware_drivers::MockUSB {
+    static inline int control_writes = 0;
+    static inline frame_capture_card::commands::i2c_batch_write_t last_batch{};
+
+    using MockUSB::MockUSB;
+
+    template <class Command>
+    [[nodiscard]] bool control_write(Command cmd) const {
+        control_writes++;
+        if constexpr (std::is_same_v<Command, frame_capture_card::commands::i2c_batch_write_t>) {
+            last_batch = cmd;
+        }
+        return MockUSB::control_write(cmd);
+    }
+};
+}  // namespace
+
+TEST_CASE("Skip the CMOS registers already in effect", "[i2c]") {
+    using frame_capture_card::commands::i2c_batch_write_t;
+    using frame_capture_card::commands::i2c_cmd_t;
+    using frame_capture_card::commands::reset_t;
+    message_router::FrameCaptureCard<CountingUSB> frame_capture_card(0);
+
+    i2c_batch_write_t exposure_gain{};
+    exposure_gain.push_back({0x1234, 30});
+    exposure_gain.push_back({0x1235, 0});
+    exposure_gain.push_back({0x1236, 0});
+
+    CountingUSB::control_writes = 0;
+    REQUIRE(frame_capture_card.sendCommand(exposure_gain).none());
+    REQUIRE(CountingUSB::control_writes == 1);
+
+    // Same exposure and gain: no bus traffic.
+    REQUIRE(frame_capture_card.sendCommand(exposure_gain).none());
+    REQUIRE(frame_capture_card.sendCommand(i2c_cmd_t{0x1234, 30}));
+    REQUIRE(CountingUSB::control_writes == 1);
+
+    // Only the exposure register differs.
+    exposure_gain.commands[0].value = 200;
+    REQUIRE(frame_capture_card.sendCommand(exposure_gain).none());
+    REQUIRE(CountingUSB::control_writes == 2);
+
+    // Reset invalidates the shadow copy.
+    REQUIRE(frame_capture_card.sendCommand(reset_t{}));
+    REQUIRE(frame_capture_card.sendCommand(exposure_gain).none());
+    REQUIRE(CountingUSB::control_writes == 4);
+}
+
+TEST_CASE("Diff the batch against the registers written earlier in the batch", "[i2c]") {
+    using frame_capture_card::commands::i2c_batch_write_t;
+    using message_router::software_reset_register;
+    message_router::FrameCaptureCard<CountingUSB> frame_capture_card(0);
+
+    i2c_batch_write_t exposure_gain{};
+    exposure_gain.push_back({0x1234, 30});
+    exposure_gain.push_back({0x1235, 0});
+    REQUIRE(frame_capture_card.sendCommand(exposure_gain).none());
+
+    // The software reset restores the defaults, so the registers after it are
+    // transmitted even though the shadow copy holds them.
+    i2c_batch_write_t reset_init{};
+    reset_init.push_back({software_reset_register, 0x01});
+    reset_init.push_back({0x1234, 30});
+    reset_init.push_back({0x1235, 0});
+    CountingUSB::last_batch = {};
+    REQUIRE(frame_capture_card.sendCommand(reset_init).none());
+    REQUIRE(CountingUSB::last_batch.count == 3);
+    REQUIRE(CountingUSB::last_batch.commands[1].addr == 0x1234);
+    REQUIRE(CountingUSB::last_batch.commands[2].addr == 0x1235);
+
+    // The last write of a register wins, even if the shadow copy holds it.
+    i2c_batch_write_t twice{};
+    twice.push_back({0x1234, 1});
+    twice.push_back({0x1234, 30});
+    CountingUSB::last_batch = {};
+    REQUIRE(frame_capture_card.sendCommand(twice).none());
+    REQUIRE(CountingUSB::last_batch.count == 2);
+    REQUIRE(CountingUSB::last_batch.commands[0].value == 1);
+    REQUIRE(CountingUSB::last_batch.commands[1].value == 30);
+
+    // Both writes are in effect in the shadow copy, in order.
+    const auto n_writes = CountingUSB::control_writes;
+    REQUIRE(frame_capture_card.sendCommand(exposure_gain).none());
+    REQUIRE(CountingUSB::control_writes == n_writes);
+}
@@ -0,0 +1,30 @@
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+
+#include "message_router.h"
+#include "mock_serial.h"
+
+using hardware_drivers::MockSerial;
+using message_router::MessageOverSerial;
+using namespace std::chrono_literals;
+
+TEST_CASE("Encode the serial commands", "[serial]") {
+    MockSerial serial{};
+    MessageOverSerial encoder{serial};
+
+    encoder.sendCommand(message::led_matrix::switch_to{3, 14});
+    REQUIRE(serial.lastCommand() == "m 3 14\n");
+
+    encoder.sendCommand(message::led_matrix::next{});
+    REQUIRE(serial.lastCommand() == "n\n");
+
+    encoder.sendCommand(message::excitation::laser{2s, 16, EGFP});
+    REQUIRE(serial.lastCommand() == "B 2 16 1\n");
+
+    encoder.sendCommand(message::motion::move_to_z{-4});
+    REQUIRE(serial.lastCommand() == "z -4\n");
+    REQUIRE(serial.bytes_written == 7 + 2 + 9 + 5);
+
+    encoder.sendCommand(message::WaitSettled{});
+    REQUIRE(serial.lastCommand() == "s\n");
+}
@@ -1,30 +1,41 @@
 #pragma once
-#include <boost/fiber/buffered_channel.hpp>
+#include <array>
 #include <chrono>
+#include <cstddef>
+#include <utility>
 #include <variant>
 #include <vector>
 
 #include "constants.h"
 #include "fiber-messages.h"
 #include "frame-commands.h"
+#include "instrumented-channel.h"
 
 namespace fiber_messages {
 
 namespace capture {
 
-using completions_signal_t = boost::fibers::buffered_channel<bool>;
+/** Signals carry the time of the event, so that the executor can tell how far
+ * apart the boards are. */
+using completions_signal_t = telemetry::instrumented_channel<std::chrono::steady_clock::time_point>;
 
+/** Capture commands report back to the executor twice: once the exposure of
+ * the frames has elapsed, on `exposure`, if set, and once all frames have
+ * arrived over USB, on `completion`. */
 struct dark_frame_t {
     completions_signal_t* completion{nullptr};
+    completions_signal_t* exposure{nullptr};
 };
 struct fpm_frame_t {
     uint8_t led_id{};
     completions_signal_t* completion{nullptr};
+    completions_signal_t* exposure{nullptr};
 };
 struct fluorescence_frame_t {
     int16_t zpos{};
     channel_t ch{EGFP};
     completions_signal_t* completion{nullptr};
+    completions_signal_t* exposure{nullptr};
 };
 
 namespace camera {
@@ -84,7 +95,27 @@ static_assert(exposure_gain_t::setExposureGain<1>(1'000ms).exposure() == 1'000ms
 
 using command_t = std::variant<dark_frame_t, fpm_frame_t, fluorescence_frame_t,
                                camera::init_sequence_t, camera::exposure_gain_t>;
-using queue_t = boost::fibers::buffered_channel<command_t>;
+using queue_t = telemetry::instrumented_channel<command_t>;
+
+/** Capture queues of all boards, indexed by the USB ID. */
+using queues_t = std::array<queue_t, frame_capture_card::n_boards>;
+
+namespace detail {
+template <size_t... I>
+queues_t
+makeQueues(const size_t capacity, telemetry::channel_stats_t& stats, std::index_sequence<I...>) {
+    auto make = [&](size_t) { return queue_t{capacity, stats}; };
+    return {{make(I)...}};
+}
+}  // namespace detail
+
+/** Create the capture queues of all boards, once their capacity is known,
+ * e.g. after parsing the command line. */
+inline queues_t
+makeQueues(const size_t capacity, telemetry::channel_stats_t& stats) {
+    return detail::makeQueues(capacity, stats,
+                              std::make_index_sequence<frame_capture_card::n_boards>{});
+}
 
 }  // namespace capture
 
@@ -98,7 +129,7 @@ struct dark_frame_t {
 
     constexpr dark_frame_t() = default;
     dark_frame_t(uint8_t b, frame_metadata_t m, std::vector<uint8_t>&& i)
-        : board_id{b}, cam_id{m.cam_id}, image_frame{i} {}
+        : board_id{b}, cam_id{m.cam_id}, image_frame{std::move(i)} {}
 };
 
 struct fpm_frame_t {
@@ -109,7 +140,7 @@ struct fpm_frame_t {
 
     constexpr fpm_frame_t() = default;
     fpm_frame_t(uint8_t b, frame_metadata_t m, std::vector<uint8_t>&& i)
-        : board_id{b}, cam_id{m.cam_id}, led_id{m.led_id}, image_frame{i} {}
+        : board_id{b}, cam_id{m.cam_id}, led_id{m.led_id}, image_frame{std::move(i)} {}
 };
 
 struct fluorescence_frame_t {
@@ -120,7 +151,7 @@ struct fluorescence_frame_t {
     std::vector<uint16_t> image_frame{};
 };
 using command_t = std::variant<dark_frame_t, fpm_frame_t, fluorescence_frame_t>;
-using queue_t = boost::fibers::buffered_channel<command_t>;
+using queue_t = telemetry::instrumented_channel<command_t>;
 
 }  // namespace write
 
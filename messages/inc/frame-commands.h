@@ -1,4 +1,6 @@
 #pragma once
+#include <array>
+#include <cstddef>
 #include <cstdint>
 
 namespace frame_capture_card {
@@ -48,7 +50,45 @@ struct i2c_cmd_t {
     uint16_t addr{};
     uint8_t value{};
 };
+
+/** Transmit up to 64 i2c commands in a single USB control transfer. The FPGA
+ * unpacks the (addr, value) pairs, 2-byte aligned as in i2c_cmd_t, and then
+ * broadcasts them in order to all 24 CMOS cameras through the MIPI bus.
+ *
+ * Only the first `count` pairs are transmitted over the wire.
+ */
+struct i2c_batch_write_t {
+    static constexpr uint16_t dev_addr{fpga_dev_addr};
+    static constexpr uint16_t reg_addr{0x0070};
+    static constexpr size_t max_count = 64;
+
+    uint16_t count{};
+    std::array<i2c_cmd_t, max_count> commands{};
+
+    /** Payload length of the control transfer. */
+    constexpr uint16_t length() const { return sizeof(count) + count * sizeof(i2c_cmd_t); }
+
+    /** Append the command to the batch. Return false if the batch is full. */
+    constexpr bool push_back(i2c_cmd_t cmd) {
+        if (count >= max_count) {
+            return false;
+        }
+        commands[count++] = cmd;
+        return true;
+    }
+};
+static_assert(sizeof(i2c_batch_write_t) ==
+              sizeof(uint16_t) + i2c_batch_write_t::max_count * sizeof(i2c_cmd_t));
 #pragma pack(pop)
 
+/** Read the acknowledgement of the last i2c_batch_write_t. The i-th bit is set
+ * if the i-th i2c command is not acknowledged by the CMOS sensors. */
+struct read_i2c_batch_status_t {
+    static constexpr uint16_t dev_addr{fpga_dev_addr};
+    static constexpr uint16_t reg_addr{0x0071};
+    uint64_t nack_mask{};
+};
+static_assert(i2c_batch_write_t::max_count <= sizeof(read_i2c_batch_status_t::nack_mask) * 8);
+
 }  // namespace commands
 }  // namespace frame_capture_card
\ No newline at end of file
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <cstdio>
 
 namespace frame_capture_card {
@@ -37,5 +38,13 @@ struct full_header_t {
 static_assert(sizeof(full_header_t) == sizeof(uint32_t) * 8);
 #pragma pack(pop)
 
+/** Byte offset of header_t in the bulk transfer, given the first runway word
+ * of the transfer. */
+constexpr int32_t
+headerOffset(const runway_t& runway) {
+    return sizeof(full_header_t) - runway.offset * sizeof(runway_t) - sizeof(header_t);
+}
+static_assert(headerOffset(runway_t{0, {}}) == sizeof(runway_t) * 6);
+
 }  // namespace frame_header
 }  // namespace frame_capture_card
\ No newline at end of file
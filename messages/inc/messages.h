@@ -13,6 +13,29 @@ struct SleepFor {
     std::chrono::milliseconds duration{};
 };
 
+/** Wait for the LED matrix and the z-stage to settle after the commands before.
+ *
+ * The firmware reports the end of the motion, within the timeout. Past the
+ * timeout, or when the firmware does not acknowledge the serial commands, the
+ * executor waits for the settle time of the distance-based model instead, but
+ * at least min_settle after the last LED or z-stage command.
+ */
+struct WaitSettled {
+    std::chrono::milliseconds timeout{1000};
+
+    /** Lower bound of the settle time by the model, which is not measured on
+     * the instrument yet, e.g. the fixed settle time the protocol used to
+     * sleep for. */
+    std::chrono::milliseconds min_settle{0};
+
+    /** Wait for at least the given time, within the default timeout. */
+    static constexpr WaitSettled atLeast(const std::chrono::milliseconds t) {
+        WaitSettled step{};
+        step.min_settle = t;
+        return step;
+    }
+};
+
 struct CloseAllCameraWorkers {};
 
 namespace led_matrix {
@@ -0,0 +1,69 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/** Time model of the 96-eyes instrument in the dry run.
+ *
+ * The figures are assumptions of the model, not measurements of the
+ * instrument. Calibrate them against a recording of the real plate, e.g. with
+ * `capture-images --record`, before trusting the predicted acquisition time.
+ */
+namespace simulator::time_model {
+
+using namespace std::chrono_literals;
+using std::chrono::nanoseconds;
+
+/** Sustained bulk transfer rate of the USB 3.0 link of one frame capture card,
+ * in bytes per second. */
+constexpr double usb_bandwidth = 320e6;
+
+/** Setup time of the bulk transfers of one frame. */
+constexpr nanoseconds usb_frame_latency = 125us;
+
+/** CPU time of the time integration of one fluorescence frame, i.e.
+ * accumulateFrame() in bench-micro. The capture workers of all boards share
+ * one CPU thread. */
+constexpr nanoseconds frame_integration = 706us;
+
+/** Baud rate of the serial port to the ATmega2560, as set by capture-images. */
+constexpr uint32_t serial_baud_rate = 115'200;
+
+/** Start, 8 data and stop bits. */
+constexpr uint32_t serial_bits_per_byte = 10;
+
+/** Time for the firmware to parse one serial command. */
+constexpr nanoseconds serial_parse = 1ms;
+
+/** Travel time of the z-stage per micrometre. */
+constexpr std::chrono::milliseconds z_travel_per_um = 10ms;
+
+/** Time for the z-stage to settle after each move. */
+constexpr std::chrono::milliseconds z_settle = 100ms;
+
+/** Time to switch the laser from one excitation channel to another. */
+constexpr std::chrono::milliseconds laser_switch = 500ms;
+
+/** Time to update the LED matrix. */
+constexpr std::chrono::milliseconds led_update = 2ms;
+
+constexpr nanoseconds
+usbTransfer(const size_t n_bytes) {
+    return nanoseconds{static_cast<int64_t>(n_bytes * 1e9 / usb_bandwidth)};
+}
+
+constexpr nanoseconds
+serialTransmit(const size_t n_bytes) {
+    return nanoseconds{static_cast<int64_t>(n_bytes * serial_bits_per_byte * 1'000'000'000ULL /
+                                            serial_baud_rate)};
+}
+
+constexpr nanoseconds
+zMove(const int32_t distance_um) {
+    return (distance_um < 0 ? -distance_um : distance_um) * z_travel_per_um + z_settle;
+}
+
+static_assert(serialTransmit(serial_baud_rate / serial_bits_per_byte) == 1s);
+static_assert(zMove(-2) == 120ms);
+
+}  // namespace simulator::time_model
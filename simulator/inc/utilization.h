@@ -0,0 +1,39 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#include "virtual-clock.h"
+
+namespace simulator {
+
+/** Time one stage of the pipeline, e.g. the z-stage, spends at work.
+ *
+ * The simulation runs on one CPU thread, so no synchronization is required.
+ */
+class busy_time_t {
+   public:
+    void add(std::chrono::nanoseconds duration) noexcept { total += duration; }
+
+    /** Count the work from now on until `end`, e.g. a stage move. */
+    void addUntil(time_point end) noexcept {
+        if (end > simulator::now()) {
+            total += end - simulator::now();
+        }
+    }
+
+    std::chrono::nanoseconds busy() const noexcept { return total; }
+
+   private:
+    std::chrono::nanoseconds total{};
+};
+
+/** Busy time of the named stage, registered on first use. The reference stays
+ * valid for the lifetime of the program. */
+busy_time_t& busyTime(const std::string& stage);
+
+/** Print the busy time and the utilization of each stage over the elapsed
+ * time, in the order of registration. */
+void printUtilizationReport(std::chrono::nanoseconds elapsed, std::FILE* out = stdout);
+
+}  // namespace simulator
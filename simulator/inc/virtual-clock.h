@@ -0,0 +1,74 @@
+#pragma once
+#include <boost/fiber/all.hpp>
+#include <chrono>
+
+/** Discrete-event simulation of the instrument in virtual time, for dry runs.
+ *
+ * The pipeline reads the time and sleeps through simulator::now() and
+ * simulator::sleep_for(). Without the virtual_time_scheduler_t, they are
+ * std::chrono::steady_clock::now() and boost::this_fiber::sleep_for(). With
+ * it, the fibers sleep in virtual time, and the clock jumps from one event to
+ * the next.
+ */
+namespace simulator {
+
+using time_point = std::chrono::steady_clock::time_point;
+
+/** Fiber properties of the virtual_time_scheduler_t. */
+struct fiber_props_t : boost::fibers::fiber_properties {
+    using boost::fibers::fiber_properties::fiber_properties;
+
+    /** Virtual time to resume the sleeping fiber at. */
+    time_point wake_at{};
+};
+
+namespace detail {
+/** Virtual time of the scheduler on this thread. Null in real time. */
+inline thread_local const time_point* virtual_now = nullptr;
+}  // namespace detail
+
+/** Whether the fibers of this thread run in virtual time. */
+inline bool
+isVirtual() noexcept {
+    return detail::virtual_now != nullptr;
+}
+
+inline time_point
+now() noexcept {
+    return isVirtual() ? *detail::virtual_now : std::chrono::steady_clock::now();
+}
+
+/** Suspend the calling fiber until the given time. */
+inline void
+sleep_until(const time_point t) {
+    if (!isVirtual()) {
+        boost::this_fiber::sleep_until(t);
+        return;
+    }
+    boost::this_fiber::properties<fiber_props_t>().wake_at = t;
+    boost::this_fiber::yield();
+}
+
+template <class Rep, class Period>
+void
+sleep_for(const std::chrono::duration<Rep, Period>& duration) {
+    if (!isVirtual()) {
+        boost::this_fiber::sleep_for(duration);
+        return;
+    }
+    sleep_until(now() + std::chrono::duration_cast<time_point::duration>(duration));
+}
+
+/** Clock of the pipeline statistics, in virtual time when simulated. Models
+ * the Clock concept of std::chrono. */
+struct clock {
+    using duration = std::chrono::steady_clock::duration;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = simulator::time_point;
+    static constexpr bool is_steady = true;
+
+    static time_point now() noexcept { return simulator::now(); }
+};
+
+}  // namespace simulator
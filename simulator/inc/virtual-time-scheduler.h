@@ -0,0 +1,69 @@
+#pragma once
+#include <boost/fiber/all.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "virtual-clock.h"
+
+namespace simulator {
+
+/** Boost.Fiber scheduler running the fibers of one thread in virtual time.
+ *
+ * The fibers ready to run are picked in FIFO order, as by
+ * boost::fibers::algo::round_robin. A fiber in simulator::sleep_until() waits
+ * in a timer queue instead. Once no fiber is ready, the virtual clock jumps to
+ * the earliest wake-up time. The CPU time of the fibers does not advance the
+ * clock, so that a protocol of hours runs in the CPU time of its commands.
+ *
+ * The virtual clock starts at the steady_clock time of the installation:
+ *
+ *     boost::fibers::use_scheduling_algorithm<simulator::virtual_time_scheduler_t>();
+ *
+ * Fibers sleeping in boost::this_fiber::sleep_for() or on a timeout still
+ * wait in real time.
+ */
+class virtual_time_scheduler_t
+    : public boost::fibers::algo::algorithm_with_properties<fiber_props_t> {
+   public:
+    virtual_time_scheduler_t();
+    ~virtual_time_scheduler_t() override;
+
+    virtual_time_scheduler_t(const virtual_time_scheduler_t&) = delete;
+    virtual_time_scheduler_t& operator=(const virtual_time_scheduler_t&) = delete;
+
+    void awakened(boost::fibers::context* ctx, fiber_props_t& props) noexcept override;
+    boost::fibers::context* pick_next() noexcept override;
+    bool has_ready_fibers() const noexcept override;
+    void suspend_until(const std::chrono::steady_clock::time_point& t) noexcept override;
+    void notify() noexcept override;
+
+   private:
+    struct timer_t {
+        time_point wake_at;
+
+        /** Tie breaker, to wake up the fibers of the same time in FIFO order. */
+        uint64_t sequence;
+        boost::fibers::context* ctx;
+
+        bool operator>(const timer_t& other) const {
+            return (wake_at != other.wake_at) ? wake_at > other.wake_at
+                                              : sequence > other.sequence;
+        }
+    };
+
+    time_point virtual_now;
+    boost::fibers::scheduler::ready_queue_type ready{};
+
+    /** Min-heap of the sleeping fibers. */
+    std::vector<timer_t> timers{};
+    uint64_t n_timers{0};
+
+    std::mutex mutex{};
+    std::condition_variable notified{};
+    bool is_notified{false};
+};
+
+}  // namespace simulator
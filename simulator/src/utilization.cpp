@@ -0,0 +1,48 @@
+#include "utilization.h"
+
+#include <fmt/format.h>
+
+#include <deque>
+#include <utility>
+
+namespace simulator {
+
+namespace {
+
+/** Stable references on insertion, in the order of registration. */
+std::deque<std::pair<std::string, busy_time_t>>&
+registry() {
+    static std::deque<std::pair<std::string, busy_time_t>> stages{};
+    return stages;
+}
+
+double
+toSeconds(const std::chrono::nanoseconds t) {
+    return std::chrono::duration<double>(t).count();
+}
+
+}  // namespace
+
+busy_time_t&
+busyTime(const std::string& stage) {
+    auto& stages = registry();
+    for (auto& [name, busy] : stages) {
+        if (name == stage) {
+            return busy;
+        }
+    }
+    return stages.emplace_back(stage, busy_time_t{}).second;
+}
+
+void
+printUtilizationReport(const std::chrono::nanoseconds elapsed, std::FILE* out) {
+    fmt::print(out, FMT_STRING("[ ] Stage utilization over {:.3f} s:\n"), toSeconds(elapsed));
+    for (const auto& [name, busy] : registry()) {
+        const double utilization =
+            (elapsed.count() > 0) ? 100.0 * busy.busy().count() / elapsed.count() : 0.0;
+        fmt::print(out, FMT_STRING("    {:16s} busy {:10.3f} s, utilization {:5.1f}%\n"), name,
+                   toSeconds(busy.busy()), utilization);
+    }
+}
+
+}  // namespace simulator
@@ -0,0 +1,78 @@
+#include "virtual-time-scheduler.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace simulator {
+
+using boost::fibers::context;
+
+virtual_time_scheduler_t::virtual_time_scheduler_t()
+    : virtual_now{std::chrono::steady_clock::now()} {
+    detail::virtual_now = &virtual_now;
+}
+
+virtual_time_scheduler_t::~virtual_time_scheduler_t() {
+    if (detail::virtual_now == &virtual_now) {
+        detail::virtual_now = nullptr;
+    }
+}
+
+void
+virtual_time_scheduler_t::awakened(context* ctx, fiber_props_t& props) noexcept {
+    if (props.wake_at > virtual_now) {
+        timers.push_back({props.wake_at, n_timers++, ctx});
+        std::push_heap(timers.begin(), timers.end(), std::greater<>{});
+        return;
+    }
+    ctx->ready_link(ready);
+}
+
+context*
+virtual_time_scheduler_t::pick_next() noexcept {
+    if (ready.empty() && !timers.empty()) {
+        // Advance to the next event, and wake up all fibers due at that time.
+        virtual_now = std::max(virtual_now, timers.front().wake_at);
+        while (!timers.empty() && timers.front().wake_at <= virtual_now) {
+            std::pop_heap(timers.begin(), timers.end(), std::greater<>{});
+            timers.back().ctx->ready_link(ready);
+            timers.pop_back();
+        }
+    }
+
+    if (ready.empty()) {
+        return nullptr;
+    }
+    context* ctx = &ready.front();
+    ready.pop_front();
+    return ctx;
+}
+
+bool
+virtual_time_scheduler_t::has_ready_fibers() const noexcept {
+    return !ready.empty() || !timers.empty();
+}
+
+void
+virtual_time_scheduler_t::suspend_until(const std::chrono::steady_clock::time_point& t) noexcept {
+    // No fiber is ready or sleeping in virtual time. Wait in real time for a
+    // fiber of another thread, or for the real-time sleep queue.
+    std::unique_lock<std::mutex> lock{mutex};
+    if (t == std::chrono::steady_clock::time_point::max()) {
+        notified.wait(lock, [this]() { return is_notified; });
+    } else {
+        notified.wait_until(lock, t, [this]() { return is_notified; });
+    }
+    is_notified = false;
+}
+
+void
+virtual_time_scheduler_t::notify() noexcept {
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        is_notified = true;
+    }
+    notified.notify_all();
+}
+
+}  // namespace simulator
@@ -0,0 +1,113 @@
+#include <boost/fiber/all.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utilization.h"
+#include "virtual-clock.h"
+#include "virtual-time-scheduler.h"
+
+using namespace std::chrono_literals;
+using std::chrono::steady_clock;
+
+namespace {
+
+/** Run the fibers in virtual time, on a thread of their own. */
+template <typename Function>
+void
+inVirtualTime(Function&& f) {
+    std::thread t{[&]() {
+        boost::fibers::use_scheduling_algorithm<simulator::virtual_time_scheduler_t>();
+        REQUIRE(simulator::isVirtual());
+        f();
+    }};
+    t.join();
+}
+
+}  // namespace
+
+TEST_CASE("Sleep in real time without the scheduler", "[virtual-clock]") {
+    REQUIRE_FALSE(simulator::isVirtual());
+
+    const auto start = steady_clock::now();
+    simulator::sleep_for(2ms);
+    CHECK(steady_clock::now() - start >= 2ms);
+}
+
+TEST_CASE("Jump to the next event in virtual time", "[virtual-clock]") {
+    const auto wall_start = steady_clock::now();
+    inVirtualTime([]() {
+        const auto start = simulator::now();
+        std::vector<std::string> events;
+
+        boost::fibers::fiber hourly{[&]() {
+            for (int i = 0; i < 24; i++) {
+                simulator::sleep_for(1h);
+            }
+            events.push_back("day");
+        }};
+        boost::fibers::fiber minutely{[&]() {
+            simulator::sleep_for(90min);
+            events.push_back("90 min");
+            simulator::sleep_until(start + 2h);
+            events.push_back("2 h");
+        }};
+        hourly.join();
+        minutely.join();
+
+        CHECK(events == std::vector<std::string>{"90 min", "2 h", "day"});
+        CHECK(simulator::now() - start == 24h);
+    });
+
+    // A day of virtual time, in a fraction of a second.
+    CHECK(steady_clock::now() - wall_start < 1s);
+    CHECK_FALSE(simulator::isVirtual());
+}
+
+TEST_CASE("Wake up the fibers of the same time in order", "[virtual-clock]") {
+    inVirtualTime([]() {
+        std::vector<int> order;
+        std::vector<boost::fibers::fiber> fibers;
+        for (int i = 0; i < 4; i++) {
+            fibers.emplace_back([&order, i]() {
+                simulator::sleep_for(10ms);
+                order.push_back(i);
+            });
+        }
+        for (auto& f : fibers) {
+            f.join();
+        }
+        CHECK(order == std::vector<int>{0, 1, 2, 3});
+    });
+}
+
+TEST_CASE("Block on channels in virtual time", "[virtual-clock]") {
+    inVirtualTime([]() {
+        const auto start = simulator::now();
+        boost::fibers::buffered_channel<int> channel{2};
+
+        // The slow consumer takes 1 s per item, so that the producer blocks
+        // on the full channel.
+        auto& consumer_busy = simulator::busyTime("consumer");
+        boost::fibers::fiber consumer{[&]() {
+            for (int item : channel) {
+                (void)item;
+                simulator::sleep_for(1s);
+                consumer_busy.add(1s);
+            }
+        }};
+
+        for (int i = 0; i < 10; i++) {
+            channel.push(i);
+        }
+        const auto pushed = simulator::now() - start;
+        channel.close();
+        consumer.join();
+
+        CHECK(pushed == 8s);
+        CHECK(simulator::now() - start == 10s);
+        CHECK(consumer_busy.busy() == 10s);
+    });
+}
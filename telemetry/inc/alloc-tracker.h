@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string_view>
+
+/** Opt-in accounting of the heap allocations per pipeline stage and per DSL
+ * step.
+ *
+ * The accounting takes effect only when the replacement global operator
+ * new/delete of alloc_hooks_dep are linked in, i.e. with the build option
+ * `-Dalloc_tracking=true`. Otherwise, the stage scopes cost one table insertion
+ * per fiber, and the statistics stay at zero.
+ *
+ * Each allocation is attributed to the pipeline stage of the calling fiber,
+ * e.g. "capture" or "writer", and to the protocol phase, i.e. the top-level
+ * step of the DSL. Allocations from fibers and threads without a stage are
+ * attributed to "unattributed".
+ *
+ * Once the pipeline is warmed up, i.e. the frame pools and the channel
+ * statistics have reached their steady-state size, call beginSteadyState().
+ * Any allocation after that is also counted separately, so that tests and long
+ * production runs can assert that the capture loop never touches the heap.
+ */
+namespace telemetry::alloc {
+
+constexpr size_t max_stages = 16;
+
+/** Protocol phases beyond this are accounted to the last phase. */
+constexpr size_t max_phases = 256;
+
+struct alloc_stats_t {
+    uint64_t n_allocations{};
+    uint64_t n_bytes{};
+};
+
+/** Snapshot of the allocations of one pipeline stage. */
+struct stage_stats_t {
+    alloc_stats_t total{};
+
+    /** Allocations since beginSteadyState(). */
+    alloc_stats_t steady_state{};
+};
+
+/** Attribute the heap allocations of the calling fiber to the pipeline stage,
+ * until the end of the scope.
+ *
+ * @param[in] name Stage name, with static storage duration.
+ */
+class stage_scope {
+   public:
+    explicit stage_scope(const char* name);
+    ~stage_scope();
+
+    stage_scope(const stage_scope&) = delete;
+    stage_scope& operator=(const stage_scope&) = delete;
+};
+
+/** True if the replacement operator new/delete are linked in. */
+bool isTracking() noexcept;
+
+/** Count the allocations from now on as steady-state allocations. */
+void beginSteadyState() noexcept;
+
+/** Allocations of the stage so far. Zero if the stage is unknown. */
+stage_stats_t stageStats(std::string_view name) noexcept;
+
+/** Allocations of the stage within one protocol phase. */
+alloc_stats_t phaseStats(std::string_view name, size_t phase) noexcept;
+
+/** Report the allocations per stage and per protocol phase, and flag the
+ * steady-state allocations. */
+void printAllocationReport(std::FILE* out = stdout);
+
+namespace detail {
+/** Called by the replacement operator new. Must not allocate. */
+void recordAllocation(size_t n_bytes) noexcept;
+
+/** Called once by the replacement operator new/delete at startup. */
+void markInstalled() noexcept;
+}  // namespace detail
+
+}  // namespace telemetry::alloc
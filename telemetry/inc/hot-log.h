@@ -0,0 +1,144 @@
+#pragma once
+#include <fmt/format.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+
+/** Asynchronous binary logger for the capture, write and serial hot paths.
+ *
+ * The logging fiber does not format anything. It copies a pointer to the
+ * static descriptor of the call site, i.e. the format string and the
+ * formatter function, and the raw bytes of the arguments into a lock-free
+ * single-producer single-consumer ring buffer owned by the calling CPU thread.
+ * A background thread drains the ring buffers every millisecond, formats the
+ * records and writes them to stdout. When a ring buffer is full, the record is
+ * dropped rather than stalling the frame capture.
+ *
+ * The arguments must be trivially copyable. Pointers and string views must
+ * refer to static storage, e.g. the string literals returned by
+ * toString(channel_t).
+ *
+ * The log level is filtered at compile time with BIOIMAGE_LOG_LEVEL, i.e. the
+ * build option `-Dlog_level=`. Filtered call sites expand to nothing, not even
+ * evaluating their arguments.
+ */
+namespace telemetry::log {
+
+enum level_t : uint8_t { DEBUG = 0, INFO = 1, WARNING = 2, ERROR = 3 };
+
+#ifndef BIOIMAGE_LOG_LEVEL
+#define BIOIMAGE_LOG_LEVEL 1
+#endif
+
+struct descriptor_t;
+using formatter_t = void (*)(fmt::memory_buffer&, const descriptor_t&, const std::byte*);
+
+/** Static description of one log call site. */
+struct descriptor_t {
+    const char* format;
+    level_t level;
+    formatter_t formatter;
+};
+
+struct record_header_t {
+    const descriptor_t* descriptor;
+    uint32_t payload_size;
+};
+
+/** Bytes per CPU thread before records are dropped. */
+constexpr size_t ring_capacity = size_t{1} << 20;
+
+/** Copy the record to the ring buffer of the calling thread, or drop it. */
+void push(const std::byte* record, size_t size) noexcept;
+
+/** Format and write all records logged so far, from the calling thread. */
+void flush();
+
+/** Redirect the formatted records, e.g. to a file. Defaults to stdout. */
+void setOutput(std::FILE* file);
+
+/** Number of records dropped so far because the ring buffer was full. */
+uint64_t dropped() noexcept;
+
+namespace detail {
+
+template <typename T>
+T
+read(const std::byte*& payload) {
+    T value;
+    std::memcpy(&value, payload, sizeof(T));
+    payload += sizeof(T);
+    return value;
+}
+
+template <typename... Args>
+void
+formatRecord(fmt::memory_buffer& out, const descriptor_t& descriptor,
+             [[maybe_unused]] const std::byte* payload) {
+    // Braced initialization evaluates read() from left to right. The format
+    // string was checked against the arguments at compile time, in write().
+    const std::tuple<Args...> args{read<Args>(payload)...};
+    std::apply(
+        [&](const auto&... a) {
+            fmt::format_to(std::back_inserter(out), fmt::runtime(descriptor.format), a...);
+        },
+        args);
+}
+
+/** Serialize one log record. FormatFn returns the FMT_STRING of the call site,
+ * and its closure type is unique per call site. */
+template <level_t level, typename FormatFn, typename... Args>
+void
+write(FormatFn format_fn, const Args&... args) noexcept {
+    static_assert((std::is_trivially_copyable_v<Args> && ...),
+                  "Log arguments are copied as raw bytes");
+
+    // Fails to compile if the format string does not match the arguments.
+    const fmt::format_string<Args...> format = format_fn();
+    static const descriptor_t descriptor{fmt::string_view(format).data(), level,
+                                         &formatRecord<Args...>};
+
+    constexpr size_t payload_size = (sizeof(Args) + ... + 0);
+    std::array<std::byte, sizeof(record_header_t) + payload_size> record;
+
+    const record_header_t header{&descriptor, payload_size};
+    std::memcpy(record.data(), &header, sizeof(header));
+
+    [[maybe_unused]] auto* payload = record.data() + sizeof(header);
+    ((std::memcpy(payload, &args, sizeof(Args)), payload += sizeof(Args)), ...);
+
+    push(record.data(), record.size());
+}
+
+}  // namespace detail
+}  // namespace telemetry::log
+
+#define HOT_LOG_IMPL(level, format, ...) \
+    ::telemetry::log::detail::write<level>([]() { return FMT_STRING(format); }, ##__VA_ARGS__)
+
+#if BIOIMAGE_LOG_LEVEL <= 0
+#define HOT_LOG_DEBUG(format, ...) HOT_LOG_IMPL(::telemetry::log::DEBUG, format, ##__VA_ARGS__)
+#else
+#define HOT_LOG_DEBUG(format, ...)
+#endif
+
+#if BIOIMAGE_LOG_LEVEL <= 1
+#define HOT_LOG_INFO(format, ...) HOT_LOG_IMPL(::telemetry::log::INFO, format, ##__VA_ARGS__)
+#else
+#define HOT_LOG_INFO(format, ...)
+#endif
+
+#if BIOIMAGE_LOG_LEVEL <= 2
+#define HOT_LOG_WARNING(format, ...) \
+    HOT_LOG_IMPL(::telemetry::log::WARNING, format, ##__VA_ARGS__)
+#else
+#define HOT_LOG_WARNING(format, ...)
+#endif
+
+#define HOT_LOG_ERROR(format, ...) HOT_LOG_IMPL(::telemetry::log::ERROR, format, ##__VA_ARGS__)
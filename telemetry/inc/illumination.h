@@ -0,0 +1,60 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "constants.h"
+#include "virtual-clock.h"
+
+/** Photobleaching budget of the fluorescence imaging.
+ *
+ * Each laser command fires the excitation laser for the time given, i.e. the
+ * light dose the protocol allows the wells. The fluorescence frames must all
+ * be exposed within the pulse. Any delay between the laser and the last frame,
+ * e.g. fiber scheduling, a full queue or the writer holding the CPU thread,
+ * bleaches the fluorophores without imaging them, and the frames past the end
+ * of the pulse are exposed in the dark.
+ *
+ * The executor records the time from the laser turning on to the last frame of
+ * each board, i.e. of its 24 wells, for every fluorescence capture. A latency
+ * beyond the laser time is an overrun of the budget.
+ */
+namespace telemetry::illumination {
+
+/** Steady clock, or the virtual clock of a dry run. */
+using clock = simulator::clock;
+
+/** Illumination of the wells of one board by one laser pulse. */
+struct illumination_t {
+    size_t phase{};
+    channel_t ch{EGFP};
+
+    /** Laser time of the laser command. */
+    std::chrono::nanoseconds budget{};
+
+    /** From the laser turning on to the last frame of the board. */
+    std::chrono::nanoseconds latency{};
+
+    bool isOverrun() const noexcept { return latency > budget; }
+};
+
+/** Record the illumination of one board, in the current protocol phase, and
+ * in telemetry::executor_metrics_t.
+ *
+ * @returns false on an overrun of the budget.
+ */
+bool observe(channel_t ch, std::chrono::nanoseconds budget, clock::time_point laser_on,
+             clock::time_point last_frame);
+
+/** Illuminations recorded so far, in order. */
+const std::vector<illumination_t>& illuminations();
+
+/** Report the latency from the laser to the last frame per protocol phase and
+ * laser channel, with the median, the 99th percentile and the worst case, and
+ * flag the wells illuminated beyond the budget.
+ */
+void printPhotobleachingReport(std::FILE* out = stdout);
+
+}  // namespace telemetry::illumination
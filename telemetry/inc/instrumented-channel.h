@@ -0,0 +1,195 @@
+#pragma once
+#include <boost/fiber/buffered_channel.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "virtual-clock.h"
+
+namespace telemetry {
+
+using boost::fibers::channel_op_status;
+
+/** Channel statistics within one protocol phase. */
+struct channel_phase_stats_t {
+    std::chrono::nanoseconds push_blocked{};
+    std::chrono::nanoseconds pop_blocked{};
+    uint64_t n_pushed{};
+    uint64_t n_popped{};
+    size_t high_water{};
+
+    /** Integral of the channel depth over time, in item-nanoseconds. */
+    double depth_integral{};
+};
+
+/** Statistics shared by one or more channels between two pipeline stages.
+ *
+ * For example, the four capture queues share one set of statistics between
+ * the executor (producer) and the capture workers (consumers). All channels
+ * are served by fibers on the same CPU thread, so no synchronization is
+ * required.
+ */
+class channel_stats_t {
+   public:
+    /** Steady clock, or the virtual clock of a dry run. */
+    using clock = simulator::clock;
+
+    channel_stats_t(std::string name, std::string producer, std::string consumer,
+                    size_t n_producers, size_t n_consumers);
+
+    void onPush(clock::time_point now, std::chrono::nanoseconds blocked);
+    void onPop(clock::time_point now, std::chrono::nanoseconds blocked);
+
+    /** Close the statistics of the current phase, and allocate those of the
+     * next phase, so that push() and pop() need not allocate. */
+    void onPhase(clock::time_point now, size_t next_phase);
+
+    const std::string name;
+    const std::string producer;
+    const std::string consumer;
+    const size_t n_producers;
+    const size_t n_consumers;
+
+    /** Statistics indexed by the protocol phase. */
+    const std::vector<channel_phase_stats_t>& phases() const { return per_phase; }
+
+   private:
+    std::vector<channel_phase_stats_t> per_phase{};
+
+    /** Number of items in all channels sharing the statistics. */
+    size_t depth{0};
+    clock::time_point last_change{clock::now()};
+
+    channel_phase_stats_t& integrate(clock::time_point now);
+};
+
+/** Register the statistics of the channels between two pipeline stages.
+ *
+ * @param[in] name Channel name to report.
+ * @param[in] producer Name of the stage pushing into the channels.
+ * @param[in] consumer Name of the stage popping from the channels.
+ * @param[in] n_producers Number of producer fibers running concurrently.
+ * @param[in] n_consumers Number of consumer fibers running concurrently.
+ * @returns reference valid until the end of the program.
+ */
+channel_stats_t& channelStats(std::string name, std::string producer, std::string consumer,
+                              size_t n_producers = 1, size_t n_consumers = 1);
+
+/** Mark the start of the protocol phase, i.e. the top-level step of the DSL. */
+void beginPhase(size_t phase);
+
+size_t currentPhase() noexcept;
+
+/** Report the stalls of each channel per protocol phase, and name the
+ * bottleneck stage, i.e. the one the other stages were waiting on the most.
+ */
+void printChannelReport(std::FILE* out = stdout);
+
+/** Drop-in replacement of boost::fibers::buffered_channel that records the
+ * time blocked in push() and pop(), the high-water mark and the occupancy
+ * over time.
+ *
+ * The fast path is a try_push() / try_pop(). The clock is read only once per
+ * operation, plus once more when the operation blocks.
+ */
+template <typename T>
+class instrumented_channel {
+   public:
+    using value_type = T;
+    using clock = channel_stats_t::clock;
+
+    instrumented_channel(size_t capacity, channel_stats_t& s) : channel{capacity}, stats{s} {}
+
+    instrumented_channel(const instrumented_channel&) = delete;
+    instrumented_channel& operator=(const instrumented_channel&) = delete;
+
+    channel_op_status push(const T& value) { return pushImpl(value); }
+    channel_op_status push(T&& value) { return pushImpl(std::move(value)); }
+
+    channel_op_status pop(T& value) {
+        auto status = channel.try_pop(value);
+        if (status == channel_op_status::success) {
+            stats.onPop(clock::now(), {});
+        } else if (status == channel_op_status::empty) {
+            const auto start = clock::now();
+            status = channel.pop(value);
+            const auto now = clock::now();
+            if (status == channel_op_status::success) {
+                stats.onPop(now, now - start);
+            }
+        }
+        return status;
+    }
+
+    void close() noexcept { channel.close(); }
+    bool is_closed() const noexcept { return channel.is_closed(); }
+
+    /** Pop until the channel is closed, as buffered_channel::iterator. */
+    class iterator {
+       public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = T*;
+        using reference = T&;
+
+        iterator() = default;
+        explicit iterator(instrumented_channel* c) : chan{c} { increment(); }
+
+        reference operator*() { return *value; }
+        pointer operator->() { return &*value; }
+
+        iterator& operator++() {
+            increment();
+            return *this;
+        }
+
+        bool operator==(const iterator& other) const { return chan == other.chan; }
+        bool operator!=(const iterator& other) const { return chan != other.chan; }
+
+       private:
+        instrumented_channel* chan{nullptr};
+        std::optional<T> value{};
+
+        void increment() {
+            T v{};
+            if (chan->pop(v) == channel_op_status::success) {
+                value = std::move(v);
+            } else {
+                chan = nullptr;
+                value.reset();
+            }
+        }
+    };
+
+    iterator begin() { return iterator{this}; }
+    iterator end() { return iterator{}; }
+
+   private:
+    boost::fibers::buffered_channel<T> channel;
+    channel_stats_t& stats;
+
+    template <typename V>
+    channel_op_status pushImpl(V&& value) {
+        // try_push() moves from the value only on success, so the value is
+        // still intact for the blocking push().
+        auto status = channel.try_push(std::forward<V>(value));
+        if (status == channel_op_status::success) {
+            stats.onPush(clock::now(), {});
+        } else if (status == channel_op_status::full) {
+            const auto start = clock::now();
+            status = channel.push(std::forward<V>(value));
+            const auto now = clock::now();
+            if (status == channel_op_status::success) {
+                stats.onPush(now, now - start);
+            }
+        }
+        return status;
+    }
+};
+
+}  // namespace telemetry
@@ -0,0 +1,178 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "constants.h"
+
+/** Live instrumentation of the image acquisition pipeline. */
+namespace telemetry {
+
+/** Monotonic counter with exactly one writer thread.
+ *
+ * The capture and write workers are Boost.Fiber tasks on the same CPU thread,
+ * so each counter is only ever written by one thread. A relaxed load-add-store
+ * avoids the lock prefix of fetch_add() in the per-frame hot loop, while the
+ * exporter thread can still read a torn-free value.
+ */
+class counter_t {
+   public:
+    void add(uint64_t n = 1) noexcept {
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    /** Publish a cumulative count maintained elsewhere, e.g. by FrameCaptureCard. */
+    void set(uint64_t n) noexcept { value.store(n, std::memory_order_relaxed); }
+
+    uint64_t load() const noexcept { return value.load(std::memory_order_relaxed); }
+
+   private:
+    std::atomic<uint64_t> value{0};
+};
+
+/** Instantaneous value, e.g. the queue depth. */
+class gauge_t {
+   public:
+    void add(int64_t n) noexcept { value.fetch_add(n, std::memory_order_relaxed); }
+    void set(int64_t n) noexcept { value.store(n, std::memory_order_relaxed); }
+    int64_t load() const noexcept { return value.load(std::memory_order_relaxed); }
+
+   private:
+    std::atomic<int64_t> value{0};
+};
+
+/** Latency histogram with power-of-two bucket boundaries, from 1us to ~8s.
+ * Single writer, as counter_t.
+ */
+class histogram_t {
+   public:
+    static constexpr size_t n_buckets = 24;
+
+    /** Upper bound of the i-th bucket, in microseconds. */
+    static constexpr uint64_t upperBound(size_t i) { return uint64_t{1} << i; }
+
+    void observe(std::chrono::nanoseconds latency) noexcept;
+
+    uint64_t bucket(size_t i) const noexcept { return buckets[i].load(); }
+    uint64_t count() const noexcept { return n_observations.load(); }
+    uint64_t sumMicroseconds() const noexcept { return sum_us.load(); }
+
+   private:
+    /** The last bucket collects everything beyond the largest boundary. */
+    std::array<counter_t, n_buckets + 1> buckets{};
+    counter_t n_observations{};
+    counter_t sum_us{};
+};
+
+/** Metrics of one frame capture card, updated by its capture worker. Indexed
+ * by the USB ID, as the board ID of the DIP switch may be of any value. */
+struct alignas(64) board_metrics_t {
+    std::array<counter_t, frame_capture_card::n_cameras_per_board> frames_per_camera{};
+    counter_t bytes{};
+
+    /** Frames discarded for carrying the wrong LED ID, or for being surplus. */
+    counter_t retries{};
+
+    /** Bulk transfers skipped while searching for the frame header. */
+    counter_t header_resyncs{};
+
+    /** Capture and writer processes restarted after a crash, in
+     * capture-images --processes. */
+    counter_t restarts{};
+
+    /** Commands waiting in the capture queue. */
+    gauge_t capture_queue_depth{};
+
+    /** Time to integrate all fluorescence frames of one capture command. */
+    histogram_t integration_time{};
+
+    /** Time to execute one command popped from the capture queue. */
+    histogram_t command_time{};
+
+    /** Time from the first board completing a capture command to this board
+     * completing it, in the run-ahead mode of the executor. */
+    histogram_t completion_skew{};
+};
+
+/** Metrics of the file write worker. */
+struct alignas(64) writer_metrics_t {
+    counter_t frames{};
+    counter_t bytes{};
+
+    /** Frames captured but not yet written. */
+    gauge_t queue_depth{};
+
+    histogram_t write_latency{};
+
+    /** Frames binned into the live preview ring. See preview-tap.h. */
+    counter_t previews{};
+
+    /** Previews due but dropped, beyond the CPU budget of the preview. */
+    counter_t previews_dropped{};
+};
+
+/** Metrics of the protocol executor. */
+struct alignas(64) executor_metrics_t {
+    /** Time waiting for the LED matrix and the z-stage to settle. */
+    histogram_t settle_wait{};
+
+    /** Settle waits past the timeout of the step, or rejected by the firmware,
+     * i.e. on the settle model. */
+    counter_t settle_timeouts{};
+
+    /** Time from the laser turning on to the last fluorescence frame of each
+     * board. See illumination.h. */
+    histogram_t illumination_latency{};
+
+    /** Illuminations of a board past the laser time, i.e. the photobleaching
+     * budget. */
+    counter_t illumination_overruns{};
+};
+
+struct Metrics {
+    std::array<board_metrics_t, frame_capture_card::n_boards> boards{};
+    writer_metrics_t writer{};
+    executor_metrics_t executor{};
+};
+
+/** The process-wide metrics registry. */
+Metrics& metrics();
+
+/** Render the metrics in the Prometheus text exposition format. */
+std::string toPrometheusText(const Metrics& m);
+
+/** Periodically write the metrics to a file for the textfile collector of
+ * Prometheus node_exporter.
+ *
+ * The file is replaced atomically via rename(), so that the collector never
+ * reads a partially written file.
+ */
+class PrometheusExporter {
+   public:
+    PrometheusExporter(std::string path,
+                       std::chrono::milliseconds interval = std::chrono::seconds{5});
+
+    /** Stop the exporter thread, and then write the final values. */
+    ~PrometheusExporter();
+
+    PrometheusExporter(const PrometheusExporter&) = delete;
+    PrometheusExporter& operator=(const PrometheusExporter&) = delete;
+
+   private:
+    const std::string path;
+    const std::chrono::milliseconds interval;
+
+    std::mutex mutex{};
+    std::condition_variable stop_requested{};
+    bool is_stopping{false};
+    std::thread exporter{};
+
+    void writeFile() const;
+};
+
+}  // namespace telemetry
@@ -0,0 +1,99 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/** Timeline tracing of the executor, capture and writer fibers.
+ *
+ * Each trace event is a named scope, recorded into a fixed-capacity ring buffer
+ * owned by the calling CPU thread. Events are laid out on one timeline lane
+ * per Boost.Fiber, and dumped at the end of the run in the Chrome trace event
+ * format. Open the JSON file at https://ui.perfetto.dev or chrome://tracing.
+ *
+ * Tracing is compiled out entirely unless BIOIMAGE_TRACE is defined, i.e. the
+ * project is configured with `meson configure -Dtracing=true`. Then, the
+ * TRACE_* macros expand to nothing.
+ */
+namespace telemetry::trace {
+
+#ifdef BIOIMAGE_TRACE
+constexpr bool is_enabled = true;
+#else
+constexpr bool is_enabled = false;
+#endif
+
+/** Events per CPU thread before the oldest ones are overwritten. */
+constexpr size_t ring_capacity = size_t{1} << 16;
+
+/** Complete event, i.e. "ph":"X" in the Chrome trace event format.
+ *
+ * The name, category and the argument name must be string literals.
+ */
+struct event_t {
+    const char* category;
+    const char* name;
+    const char* arg_name;
+    int64_t arg;
+    uint64_t lane;
+    std::chrono::steady_clock::time_point begin;
+    std::chrono::steady_clock::time_point end;
+};
+
+/** Append the event to the ring buffer of the calling thread. */
+void record(const event_t& event) noexcept;
+
+/** Timeline lane of the calling fiber. */
+uint64_t currentLane() noexcept;
+
+/** Label the timeline lane of the calling fiber, e.g. "capture usb0". */
+void nameLane(std::string name);
+
+/** Write all recorded events in the Chrome trace event format.
+ *
+ * Not thread-safe against concurrent record(). Call after all traced fibers
+ * and threads are joined.
+ */
+void dump(const std::string& path);
+
+/** Record the lifetime of the object as one trace event. */
+class Scope {
+   public:
+    Scope(const char* category, const char* name, const char* arg_name = nullptr,
+          int64_t arg = 0) noexcept
+        : event{category, name, arg_name, arg, currentLane(), clock::now(), {}} {}
+
+    ~Scope() {
+        event.end = clock::now();
+        record(event);
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+   private:
+    using clock = std::chrono::steady_clock;
+    event_t event;
+};
+
+}  // namespace telemetry::trace
+
+#define BIOIMAGE_TRACE_CONCAT_IMPL(a, b) a##b
+#define BIOIMAGE_TRACE_CONCAT(a, b) BIOIMAGE_TRACE_CONCAT_IMPL(a, b)
+
+#ifdef BIOIMAGE_TRACE
+/** Trace the enclosing scope, e.g. TRACE_SCOPE("capture", "FPM frame"). */
+#define TRACE_SCOPE(category, name) \
+    const ::telemetry::trace::Scope BIOIMAGE_TRACE_CONCAT(trace_scope_, __LINE__) { category, name }
+
+/** Trace the enclosing scope with one integer argument. */
+#define TRACE_SCOPE_ARG(category, name, arg_name, arg)                            \
+    const ::telemetry::trace::Scope BIOIMAGE_TRACE_CONCAT(trace_scope_, __LINE__) { \
+        category, name, arg_name, static_cast<int64_t>(arg)                         \
+    }
+
+#define TRACE_LANE_NAME(name) ::telemetry::trace::nameLane(name)
+#else
+#define TRACE_SCOPE(category, name)
+#define TRACE_SCOPE_ARG(category, name, arg_name, arg)
+#define TRACE_LANE_NAME(name)
+#endif
@@ -0,0 +1,106 @@
+/** Replacement global operator new/delete for the allocation accounting of
+ * alloc-tracker.h. Linked in whole by alloc_hooks_dep. */
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#include "alloc-tracker.h"
+
+namespace {
+
+using telemetry::alloc::detail::recordAllocation;
+
+[[maybe_unused]] const bool is_installed = []() {
+    telemetry::alloc::detail::markInstalled();
+    return true;
+}();
+
+void*
+allocate(std::size_t size) noexcept {
+    recordAllocation(size);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void*
+allocateAligned(std::size_t size, std::align_val_t alignment) noexcept {
+    recordAllocation(size);
+    void* p = nullptr;
+    const auto a = std::max(static_cast<std::size_t>(alignment), sizeof(void*));
+    return (posix_memalign(&p, a, size == 0 ? 1 : size) == 0) ? p : nullptr;
+}
+
+}  // namespace
+
+void*
+operator new(std::size_t size) {
+    if (void* p = allocate(size)) return p;
+    throw std::bad_alloc{};
+}
+
+void*
+operator new[](std::size_t size) {
+    if (void* p = allocate(size)) return p;
+    throw std::bad_alloc{};
+}
+
+void*
+operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void*
+operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void*
+operator new(std::size_t size, std::align_val_t alignment) {
+    if (void* p = allocateAligned(size, alignment)) return p;
+    throw std::bad_alloc{};
+}
+
+void*
+operator new[](std::size_t size, std::align_val_t alignment) {
+    if (void* p = allocateAligned(size, alignment)) return p;
+    throw std::bad_alloc{};
+}
+
+void
+operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void
+operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void
+operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void
+operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void
+operator delete(void* p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void
+operator delete[](void* p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void
+operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void
+operator delete[](void* p, std::size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
@@ -0,0 +1,213 @@
+#include "alloc-tracker.h"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <boost/fiber/context.hpp>
+#include <mutex>
+
+#include "instrumented-channel.h"
+
+namespace telemetry::alloc {
+
+namespace {
+
+using stage_id_t = uint8_t;
+constexpr stage_id_t unattributed = 0;
+
+struct counters_t {
+    std::atomic<uint64_t> n_allocations{0};
+    std::atomic<uint64_t> n_bytes{0};
+
+    void add(size_t n) noexcept {
+        n_allocations.fetch_add(1, std::memory_order_relaxed);
+        n_bytes.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    alloc_stats_t load() const noexcept {
+        return {n_allocations.load(std::memory_order_relaxed),
+                n_bytes.load(std::memory_order_relaxed)};
+    }
+};
+
+/** Statically allocated, so that the operator new never allocates. */
+struct registry_t {
+    std::mutex mutex{};
+    std::array<const char*, max_stages> names{"unattributed"};
+    std::atomic<size_t> n_stages{1};
+
+    std::array<std::array<counters_t, max_phases>, max_stages> per_phase{};
+    std::array<counters_t, max_stages> steady_state{};
+
+    std::atomic<bool> is_installed{false};
+    std::atomic<bool> is_steady_state{false};
+
+    stage_id_t find(std::string_view name) const noexcept {
+        const auto n = n_stages.load(std::memory_order_acquire);
+        for (stage_id_t i = 0; i < n; i++) {
+            if (name == names[i]) return i;
+        }
+        return max_stages;
+    }
+
+    stage_id_t registerStage(const char* name) {
+        std::lock_guard lock{mutex};
+        if (const auto id = find(name); id < max_stages) {
+            return id;
+        }
+        const auto id = n_stages.load(std::memory_order_relaxed);
+        if (id == max_stages) {
+            return unattributed;
+        }
+        names[id] = name;
+        n_stages.store(id + 1, std::memory_order_release);
+        return static_cast<stage_id_t>(id);
+    }
+};
+
+registry_t registry{};
+
+/** Stage of each fiber on this thread, keyed by the fiber context. */
+struct fiber_stage_t {
+    const void* context;
+    stage_id_t stage;
+};
+constexpr size_t max_fibers_per_thread = 32;
+thread_local std::array<fiber_stage_t, max_fibers_per_thread> fiber_stages{};
+thread_local size_t n_fiber_stages{0};
+
+/** Allocations made by the accounting itself are not accounted. */
+thread_local bool is_recording{false};
+
+stage_id_t
+currentStage() noexcept {
+    // Threads without stages may have no fiber context at all. Do not create
+    // one from within operator new.
+    if (n_fiber_stages == 0) {
+        return unattributed;
+    }
+    const void* context = boost::fibers::context::active();
+    for (size_t i = 0; i < n_fiber_stages; i++) {
+        if (fiber_stages[i].context == context) {
+            return fiber_stages[i].stage;
+        }
+    }
+    return unattributed;
+}
+
+void
+printStats(std::FILE* out, std::string_view label, const alloc_stats_t& s) {
+    fmt::print(out, FMT_STRING("    {:24s} {:10d} allocations {:12.3f} MB\n"), label,
+               s.n_allocations, s.n_bytes * 1e-6);
+}
+
+}  // namespace
+
+stage_scope::stage_scope(const char* name) {
+    const auto stage = registry.registerStage(name);
+    if (n_fiber_stages < max_fibers_per_thread) {
+        fiber_stages[n_fiber_stages++] = {boost::fibers::context::active(), stage};
+    }
+}
+
+stage_scope::~stage_scope() {
+    const void* context = boost::fibers::context::active();
+    const auto end = fiber_stages.begin() + n_fiber_stages;
+    const auto it = std::find_if(fiber_stages.begin(), end,
+                                 [&](const auto& f) { return f.context == context; });
+    if (it != end) {
+        *it = *(end - 1);
+        n_fiber_stages--;
+    }
+}
+
+bool
+isTracking() noexcept {
+    return registry.is_installed.load(std::memory_order_relaxed);
+}
+
+void
+beginSteadyState() noexcept {
+    registry.is_steady_state.store(true, std::memory_order_relaxed);
+}
+
+stage_stats_t
+stageStats(std::string_view name) noexcept {
+    const auto id = registry.find(name);
+    if (id >= max_stages) {
+        return {};
+    }
+
+    stage_stats_t stats{};
+    for (const auto& phase : registry.per_phase[id]) {
+        const auto s = phase.load();
+        stats.total.n_allocations += s.n_allocations;
+        stats.total.n_bytes += s.n_bytes;
+    }
+    stats.steady_state = registry.steady_state[id].load();
+    return stats;
+}
+
+alloc_stats_t
+phaseStats(std::string_view name, size_t phase) noexcept {
+    const auto id = registry.find(name);
+    if (id >= max_stages) {
+        return {};
+    }
+    return registry.per_phase[id][std::min(phase, max_phases - 1)].load();
+}
+
+void
+printAllocationReport(std::FILE* out) {
+    if (!isTracking()) {
+        fmt::print(out, "[ ] Heap allocations not tracked. Build with -Dalloc_tracking=true\n");
+        return;
+    }
+
+    fmt::print(out, "[ ] Heap allocations per pipeline stage and protocol step:\n");
+    const auto n_stages = registry.n_stages.load(std::memory_order_acquire);
+    for (stage_id_t id = 0; id < n_stages; id++) {
+        const auto stats = stageStats(registry.names[id]);
+        printStats(out, registry.names[id], stats.total);
+
+        const auto& phases = registry.per_phase[id];
+        for (size_t phase = 0; phase < max_phases; phase++) {
+            if (const auto s = phases[phase].load(); s.n_allocations > 0) {
+                printStats(out, fmt::format(FMT_STRING("  step {:d}"), phase), s);
+            }
+        }
+        if (stats.steady_state.n_allocations > 0) {
+            printStats(out, "  after warm-up", stats.steady_state);
+        }
+    }
+}
+
+namespace detail {
+
+void
+recordAllocation(size_t n_bytes) noexcept {
+    if (is_recording) {
+        return;
+    }
+    is_recording = true;
+
+    const auto stage = currentStage();
+    const auto phase = std::min(telemetry::currentPhase(), max_phases - 1);
+    registry.per_phase[stage][phase].add(n_bytes);
+    if (registry.is_steady_state.load(std::memory_order_relaxed)) {
+        registry.steady_state[stage].add(n_bytes);
+    }
+
+    is_recording = false;
+}
+
+void
+markInstalled() noexcept {
+    registry.is_installed.store(true, std::memory_order_relaxed);
+}
+
+}  // namespace detail
+
+}  // namespace telemetry::alloc
@@ -0,0 +1,168 @@
+#include "hot-log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace telemetry::log {
+
+namespace {
+
+/** Single-producer single-consumer byte ring buffer. The indices increase
+ * monotonically, and wrap around only when addressing the storage. */
+class ring_t {
+   public:
+    bool tryPush(const std::byte* record, size_t size) noexcept {
+        const auto h = head.load(std::memory_order_relaxed);
+        const auto t = tail.load(std::memory_order_acquire);
+        if (ring_capacity - (h - t) < size) {
+            return false;
+        }
+        copyIn(h, record, size);
+        head.store(h + size, std::memory_order_release);
+        return true;
+    }
+
+    /** Format all complete records, and release their storage to the producer. */
+    void drain(fmt::memory_buffer& out, std::vector<std::byte>& payload) {
+        auto t = tail.load(std::memory_order_relaxed);
+        const auto h = head.load(std::memory_order_acquire);
+        while (t < h) {
+            record_header_t header;
+            copyOut(t, reinterpret_cast<std::byte*>(&header), sizeof(header));
+            payload.resize(header.payload_size);
+            copyOut(t + sizeof(header), payload.data(), header.payload_size);
+            t += sizeof(header) + header.payload_size;
+
+            header.descriptor->formatter(out, *header.descriptor, payload.data());
+            out.push_back('\n');
+        }
+        tail.store(t, std::memory_order_release);
+    }
+
+   private:
+    std::unique_ptr<std::byte[]> data{new std::byte[ring_capacity]};
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+
+    void copyIn(size_t index, const std::byte* src, size_t size) noexcept {
+        const auto offset = index % ring_capacity;
+        const auto first = std::min(size, ring_capacity - offset);
+        std::memcpy(data.get() + offset, src, first);
+        std::memcpy(data.get(), src + first, size - first);
+    }
+
+    void copyOut(size_t index, std::byte* dst, size_t size) const noexcept {
+        const auto offset = index % ring_capacity;
+        const auto first = std::min(size, ring_capacity - offset);
+        std::memcpy(dst, data.get() + offset, first);
+        std::memcpy(dst + first, data.get(), size - first);
+    }
+};
+
+/** Ring buffers of all threads, and the background formatting thread. */
+class backend_t {
+   public:
+    backend_t() {
+        formatter = std::thread{[this]() {
+            std::unique_lock lock{stop_mutex};
+            while (!stop_requested.wait_for(lock, std::chrono::milliseconds{1},
+                                            [this]() { return is_stopping; })) {
+                drainAll();
+            }
+        }};
+    }
+
+    ~backend_t() {
+        {
+            std::lock_guard lock{stop_mutex};
+            is_stopping = true;
+        }
+        stop_requested.notify_one();
+        formatter.join();
+        drainAll();
+
+        if (const auto n = n_dropped.load(); n > 0) {
+            fmt::print(stderr, FMT_STRING("[ ] Log ring buffers overflowed; {:d} records lost\n"),
+                       n);
+        }
+    }
+
+    ring_t* registerThread() {
+        std::lock_guard lock{rings_mutex};
+        rings.push_back(std::make_unique<ring_t>());
+        return rings.back().get();
+    }
+
+    /** Only one consumer may drain at a time: the formatter thread or flush(). */
+    void drainAll() {
+        std::lock_guard lock{rings_mutex};
+        for (auto& ring : rings) {
+            ring->drain(out, payload);
+        }
+        if (out.size() > 0) {
+            std::fwrite(out.data(), 1, out.size(), output);
+            std::fflush(output);
+            out.clear();
+        }
+    }
+
+    void setOutput(std::FILE* file) {
+        std::lock_guard lock{rings_mutex};
+        output = file;
+    }
+
+    std::atomic<uint64_t> n_dropped{0};
+
+   private:
+    std::mutex rings_mutex{};
+    std::vector<std::unique_ptr<ring_t>> rings{};
+    fmt::memory_buffer out{};
+    std::vector<std::byte> payload{};
+    std::FILE* output{stdout};
+
+    std::mutex stop_mutex{};
+    std::condition_variable stop_requested{};
+    bool is_stopping{false};
+    std::thread formatter{};
+};
+
+backend_t&
+backend() {
+    static backend_t b{};
+    return b;
+}
+
+}  // namespace
+
+void
+push(const std::byte* record, size_t size) noexcept {
+    // Registration locks the mutex only once per thread.
+    thread_local ring_t* const ring = backend().registerThread();
+    if (!ring->tryPush(record, size)) {
+        backend().n_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void
+flush() {
+    backend().drainAll();
+}
+
+void
+setOutput(std::FILE* file) {
+    backend().setOutput(file);
+}
+
+uint64_t
+dropped() noexcept {
+    return backend().n_dropped.load(std::memory_order_relaxed);
+}
+
+}  // namespace telemetry::log
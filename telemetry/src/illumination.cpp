@@ -0,0 +1,111 @@
+#include "illumination.h"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <map>
+#include <utility>
+
+#include "instrumented-channel.h"
+#include "metrics.h"
+
+namespace telemetry::illumination {
+
+namespace {
+
+std::vector<illumination_t>&
+registry() {
+    static std::vector<illumination_t> r{};
+    return r;
+}
+
+double
+toSeconds(std::chrono::nanoseconds t) {
+    return std::chrono::duration<double>(t).count();
+}
+
+/** Nearest-rank percentile of the sorted latencies. */
+std::chrono::nanoseconds
+percentile(const std::vector<std::chrono::nanoseconds>& sorted, const size_t p) {
+    const size_t rank = (p * sorted.size() + 99) / 100;
+    return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+}  // namespace
+
+bool
+observe(channel_t ch, std::chrono::nanoseconds budget, clock::time_point laser_on,
+        clock::time_point last_frame) {
+    const illumination_t illumination{currentPhase(), ch, budget, last_frame - laser_on};
+    registry().push_back(illumination);
+
+    auto& executor_metrics = metrics().executor;
+    executor_metrics.illumination_latency.observe(illumination.latency);
+    if (illumination.isOverrun()) {
+        executor_metrics.illumination_overruns.add(1);
+        return false;
+    }
+    return true;
+}
+
+const std::vector<illumination_t>&
+illuminations() {
+    return registry();
+}
+
+void
+printPhotobleachingReport(std::FILE* out) {
+    using frame_capture_card::n_cameras_per_board;
+
+    const auto& r = registry();
+    if (r.empty()) {
+        return;
+    }
+    fmt::print(out, "[ ] Photobleaching budget, from the laser to the last frame of each board:\n");
+
+    std::map<std::pair<size_t, channel_t>, std::vector<const illumination_t*>> groups;
+    for (const auto& illumination : r) {
+        groups[{illumination.phase, illumination.ch}].push_back(&illumination);
+    }
+
+    size_t n_overruns = 0;
+    std::chrono::nanoseconds excess{};
+    for (const auto& [key, group] : groups) {
+        std::vector<std::chrono::nanoseconds> latencies;
+        std::chrono::nanoseconds budget{};
+        size_t n_group_overruns = 0;
+        for (const auto* illumination : group) {
+            latencies.push_back(illumination->latency);
+            budget = std::max(budget, illumination->budget);
+            if (illumination->isOverrun()) {
+                n_group_overruns++;
+                excess += illumination->latency - illumination->budget;
+            }
+        }
+        std::sort(latencies.begin(), latencies.end());
+        n_overruns += n_group_overruns;
+
+        fmt::print(out,
+                   FMT_STRING("    step {:d} {:5s} {:4d} boards, p50 {:6.3f} s, p99 {:6.3f} s, "
+                              "max {:6.3f} s, budget {:6.3f} s{:s}\n"),
+                   key.first, toString(key.second), latencies.size(),
+                   toSeconds(percentile(latencies, 50)), toSeconds(percentile(latencies, 99)),
+                   toSeconds(latencies.back()), toSeconds(budget),
+                   (n_group_overruns > 0)
+                       ? fmt::format(FMT_STRING(", {:d} OVER BUDGET"), n_group_overruns)
+                       : std::string{});
+    }
+
+    if (n_overruns == 0) {
+        fmt::print(out, FMT_STRING("    Wells over budget: none of {:d}\n"),
+                   r.size() * n_cameras_per_board);
+    } else {
+        fmt::print(out,
+                   FMT_STRING("    Wells over budget: {:d} of {:d}, the boards {:.3f} s past the "
+                              "laser time in total\n"),
+                   n_overruns * n_cameras_per_board, r.size() * n_cameras_per_board,
+                   toSeconds(excess));
+    }
+}
+
+}  // namespace telemetry::illumination
@@ -0,0 +1,158 @@
+#include "instrumented-channel.h"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+
+namespace telemetry {
+
+namespace {
+
+using clock = channel_stats_t::clock;
+
+struct registry_t {
+    /** Deque, so that the references returned by channelStats() stay valid. */
+    std::deque<channel_stats_t> channels{};
+
+    /** Start time of each protocol phase. */
+    std::vector<clock::time_point> phase_start{clock::now()};
+};
+
+/** Constant-initialized, so that the replacement operator new of the
+ * allocation tracker may read it at any time. */
+size_t current_phase{0};
+
+registry_t&
+registry() {
+    static registry_t r{};
+    return r;
+}
+
+double
+toSeconds(std::chrono::nanoseconds t) {
+    return std::chrono::duration<double>(t).count();
+}
+
+}  // namespace
+
+channel_stats_t::channel_stats_t(std::string n, std::string p, std::string c, size_t n_p,
+                                 size_t n_c)
+    : name{std::move(n)},
+      producer{std::move(p)},
+      consumer{std::move(c)},
+      n_producers{n_p},
+      n_consumers{n_c} {}
+
+channel_phase_stats_t&
+channel_stats_t::integrate(clock::time_point now) {
+    const auto phase = currentPhase();
+    if (per_phase.size() <= phase) {
+        per_phase.resize(phase + 1);
+    }
+
+    auto& stats = per_phase[phase];
+    stats.depth_integral += static_cast<double>(depth) * (now - last_change).count();
+    last_change = now;
+    return stats;
+}
+
+void
+channel_stats_t::onPhase(clock::time_point now, size_t next_phase) {
+    integrate(now);
+    if (per_phase.size() <= next_phase) {
+        per_phase.resize(next_phase + 1);
+    }
+}
+
+void
+channel_stats_t::onPush(clock::time_point now, std::chrono::nanoseconds blocked) {
+    auto& stats = integrate(now);
+    depth++;
+    stats.n_pushed++;
+    stats.push_blocked += blocked;
+    stats.high_water = std::max(stats.high_water, depth);
+}
+
+void
+channel_stats_t::onPop(clock::time_point now, std::chrono::nanoseconds blocked) {
+    auto& stats = integrate(now);
+    depth--;
+    stats.n_popped++;
+    stats.pop_blocked += blocked;
+}
+
+channel_stats_t&
+channelStats(std::string name, std::string producer, std::string consumer, size_t n_producers,
+             size_t n_consumers) {
+    return registry().channels.emplace_back(std::move(name), std::move(producer),
+                                            std::move(consumer), n_producers, n_consumers);
+}
+
+void
+beginPhase(size_t phase) {
+    auto& r = registry();
+    const auto now = clock::now();
+    if (r.phase_start.size() <= phase) {
+        r.phase_start.resize(phase + 1, now);
+    }
+    r.phase_start[phase] = now;
+    for (auto& c : r.channels) {
+        c.onPhase(now, phase);
+    }
+    current_phase = phase;
+}
+
+size_t
+currentPhase() noexcept {
+    return current_phase;
+}
+
+void
+printChannelReport(std::FILE* out) {
+    const auto& r = registry();
+    const auto end_time = clock::now();
+
+    size_t n_phases = r.phase_start.size();
+    for (const auto& c : r.channels) {
+        n_phases = std::max(n_phases, c.phases().size());
+    }
+
+    for (size_t phase = 0; phase < n_phases; phase++) {
+        const auto start = (phase < r.phase_start.size()) ? r.phase_start[phase] : end_time;
+        const auto stop = (phase + 1 < r.phase_start.size()) ? r.phase_start[phase + 1] : end_time;
+        const auto duration = std::chrono::duration<double, std::nano>(stop - start).count();
+
+        fmt::print(out, FMT_STRING("[ ] Channel stalls in protocol step {:d} ({:.3f} s):\n"), phase,
+                   duration * 1e-9);
+
+        // Time each stage kept the other stages waiting, per waiting fiber.
+        std::map<std::string, double> blame;
+        for (const auto& c : r.channels) {
+            if (c.phases().size() <= phase) continue;
+            const auto& s = c.phases()[phase];
+
+            fmt::print(out,
+                       FMT_STRING("    {:12s} push blocked {:8.3f} s, pop blocked {:8.3f} s, "
+                                  "high-water {:d}, mean depth {:.2f}\n"),
+                       c.name, toSeconds(s.push_blocked), toSeconds(s.pop_blocked), s.high_water,
+                       (duration > 0) ? s.depth_integral / duration : 0.0);
+
+            blame[c.consumer] += toSeconds(s.push_blocked) / c.n_producers;
+            blame[c.producer] += toSeconds(s.pop_blocked) / c.n_consumers;
+        }
+
+        const auto bottleneck = std::max_element(
+            blame.begin(), blame.end(),
+            [](const auto& a, const auto& b) { return a.second < b.second; });
+        if (bottleneck == blame.end() || bottleneck->second <= 0) {
+            fmt::print(out, "    Bottleneck: none\n");
+        } else {
+            fmt::print(out, FMT_STRING("    Bottleneck: {:s} (others waited {:.3f} s on it)\n"),
+                       bottleneck->first, bottleneck->second);
+        }
+    }
+}
+
+}  // namespace telemetry
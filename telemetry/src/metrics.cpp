@@ -0,0 +1,213 @@
+#include "metrics.h"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <string_view>
+
+namespace telemetry {
+
+void
+histogram_t::observe(std::chrono::nanoseconds latency) noexcept {
+    const auto us = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+
+    // Index of the smallest power-of-two boundary >= us.
+    const size_t i = (us <= 1) ? 0 : (64 - __builtin_clzll(us - 1));
+    buckets[std::min(i, n_buckets)].add();
+    n_observations.add();
+    sum_us.add(us);
+}
+
+Metrics&
+metrics() {
+    static Metrics registry{};
+    return registry;
+}
+
+namespace {
+
+using buffer_t = fmt::memory_buffer;
+
+void
+writeHeader(buffer_t& out, std::string_view name, std::string_view type, std::string_view help) {
+    fmt::format_to(std::back_inserter(out), FMT_STRING("# HELP {:s} {:s}\n# TYPE {:s} {:s}\n"),
+                   name, help, name, type);
+}
+
+void
+writeHistogram(buffer_t& out, std::string_view name, std::string_view labels,
+               const histogram_t& h) {
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < histogram_t::n_buckets; i++) {
+        cumulative += h.bucket(i);
+        fmt::format_to(std::back_inserter(out),
+                       FMT_STRING("{:s}_bucket{{{:s}le=\"{:g}\"}} {:d}\n"), name, labels,
+                       histogram_t::upperBound(i) * 1e-6, cumulative);
+    }
+    cumulative += h.bucket(histogram_t::n_buckets);
+    fmt::format_to(std::back_inserter(out), FMT_STRING("{:s}_bucket{{{:s}le=\"+Inf\"}} {:d}\n"),
+                   name, labels, cumulative);
+
+    // Trim the trailing comma of the labels.
+    const auto label_set = labels.empty()
+                               ? std::string{}
+                               : fmt::format("{{{:s}}}", labels.substr(0, labels.size() - 1));
+    fmt::format_to(std::back_inserter(out), FMT_STRING("{:s}_sum{:s} {:g}\n"), name, label_set,
+                   h.sumMicroseconds() * 1e-6);
+    fmt::format_to(std::back_inserter(out), FMT_STRING("{:s}_count{:s} {:d}\n"), name, label_set,
+                   h.count());
+}
+
+}  // namespace
+
+std::string
+toPrometheusText(const Metrics& m) {
+    buffer_t out;
+    auto it = std::back_inserter(out);
+
+    writeHeader(out, "bioimage_frames_total", "counter", "Frames captured per camera.");
+    for (size_t b = 0; b < m.boards.size(); b++) {
+        for (size_t c = 0; c < m.boards[b].frames_per_camera.size(); c++) {
+            fmt::format_to(it,
+                           FMT_STRING("bioimage_frames_total{{board=\"{:d}\",camera=\"{:d}\"}} "
+                                      "{:d}\n"),
+                           b, c + 1, m.boards[b].frames_per_camera[c].load());
+        }
+    }
+
+    writeHeader(out, "bioimage_capture_bytes_total", "counter", "Pixel bytes received over USB.");
+    for (size_t b = 0; b < m.boards.size(); b++) {
+        fmt::format_to(it, FMT_STRING("bioimage_capture_bytes_total{{board=\"{:d}\"}} {:d}\n"),
+                       b, m.boards[b].bytes.load());
+    }
+
+    writeHeader(out, "bioimage_capture_retries_total", "counter",
+                "Frames discarded for the wrong LED ID, or for being surplus.");
+    for (size_t b = 0; b < m.boards.size(); b++) {
+        fmt::format_to(it, FMT_STRING("bioimage_capture_retries_total{{board=\"{:d}\"}} {:d}\n"),
+                       b, m.boards[b].retries.load());
+    }
+
+    writeHeader(out, "bioimage_header_resyncs_total", "counter",
+                "Bulk transfers skipped while searching for the frame header.");
+    for (size_t b = 0; b < m.boards.size(); b++) {
+        fmt::format_to(it, FMT_STRING("bioimage_header_resyncs_total{{board=\"{:d}\"}} {:d}\n"),
+                       b, m.boards[b].header_resyncs.load());
+    }
+
+    writeHeader(out, "bioimage_capture_restarts_total", "counter",
+                "Capture and writer processes restarted after a crash.");
+    for (size_t b = 0; b < m.boards.size(); b++) {
+        fmt::format_to(it, FMT_STRING("bioimage_capture_restarts_total{{board=\"{:d}\"}} {:d}\n"),
+                       b, m.boards[b].restarts.load());
+    }
+
+    writeHeader(out, "bioimage_capture_queue_depth", "gauge",
+                "Commands waiting in the capture queue.");
+    for (size_t b = 0; b < m.boards.size(); b++) {
+        fmt::format_to(it, FMT_STRING("bioimage_capture_queue_depth{{board=\"{:d}\"}} {:d}\n"),
+                       b, m.boards[b].capture_queue_depth.load());
+    }
+
+    writeHeader(out, "bioimage_integration_seconds", "histogram",
+                "Time to integrate the fluorescence frames of one capture command.");
+    for (size_t b = 0; b < m.boards.size(); b++) {
+        writeHistogram(out, "bioimage_integration_seconds", fmt::format("board=\"{:d}\",", b),
+                       m.boards[b].integration_time);
+    }
+
+    writeHeader(out, "bioimage_capture_command_seconds", "histogram",
+                "Time to execute one command from the capture queue.");
+    for (size_t b = 0; b < m.boards.size(); b++) {
+        writeHistogram(out, "bioimage_capture_command_seconds", fmt::format("board=\"{:d}\",", b),
+                       m.boards[b].command_time);
+    }
+
+    writeHeader(out, "bioimage_capture_skew_seconds", "histogram",
+                "Time behind the first board to complete the same capture command.");
+    for (size_t b = 0; b < m.boards.size(); b++) {
+        writeHistogram(out, "bioimage_capture_skew_seconds", fmt::format("board=\"{:d}\",", b),
+                       m.boards[b].completion_skew);
+    }
+
+    writeHeader(out, "bioimage_written_frames_total", "counter", "Frames written to disk.");
+    fmt::format_to(it, FMT_STRING("bioimage_written_frames_total {:d}\n"), m.writer.frames.load());
+
+    writeHeader(out, "bioimage_written_bytes_total", "counter", "Pixel bytes written to disk.");
+    fmt::format_to(it, FMT_STRING("bioimage_written_bytes_total {:d}\n"), m.writer.bytes.load());
+
+    writeHeader(out, "bioimage_write_queue_depth", "gauge", "Frames captured but not yet written.");
+    fmt::format_to(it, FMT_STRING("bioimage_write_queue_depth {:d}\n"),
+                   m.writer.queue_depth.load());
+
+    writeHeader(out, "bioimage_write_latency_seconds", "histogram", "Time to write one frame.");
+    writeHistogram(out, "bioimage_write_latency_seconds", "", m.writer.write_latency);
+
+    writeHeader(out, "bioimage_previews_total", "counter",
+                "Frames binned into the live preview ring.");
+    fmt::format_to(it, FMT_STRING("bioimage_previews_total {:d}\n"), m.writer.previews.load());
+
+    writeHeader(out, "bioimage_previews_dropped_total", "counter",
+                "Previews dropped beyond the CPU budget of the preview.");
+    fmt::format_to(it, FMT_STRING("bioimage_previews_dropped_total {:d}\n"),
+                   m.writer.previews_dropped.load());
+
+    writeHeader(out, "bioimage_settle_wait_seconds", "histogram",
+                "Time waiting for the LED matrix and the z-stage to settle.");
+    writeHistogram(out, "bioimage_settle_wait_seconds", "", m.executor.settle_wait);
+
+    writeHeader(out, "bioimage_settle_timeouts_total", "counter",
+                "Settle waits past the timeout or rejected, on the settle model.");
+    fmt::format_to(it, FMT_STRING("bioimage_settle_timeouts_total {:d}\n"),
+                   m.executor.settle_timeouts.load());
+
+    writeHeader(out, "bioimage_illumination_seconds", "histogram",
+                "Time from the laser on to the last fluorescence frame of each board.");
+    writeHistogram(out, "bioimage_illumination_seconds", "", m.executor.illumination_latency);
+
+    writeHeader(out, "bioimage_illumination_overruns_total", "counter",
+                "Illuminations of a board past the laser time.");
+    fmt::format_to(it, FMT_STRING("bioimage_illumination_overruns_total {:d}\n"),
+                   m.executor.illumination_overruns.load());
+
+    return fmt::to_string(out);
+}
+
+PrometheusExporter::PrometheusExporter(std::string p, std::chrono::milliseconds i)
+    : path{std::move(p)}, interval{i} {
+    exporter = std::thread{[this]() {
+        std::unique_lock lock{mutex};
+        while (!stop_requested.wait_for(lock, interval, [this]() { return is_stopping; })) {
+            writeFile();
+        }
+    }};
+}
+
+PrometheusExporter::~PrometheusExporter() {
+    {
+        std::lock_guard lock{mutex};
+        is_stopping = true;
+    }
+    stop_requested.notify_one();
+    exporter.join();
+    writeFile();
+}
+
+void
+PrometheusExporter::writeFile() const {
+    const auto text = toPrometheusText(metrics());
+    const auto temp_path = path + ".tmp";
+
+    std::FILE* file = std::fopen(temp_path.c_str(), "w");
+    if (file == nullptr) {
+        return;
+    }
+    std::fwrite(text.data(), 1, text.size(), file);
+    std::fclose(file);
+    std::rename(temp_path.c_str(), path.c_str());
+}
+
+}  // namespace telemetry
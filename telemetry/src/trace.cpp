@@ -0,0 +1,164 @@
+#include "trace.h"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <array>
+#include <boost/fiber/all.hpp>
+#include <cstdio>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace telemetry::trace {
+
+namespace {
+
+struct ring_buffer_t {
+    std::array<event_t, ring_capacity> events{};
+
+    /** Total number of events, including the overwritten ones. */
+    size_t n_recorded{0};
+};
+
+/** Ring buffers of all threads, which outlive the threads for the final dump. */
+struct registry_t {
+    std::mutex mutex{};
+    std::vector<std::unique_ptr<ring_buffer_t>> buffers{};
+    std::unordered_map<uint64_t, std::string> lane_names{};
+};
+
+registry_t&
+registry() {
+    static registry_t r{};
+    return r;
+}
+
+ring_buffer_t&
+threadBuffer() {
+    // Registration locks the mutex only once per thread.
+    thread_local ring_buffer_t* const buffer = []() {
+        auto& r = registry();
+        std::lock_guard lock{r.mutex};
+        r.buffers.push_back(std::make_unique<ring_buffer_t>());
+        return r.buffers.back().get();
+    }();
+    return *buffer;
+}
+
+void
+writeEscaped(fmt::memory_buffer& out, std::string_view s) {
+    for (const char c : s) {
+        if (c == '"' || c == '\\') {
+            out.push_back('\\');
+        }
+        out.push_back(c);
+    }
+}
+
+}  // namespace
+
+void
+record(const event_t& event) noexcept {
+    auto& buffer = threadBuffer();
+    buffer.events[buffer.n_recorded % ring_capacity] = event;
+    buffer.n_recorded++;
+}
+
+uint64_t
+currentLane() noexcept {
+    // Same identity as boost::this_fiber::get_id(), which is not hashable.
+    return reinterpret_cast<uintptr_t>(boost::fibers::context::active());
+}
+
+void
+nameLane(std::string name) {
+    auto& r = registry();
+    std::lock_guard lock{r.mutex};
+    r.lane_names[currentLane()] = std::move(name);
+}
+
+void
+dump(const std::string& path) {
+    auto& r = registry();
+    std::lock_guard lock{r.mutex};
+
+    std::vector<event_t> events;
+    size_t n_overwritten = 0;
+    for (const auto& buffer : r.buffers) {
+        const auto n = std::min(buffer->n_recorded, ring_capacity);
+        n_overwritten += buffer->n_recorded - n;
+        events.insert(events.end(), buffer->events.begin(), buffer->events.begin() + n);
+    }
+    std::sort(events.begin(), events.end(),
+              [](const event_t& a, const event_t& b) { return a.begin < b.begin; });
+
+    // Number the lanes in the order of appearance, so that the timeline of
+    // the executor fiber comes first.
+    std::map<uint64_t, size_t> lane_ids;
+    for (const auto& e : events) {
+        lane_ids.emplace(e.lane, lane_ids.size());
+    }
+
+    fmt::memory_buffer out;
+    auto it = std::back_inserter(out);
+    fmt::format_to(it, "{{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    bool is_first = true;
+    const auto separator = [&]() {
+        if (!is_first) {
+            fmt::format_to(it, ",\n");
+        }
+        is_first = false;
+    };
+
+    for (const auto& [lane, tid] : lane_ids) {
+        separator();
+        fmt::format_to(it, FMT_STRING("{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                                      "\"tid\":{:d},\"args\":{{\"name\":\""),
+                       tid);
+        if (const auto name = r.lane_names.find(lane); name != r.lane_names.end()) {
+            writeEscaped(out, name->second);
+        } else {
+            fmt::format_to(it, FMT_STRING("fiber {:d}"), tid);
+        }
+        fmt::format_to(it, "\"}}}}");
+    }
+
+    const auto origin = events.empty() ? std::chrono::steady_clock::time_point{}
+                                       : events.front().begin;
+    using us = std::chrono::duration<double, std::micro>;
+    for (const auto& e : events) {
+        separator();
+        fmt::format_to(it,
+                       FMT_STRING("{{\"name\":\"{:s}\",\"cat\":\"{:s}\",\"ph\":\"X\",\"ts\":{:.3f},"
+                                  "\"dur\":{:.3f},\"pid\":1,\"tid\":{:d}"),
+                       e.name, e.category, us{e.begin - origin}.count(),
+                       us{e.end - e.begin}.count(), lane_ids.at(e.lane));
+        if (e.arg_name != nullptr) {
+            fmt::format_to(it, FMT_STRING(",\"args\":{{\"{:s}\":{:d}}}"), e.arg_name, e.arg);
+        }
+        out.push_back('}');
+    }
+    fmt::format_to(it, "\n]}}\n");
+
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        throw std::runtime_error(fmt::format(FMT_STRING("Cannot write trace to {:s}"), path));
+    }
+    std::fwrite(out.data(), 1, out.size(), file);
+    std::fclose(file);
+
+    if (n_overwritten > 0) {
+        fmt::print(stderr,
+                   FMT_STRING("[ ] Trace ring buffers overflowed; {:d} oldest events lost\n"),
+                   n_overwritten);
+    }
+}
+
+}  // namespace telemetry::trace
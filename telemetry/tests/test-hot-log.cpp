@@ -0,0 +1,52 @@
+#include <boost/fiber/all.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstdio>
+#include <fmt/chrono.h>
+#include <string>
+#include <string_view>
+
+#include "hot-log.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+std::string
+readAll(std::FILE* file) {
+    std::rewind(file);
+    std::string text(1 << 16, '\0');
+    text.resize(std::fread(text.data(), 1, text.size(), file));
+    return text;
+}
+
+}  // namespace
+
+TEST_CASE("Format the log records in the background", "[hot_log]") {
+    std::FILE* out = std::tmpfile();
+    telemetry::log::setOutput(out);
+
+    constexpr std::string_view channel{"EGFP"};
+    const uint8_t board_id = 3;
+    boost::fibers::fiber worker{[&]() {
+        for (int cam_id = 1; cam_id <= 3; cam_id++) {
+            HOT_LOG_INFO("[{:d}] cam={:d} ch={:s}", board_id, cam_id, channel);
+        }
+        HOT_LOG_WARNING("[{:d}] exposure = {}, reg {:#x}", board_id, 30ms, uint16_t{0x3012});
+        HOT_LOG_ERROR("Closing");
+    }};
+    worker.join();
+
+    telemetry::log::flush();
+    const auto text = readAll(out);
+    telemetry::log::setOutput(stdout);
+    std::fclose(out);
+
+    REQUIRE(text ==
+            "[3] cam=1 ch=EGFP\n"
+            "[3] cam=2 ch=EGFP\n"
+            "[3] cam=3 ch=EGFP\n"
+            "[3] exposure = 30ms, reg 0x3012\n"
+            "Closing\n");
+    REQUIRE(telemetry::log::dropped() == 0);
+}
@@ -0,0 +1,56 @@
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#include "illumination.h"
+#include "instrumented-channel.h"
+#include "metrics.h"
+
+using namespace std::chrono_literals;
+namespace illumination = telemetry::illumination;
+
+namespace {
+
+std::string
+photobleachingReport() {
+    std::FILE* report = std::tmpfile();
+    illumination::printPhotobleachingReport(report);
+    std::rewind(report);
+    std::string text(4096, '\0');
+    text.resize(std::fread(text.data(), 1, text.size(), report));
+    std::fclose(report);
+    return text;
+}
+
+}  // namespace
+
+TEST_CASE("Flag the wells illuminated past the laser time", "[illumination]") {
+    const auto& executor_metrics = telemetry::metrics().executor;
+    const illumination::clock::time_point laser_on{};
+
+    REQUIRE(photobleachingReport().empty());
+
+    telemetry::beginPhase(3);
+    for (const auto latency : {900ms, 950ms, 990ms}) {
+        CHECK(illumination::observe(EGFP, 1s, laser_on, laser_on + latency));
+    }
+    CHECK_FALSE(illumination::observe(EGFP, 1s, laser_on, laser_on + 1250ms));
+    CHECK(illumination::observe(TXRED, 2s, laser_on, laser_on + 1500ms));
+
+    const auto& illuminations = illumination::illuminations();
+    REQUIRE(illuminations.size() == 5);
+    CHECK(illuminations[3].phase == 3);
+    CHECK(illuminations[3].latency == 1250ms);
+    CHECK(illuminations[3].isOverrun());
+    CHECK(executor_metrics.illumination_latency.count() == 5);
+    CHECK(executor_metrics.illumination_overruns.load() == 1);
+
+    const auto text = photobleachingReport();
+    CHECK(text.find("step 3 EGFP     4 boards, p50  0.950 s, p99  1.250 s, max  1.250 s, "
+                    "budget  1.000 s, 1 OVER BUDGET\n") != std::string::npos);
+    CHECK(text.find("step 3 TXRED    1 boards, p50  1.500 s, p99  1.500 s, max  1.500 s, "
+                    "budget  2.000 s\n") != std::string::npos);
+    CHECK(text.find("Wells over budget: 24 of 120, the boards 0.250 s past the laser time") !=
+          std::string::npos);
+}
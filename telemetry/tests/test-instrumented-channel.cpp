@@ -0,0 +1,58 @@
+#include <boost/fiber/all.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "instrumented-channel.h"
+
+using namespace std::chrono_literals;
+using telemetry::instrumented_channel;
+
+TEST_CASE("Attribute channel stalls to the slow consumer", "[instrumented_channel]") {
+    auto& stats = telemetry::channelStats("frames", "camera", "disk");
+    instrumented_channel<std::vector<int>> channel{4, stats};
+
+    telemetry::beginPhase(0);
+    boost::fibers::fiber producer{[&]() {
+        for (int i = 0; i < 8; i++) {
+            channel.push(std::vector<int>(16, i));
+        }
+        channel.close();
+    }};
+
+    std::vector<int> received;
+    boost::fibers::fiber consumer{[&]() {
+        for (auto&& frame : channel) {
+            REQUIRE(frame.size() == 16);
+            received.push_back(frame.front());
+            boost::this_fiber::sleep_for(2ms);
+        }
+    }};
+    producer.join();
+    consumer.join();
+
+    REQUIRE(received == std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7});
+
+    REQUIRE(stats.phases().size() == 1);
+    const auto& s = stats.phases()[0];
+    REQUIRE(s.n_pushed == 8);
+    REQUIRE(s.n_popped == 8);
+
+    // buffered_channel holds one item less than its capacity.
+    REQUIRE(s.high_water == 3);
+    REQUIRE(s.push_blocked > 5ms);
+    REQUIRE(s.push_blocked > s.pop_blocked);
+    REQUIRE(s.depth_integral > 0);
+
+    std::FILE* report = std::tmpfile();
+    telemetry::printChannelReport(report);
+    std::rewind(report);
+    std::string text(4096, '\0');
+    text.resize(std::fread(text.data(), 1, text.size(), report));
+    std::fclose(report);
+
+    REQUIRE(text.find("Channel stalls in protocol step 0") != std::string::npos);
+    REQUIRE(text.find("Bottleneck: disk") != std::string::npos);
+}
@@ -0,0 +1,62 @@
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "metrics.h"
+
+using namespace std::chrono_literals;
+using telemetry::histogram_t;
+
+TEST_CASE("Histogram buckets are powers of two microseconds", "[metrics]") {
+    histogram_t h{};
+    h.observe(500ns);
+    h.observe(1us);
+    h.observe(3us);
+    h.observe(4us);
+    h.observe(1000s);
+
+    REQUIRE(h.bucket(0) == 2);
+    REQUIRE(h.bucket(2) == 2);
+    REQUIRE(h.bucket(histogram_t::n_buckets) == 1);
+    REQUIRE(h.count() == 5);
+    REQUIRE(h.sumMicroseconds() == 1 + 3 + 4 + 1'000'000'000);
+}
+
+TEST_CASE("Render the metrics in Prometheus text format", "[metrics]") {
+    telemetry::Metrics m{};
+    m.boards[1].frames_per_camera[23].add(7);
+    m.boards[2].capture_queue_depth.add(2);
+    m.boards[2].capture_queue_depth.add(-1);
+    m.boards[3].completion_skew.observe(5ms);
+    m.writer.write_latency.observe(2ms);
+    m.executor.settle_timeouts.add(1);
+
+    const auto text = telemetry::toPrometheusText(m);
+    REQUIRE(text.find("# TYPE bioimage_frames_total counter\n") != std::string::npos);
+    REQUIRE(text.find("bioimage_frames_total{board=\"1\",camera=\"24\"} 7\n") !=
+            std::string::npos);
+    REQUIRE(text.find("bioimage_capture_queue_depth{board=\"2\"} 1\n") != std::string::npos);
+    REQUIRE(text.find("bioimage_capture_skew_seconds_count{board=\"3\"} 1\n") !=
+            std::string::npos);
+    REQUIRE(text.find("bioimage_write_latency_seconds_bucket{le=\"+Inf\"} 1\n") !=
+            std::string::npos);
+    REQUIRE(text.find("bioimage_write_latency_seconds_count 1\n") != std::string::npos);
+    REQUIRE(text.find("bioimage_settle_wait_seconds_count 0\n") != std::string::npos);
+    REQUIRE(text.find("bioimage_settle_timeouts_total 1\n") != std::string::npos);
+}
+
+TEST_CASE("Export the final values on shutdown", "[metrics]") {
+    const char* path = "test-metrics.prom";
+    telemetry::metrics().writer.frames.add(3);
+    { telemetry::PrometheusExporter exporter{path, 1h}; }
+
+    std::ifstream file{path};
+    REQUIRE(file.good());
+    std::stringstream text;
+    text << file.rdbuf();
+    REQUIRE(text.str().find("bioimage_written_frames_total 3\n") != std::string::npos);
+    std::remove(path);
+}
@@ -0,0 +1,57 @@
+#include <boost/fiber/all.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "trace.h"
+
+namespace {
+
+void
+tracedWorker(const char* lane_name, int n_events) {
+    TRACE_LANE_NAME(lane_name);
+    for (int i = 0; i < n_events; i++) {
+        TRACE_SCOPE_ARG("test", "work", "i", i);
+        boost::this_fiber::yield();
+    }
+}
+
+size_t
+countOccurrences(const std::string& text, const std::string& pattern) {
+    size_t n = 0;
+    for (auto pos = text.find(pattern); pos != std::string::npos;
+         pos = text.find(pattern, pos + 1)) {
+        n++;
+    }
+    return n;
+}
+
+}  // namespace
+
+TEST_CASE("One timeline lane per fiber", "[trace]") {
+    static_assert(telemetry::trace::is_enabled);
+
+    boost::fibers::fiber producer{tracedWorker, "producer", 3};
+    boost::fibers::fiber consumer{tracedWorker, "consumer", 2};
+    producer.join();
+    consumer.join();
+
+    const char* path = "test-trace.json";
+    telemetry::trace::dump(path);
+
+    std::ifstream file{path};
+    REQUIRE(file.good());
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    const auto text = buffer.str();
+
+    REQUIRE(text.rfind("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 0) == 0);
+    REQUIRE(countOccurrences(text, "\"ph\":\"M\"") == 2);
+    REQUIRE(text.find("\"args\":{\"name\":\"producer\"}") != std::string::npos);
+    REQUIRE(text.find("\"args\":{\"name\":\"consumer\"}") != std::string::npos);
+    REQUIRE(countOccurrences(text, "\"name\":\"work\",\"cat\":\"test\",\"ph\":\"X\"") == 5);
+    REQUIRE(text.find("\"args\":{\"i\":2}") != std::string::npos);
+    std::remove(path);
+}
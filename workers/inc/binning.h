@@ -0,0 +1,66 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <nonstd/span.hpp>
+
+/** Intensity statistics of one full-resolution frame. */
+struct frame_stats_t {
+    uint16_t min{};
+    uint16_t max{};
+    double mean{};
+};
+
+/** Downsample the frame by `factor` in both directions for the live preview,
+ * and compute its statistics in the same pass.
+ *
+ * Each preview pixel is the mean of a factor x factor block. The rows of each
+ * block are summed into `row_sums`, one column per element, in a plain loop
+ * over the row that the compiler auto-vectorizes when built with
+ * -march=native, as accumulateFrame(). Only the final horizontal sum runs at
+ * the preview resolution.
+ *
+ * @param[in] frame Pixels in row-major order, width x height.
+ * @param[out] row_sums Scratch of `width` elements.
+ * @param[out] preview Pixels of (width / factor) x (height / factor).
+ */
+template <int32_t factor, typename Pixel>
+frame_stats_t
+binFrame(nonstd::span<const Pixel> frame, const int32_t width, const int32_t height,
+         nonstd::span<uint32_t> row_sums, nonstd::span<uint16_t> preview) {
+    static_assert(factor > 0 && (factor & (factor - 1)) == 0);
+    static_assert(sizeof(Pixel) <= sizeof(uint16_t));
+
+    const int32_t preview_width = width / factor;
+    Pixel lo = std::numeric_limits<Pixel>::max();
+    Pixel hi = std::numeric_limits<Pixel>::min();
+    uint64_t sum = 0;
+
+    uint32_t* __restrict sums = row_sums.data();
+    for (int32_t by = 0; by < height / factor; by++) {
+        std::fill_n(sums, width, 0);
+        for (int32_t dy = 0; dy < factor; dy++) {
+            const Pixel* __restrict row = frame.data() + (by * factor + dy) * width;
+            uint32_t row_sum = 0;
+            for (int32_t x = 0; x < width; x++) {
+                const Pixel v = row[x];
+                sums[x] += v;
+                row_sum += v;
+                lo = std::min(lo, v);
+                hi = std::max(hi, v);
+            }
+            sum += row_sum;
+        }
+
+        uint16_t* out = preview.data() + by * preview_width;
+        for (int32_t bx = 0; bx < preview_width; bx++) {
+            uint32_t block = 0;
+            for (int32_t k = 0; k < factor; k++) {
+                block += sums[bx * factor + k];
+            }
+            out[bx] = static_cast<uint16_t>(block / (factor * factor));
+        }
+    }
+
+    return {lo, hi, static_cast<double>(sum) / (static_cast<double>(width) * height)};
+}
@@ -0,0 +1,281 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+#include "constants.h"
+#include "fiber-messages.h"
+
+/** Link of the supervisor to the processes of one board, in POSIX shared
+ * memory.
+ *
+ * In capture-images --processes, the capture worker of each board runs in a
+ * process of its own, and hands its frames over to a writer process of its
+ * own, so that a crash of one board leaves the other boards running. The
+ * supervisor, i.e. capture-images, creates one shared memory per board, e.g.
+ * /dev/shm/bioimage-board0, holding:
+ *
+ * - the capture commands, from the supervisor to the capture process,
+ * - the exposure and completion events, back to the supervisor, and
+ * - the frame slots. The capture process fills a free slot, and queues its
+ *   index to the writer process, which writes the frame in place and frees
+ *   the slot. The frames change owner, not place.
+ *
+ * Each queue is a lock-free ring of one producer and one consumer. The
+ * processes poll the rings every poll_interval while there is nothing to do.
+ */
+namespace board_link {
+
+/** "BILK" */
+constexpr uint32_t magic = 0x4b4c4942;
+constexpr uint32_t layout_version = 3;
+
+/** Time between two polls of an empty ring, or of a full one. */
+constexpr std::chrono::microseconds poll_interval{1000};
+
+/** Lock-free ring of one producer and one consumer, in shared memory. */
+template <typename T, size_t capacity>
+struct spsc_ring_t {
+    static_assert(std::is_trivially_copyable_v<T>, "The items are copied across processes");
+    static_assert((capacity & (capacity - 1)) == 0);
+
+    /** Items popped so far. Written by the consumer only. */
+    alignas(64) std::atomic<uint64_t> head{0};
+
+    /** Items pushed so far. Written by the producer only. */
+    alignas(64) std::atomic<uint64_t> tail{0};
+
+    alignas(64) std::array<T, capacity> items{};
+
+    /** @returns false if full. */
+    bool tryPush(const T& item) {
+        const uint64_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == capacity) {
+            return false;
+        }
+        items[t % capacity] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Pass the oldest item to `consume`, in place, and only then pop it. A
+     * consumer crashing in `consume` leaves the item in the ring.
+     *
+     * @returns false if empty.
+     */
+    template <typename F>
+    bool tryConsume(F&& consume) {
+        const uint64_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        consume(items[h % capacity]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& item) {
+        return tryConsume([&](const T& i) { item = i; });
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+    /** Drop the items not popped yet, in place of the consumer, once the
+     * consumer process is gone. */
+    void discard() { head.store(tail.load(std::memory_order_acquire), std::memory_order_release); }
+};
+
+/** Capture command to the capture process. The completion and exposure
+ * channels are those of the supervisor. The capture process signals its own
+ * instead, and reports the events back. */
+struct command_record_t {
+    enum op_t : uint8_t { CAPTURE, STOP } op{CAPTURE};
+    fiber_messages::capture::command_t command{};
+
+    /** Number of the capture command, from 1. A replay keeps it. */
+    uint32_t seq{};
+
+    /** Cameras whose frame of the command a crashed capture process handed
+     * over already, not to hand over again. Bit i - 1 of camera i. */
+    uint32_t skip_cameras{};
+};
+
+/** Exposure or completion of the oldest capture command awaiting one. */
+struct event_t {
+    enum kind_t : uint8_t { EXPOSED, COMPLETED } kind{};
+
+    /** Nanoseconds of the steady clock, which all processes share. */
+    int64_t time_ns{};
+};
+
+/** Bit of the camera in command_record_t::skip_cameras and handover_t. */
+constexpr uint32_t
+cameraBit(const uint8_t cam_id) {
+    return uint32_t{1} << (cam_id - 1);
+}
+
+static_assert(frame_capture_card::n_cameras_per_board <= 32, "A bit per camera");
+
+/** Frames of the capture command handed over last to the writer process. */
+struct handover_t {
+    /** Of the command. */
+    uint32_t seq{};
+
+    /** Bit i - 1 of camera i. */
+    uint32_t cameras{};
+};
+
+/** Owner of a frame slot. A slot goes FREE -> FILLING (capture process) ->
+ * QUEUED -> WRITING (writer process) -> FREE. */
+enum class slot_state_t : uint32_t { FREE, FILLING, QUEUED, WRITING };
+
+/** Capture command of the frame. */
+enum class frame_kind_t : uint8_t { DARK, FPM, FLUORESCENCE };
+
+/** One frame, followed by its pixels. */
+struct alignas(64) frame_slot_t {
+    std::atomic<slot_state_t> state{slot_state_t::FREE};
+
+    frame_kind_t kind{};
+
+    /** Capture command of the frame, by its seq. */
+    uint32_t command_seq{};
+
+    uint8_t board_id{};
+    uint8_t cam_id{};
+    uint8_t led_id{};
+    int16_t zpos{};
+    channel_t ch{EGFP};
+
+    /** Of the pixels: 8-bit raw frames, or 16-bit integrated ones. */
+    uint32_t n_bytes{};
+
+    const uint8_t* pixels() const { return reinterpret_cast<const uint8_t*>(this + 1); }
+    uint8_t* pixels() { return reinterpret_cast<uint8_t*>(this + 1); }
+};
+
+/** Frame slots per board, at most. */
+constexpr size_t max_slots = 64;
+
+/** Start of the shared memory, followed by the frame slots. */
+struct alignas(64) header_t {
+    uint32_t magic{board_link::magic};
+    uint32_t version{layout_version};
+    uint32_t usb_id{};
+    uint32_t n_slots{};
+
+    /** Bytes per slot, including the pixels. */
+    uint32_t slot_size{};
+
+    spsc_ring_t<command_record_t, 16> commands{};
+    spsc_ring_t<event_t, 64> events{};
+
+    /** Indices of the QUEUED slots, in the order of capture. Each slot is
+     * there at most once: the writer process marks it WRITING as it pops it. */
+    spsc_ring_t<uint32_t, max_slots> frames{};
+
+    /** handover_t, packed as the seq in the upper 32 bits and the cameras in
+     * the lower ones. Written by the capture process, or by the supervisor
+     * once it is gone. */
+    std::atomic<uint64_t> handed_over{0};
+
+    /** Set by the capture process once it has queued its last frame. */
+    std::atomic<uint32_t> is_capture_done{0};
+
+    std::atomic<uint64_t> frames_captured{0};
+    std::atomic<uint64_t> frames_written{0};
+    std::atomic<uint64_t> bytes_written{0};
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                  std::atomic<slot_state_t>::is_always_lock_free,
+              "The rings are shared across processes");
+
+/** Shared memory of one board, e.g. "/bioimage-board0". */
+std::string linkName(const std::string& prefix, uint8_t usb_id);
+
+/** Mapping of the shared memory of one board. */
+class board_link_t {
+   public:
+    /** Create the shared memory, or replace the one of a previous run. It is
+     * unlinked on destruction.
+     *
+     * @throws std::invalid_argument on more than max_slots, and
+     * std::runtime_error if the shared memory cannot be created.
+     */
+    board_link_t(std::string name, uint8_t usb_id, size_t n_slots);
+
+    /** Open the shared memory of the supervisor.
+     *
+     * @throws std::runtime_error if it does not exist, or is of another layout.
+     */
+    explicit board_link_t(std::string name);
+
+    ~board_link_t();
+
+    board_link_t(const board_link_t&) = delete;
+    board_link_t& operator=(const board_link_t&) = delete;
+
+    header_t& header() { return *link; }
+    const header_t& header() const { return *link; }
+
+    size_t nSlots() const { return link->n_slots; }
+    frame_slot_t& slot(size_t i) {
+        return *reinterpret_cast<frame_slot_t*>(reinterpret_cast<char*>(link + 1) +
+                                                i * link->slot_size);
+    }
+
+    /** Capacity of a slot, in pixel bytes. */
+    size_t slotCapacity() const { return link->slot_size - sizeof(frame_slot_t); }
+
+    /** Take a free slot to fill, as the capture process.
+     *
+     * @returns nullptr if all slots are taken.
+     */
+    frame_slot_t* claimSlot();
+
+    /** Hand the filled slot over to the writer process, and add its camera to
+     * the frames handed over of its capture command. */
+    void queueSlot(frame_slot_t& slot);
+
+    /** The frames of the capture commands come in the order of the
+     * commands, so that the commands before the one handed over last are
+     * handed over in full. */
+    handover_t handedOver() const;
+
+    /** Take the next queued slot to write, as the writer process. The slot is
+     * WRITING before it leaves the ring, so that it is never lost to a crash
+     * of the writer.
+     *
+     * @returns nullptr if none is queued.
+     */
+    frame_slot_t* nextQueuedSlot();
+
+    /** Give the written slot back to the capture process. */
+    void releaseSlot(frame_slot_t& slot);
+
+    /** Recover the slots of a crashed capture process, in its place: free the
+     * slots it was filling, and take their cameras off the frames handed over,
+     * and queue the ones it marked QUEUED but crashed before queueing.
+     *
+     * @returns the frames lost, i.e. the slots freed.
+     */
+    size_t recoverCaptureSlots();
+
+   private:
+    const std::string name;
+    const bool is_owner;
+
+    header_t* link{nullptr};
+    size_t mapped_size{};
+
+    uint32_t indexOf(const frame_slot_t& slot) const;
+};
+
+}  // namespace board_link
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+
+#include "board-link.h"
+#include "fiber-messages.h"
+
+/** Capture worker of one board bound to its USB source, e.g. imageCaptureWorker. */
+using capture_worker_fn =
+    std::function<void(fiber_messages::capture::queue_t&, fiber_messages::write::queue_t&)>;
+
+/** Fault injection into the capture process, to exercise the supervisor. */
+struct capture_process_config_t {
+    /** Crash the process, as on a corrupt bulk transfer, once it has handed
+     * over this many frames. Zero to never crash. */
+    uint64_t crash_after_frames{0};
+};
+
+/** Body of the capture process of one board.
+ *
+ * Runs the capture worker on the commands of the supervisor, reports the
+ * exposure and completion events back, and hands the frames over to the
+ * writer process. The frame is copied once, from the buffer of the capture
+ * worker into a free slot of the link. Returns once the supervisor stops the
+ * process, and the last frame is queued.
+ */
+void linkedCaptureWorker(board_link::board_link_t& link, const capture_worker_fn& capture_worker,
+                         capture_process_config_t config = {});
+
+/** Body of the writer process of one board: write the queued frames in place
+ * in the link, starting with those a crashed writer process left half written,
+ * until the capture process is done. */
+void linkedFileWriteWorker(board_link::board_link_t& link);
@@ -0,0 +1,178 @@
+#pragma once
+#include <sys/types.h>
+
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "board-link.h"
+#include "fiber-messages.h"
+
+/** Worker process of one board. */
+enum class board_process_t { CAPTURE, WRITER };
+
+/** Start a worker process of the board on the link, e.g. board-worker
+ * --capture, and return its PID.
+ *
+ * @param[in] generation Number of the process of this role, from 0, counting
+ * the restarts.
+ */
+using spawn_fn = std::function<pid_t(board_process_t role, uint8_t usb_id,
+                                     const std::string& link_name, uint32_t generation)>;
+
+/** Start the executable argv[0] with the arguments.
+ *
+ * @throws std::runtime_error if it cannot be started.
+ */
+pid_t spawnProcess(const std::vector<std::string>& argv);
+
+struct supervisor_config_t {
+    /** Shared memory of each board, suffixed with the USB ID. */
+    std::string link_prefix{"/bioimage-board"};
+
+    /** Frames in flight from the capture process to the writer process. */
+    size_t n_slots{8};
+
+    /** Restarts of the capture and writer processes of the board, together,
+     * before giving up the plate. */
+    size_t max_restarts{3};
+};
+
+/** Stand-in of the capture worker of one board in the supervisor, i.e. the
+ * process of the executor.
+ *
+ * Forwards the capture commands of the executor to the capture process of the
+ * board, and relays its exposure and completion events back. If the capture
+ * process crashes, the supervisor starts another one, and replays to it the
+ * camera settings and the capture commands in flight, so that the executor
+ * only sees the command take longer. The frames the crashed process was
+ * filling are lost. The command in flight is captured again, and hands over
+ * only the frames of the cameras not handed over before the crash. A
+ * crashed writer process is restarted, and its successor writes the frame it
+ * was writing.
+ */
+class board_supervisor_t {
+   public:
+    /** Create the link of the board, and start its processes.
+     *
+     * @throws std::runtime_error if the link or the processes cannot be
+     * created.
+     */
+    board_supervisor_t(uint8_t usb_id, spawn_fn spawn, supervisor_config_t config = {});
+
+    /** Kill the processes still running, and unlink the shared memory. */
+    ~board_supervisor_t();
+
+    board_supervisor_t(const board_supervisor_t&) = delete;
+    board_supervisor_t& operator=(const board_supervisor_t&) = delete;
+
+    /** Fiber body, in place of imageCaptureWorker(): forward the capture
+     * queue until it is closed, and return once the board's frames are
+     * written.
+     *
+     * Once the plate is given up, the capture commands complete at once,
+     * without frames, until the queue is closed. The executor never waits on
+     * the board.
+     *
+     * @param[in] on_give_up Called as the board gives up the plate, e.g. to
+     * give up the other boards.
+     * @throws std::runtime_error once the processes of the board crashed more
+     * than max_restarts times, i.e. the plate is given up.
+     */
+    void run(fiber_messages::capture::queue_t& capture_queue,
+             const std::function<void()>& on_give_up = {});
+
+    /** Give up the plate, e.g. as another board did: kill the processes of
+     * the board, and complete its capture commands without frames. */
+    void giveUp() { is_given_up = true; }
+
+    /** Restarts of the capture and writer processes so far. */
+    size_t restarts() const { return n_restarts; }
+    const board_link::header_t& header() const { return link.header(); }
+
+    /** Whether the board gave up the plate on its processes crashing. */
+    bool failed() const { return failure != nullptr; }
+
+   private:
+    const uint8_t usb_id;
+    const spawn_fn spawn;
+    const supervisor_config_t config;
+    const std::string link_name;
+    board_link::board_link_t link;
+
+    pid_t capture_pid{-1};
+    pid_t writer_pid{-1};
+    uint32_t capture_generation{0};
+    uint32_t writer_generation{0};
+    bool is_capture_done{false};
+    bool is_writer_done{false};
+    size_t n_restarts{0};
+
+    /** Capture commands sent so far, for their seq. */
+    uint32_t n_commands{0};
+
+    /** Why the plate was given up, for run() to rethrow. */
+    std::exception_ptr failure{};
+
+    /** Capture commands sent but not yet completed, in order, with the
+     * signals already delivered cleared. */
+    std::deque<board_link::command_record_t> in_flight{};
+
+    /** Camera settings of the commands completed so far, to replay. */
+    std::optional<fiber_messages::capture::camera::init_sequence_t> init_sequence{};
+    std::optional<fiber_messages::capture::camera::exposure_gain_t> exposure_gain{};
+
+    /** Records still to resend to the restarted capture process. The
+     * forwarding of new commands waits for them. */
+    std::deque<board_link::command_record_t> replay{};
+
+    bool is_stopping{false};
+    bool is_given_up{false};
+
+    /** Frames and bytes written, already added to the metrics. */
+    uint64_t n_written{0};
+    uint64_t n_bytes_written{0};
+
+    /** Send the command to the capture process, unless it crashes meanwhile,
+     * in which case the restart replays it. */
+    void send(const board_link::command_record_t& record);
+
+    /** Relay the events of the capture process to the executor, and retire
+     * the commands with all their signals delivered. */
+    void relayEvents();
+
+    /** Wait for the processes of the board to finish, restarting them if
+     * they crash, unless the plate is given up. */
+    void supervise(const std::function<void()>& on_give_up);
+
+    /** Deliver the signals still pending of the commands in flight, for the
+     * plate given up. */
+    void releaseSignals();
+
+    void killProcesses();
+
+    /** Count the restart of the crashed process, in restarts() and in the
+     * metrics of the board.
+     *
+     * @throws std::runtime_error beyond max_restarts.
+     */
+    void countRestart(board_process_t role, int status);
+
+    /** @throws std::runtime_error beyond max_restarts. */
+    void restartCapture(int status);
+    void restartWriter(int status);
+};
+
+/** Fiber body of the stand-in capture worker of the board in
+ * capture-images --processes: board_supervisor_t::run(), which, on giving up
+ * the plate, gives up the other boards too. The executor then runs the
+ * protocol out without captures.
+ *
+ * @param[in] boards Supervisors of all the boards.
+ */
+void superviseBoard(board_supervisor_t& board, fiber_messages::capture::queue_t& capture_queue,
+                    const std::vector<board_supervisor_t*>& boards);
@@ -3,4 +3,13 @@
 
 #include "fiber-messages.h"
 
-void fileWriteWorker(fiber_messages::write::queue_t& write_queue);
\ No newline at end of file
+namespace preview {
+class preview_tap_t;
+}
+
+void fileWriteWorker(fiber_messages::write::queue_t& write_queue);
+
+/** Write the frames, and publish their live previews to the shared memory of
+ * the tap, in the idle time of the writer. See preview-tap.h. */
+void previewingFileWriteWorker(fiber_messages::write::queue_t& write_queue,
+                               preview::preview_tap_t& preview_tap);
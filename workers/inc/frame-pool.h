@@ -0,0 +1,55 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/** Free list of frame buffers, recycled from the file writer back to the
+ * capture workers, so that the capture loop stops allocating once warmed up.
+ *
+ * The pool grows on demand up to the peak number of frames in flight. All
+ * users run as fibers on the same CPU thread, so no synchronization is
+ * required.
+ */
+template <typename Pixel>
+class frame_pool_t {
+   public:
+    /**
+     * @param[in] n Number of pixels per frame.
+     * @param[in] max_free Buffers kept in the free list. The buffers released
+     * beyond are freed.
+     */
+    frame_pool_t(size_t n, size_t max_free) : n_pixels{n} { free_frames.reserve(max_free); }
+
+    frame_pool_t(const frame_pool_t&) = delete;
+    frame_pool_t& operator=(const frame_pool_t&) = delete;
+
+    /** Buffer of n_pixels with unspecified content. Allocates only if the
+     * free list is empty. */
+    std::vector<Pixel> acquire() {
+        if (free_frames.empty()) {
+            return std::vector<Pixel>(n_pixels);
+        }
+        auto frame = std::move(free_frames.back());
+        free_frames.pop_back();
+        return frame;
+    }
+
+    void release(std::vector<Pixel> frame) {
+        if (frame.size() == n_pixels && free_frames.size() < free_frames.capacity()) {
+            free_frames.push_back(std::move(frame));
+        }
+    }
+
+    size_t available() const { return free_frames.size(); }
+
+   private:
+    const size_t n_pixels;
+    std::vector<std::vector<Pixel>> free_frames{};
+};
+
+/** Buffers of the raw 8-bit frames from the capture cards. */
+frame_pool_t<uint8_t>& rawFramePool();
+
+/** Buffers of the time-integrated 16-bit fluorescence frames. */
+frame_pool_t<uint16_t>& integratedFramePool();
@@ -2,8 +2,29 @@
 #include <array>
 #include <boost/fiber/barrier.hpp>
 #include <cstdint>
+#include <string>
 
 #include "fiber-messages.h"
 
 void imageCaptureWorker(const uint8_t board_id, fiber_messages::capture::queue_t& capture_queue,
-                        fiber_messages::write::queue_t& write_queue);
\ No newline at end of file
+                        fiber_messages::write::queue_t& write_queue);
+
+/** Capture frames from the mock USB, and record the bulk transfers to the
+ * capture file for later replay. */
+void recordingCaptureWorker(const uint8_t board_id, const std::string& capture_path,
+                            fiber_messages::capture::queue_t& capture_queue,
+                            fiber_messages::write::queue_t& write_queue);
+
+/** Capture frames from the recorded bulk transfers of a real well plate.
+ *
+ * @param[in] realtime Replay the bulk transfers at the recorded timing, or as
+ * fast as possible.
+ */
+void replayCaptureWorker(const uint8_t board_id, const std::string& capture_path,
+                         const bool realtime, fiber_messages::capture::queue_t& capture_queue,
+                         fiber_messages::write::queue_t& write_queue);
+
+/** Capture frames from the mock USB in virtual time, for dry runs. The frames
+ * take the exposure and USB transfer time of simulator::time_model. */
+void simulatedCaptureWorker(const uint8_t board_id, fiber_messages::capture::queue_t& capture_queue,
+                            fiber_messages::write::queue_t& write_queue);
@@ -0,0 +1,224 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <nonstd/span.hpp>
+#include <string>
+#include <vector>
+
+#include "binning.h"
+#include "constants.h"
+
+/** Live preview of the cameras, in POSIX shared memory.
+ *
+ * The file writer bins the frames it writes, and publishes them to a ring of
+ * preview slots, e.g. /dev/shm/bioimage-preview. A viewer process maps the
+ * ring read-only, and renders each preview in place, without copies.
+ *
+ * Each slot is guarded by a seqlock: the sequence number is odd while the
+ * writer fills the slot. The writer never waits for the viewer. It overwrites
+ * the oldest slot, and a viewer reading it at that time sees the sequence
+ * change and drops the preview.
+ */
+namespace preview {
+
+/** "BIPV" */
+constexpr uint32_t magic = 0x56504942;
+constexpr uint32_t layout_version = 1;
+
+/** Capture command of the previewed frame. */
+enum class frame_kind_t : uint8_t { DARK, FPM, FLUORESCENCE };
+
+/** One preview, followed by its pixels up to the capacity of the ring. */
+struct alignas(64) slot_t {
+    /** Odd while the writer fills the slot. */
+    std::atomic<uint32_t> sequence{0};
+
+    uint8_t board_id{};
+    uint8_t cam_id{};
+    frame_kind_t kind{};
+    uint8_t led_id{};
+    int16_t zpos{};
+    channel_t ch{EGFP};
+    uint8_t binning{};
+    uint16_t width{};
+    uint16_t height{};
+
+    /** Of the full-resolution frame. */
+    frame_stats_t stats{};
+
+    /** Frames previewed so far, including this one. */
+    uint64_t frame_number{};
+
+    /** Capture time, in nanoseconds of the steady clock, or of the virtual
+     * clock of a dry run. */
+    int64_t timestamp_ns{};
+
+    const uint16_t* pixels() const { return reinterpret_cast<const uint16_t*>(this + 1); }
+    uint16_t* pixels() { return reinterpret_cast<uint16_t*>(this + 1); }
+};
+
+/** Start of the shared memory, followed by the slots. */
+struct alignas(64) header_t {
+    uint32_t magic{preview::magic};
+    uint32_t version{layout_version};
+    uint32_t n_slots{};
+
+    /** Bytes per slot, including the pixels. */
+    uint32_t slot_size{};
+
+    /** Previews published so far. The next one goes to the slot
+     * n_published % n_slots. */
+    std::atomic<uint64_t> n_published{0};
+
+    /** Slot of the latest preview of each camera, plus one, by the well index
+     * board_id * 24 + cam_id - 1. Zero for none yet. */
+    std::array<std::atomic<uint32_t>, well_plate::n_wells> latest{};
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free &&
+                  std::atomic<uint64_t>::is_always_lock_free,
+              "The seqlock is shared across processes");
+
+/** Resolution and CPU budget of the live preview. */
+struct preview_config_t {
+    /** Downsampling factor, 4 or 8. */
+    int32_t binning{8};
+
+    /** Previews kept in the ring. */
+    size_t n_slots{32};
+
+    /** Time between two previews of the same camera. */
+    std::chrono::milliseconds min_interval{500};
+
+    /** Share of the run time the tap may spend binning. */
+    double max_duty_cycle{0.02};
+};
+
+/** Writer of the preview ring, i.e. the tap of the file writer.
+ *
+ * The tap bins at most one frame per camera every min_interval, and only
+ * within max_duty_cycle of the run time, so that the previews hold back the
+ * capture workers by that share of the CPU thread at most. The frames offered
+ * beyond are dropped.
+ */
+class preview_tap_t {
+   public:
+    /** Create the shared memory, or replace the one of a previous run.
+     *
+     * @param[in] name Name of the POSIX shared memory, e.g. "/bioimage-preview".
+     * @throws std::invalid_argument on another binning factor, and
+     * std::runtime_error if the shared memory cannot be created.
+     */
+    explicit preview_tap_t(std::string name, preview_config_t config = {});
+
+    /** Unmap and unlink the shared memory. The viewers keep their mapping. */
+    ~preview_tap_t();
+
+    preview_tap_t(const preview_tap_t&) = delete;
+    preview_tap_t& operator=(const preview_tap_t&) = delete;
+
+    /** Description of the frame, as in the preview slot. */
+    struct frame_t {
+        uint8_t board_id{};
+        uint8_t cam_id{};
+        frame_kind_t kind{};
+        uint8_t led_id{};
+        int16_t zpos{};
+        channel_t ch{EGFP};
+    };
+
+    /** Publish the preview of the frame, unless the camera was previewed
+     * within min_interval, or unless the tap is over its CPU budget. The
+     * frames of an unknown camera, e.g. of a corrupt frame header, are
+     * ignored.
+     *
+     * @returns true if published.
+     */
+    bool offer(const frame_t& frame, nonstd::span<const uint8_t> pixels);
+    bool offer(const frame_t& frame, nonstd::span<const uint16_t> pixels);
+
+    const header_t& header() const { return *ring; }
+
+   private:
+    const std::string name;
+    const preview_config_t config;
+
+    header_t* ring{nullptr};
+    size_t mapped_size{};
+
+    std::vector<uint32_t> row_sums{};
+
+    /** Last preview of each camera, by the well index. */
+    std::array<std::chrono::steady_clock::time_point, well_plate::n_wells> last_published{};
+
+    /** CPU time spent binning, since the tap started. */
+    std::chrono::steady_clock::time_point start_time{std::chrono::steady_clock::now()};
+    std::chrono::nanoseconds busy_time{};
+
+    /** Whether to bin the frame of the camera now. Counts the drops. */
+    bool isDue(const frame_t& frame);
+
+    /** Claim the next slot, and mark it as being written. */
+    slot_t& beginWrite(const frame_t& frame);
+
+    /** Make the preview visible to the viewers. */
+    void endWrite(slot_t& slot, const frame_t& frame, frame_stats_t stats);
+
+    template <typename Pixel>
+    bool publish(const frame_t& frame, nonstd::span<const Pixel> pixels);
+};
+
+/** Read-only mapping of the preview ring, for a viewer process. */
+class preview_reader_t {
+   public:
+    /** @throws std::runtime_error if the ring does not exist, or is of
+     * another layout. */
+    explicit preview_reader_t(const std::string& name);
+    ~preview_reader_t();
+
+    preview_reader_t(const preview_reader_t&) = delete;
+    preview_reader_t& operator=(const preview_reader_t&) = delete;
+
+    const header_t& header() const { return *ring; }
+
+    /** Pass the latest preview of the camera to `render`, in place in the
+     * shared memory.
+     *
+     * The writer may overwrite the slot meanwhile. The preview is then torn,
+     * and `render` must discard whatever it made of it.
+     *
+     * @returns false if the camera has no preview yet, or if the preview was
+     * overwritten, i.e. dropped.
+     */
+    template <typename F>
+    bool readLatest(size_t well, F&& render) const {
+        const uint32_t index = ring->latest[well].load(std::memory_order_acquire);
+        if (index == 0) {
+            return false;
+        }
+        const slot_t& slot = slotAt(index - 1);
+        const uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if ((sequence & 1) != 0 ||
+            size_t{slot.board_id} * frame_capture_card::n_cameras_per_board + slot.cam_id - 1 !=
+                well) {
+            return false;
+        }
+        render(slot);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.sequence.load(std::memory_order_relaxed) == sequence;
+    }
+
+   private:
+    const header_t* ring{nullptr};
+    size_t mapped_size{};
+
+    const slot_t& slotAt(size_t i) const {
+        return *reinterpret_cast<const slot_t*>(reinterpret_cast<const char*>(ring + 1) +
+                                                i * ring->slot_size);
+    }
+};
+
+}  // namespace preview
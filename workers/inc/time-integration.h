@@ -0,0 +1,16 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <nonstd/span.hpp>
+
+/** Digital time integration of the fluorescence frames.
+ *
+ * Widen the 8-bit raw pixels to 16-bit, and add them to the accumulated frame.
+ * Written as a plain std::transform, so that the compiler auto-vectorizes it
+ * when built with -march=native.
+ */
+inline void
+accumulateFrame(nonstd::span<const uint8_t> raw_pixels, nonstd::span<uint16_t> accumulated) {
+    std::transform(raw_pixels.begin(), raw_pixels.end(), accumulated.begin(), accumulated.begin(),
+                   [](const auto x, const auto y) -> uint16_t { return x + y; });
+}
@@ -0,0 +1,210 @@
+#include "board-link.h"
+
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace board_link {
+
+namespace {
+
+std::runtime_error
+sharedMemoryError(std::string_view what, const std::string& name) {
+    return std::runtime_error(fmt::format(FMT_STRING("Cannot {:s} the shared memory {:s}: {:s}"),
+                                          what, name, std::strerror(errno)));
+}
+
+uint64_t
+pack(const handover_t handover) {
+    return (uint64_t{handover.seq} << 32) | handover.cameras;
+}
+
+}  // namespace
+
+std::string
+linkName(const std::string& prefix, const uint8_t usb_id) {
+    return fmt::format(FMT_STRING("{:s}{:d}"), prefix, usb_id);
+}
+
+board_link_t::board_link_t(std::string shm_name, const uint8_t usb_id, const size_t n_slots)
+    : name{std::move(shm_name)}, is_owner{true} {
+    if (n_slots == 0 || n_slots > max_slots) {
+        throw std::invalid_argument(fmt::format(
+            FMT_STRING("A board link holds 1 to {:d} frame slots, not {:d}"), max_slots, n_slots));
+    }
+
+    // Widest frame: the 16-bit integrated fluorescence frame.
+    const size_t n_bytes = size_t(camera::n_pixels) * sizeof(uint16_t);
+    const size_t slot_size = (sizeof(frame_slot_t) + n_bytes + alignof(frame_slot_t) - 1) /
+                             alignof(frame_slot_t) * alignof(frame_slot_t);
+    mapped_size = sizeof(header_t) + n_slots * slot_size;
+
+    // A stale link of a crashed run may be of another size. Replace it.
+    ::shm_unlink(name.c_str());
+    const int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        throw sharedMemoryError("create", name);
+    }
+    if (::ftruncate(fd, static_cast<off_t>(mapped_size)) != 0) {
+        const auto error = sharedMemoryError("size", name);
+        ::close(fd);
+        ::shm_unlink(name.c_str());
+        throw error;
+    }
+    void* p = ::mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        const auto error = sharedMemoryError("map", name);
+        ::shm_unlink(name.c_str());
+        throw error;
+    }
+
+    // The pixels are first touched by the capture process, so that they are
+    // allocated on its NUMA node.
+    auto* slots = reinterpret_cast<char*>(p) + sizeof(header_t);
+    for (size_t i = 0; i < n_slots; i++) {
+        new (slots + i * slot_size) frame_slot_t{};
+    }
+    link = new (p) header_t{};
+    link->usb_id = usb_id;
+    link->n_slots = static_cast<uint32_t>(n_slots);
+    link->slot_size = static_cast<uint32_t>(slot_size);
+}
+
+board_link_t::board_link_t(std::string shm_name) : name{std::move(shm_name)}, is_owner{false} {
+    const int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        throw sharedMemoryError("open", name);
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(header_t)) {
+        ::close(fd);
+        throw std::runtime_error(
+            fmt::format(FMT_STRING("The shared memory {:s} is not a board link"), name));
+    }
+    mapped_size = size_t(st.st_size);
+    void* p = ::mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        throw sharedMemoryError("map", name);
+    }
+
+    link = reinterpret_cast<header_t*>(p);
+    if (link->magic != magic || link->version != layout_version || link->n_slots > max_slots ||
+        sizeof(header_t) + size_t(link->n_slots) * link->slot_size > mapped_size) {
+        ::munmap(p, mapped_size);
+        throw std::runtime_error(
+            fmt::format(FMT_STRING("The shared memory {:s} is not a board link of version {:d}"),
+                        name, layout_version));
+    }
+}
+
+board_link_t::~board_link_t() {
+    ::munmap(link, mapped_size);
+    if (is_owner) {
+        ::shm_unlink(name.c_str());
+    }
+}
+
+uint32_t
+board_link_t::indexOf(const frame_slot_t& s) const {
+    return static_cast<uint32_t>((reinterpret_cast<const char*>(&s) -
+                                  reinterpret_cast<const char*>(link + 1)) /
+                                 link->slot_size);
+}
+
+frame_slot_t*
+board_link_t::claimSlot() {
+    for (size_t i = 0; i < nSlots(); i++) {
+        auto& s = slot(i);
+        auto expected = slot_state_t::FREE;
+        if (s.state.compare_exchange_strong(expected, slot_state_t::FILLING,
+                                            std::memory_order_acquire)) {
+            return &s;
+        }
+    }
+    return nullptr;
+}
+
+void
+board_link_t::queueSlot(frame_slot_t& s) {
+    // The camera before the state: on a crash, the slot still FILLING takes
+    // its camera off again.
+    const auto last = handedOver();
+    const uint32_t cameras = (last.seq == s.command_seq) ? last.cameras : 0;
+    link->handed_over.store(pack({s.command_seq, cameras | cameraBit(s.cam_id)}),
+                            std::memory_order_release);
+    s.state.store(slot_state_t::QUEUED, std::memory_order_release);
+
+    // The ring holds every slot. It is never full.
+    const bool is_queued = link->frames.tryPush(indexOf(s));
+    assert(is_queued);
+    (void)is_queued;
+    link->frames_captured.fetch_add(1, std::memory_order_relaxed);
+}
+
+handover_t
+board_link_t::handedOver() const {
+    const uint64_t packed = link->handed_over.load(std::memory_order_acquire);
+    return {static_cast<uint32_t>(packed >> 32), static_cast<uint32_t>(packed)};
+}
+
+frame_slot_t*
+board_link_t::nextQueuedSlot() {
+    frame_slot_t* next = nullptr;
+    link->frames.tryConsume([&](const uint32_t i) {
+        next = &slot(i);
+        next->state.store(slot_state_t::WRITING, std::memory_order_release);
+    });
+    return next;
+}
+
+void
+board_link_t::releaseSlot(frame_slot_t& s) {
+    link->frames_written.fetch_add(1, std::memory_order_relaxed);
+    link->bytes_written.fetch_add(s.n_bytes, std::memory_order_relaxed);
+    s.state.store(slot_state_t::FREE, std::memory_order_release);
+}
+
+size_t
+board_link_t::recoverCaptureSlots() {
+    // The producer is gone, so the ring only shrinks meanwhile. The slots
+    // popped since the snapshot are WRITING already.
+    const auto& frames = link->frames;
+    const uint64_t tail = frames.tail.load(std::memory_order_acquire);
+    std::vector<bool> is_in_ring(nSlots());
+    for (uint64_t k = frames.head.load(std::memory_order_acquire); k < tail; k++) {
+        is_in_ring.at(frames.items[k % frames.items.size()]) = true;
+    }
+
+    auto handover = handedOver();
+    size_t n_lost = 0;
+    for (size_t i = 0; i < nSlots(); i++) {
+        auto& s = slot(i);
+        const auto state = s.state.load(std::memory_order_acquire);
+        if (state == slot_state_t::FILLING) {
+            if (s.command_seq == handover.seq) {
+                handover.cameras &= ~cameraBit(s.cam_id);
+            }
+            s.state.store(slot_state_t::FREE, std::memory_order_release);
+            n_lost++;
+        } else if (state == slot_state_t::QUEUED && !is_in_ring[i]) {
+            link->frames.tryPush(static_cast<uint32_t>(i));
+            link->frames_captured.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    link->handed_over.store(pack(handover), std::memory_order_release);
+    return n_lost;
+}
+
+}  // namespace board_link
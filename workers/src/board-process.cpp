@@ -0,0 +1,309 @@
+#include "board-process.h"
+
+#include <fmt/format.h>
+
+#include <boost/fiber/all.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <thread>
+
+#include "frame-pool.h"
+#include "hot-log.h"
+#include "metrics.h"
+
+using board_link::board_link_t;
+using board_link::command_record_t;
+using board_link::event_t;
+using board_link::frame_kind_t;
+using board_link::frame_slot_t;
+using board_link::poll_interval;
+using board_link::slot_state_t;
+using boost::fibers::fiber;
+using fiber_messages::capture::completions_signal_t;
+
+namespace {
+
+/** Capacity of the local channels of the capture process. The ring of the
+ * link holds the commands beyond. */
+constexpr size_t capture_queue_capacity = 2;
+constexpr size_t write_queue_capacity = 4;
+constexpr size_t signal_capacity = 16;
+
+/** Point the capture command to the signals of the capture process, in place
+ * of those of the supervisor. */
+void
+redirectSignals(fiber_messages::capture::command_t& command, completions_signal_t& completion,
+                completions_signal_t& exposure) {
+    std::visit(
+        [&](auto& c) {
+            using T = std::decay_t<decltype(c)>;
+            if constexpr (!std::is_same_v<T, fiber_messages::capture::camera::init_sequence_t> &&
+                          !std::is_same_v<T, fiber_messages::capture::camera::exposure_gain_t>) {
+                c.completion = (c.completion != nullptr) ? &completion : nullptr;
+                c.exposure = (c.exposure != nullptr) ? &exposure : nullptr;
+            }
+        },
+        command);
+}
+
+/** Capture command whose frames the capture process hands over. */
+struct frame_command_t {
+    uint32_t seq{};
+
+    /** Cameras handed over already by a crashed capture process. */
+    uint32_t skip_cameras{};
+
+    /** Cameras of the frames of the command so far. */
+    uint32_t cameras{};
+
+    fiber_messages::capture::command_t command{};
+};
+
+bool
+isFrameCommand(const fiber_messages::capture::command_t& command) {
+    return !std::holds_alternative<fiber_messages::capture::camera::init_sequence_t>(command) &&
+           !std::holds_alternative<fiber_messages::capture::camera::exposure_gain_t>(command);
+}
+
+/** Whether the frame is of the capture command, by its kind, and by its LED
+ * or its z-position and channel. */
+bool
+isFrameOf(const fiber_messages::write::command_t& frame,
+          const fiber_messages::capture::command_t& command) {
+    namespace capture = fiber_messages::capture;
+    namespace write = fiber_messages::write;
+    return std::visit(
+        [&](const auto& f) {
+            using T = std::decay_t<decltype(f)>;
+            if constexpr (std::is_same_v<T, write::fpm_frame_t>) {
+                const auto* c = std::get_if<capture::fpm_frame_t>(&command);
+                return c != nullptr && c->led_id == f.led_id;
+            } else if constexpr (std::is_same_v<T, write::fluorescence_frame_t>) {
+                const auto* c = std::get_if<capture::fluorescence_frame_t>(&command);
+                return c != nullptr && c->zpos == f.zpos && c->ch == f.ch;
+            } else {
+                return std::holds_alternative<capture::dark_frame_t>(command);
+            }
+        },
+        frame);
+}
+
+/** Recycle the frame buffer to the capture worker. */
+void
+recycleFrame(fiber_messages::write::command_t& frame) {
+    std::visit(
+        [](auto& f) {
+            using T = std::decay_t<decltype(f)>;
+            if constexpr (std::is_same_v<T, fiber_messages::write::fluorescence_frame_t>) {
+                integratedFramePool().release(std::move(f.image_frame));
+            } else {
+                rawFramePool().release(std::move(f.image_frame));
+            }
+        },
+        frame);
+}
+
+void
+pushEvent(board_link::header_t& header, const event_t::kind_t kind,
+          const std::chrono::steady_clock::time_point time) {
+    const event_t event{kind, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                  time.time_since_epoch())
+                                  .count()};
+    while (!header.events.tryPush(event)) {
+        boost::this_fiber::sleep_for(poll_interval);
+    }
+}
+
+template <typename T>
+void
+fillSlot(frame_slot_t& slot, const size_t capacity, const T& frame) {
+    using fiber_messages::write::dark_frame_t;
+    using fiber_messages::write::fpm_frame_t;
+
+    slot.board_id = frame.board_id;
+    slot.cam_id = frame.cam_id;
+    if constexpr (std::is_same_v<T, dark_frame_t>) {
+        slot.kind = frame_kind_t::DARK;
+    } else if constexpr (std::is_same_v<T, fpm_frame_t>) {
+        slot.kind = frame_kind_t::FPM;
+        slot.led_id = frame.led_id;
+    } else {
+        slot.kind = frame_kind_t::FLUORESCENCE;
+        slot.zpos = frame.zpos;
+        slot.ch = frame.ch;
+    }
+
+    const size_t n_bytes =
+        frame.image_frame.size() * sizeof(typename decltype(frame.image_frame)::value_type);
+    if (n_bytes > capacity) {
+        throw std::runtime_error(fmt::format(
+            FMT_STRING("Frame of {:d} bytes exceeds the slot of {:d} bytes"), n_bytes, capacity));
+    }
+    slot.n_bytes = static_cast<uint32_t>(n_bytes);
+    std::memcpy(slot.pixels(), frame.image_frame.data(), n_bytes);
+}
+
+void
+writeFrame(board_link_t& link, frame_slot_t& slot) {
+    switch (slot.kind) {
+        case frame_kind_t::DARK:
+            HOT_LOG_INFO("[{:d}] Writing darkframe from camera {:d}...", slot.board_id,
+                         slot.cam_id);
+            break;
+        case frame_kind_t::FPM:
+            HOT_LOG_INFO("[{:d}] Writing FPM frame {:d} from camera {:d}...", slot.board_id,
+                         slot.led_id, slot.cam_id);
+            break;
+        case frame_kind_t::FLUORESCENCE:
+            HOT_LOG_INFO("[{:d}] Writing fluorescence frame at [z={:d}, ch={:s}] "
+                         "from camera {:d}...",
+                         slot.board_id, slot.zpos, toString(slot.ch), slot.cam_id);
+            break;
+    }
+    link.releaseSlot(slot);
+}
+
+}  // namespace
+
+void
+linkedCaptureWorker(board_link_t& link, const capture_worker_fn& capture_worker,
+                    const capture_process_config_t config) {
+    auto& header = link.header();
+    const auto usb_id = static_cast<uint8_t>(header.usb_id);
+    auto& capture_queue_stats = telemetry::channelStats("capture", "supervisor", "capture");
+    auto& write_queue_stats = telemetry::channelStats("write", "capture", "link");
+    auto& signal_stats = telemetry::channelStats("signal", "capture", "supervisor");
+    fiber_messages::capture::queue_t capture_queue{capture_queue_capacity, capture_queue_stats};
+    fiber_messages::write::queue_t write_queue{write_queue_capacity, write_queue_stats};
+    completions_signal_t completion{signal_capacity, signal_stats};
+    completions_signal_t exposure{signal_capacity, signal_stats};
+
+    // Frame commands received, oldest first, for the handover to tell the
+    // command of each frame.
+    std::deque<frame_command_t> frame_commands{};
+
+    fiber receive_task{[&]() {
+        auto& capture_queue_depth = telemetry::metrics().boards.at(usb_id).capture_queue_depth;
+        command_record_t record{};
+        for (;;) {
+            if (!header.commands.tryPop(record)) {
+                boost::this_fiber::sleep_for(poll_interval);
+                continue;
+            }
+            if (record.op == command_record_t::STOP) {
+                break;
+            }
+            redirectSignals(record.command, completion, exposure);
+            if (isFrameCommand(record.command)) {
+                frame_commands.push_back({record.seq, record.skip_cameras, 0, record.command});
+            }
+            capture_queue_depth.add(1);
+            capture_queue.push(record.command);
+        }
+        capture_queue.close();
+    }};
+
+    fiber capture_task{[&]() {
+        capture_worker(capture_queue, write_queue);
+
+        // Only the worker of board 0 closes the shared write queue of the
+        // single process.
+        write_queue.close();
+        completion.close();
+        exposure.close();
+    }};
+
+    auto relay = [&](completions_signal_t& signal, const event_t::kind_t kind) {
+        for (auto&& time : signal) {
+            pushEvent(header, kind, time);
+        }
+    };
+    fiber completion_task{relay, std::ref(completion), event_t::COMPLETED};
+    fiber exposure_task{relay, std::ref(exposure), event_t::EXPOSED};
+
+    fiber handover_task{[&]() {
+        auto& writer_metrics = telemetry::metrics().writer;
+        uint64_t n_frames = 0;
+        for (auto&& f : write_queue) {
+            writer_metrics.queue_depth.add(-1);
+
+            // The frames come in the order of the commands, one per camera.
+            // A frame of another command, or of a camera seen already, is of
+            // the next one.
+            const uint8_t cam_id = std::visit([](const auto& frame) { return frame.cam_id; }, f);
+            const uint32_t camera = board_link::cameraBit(cam_id);
+            while (frame_commands.size() > 1 &&
+                   (!isFrameOf(f, frame_commands.front().command) ||
+                    (frame_commands.front().cameras & camera) != 0)) {
+                frame_commands.pop_front();
+            }
+            frame_command_t owner{};
+            if (!frame_commands.empty()) {
+                frame_commands.front().cameras |= camera;
+                owner = frame_commands.front();
+            }
+
+            // Handed over by the crashed capture process already.
+            if ((owner.skip_cameras & camera) != 0) {
+                recycleFrame(f);
+                continue;
+            }
+
+            frame_slot_t* slot = link.claimSlot();
+            while (slot == nullptr) {
+                boost::this_fiber::sleep_for(poll_interval);
+                slot = link.claimSlot();
+            }
+            std::visit([&](const auto& frame) { fillSlot(*slot, link.slotCapacity(), frame); },
+                       f);
+            slot->command_seq = owner.seq;
+            recycleFrame(f);
+            link.queueSlot(*slot);
+
+            if (++n_frames == config.crash_after_frames) {
+                fmt::print(stderr, FMT_STRING("[{:d}] Injected crash after {:d} frames\n"), usb_id,
+                           n_frames);
+                std::abort();
+            }
+        }
+    }};
+
+    receive_task.join();
+    capture_task.join();
+    completion_task.join();
+    exposure_task.join();
+    handover_task.join();
+
+    header.is_capture_done.store(1, std::memory_order_release);
+    HOT_LOG_INFO("[{:d}] Closing capture process", usb_id);
+}
+
+void
+linkedFileWriteWorker(board_link_t& link) {
+    auto& header = link.header();
+
+    for (size_t i = 0; i < link.nSlots(); i++) {
+        auto& slot = link.slot(i);
+        if (slot.state.load(std::memory_order_acquire) == slot_state_t::WRITING) {
+            writeFrame(link, slot);
+        }
+    }
+
+    for (;;) {
+        // Done only if no frame was queued before the capture process ended.
+        const bool is_capture_done = header.is_capture_done.load(std::memory_order_acquire) != 0;
+        if (auto* slot = link.nextQueuedSlot()) {
+            writeFrame(link, *slot);
+        } else if (is_capture_done) {
+            break;
+        } else {
+            std::this_thread::sleep_for(poll_interval);
+        }
+    }
+
+    HOT_LOG_INFO("[{:d}] Closing file worker", header.usb_id);
+}
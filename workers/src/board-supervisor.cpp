@@ -0,0 +1,376 @@
+#include "board-supervisor.h"
+
+#include <fmt/format.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <boost/fiber/all.hpp>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include "hot-log.h"
+#include "metrics.h"
+
+extern char** environ;
+
+using board_link::command_record_t;
+using board_link::event_t;
+using board_link::poll_interval;
+using boost::fibers::fiber;
+using fiber_messages::capture::completions_signal_t;
+using fiber_messages::capture::camera::exposure_gain_t;
+using fiber_messages::capture::camera::init_sequence_t;
+
+namespace {
+
+/** Signals of the capture command still to deliver, if a capture command. */
+struct signals_t {
+    completions_signal_t** completion{nullptr};
+    completions_signal_t** exposure{nullptr};
+};
+
+signals_t
+signalsOf(fiber_messages::capture::command_t& command) {
+    return std::visit(
+        [](auto& c) {
+            using T = std::decay_t<decltype(c)>;
+            if constexpr (std::is_same_v<T, init_sequence_t> ||
+                          std::is_same_v<T, exposure_gain_t>) {
+                return signals_t{};
+            } else {
+                return signals_t{&c.completion, &c.exposure};
+            }
+        },
+        command);
+}
+
+bool
+isSettled(fiber_messages::capture::command_t& command) {
+    const auto signals = signalsOf(command);
+    return signals.completion == nullptr ||
+           (*signals.completion == nullptr && *signals.exposure == nullptr);
+}
+
+/** Exit code of the process, or minus the signal that killed it. */
+int
+exitCode(const int status) {
+    return WIFSIGNALED(status) ? -WTERMSIG(status) : WEXITSTATUS(status);
+}
+
+bool
+isSuccess(const int status) {
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/** Reap the process if it has ended. */
+std::optional<int>
+pollExit(const pid_t pid) {
+    int status{};
+    const pid_t result = ::waitpid(pid, &status, WNOHANG);
+    if (result < 0) {
+        throw std::runtime_error(fmt::format(FMT_STRING("Cannot wait for the process {:d}: {:s}"),
+                                             pid, std::strerror(errno)));
+    }
+    return (result == pid) ? std::optional<int>{status} : std::nullopt;
+}
+
+}  // namespace
+
+pid_t
+spawnProcess(const std::vector<std::string>& argv) {
+    std::vector<char*> args{};
+    for (const auto& arg : argv) {
+        args.push_back(const_cast<char*>(arg.c_str()));
+    }
+    args.push_back(nullptr);
+
+    // Unlike fork(), posix_spawn() does not copy the threads of the log and
+    // of the metrics exporter in an inconsistent state.
+    pid_t pid{};
+    const int error = ::posix_spawn(&pid, args.at(0), nullptr, nullptr, args.data(), environ);
+    if (error != 0) {
+        throw std::runtime_error(fmt::format(FMT_STRING("Cannot start {:s}: {:s}"), argv.at(0),
+                                             std::strerror(error)));
+    }
+    return pid;
+}
+
+board_supervisor_t::board_supervisor_t(const uint8_t id, spawn_fn s, supervisor_config_t c)
+    : usb_id{id},
+      spawn{std::move(s)},
+      config{std::move(c)},
+      link_name{board_link::linkName(config.link_prefix, usb_id)},
+      link{link_name, usb_id, config.n_slots} {
+    capture_pid = spawn(board_process_t::CAPTURE, usb_id, link_name, capture_generation);
+    writer_pid = spawn(board_process_t::WRITER, usb_id, link_name, writer_generation);
+}
+
+board_supervisor_t::~board_supervisor_t() { killProcesses(); }
+
+void
+board_supervisor_t::run(fiber_messages::capture::queue_t& capture_queue,
+                        const std::function<void()>& on_give_up) {
+    fiber supervise_task{[&]() { supervise(on_give_up); }};
+
+    auto& capture_queue_depth = telemetry::metrics().boards.at(usb_id).capture_queue_depth;
+    for (auto&& command : capture_queue) {
+        capture_queue_depth.add(-1);
+        const command_record_t record{command_record_t::CAPTURE, command, ++n_commands};
+        in_flight.push_back(record);
+        if (is_given_up) {
+            releaseSignals();
+        } else {
+            send(record);
+        }
+    }
+
+    is_stopping = true;
+    if (!is_given_up) {
+        send({command_record_t::STOP});
+    }
+    supervise_task.join();
+
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+
+void
+board_supervisor_t::send(const command_record_t& record) {
+    // A restart meanwhile replays the commands in flight, and the stop. The
+    // new commands wait for the replay.
+    const auto generation = capture_generation;
+    while (capture_generation == generation && !is_given_up) {
+        if (replay.empty() && link.header().commands.tryPush(record)) {
+            return;
+        }
+        boost::this_fiber::sleep_for(poll_interval);
+    }
+}
+
+void
+board_supervisor_t::relayEvents() {
+    event_t event{};
+    while (link.header().events.tryPop(event)) {
+        const std::chrono::steady_clock::time_point time{std::chrono::nanoseconds{event.time_ns}};
+
+        // Each kind of event comes in the order of the commands.
+        completions_signal_t** signal = nullptr;
+        for (auto& record : in_flight) {
+            const auto signals = signalsOf(record.command);
+            auto* s = (event.kind == event_t::COMPLETED) ? signals.completion : signals.exposure;
+            if (s != nullptr && *s != nullptr) {
+                signal = s;
+                break;
+            }
+        }
+        if (signal == nullptr) {
+            HOT_LOG_WARNING("[{:d}] Event {:d} of no capture command in flight", usb_id,
+                            static_cast<uint8_t>(event.kind));
+            continue;
+        }
+        (*signal)->push(time);
+        *signal = nullptr;
+    }
+
+    while (!in_flight.empty() && isSettled(in_flight.front().command)) {
+        std::visit(
+            [&](auto& c) {
+                using T = std::decay_t<decltype(c)>;
+                if constexpr (std::is_same_v<T, init_sequence_t>) {
+                    init_sequence = c;
+                } else if constexpr (std::is_same_v<T, exposure_gain_t>) {
+                    exposure_gain = c;
+                }
+            },
+            in_flight.front().command);
+        in_flight.pop_front();
+    }
+}
+
+void
+board_supervisor_t::supervise(const std::function<void()>& on_give_up) {
+    auto& header = link.header();
+    auto& writer_metrics = telemetry::metrics().writer;
+    try {
+        while ((!is_capture_done || !is_writer_done) && !is_given_up) {
+            relayEvents();
+            while (!replay.empty() && header.commands.tryPush(replay.front())) {
+                replay.pop_front();
+            }
+
+            if (capture_pid > 0) {
+                if (const auto status = pollExit(capture_pid)) {
+                    capture_pid = -1;
+                    if (header.is_capture_done.load(std::memory_order_acquire) != 0) {
+                        is_capture_done = true;
+                    } else {
+                        restartCapture(*status);
+                    }
+                }
+            }
+            if (writer_pid > 0) {
+                if (const auto status = pollExit(writer_pid)) {
+                    writer_pid = -1;
+                    // The writer exits only once the capture process is done.
+                    if (isSuccess(*status)) {
+                        is_writer_done = true;
+                    } else {
+                        restartWriter(*status);
+                    }
+                }
+            }
+
+            const auto written = header.frames_written.load(std::memory_order_relaxed);
+            const auto bytes_written = header.bytes_written.load(std::memory_order_relaxed);
+            writer_metrics.frames.add(written - n_written);
+            writer_metrics.bytes.add(bytes_written - n_bytes_written);
+            n_written = written;
+            n_bytes_written = bytes_written;
+
+            boost::this_fiber::sleep_for(poll_interval);
+        }
+        relayEvents();
+    } catch (const std::exception&) {
+        HOT_LOG_ERROR("[{:d}] Giving up the plate", usb_id);
+        failure = std::current_exception();
+        is_given_up = true;
+        if (on_give_up) {
+            on_give_up();
+        }
+    }
+
+    if (is_given_up) {
+        killProcesses();
+        releaseSignals();
+    }
+}
+
+void
+board_supervisor_t::releaseSignals() {
+    // The events sent before are valid. The exposure of the others is over
+    // anyway.
+    relayEvents();
+    const auto now = std::chrono::steady_clock::now();
+    for (auto& record : in_flight) {
+        const auto signals = signalsOf(record.command);
+        if (signals.completion == nullptr) {
+            continue;
+        }
+        for (auto* signal : {signals.exposure, signals.completion}) {
+            if (*signal != nullptr) {
+                (*signal)->push(now);
+                *signal = nullptr;
+            }
+        }
+    }
+    in_flight.clear();
+    replay.clear();
+}
+
+void
+board_supervisor_t::killProcesses() {
+    for (pid_t* pid : {&capture_pid, &writer_pid}) {
+        if (*pid > 0) {
+            ::kill(*pid, SIGKILL);
+            ::waitpid(*pid, nullptr, 0);
+            *pid = -1;
+        }
+    }
+}
+
+void
+board_supervisor_t::countRestart(const board_process_t role, const int status) {
+    n_restarts++;
+    telemetry::metrics().boards.at(usb_id).restarts.add();
+    if (n_restarts > config.max_restarts) {
+        throw std::runtime_error(fmt::format(
+            FMT_STRING("The {:s} process of board {:d} ended with {:d} after {:d} restarts. "
+                       "Giving up the plate"),
+            (role == board_process_t::CAPTURE) ? "capture" : "writer", usb_id, exitCode(status),
+            config.max_restarts));
+    }
+}
+
+void
+board_supervisor_t::restartCapture(const int status) {
+    countRestart(board_process_t::CAPTURE, status);
+
+    // The events the process sent before crashing are valid.
+    relayEvents();
+    auto& header = link.header();
+    header.commands.discard();
+    const auto n_lost = link.recoverCaptureSlots();
+    HOT_LOG_WARNING("[{:d}] Capture process ended with {:d}, {:d} frames lost. Restarting it...",
+                    usb_id, exitCode(status), n_lost);
+
+    capture_generation++;
+    capture_pid = spawn(board_process_t::CAPTURE, usb_id, link_name, capture_generation);
+
+    // The camera settings first, as the crashed process left the camera. Then
+    // the commands in flight, less the signals already delivered, and less
+    // the frames handed over already.
+    const auto handover = link.handedOver();
+    replay.clear();
+    if (init_sequence) {
+        replay.push_back({command_record_t::CAPTURE, *init_sequence});
+    }
+    if (exposure_gain) {
+        replay.push_back({command_record_t::CAPTURE, *exposure_gain});
+    }
+    for (auto& record : in_flight) {
+        const auto signals = signalsOf(record.command);
+        if (signals.completion != nullptr &&
+            (*signals.completion == nullptr || record.seq < handover.seq)) {
+            // Completed, or its frames all handed over, but its events were
+            // lost in the crash. The exposure is over anyway.
+            for (auto* signal : {signals.exposure, signals.completion}) {
+                if (*signal != nullptr) {
+                    (*signal)->push(std::chrono::steady_clock::now());
+                    *signal = nullptr;
+                }
+            }
+            continue;
+        }
+        if (record.seq == handover.seq) {
+            record.skip_cameras = handover.cameras;
+        }
+        replay.push_back(record);
+    }
+    if (is_stopping) {
+        replay.push_back({command_record_t::STOP});
+    }
+    relayEvents();
+}
+
+void
+board_supervisor_t::restartWriter(const int status) {
+    countRestart(board_process_t::WRITER, status);
+    HOT_LOG_WARNING("[{:d}] Writer process ended with {:d}. Restarting it...", usb_id,
+                    exitCode(status));
+    writer_generation++;
+    writer_pid = spawn(board_process_t::WRITER, usb_id, link_name, writer_generation);
+}
+
+void
+superviseBoard(board_supervisor_t& board, fiber_messages::capture::queue_t& capture_queue,
+               const std::vector<board_supervisor_t*>& boards) {
+    try {
+        board.run(capture_queue, [&]() {
+            for (auto* other : boards) {
+                other->giveUp();
+            }
+        });
+    } catch (const std::runtime_error& e) {
+        // An exception escaping the fiber would terminate the process, with
+        // the shared memory of the boards left behind.
+        fmt::print(stderr, FMT_STRING("{:s}\n"), e.what());
+    }
+}
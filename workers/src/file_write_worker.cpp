@@ -3,35 +3,104 @@
 #include <fmt/format.h>
 
 #include <boost/fiber/all.hpp>
+#include <chrono>
+
+#include "alloc-tracker.h"
+#include "frame-pool.h"
+#include "hot-log.h"
+#include "metrics.h"
+#include "preview-tap.h"
+#include "trace.h"
+#include "virtual-clock.h"
 
 using fiber_messages::write::dark_frame_t;
 using fiber_messages::write::fluorescence_frame_t;
 using fiber_messages::write::fpm_frame_t;
+using preview::frame_kind_t;
+
+namespace {
 
+/** Offer the frame to the live preview, before its buffer goes back to the
+ * pool. */
+template <typename T>
 void
-fileWriteWorker(fiber_messages::write::queue_t& write_queue) {
+offerPreview(preview::preview_tap_t& preview_tap, const T& frame) {
+    preview::preview_tap_t::frame_t f{frame.board_id, frame.cam_id};
+    if constexpr (std::is_same_v<T, dark_frame_t>) {
+        f.kind = frame_kind_t::DARK;
+    } else if constexpr (std::is_same_v<T, fpm_frame_t>) {
+        f.kind = frame_kind_t::FPM;
+        f.led_id = frame.led_id;
+    } else {
+        f.kind = frame_kind_t::FLUORESCENCE;
+        f.zpos = frame.zpos;
+        f.ch = frame.ch;
+    }
+    preview_tap.offer(f, frame.image_frame);
+}
+
+void
+runFileWriter(fiber_messages::write::queue_t& write_queue, preview::preview_tap_t* preview_tap) {
     using namespace std::string_view_literals;
+    auto& writer_metrics = telemetry::metrics().writer;
+    TRACE_LANE_NAME("file writer");
+    telemetry::alloc::stage_scope alloc_stage{"writer"};
+
     for (auto&& f : write_queue) {
+        TRACE_SCOPE("write", "frame");
+        writer_metrics.queue_depth.add(-1);
+        const auto write_start = simulator::now();
+
         std::visit(
-            [](auto&& frame) {
+            [&](auto&& frame) {
                 using T = std::decay_t<decltype(frame)>;
 
                 if constexpr (std::is_same_v<T, dark_frame_t>) {
-                    fmt::print(FMT_STRING("[{:d}] Writing darkframe from camera {:d}...\n"),
-                               frame.board_id, frame.cam_id);
+                    HOT_LOG_INFO("[{:d}] Writing darkframe from camera {:d}...", frame.board_id,
+                                 frame.cam_id);
                 } else if constexpr (std::is_same_v<T, fpm_frame_t>) {
-                    fmt::print(FMT_STRING("[{:d}] Writing FPM frame {:d} from camera {:d}...\n"),
-                               frame.board_id, frame.led_id, frame.cam_id);
+                    HOT_LOG_INFO("[{:d}] Writing FPM frame {:d} from camera {:d}...",
+                                 frame.board_id, frame.led_id, frame.cam_id);
                 } else if constexpr (std::is_same_v<T, fluorescence_frame_t>) {
-                    fmt::print(FMT_STRING("[{:d}] Writing fluorescence frame at [z={:d}, ch={:s}] "
-                                          "from camera {:d}...\n"),
-                               frame.board_id, frame.zpos, toString(frame.ch), frame.cam_id);
+                    HOT_LOG_INFO("[{:d}] Writing fluorescence frame at [z={:d}, ch={:s}] "
+                                 "from camera {:d}...",
+                                 frame.board_id, frame.zpos, toString(frame.ch), frame.cam_id);
                 } else {
                     static_assert(sizeof(T) == 0, "File write command not recognized");
                 }
+
+                if (preview_tap != nullptr) {
+                    offerPreview(*preview_tap, frame);
+                }
+
+                writer_metrics.bytes.add(frame.image_frame.size() *
+                                         sizeof(typename decltype(frame.image_frame)::value_type));
+
+                // Recycle the frame buffer to the capture workers.
+                if constexpr (std::is_same_v<T, fluorescence_frame_t>) {
+                    integratedFramePool().release(std::move(frame.image_frame));
+                } else {
+                    rawFramePool().release(std::move(frame.image_frame));
+                }
             },
             f);
+
+        writer_metrics.frames.add();
+        writer_metrics.write_latency.observe(simulator::now() - write_start);
     }
 
-    std::puts("[ ] Closing file worker\n");
+    HOT_LOG_INFO("[ ] Closing file worker");
+}
+
+}  // namespace
+
+void
+fileWriteWorker(fiber_messages::write::queue_t& write_queue) {
+    runFileWriter(write_queue, nullptr);
+}
+
+void
+previewingFileWriteWorker(fiber_messages::write::queue_t& write_queue,
+                          preview::preview_tap_t& preview_tap) {
+    runFileWriter(write_queue, &preview_tap);
 }
\ No newline at end of file
@@ -0,0 +1,20 @@
+#include "frame-pool.h"
+
+#include "constants.h"
+
+namespace {
+/** Two frames per camera of the well plate. */
+constexpr size_t max_free_frames = 2 * well_plate::n_wells;
+}  // namespace
+
+frame_pool_t<uint8_t>&
+rawFramePool() {
+    static frame_pool_t<uint8_t> pool{camera::n_pixels, max_free_frames};
+    return pool;
+}
+
+frame_pool_t<uint16_t>&
+integratedFramePool() {
+    static frame_pool_t<uint16_t> pool{camera::n_pixels, max_free_frames};
+    return pool;
+}
@@ -4,6 +4,7 @@
 #include <fmt/format.h>
 #include <fmt/std.h>
 
+#include <algorithm>
 #include <bitset>
 #include <string_view>
 #include <type_traits>
@@ -12,10 +13,21 @@
 //
 #include <nonstd/span.hpp>
 
+#include "alloc-tracker.h"
 #include "frame-capture-card.h"
+#include "frame-pool.h"
+#include "hot-log.h"
+#include "metrics.h"
 #include "mock_usb.h"
+#include "recording_usb.h"
+#include "replay_usb.h"
+#include "simulated_usb.h"
+#include "time-integration.h"
+#include "time-model.h"
+#include "trace.h"
+#include "utilization.h"
+#include "virtual-clock.h"
 
-using boost::this_fiber::sleep_for;
 using boost::this_fiber::yield;
 using namespace std::chrono_literals;
 using boost::fibers::barrier;
@@ -25,9 +37,13 @@ using fiber_messages::capture::fpm_frame_t;
 using fiber_messages::capture::camera::exposure_gain_t;
 using fiber_messages::capture::camera::init_sequence_t;
 using frame_capture_card::n_cameras_per_board;
+using frame_capture_card::commands::i2c_batch_write_t;
 using frame_capture_card::commands::i2c_cmd_t;
 using frame_capture_card::commands::write_led_id_t;
 using hardware_drivers::MockUSB;
+using hardware_drivers::RecordingUSB;
+using hardware_drivers::ReplayUSB;
+using hardware_drivers::SimulatedUSB;
 using message_router::FrameCaptureCard;
 using std::chrono::steady_clock;
 using frame_arrival_mask_t = std::bitset<n_cameras_per_board>;
@@ -37,28 +53,108 @@ namespace {
 
 constexpr auto all_frames_arrived = (uint32_t{1} << n_cameras_per_board) - 1;
 
+/** Report the end of the exposure to the executor, for the capture commands
+ * issued with concurrently().
+ *
+ * All cameras expose at once on the trigger, i.e. write_led_id_t, for the
+ * exposure time set by the last exposure_gain_t. The signal goes out once the
+ * exposure has elapsed, or once all frames have arrived, whichever comes first.
+ */
+class exposure_signal_t {
+    fiber_messages::capture::completions_signal_t* signal;
+    steady_clock::time_point end;
+
+   public:
+    exposure_signal_t(fiber_messages::capture::completions_signal_t* s,
+                      const std::chrono::milliseconds exposure)
+        : signal{s}, end{simulator::now() + exposure} {}
+
+    /** Check the clock between two frames. */
+    void poll() {
+        if (signal != nullptr && simulator::now() >= end) {
+            finish();
+        }
+    }
+
+    void finish() {
+        if (signal != nullptr) {
+            signal->push(simulator::now());
+            signal = nullptr;
+        }
+    }
+};
+
+/** Add the raw frame to the accumulated one.
+ *
+ * In virtual time, the pixel values do not matter. The capture workers take
+ * the CPU time of the integration instead, one board at a time, as they share
+ * the CPU thread.
+ */
+template <class U>
+void
+integrateFrame(span<const uint8_t> raw_pixels, span<uint16_t> accumulated) {
+    if constexpr (hardware_drivers::is_virtual_time_v<U>) {
+        static auto& cpu_busy = simulator::busyTime("integration CPU");
+        static simulator::time_point cpu_idle_at{};
+
+        cpu_idle_at = std::max(simulator::now(), cpu_idle_at) +
+                      simulator::time_model::frame_integration;
+        cpu_busy.add(simulator::time_model::frame_integration);
+        simulator::sleep_until(cpu_idle_at);
+    } else {
+        accumulateFrame(raw_pixels, accumulated);
+    }
+}
+
+/** Publish the statistics of one frame received over USB. */
+template <class U>
+void
+countFrame(telemetry::board_metrics_t& board_metrics, const FrameCaptureCard<U>& capture_card,
+           const uint8_t cam_id, const bool is_accepted) {
+    board_metrics.bytes.add(camera::n_pixels);
+    board_metrics.header_resyncs.set(capture_card.stats().header_resyncs);
+    if (is_accepted) {
+        board_metrics.frames_per_camera.at(cam_id - 1).add();
+    } else {
+        board_metrics.retries.add();
+    }
+}
+
+/** Read one frame from any of the 24 cameras. */
+template <class U, class Buffer>
+auto
+captureFrame(FrameCaptureCard<U>& capture_card, Buffer& buffer) {
+    TRACE_SCOPE("capture", "frame");
+    return capture_card.captureSingleFrame(buffer);
+}
+
 /** Try to read frames from all 24 cameras. Giving up after 10 trials. */
 template <class WriteMessage, class U>
 frame_arrival_mask_t
 captureFrom24Cameras(const uint8_t board_id, FrameCaptureCard<U>& capture_card,
-                     const uint8_t target_led_id, fiber_messages::write::queue_t& write_queue,
+                     telemetry::board_metrics_t& board_metrics, const uint8_t target_led_id,
+                     fiber_messages::write::queue_t& write_queue, exposure_signal_t& exposed,
                      uint16_t max_retry = 10) {
-    // Allocate memory
-    std::vector<uint8_t> image_buffer(camera::n_pixels);
+    auto& frame_pool = rawFramePool();
+    auto image_buffer = frame_pool.acquire();
 
     std::bitset<n_cameras_per_board> frame_arrival_mask{0U};
     for (size_t retry = 0; retry < max_retry * frame_capture_card::n_cameras_per_board; retry++) {
-        const auto ret = capture_card.captureSingleFrame(image_buffer);
+        const auto ret = captureFrame(capture_card, image_buffer);
+        exposed.poll();
 
-        if (ret.led_id != target_led_id) continue;
+        const bool is_target_led = (ret.led_id == target_led_id);
+        countFrame(board_metrics, capture_card, ret.cam_id, is_target_led);
+        if (!is_target_led) continue;
 
         // Mark the i-th camera as captured.
         frame_arrival_mask.set(ret.cam_id - 1);
 
         // Transmit the frame to the write queue
-        std::vector<uint8_t> captured_image(camera::n_pixels);
+        auto captured_image = frame_pool.acquire();
         std::swap(captured_image, image_buffer);
 
+        telemetry::metrics().writer.queue_depth.add(1);
         write_queue.push(WriteMessage{
             board_id,
             ret,
@@ -70,64 +166,77 @@ captureFrom24Cameras(const uint8_t board_id, FrameCaptureCard<U>& capture_card,
         }
     }
 
+    frame_pool.release(std::move(image_buffer));
+    exposed.finish();
     return frame_arrival_mask;
 }
 
 template <class U, uint16_t max_retry = 10>
 void
-execute(const uint8_t board_id, FrameCaptureCard<U>& capture_card, const dark_frame_t& cmd,
-        fiber_messages::write::queue_t& write_queue) {
-    fmt::print(FMT_STRING("[{:d}] Capture darkframe...\n"), board_id);
+execute(const uint8_t board_id, FrameCaptureCard<U>& capture_card,
+        telemetry::board_metrics_t& board_metrics, const dark_frame_t& cmd,
+        fiber_messages::write::queue_t& write_queue, const std::chrono::milliseconds exposure) {
+    TRACE_SCOPE("capture", "dark frame");
+    HOT_LOG_INFO("[{:d}] Capture darkframe...", board_id);
     static uint8_t frame_id{0};
     assert(capture_card.sendCommand(write_led_id_t{++frame_id}));
+    exposure_signal_t exposed{cmd.exposure, exposure};
 
     // Stream frames from 24 cameras to the write queue.
     const auto frame_arrival_mask = captureFrom24Cameras<fiber_messages::write::dark_frame_t>(
-        board_id, capture_card, frame_id, write_queue);
+        board_id, capture_card, board_metrics, frame_id, write_queue, exposed);
     if (frame_arrival_mask != all_frames_arrived) {
-        fmt::print(FMT_STRING("[{:d}] Warning: not all frames arrived.\n"), board_id);
+        HOT_LOG_WARNING("[{:d}] Warning: not all frames arrived.", board_id);
     }
 
     // Send completion signal to main loop
     assert(cmd.completion != nullptr);
-    cmd.completion->push(true);
+    cmd.completion->push(simulator::now());
 }
 
 template <class U>
 void
 execute(const uint8_t board_id, FrameCaptureCard<U>& capture_card,
-        const fpm_frame_t& capture_command, fiber_messages::write::queue_t& write_queue) {
-    fmt::print(FMT_STRING("[{:d}] Capture FPM frame {:d}...\n"), board_id, capture_command.led_id);
+        telemetry::board_metrics_t& board_metrics, const fpm_frame_t& capture_command,
+        fiber_messages::write::queue_t& write_queue, const std::chrono::milliseconds exposure) {
+    TRACE_SCOPE_ARG("capture", "FPM frame", "led_id", capture_command.led_id);
+    HOT_LOG_INFO("[{:d}] Capture FPM frame {:d}...", board_id, capture_command.led_id);
     assert(capture_card.sendCommand(write_led_id_t{capture_command.led_id}));
+    exposure_signal_t exposed{capture_command.exposure, exposure};
 
     // Transfer images from camera board
     const auto frame_arrival_mask = captureFrom24Cameras<fiber_messages::write::fpm_frame_t>(
-        board_id, capture_card, capture_command.led_id, write_queue);
+        board_id, capture_card, board_metrics, capture_command.led_id, write_queue, exposed);
     if (frame_arrival_mask != all_frames_arrived) {
-        fmt::print(FMT_STRING("[{:d}] Warning: not all frames arrived.\n"), board_id);
+        HOT_LOG_WARNING("[{:d}] Warning: not all frames arrived.", board_id);
     }
 
     // Send completion signal to the main loop
     assert(capture_command.completion != nullptr);
-    capture_command.completion->push(true);
+    capture_command.completion->push(simulator::now());
 }
 
-template <class U, uint8_t n_frames = 8>
+template <class U, uint8_t n_frames = camera::n_integration_frames>
 void
 execute(const uint8_t board_id, FrameCaptureCard<U>& capture_card,
-        const fluorescence_frame_t& capture_command, fiber_messages::write::queue_t& write_queue) {
+        telemetry::board_metrics_t& board_metrics, const fluorescence_frame_t& capture_command,
+        fiber_messages::write::queue_t& write_queue, const std::chrono::milliseconds exposure) {
     using frame_capture_card::n_cameras_per_board;
+    TRACE_SCOPE_ARG("capture", "fluorescence frame", "zpos", capture_command.zpos);
 
     const uint8_t frame_id =
         (capture_command.zpos * 2 + static_cast<uint8_t>(capture_command.ch)) & 0xff;
     assert(capture_card.sendCommand(write_led_id_t{frame_id}));
+    exposure_signal_t exposed{capture_command.exposure, exposure * n_frames};
+
+    const auto integration_start = simulator::now();
 
-    // Allocate memory
     std::array<std::vector<uint16_t>, n_cameras_per_board> accumulated{};
-    std::vector<uint8_t> raw_pixels(camera::n_pixels);
+    auto raw_pixels = rawFramePool().acquire();
 
     for (auto& frame : accumulated) {
-        frame.resize(camera::n_pixels);
+        frame = integratedFramePool().acquire();
+        std::fill(frame.begin(), frame.end(), uint16_t{0});
     }
 
     // Time integration count
@@ -136,20 +245,24 @@ execute(const uint8_t board_id, FrameCaptureCard<U>& capture_card,
     const size_t max_retry = 10 * n_cameras_per_board * n_frames;
     // Accumulate intensity
     for (size_t retry = 0; retry < max_retry; retry++) {
-        const auto [cam_id, led_id] = capture_card.captureSingleFrame(raw_pixels);
+        const auto [cam_id, led_id] = captureFrame(capture_card, raw_pixels);
+        exposed.poll();
 
         // Skip frame if it is captured before the laser trigger.
-        if (led_id != frame_id) continue;
+        if (led_id != frame_id) {
+            countFrame(board_metrics, capture_card, cam_id, false);
+            continue;
+        }
 
         // Skip frame if sufficient number of frames is time-integrated for the camera.
         auto& frame_count = accumulated_frame_count.at(cam_id - 1);
+        countFrame(board_metrics, capture_card, cam_id, frame_count < n_frames);
         if (frame_count >= n_frames) continue;
 
-        fmt::print(
-            "[{:d}] Flurescence time integration {:d}/{:d} at [z={:d}, "
-            "ch={:s}, cam={:d}]...\n",
-            board_id, frame_count, n_frames, capture_command.zpos, toString(capture_command.ch),
-            cam_id);
+        HOT_LOG_DEBUG("[{:d}] Flurescence time integration {:d}/{:d} at "
+                      "[z={:d}, ch={:s}, cam={:d}]...",
+                      board_id, frame_count, n_frames, capture_command.zpos,
+                      toString(capture_command.ch), cam_id);
 
 #ifndef __OPTIMIZE__
 #warning Digital time integration of image frames takes too long. Try compiler arguments -march=native -O3
@@ -157,14 +270,16 @@ execute(const uint8_t board_id, FrameCaptureCard<U>& capture_card,
 
         // Now, perform digital time integration
         auto& target_frame = accumulated.at(cam_id - 1);
-        std::transform(raw_pixels.begin(), raw_pixels.end(), target_frame.begin(),
-                       target_frame.begin(),
-                       [](const auto x, const auto y) -> uint16_t { return x + y; });
+        {
+            TRACE_SCOPE_ARG("capture", "integration pass", "cam_id", cam_id);
+            integrateFrame<U>(raw_pixels, target_frame);
+        }
         yield();
 
         // If time intergration is complete, transmit the frame of the corresponding camera once and
         // only once.
         if (++frame_count == n_frames) {
+            telemetry::metrics().writer.queue_depth.add(1);
             write_queue.push(fiber_messages::write::fluorescence_frame_t{
                 board_id,
                 cam_id,
@@ -181,57 +296,97 @@ execute(const uint8_t board_id, FrameCaptureCard<U>& capture_card,
         }
     }
 
+    board_metrics.integration_time.observe(simulator::now() - integration_start);
+
+    // Recycle the frames of the cameras not transmitted.
+    for (auto& frame : accumulated) {
+        if (!frame.empty()) {
+            integratedFramePool().release(std::move(frame));
+        }
+    }
+    rawFramePool().release(std::move(raw_pixels));
+    exposed.finish();
+
     // Send the completion signal to the main loop
     assert(capture_command.completion != nullptr);
-    capture_command.completion->push(true);
+    capture_command.completion->push(simulator::now());
 }
 
+/** Transmit the i2c commands to the CMOS sensors, packing up to 64 commands
+ * in one USB control transfer. Report the commands not acknowledged. */
 template <class U>
 void
-execute(const uint8_t board_id, FrameCaptureCard<U>& capture_card,
-        const init_sequence_t& capture_command) {
-    fmt::print(FMT_STRING("[{:d}] Camera init sequence...\n"), board_id);
+sendI2CCommands(const uint8_t board_id, FrameCaptureCard<U>& capture_card,
+                span<const i2c_cmd_t> commands) {
+    constexpr size_t max_count = i2c_batch_write_t::max_count;
+    for (size_t offset = 0; offset < commands.size(); offset += max_count) {
+        const auto chunk = commands.subspan(offset, std::min(max_count, commands.size() - offset));
+        TRACE_SCOPE_ARG("capture", "i2c batch", "count", chunk.size());
+
+        i2c_batch_write_t batch{};
+        for (const auto& i2c_cmd : chunk) {
+            batch.push_back(i2c_cmd);
+        }
 
-    for (const auto& i2c_cmd : span{capture_command.commands}.subspan(0, capture_command.count)) {
-        const bool is_transmitted = capture_card.sendCommand(i2c_cmd);
-        if (!is_transmitted) {
-            fmt::print(FMT_STRING("[{:d}] i2c command failed: {:#x},{:#x}={:#x}"), board_id,
-                       i2c_cmd.dev_addr, i2c_cmd.addr, i2c_cmd.value);
+        const auto failed = capture_card.sendCommand(batch);
+        for (size_t i = 0; i < chunk.size(); i++) {
+            if (failed[i]) {
+                HOT_LOG_WARNING("[{:d}] i2c command failed: {:#x},{:#x}={:#x}", board_id,
+                                chunk[i].dev_addr, chunk[i].addr, chunk[i].value);
+            }
         }
         yield();
     }
 }
 
+template <class U>
+void
+execute(const uint8_t board_id, FrameCaptureCard<U>& capture_card,
+        const init_sequence_t& capture_command) {
+    TRACE_SCOPE("capture", "CMOS init sequence");
+    HOT_LOG_INFO("[{:d}] Camera init sequence...", board_id);
+
+    sendI2CCommands(board_id, capture_card,
+                    span{capture_command.commands}.subspan(0, capture_command.count));
+}
+
 template <class U>
 void
 execute(const uint8_t board_id, FrameCaptureCard<U>& capture_card,
         const exposure_gain_t& capture_command) {
-    fmt::print(FMT_STRING("[{:d}] Set exposure = {}, gain={:d}x\n"), board_id,
-               capture_command.exposure(), capture_command.gain());
+    TRACE_SCOPE("capture", "exposure/gain");
+    HOT_LOG_INFO("[{:d}] Set exposure = {}, gain={:d}x", board_id, capture_command.exposure(),
+                 capture_command.gain());
 
     static_assert(sizeof(exposure_gain_t) % sizeof(i2c_cmd_t) == 0);
     constexpr int32_t n_commands = sizeof(exposure_gain_t) / sizeof(i2c_cmd_t);
-    for (const auto& i2c_cmd :
-         span{reinterpret_cast<const i2c_cmd_t*>(&capture_command), n_commands}) {
-        const bool is_transmitted = capture_card.sendCommand(i2c_cmd);
-        if (!is_transmitted) {
-            fmt::print(FMT_STRING("[{:d}] i2c command failed: {:#x},{:#x}={:#x}"), board_id,
-                       i2c_cmd.dev_addr, i2c_cmd.addr, i2c_cmd.value);
-        }
-        yield();
-    }
+    sendI2CCommands(board_id, capture_card,
+                    span{reinterpret_cast<const i2c_cmd_t*>(&capture_command), n_commands});
 }
-}  // namespace
 
+template <class USBInterface, typename... Args>
 void
-imageCaptureWorker(const uint8_t usb_id, fiber_messages::capture::queue_t& capture_queue,
-                   fiber_messages::write::queue_t& write_queue) {
+runCaptureWorker(const uint8_t usb_id, fiber_messages::capture::queue_t& capture_queue,
+                 fiber_messages::write::queue_t& write_queue, Args&&... usb_args) {
+    TRACE_LANE_NAME(fmt::format(FMT_STRING("capture usb{:d}"), usb_id));
+    telemetry::alloc::stage_scope alloc_stage{"capture"};
+
     // Initialize camera board
-    message_router::FrameCaptureCard<MockUSB> capture_card{usb_id};
+    message_router::FrameCaptureCard<USBInterface> capture_card{usb_id,
+                                                                std::forward<Args>(usb_args)...};
     const auto board_id = capture_card.readBoardID();
 
+    // Indexed by the USB ID: the board ID is that of the DIP switch, of any
+    // value.
+    auto& board_metrics = telemetry::metrics().boards.at(usb_id);
+    auto& capture_queue_depth = board_metrics.capture_queue_depth;
+    auto& command_time = board_metrics.command_time;
+    std::chrono::milliseconds exposure{};
+
     for (auto&& cmd : capture_queue) {
         using namespace std::string_view_literals;
+        capture_queue_depth.add(-1);
+        const auto command_start = simulator::now();
 
         // Write to file
         std::visit(
@@ -239,19 +394,55 @@ imageCaptureWorker(const uint8_t usb_id, fiber_messages::capture::queue_t& captu
                 using T = std::decay_t<decltype(capture_command)>;
                 if constexpr (std::is_same_v<T, dark_frame_t> || std::is_same_v<T, fpm_frame_t> ||
                               std::is_same_v<T, fluorescence_frame_t>) {
-                    execute(board_id, capture_card, capture_command, write_queue);
+                    execute(board_id, capture_card, board_metrics, capture_command, write_queue,
+                            exposure);
+                } else if constexpr (std::is_same_v<T, exposure_gain_t>) {
+                    exposure = capture_command.exposure();
+                    execute(board_id, capture_card, capture_command);
                 } else {
                     execute(board_id, capture_card, capture_command);
                 }
             },
             cmd);
+
+        command_time.observe(simulator::now() - command_start);
     }
 
     if (board_id == 0) {
-        std::puts("[0] No more instrument control commands. Closing the file worker...\n");
+        HOT_LOG_INFO("[0] No more instrument control commands. Closing the file worker...");
         write_queue.close();
     }
 
-    // Need to capture the board_id value from the stack before it vanishes from the stack.
-    [=]() { fmt::print(FMT_STRING("[{:d}] Closing image capture worker\n"), board_id); }();
-}
\ No newline at end of file
+    HOT_LOG_INFO("[{:d}] Closing image capture worker", board_id);
+}
+}  // namespace
+
+void
+imageCaptureWorker(const uint8_t usb_id, fiber_messages::capture::queue_t& capture_queue,
+                   fiber_messages::write::queue_t& write_queue) {
+    runCaptureWorker<MockUSB>(usb_id, capture_queue, write_queue);
+}
+
+void
+recordingCaptureWorker(const uint8_t usb_id, const std::string& capture_path,
+                       fiber_messages::capture::queue_t& capture_queue,
+                       fiber_messages::write::queue_t& write_queue) {
+    runCaptureWorker<RecordingUSB<MockUSB>>(usb_id, capture_queue, write_queue,
+                                            capture_path.c_str());
+}
+
+void
+replayCaptureWorker(const uint8_t usb_id, const std::string& capture_path, const bool realtime,
+                    fiber_messages::capture::queue_t& capture_queue,
+                    fiber_messages::write::queue_t& write_queue) {
+    using pacing_t = ReplayUSB::pacing_t;
+    runCaptureWorker<ReplayUSB>(usb_id, capture_queue, write_queue, capture_path.c_str(),
+                                realtime ? pacing_t::ORIGINAL_TIMING
+                                         : pacing_t::AS_FAST_AS_POSSIBLE);
+}
+
+void
+simulatedCaptureWorker(const uint8_t usb_id, fiber_messages::capture::queue_t& capture_queue,
+                       fiber_messages::write::queue_t& write_queue) {
+    runCaptureWorker<SimulatedUSB<MockUSB>>(usb_id, capture_queue, write_queue);
+}
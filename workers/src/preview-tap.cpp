@@ -0,0 +1,214 @@
+#include "preview-tap.h"
+
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+#include "metrics.h"
+#include "virtual-clock.h"
+
+namespace preview {
+
+namespace {
+
+using frame_capture_card::n_cameras_per_board;
+
+/** The camera IDs of the frame header count from 1. */
+size_t
+wellOf(uint8_t board_id, uint8_t cam_id) {
+    return size_t{board_id} * n_cameras_per_board + cam_id - 1;
+}
+
+std::runtime_error
+sharedMemoryError(std::string_view what, const std::string& name) {
+    return std::runtime_error(fmt::format(FMT_STRING("Cannot {:s} the shared memory {:s}: {:s}"),
+                                          what, name, std::strerror(errno)));
+}
+
+}  // namespace
+
+preview_tap_t::preview_tap_t(std::string shm_name, preview_config_t c)
+    : name{std::move(shm_name)}, config{c} {
+    const auto binning = config.binning;
+    const auto n_slots = config.n_slots;
+    if (binning != 4 && binning != 8) {
+        throw std::invalid_argument(
+            fmt::format(FMT_STRING("Preview binning must be 4 or 8, not {:d}"), binning));
+    }
+    if (n_slots == 0) {
+        throw std::invalid_argument("The preview ring needs at least one slot");
+    }
+
+    const size_t n_pixels = size_t(camera::width / binning) * (camera::height / binning);
+    const size_t slot_size =
+        (sizeof(slot_t) + n_pixels * sizeof(uint16_t) + alignof(slot_t) - 1) /
+        alignof(slot_t) * alignof(slot_t);
+    mapped_size = sizeof(header_t) + n_slots * slot_size;
+
+    // A stale ring of a previous run may be of another size. Replace it. Its
+    // viewers keep their mapping of the old one until they open it again.
+    ::shm_unlink(name.c_str());
+    const int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        throw sharedMemoryError("create", name);
+    }
+    if (::ftruncate(fd, static_cast<off_t>(mapped_size)) != 0) {
+        const auto error = sharedMemoryError("size", name);
+        ::close(fd);
+        ::shm_unlink(name.c_str());
+        throw error;
+    }
+    void* p = ::mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        const auto error = sharedMemoryError("map", name);
+        ::shm_unlink(name.c_str());
+        throw error;
+    }
+
+    auto* slots = reinterpret_cast<char*>(p) + sizeof(header_t);
+    for (size_t i = 0; i < n_slots; i++) {
+        new (slots + i * slot_size) slot_t{};
+    }
+    ring = new (p) header_t{};
+    ring->n_slots = static_cast<uint32_t>(n_slots);
+    ring->slot_size = static_cast<uint32_t>(slot_size);
+
+    // Widest frame of the camera, for binFrame().
+    row_sums.resize(camera::width);
+}
+
+preview_tap_t::~preview_tap_t() {
+    ::munmap(ring, mapped_size);
+    ::shm_unlink(name.c_str());
+}
+
+bool
+preview_tap_t::offer(const frame_t& frame, nonstd::span<const uint8_t> pixels) {
+    return publish(frame, pixels);
+}
+
+bool
+preview_tap_t::offer(const frame_t& frame, nonstd::span<const uint16_t> pixels) {
+    return publish(frame, pixels);
+}
+
+bool
+preview_tap_t::isDue(const frame_t& frame) {
+    const auto now = simulator::now();
+    auto& last = last_published[wellOf(frame.board_id, frame.cam_id)];
+    if (last != simulator::time_point{} && now - last < config.min_interval) {
+        return false;
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start_time;
+    if (busy_time > elapsed * config.max_duty_cycle) {
+        telemetry::metrics().writer.previews_dropped.add();
+        return false;
+    }
+    last = now;
+    return true;
+}
+
+template <typename Pixel>
+bool
+preview_tap_t::publish(const frame_t& frame, nonstd::span<const Pixel> pixels) {
+    const bool is_camera_known = frame.board_id < frame_capture_card::n_boards &&
+                                 frame.cam_id >= 1 && frame.cam_id <= n_cameras_per_board;
+    if (!is_camera_known || pixels.size() != size_t(camera::n_pixels) || !isDue(frame)) {
+        return false;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    slot_t& slot = beginWrite(frame);
+    const auto n_preview_pixels = size_t(slot.width) * slot.height;
+    const nonstd::span<uint16_t> preview_pixels{slot.pixels(), n_preview_pixels};
+    const auto stats = (config.binning == 4)
+                           ? binFrame<4>(pixels, camera::width, camera::height, row_sums,
+                                         preview_pixels)
+                           : binFrame<8>(pixels, camera::width, camera::height, row_sums,
+                                         preview_pixels);
+    endWrite(slot, frame, stats);
+    busy_time += std::chrono::steady_clock::now() - start;
+    return true;
+}
+
+slot_t&
+preview_tap_t::beginWrite(const frame_t& frame) {
+    const uint64_t n = ring->n_published.load(std::memory_order_relaxed);
+    auto& slot = *reinterpret_cast<slot_t*>(reinterpret_cast<char*>(ring + 1) +
+                                            (n % ring->n_slots) * ring->slot_size);
+
+    // Odd: the viewers drop what they read from here on.
+    slot.sequence.store(slot.sequence.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.board_id = frame.board_id;
+    slot.cam_id = frame.cam_id;
+    slot.kind = frame.kind;
+    slot.led_id = frame.led_id;
+    slot.zpos = frame.zpos;
+    slot.ch = frame.ch;
+    slot.binning = static_cast<uint8_t>(config.binning);
+    slot.width = static_cast<uint16_t>(camera::width / config.binning);
+    slot.height = static_cast<uint16_t>(camera::height / config.binning);
+    return slot;
+}
+
+void
+preview_tap_t::endWrite(slot_t& slot, const frame_t& frame, const frame_stats_t stats) {
+    const uint64_t n = ring->n_published.load(std::memory_order_relaxed);
+    slot.stats = stats;
+    slot.frame_number = n + 1;
+    slot.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            simulator::now().time_since_epoch())
+                            .count();
+
+    slot.sequence.store(slot.sequence.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_release);
+    ring->latest[wellOf(frame.board_id, frame.cam_id)].store(
+        static_cast<uint32_t>(n % ring->n_slots + 1), std::memory_order_release);
+    ring->n_published.store(n + 1, std::memory_order_release);
+
+    telemetry::metrics().writer.previews.add();
+}
+
+preview_reader_t::preview_reader_t(const std::string& name) {
+    const int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        throw sharedMemoryError("open", name);
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(header_t)) {
+        ::close(fd);
+        throw std::runtime_error(
+            fmt::format(FMT_STRING("The shared memory {:s} is not a preview ring"), name));
+    }
+    mapped_size = size_t(st.st_size);
+    void* p = ::mmap(nullptr, mapped_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        throw sharedMemoryError("map", name);
+    }
+
+    ring = reinterpret_cast<const header_t*>(p);
+    if (ring->magic != magic || ring->version != layout_version ||
+        sizeof(header_t) + size_t(ring->n_slots) * ring->slot_size > mapped_size) {
+        ::munmap(p, mapped_size);
+        throw std::runtime_error(
+            fmt::format(FMT_STRING("The shared memory {:s} is not a preview ring of version {:d}"),
+                        name, layout_version));
+    }
+}
+
+preview_reader_t::~preview_reader_t() { ::munmap(const_cast<header_t*>(ring), mapped_size); }
+
+}  // namespace preview
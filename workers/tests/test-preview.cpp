@@ -0,0 +1,137 @@
+#include <unistd.h>
+
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "binning.h"
+#include "constants.h"
+#include "metrics.h"
+#include "preview-tap.h"
+
+using namespace std::chrono_literals;
+using preview::frame_kind_t;
+using preview::preview_reader_t;
+using preview::preview_tap_t;
+using preview::slot_t;
+
+namespace {
+
+std::string
+ringName() {
+    return "/bioimage-preview-test-" + std::to_string(::getpid());
+}
+
+/** Frame of the camera with a gradient, brightest at the bottom right. */
+std::vector<uint8_t>
+gradientFrame() {
+    std::vector<uint8_t> frame(camera::n_pixels);
+    for (int32_t y = 0; y < camera::height; y++) {
+        for (int32_t x = 0; x < camera::width; x++) {
+            frame[y * camera::width + x] = static_cast<uint8_t>((x + y) * 255 /
+                                                                (camera::width + camera::height));
+        }
+    }
+    return frame;
+}
+
+}  // namespace
+
+TEST_CASE("Bin the frame into the block means", "[preview]") {
+    constexpr int32_t width = 24;
+    constexpr int32_t height = 16;
+    std::vector<uint16_t> frame(width * height);
+    std::iota(frame.begin(), frame.end(), uint16_t{100});
+    std::vector<uint32_t> row_sums(width);
+
+    std::vector<uint16_t> preview(width / 4 * height / 4);
+    const auto stats = binFrame<4, uint16_t>(frame, width, height, row_sums, preview);
+    CHECK(stats.min == 100);
+    CHECK(stats.max == 100 + width * height - 1);
+    CHECK(stats.mean == 100 + (width * height - 1) / 2.0);
+
+    // The mean of each 4 x 4 block is at the center of the block.
+    for (int32_t by = 0; by < height / 4; by++) {
+        for (int32_t bx = 0; bx < width / 4; bx++) {
+            const uint32_t center = 100 + (by * 4 + 1) * width + bx * 4 + 1;
+            CHECK(preview[by * (width / 4) + bx] == (center * 2 + width + 1) / 2);
+        }
+    }
+
+    std::vector<uint16_t> coarse(width / 8 * height / 8);
+    binFrame<8, uint16_t>(frame, width, height, row_sums, coarse);
+    CHECK(coarse[0] == 100 + (7 * width + 7) / 2);
+}
+
+TEST_CASE("Publish the previews to the viewer in shared memory", "[preview]") {
+    const auto& writer_metrics = telemetry::metrics().writer;
+    const auto frame = gradientFrame();
+    const auto n_previews = writer_metrics.previews.load();
+    preview_tap_t tap{ringName(), {8, 4, 1h, 1.0}};
+    preview_reader_t reader{ringName()};
+    REQUIRE(reader.header().n_slots == 4);
+
+    // No preview yet.
+    CHECK_FALSE(reader.readLatest(0, [](const slot_t&) {}));
+
+    preview_tap_t::frame_t fpm{1, 3, frame_kind_t::FPM, 7};
+    REQUIRE(tap.offer(fpm, frame));
+
+    // Camera 3 of board 1. The camera IDs count from 1.
+    const size_t well = frame_capture_card::n_cameras_per_board + 2;
+    uint16_t corner{};
+    const bool is_read = reader.readLatest(well, [&](const slot_t& slot) {
+        CHECK(slot.kind == frame_kind_t::FPM);
+        CHECK(slot.led_id == 7);
+        CHECK(slot.width == camera::width / 8);
+        CHECK(slot.height == camera::height / 8);
+        CHECK(slot.stats.min == 0);
+        CHECK(slot.stats.max == 254);
+        corner = slot.pixels()[slot.width * slot.height - 1];
+    });
+    REQUIRE(is_read);
+    CHECK(corner > 250);
+    CHECK(reader.header().n_published.load() == 1);
+
+    SECTION("One preview per camera per interval") {
+        CHECK_FALSE(tap.offer(fpm, frame));
+        CHECK(tap.offer(preview_tap_t::frame_t{1, 4}, frame));
+        CHECK_FALSE(tap.offer(preview_tap_t::frame_t{1, 25}, frame));
+        CHECK(writer_metrics.previews.load() == n_previews + 2);
+    }
+
+    SECTION("Drop the preview overwritten while the viewer reads it") {
+        bool is_rendered = false;
+        const bool is_valid = reader.readLatest(well, [&](const slot_t&) {
+            // The viewer falls behind by a whole ring. The writer does not
+            // wait for it.
+            for (uint8_t cam_id = 11; cam_id <= 14; cam_id++) {
+                REQUIRE(tap.offer(preview_tap_t::frame_t{0, cam_id}, frame));
+            }
+            is_rendered = true;
+        });
+        CHECK(is_rendered);
+        CHECK_FALSE(is_valid);
+
+        // And the camera has no preview left in the ring.
+        CHECK_FALSE(reader.readLatest(well, [](const slot_t&) {}));
+        CHECK(reader.readLatest(13, [](const slot_t&) {}));
+    }
+}
+
+TEST_CASE("Drop the previews beyond the CPU budget", "[preview]") {
+    const auto frame = gradientFrame();
+    preview_tap_t tap{ringName(), {4, 2, 0ms, 1e-6}};
+
+    const auto n_dropped = telemetry::metrics().writer.previews_dropped.load();
+    CHECK(tap.offer(preview_tap_t::frame_t{0, 1}, frame));
+    CHECK_FALSE(tap.offer(preview_tap_t::frame_t{0, 2}, frame));
+    CHECK(telemetry::metrics().writer.previews_dropped.load() == n_dropped + 1);
+}
+
+TEST_CASE("Reject a missing ring and an unsupported binning", "[preview]") {
+    CHECK_THROWS_AS(preview_reader_t{"/bioimage-preview-missing"}, std::runtime_error);
+    CHECK_THROWS_AS((preview_tap_t{ringName(), {2}}), std::invalid_argument);
+}
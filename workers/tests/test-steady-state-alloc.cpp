@@ -0,0 +1,71 @@
+#include <boost/fiber/all.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include "alloc-tracker.h"
+#include "file_write_worker.h"
+#include "hot-log.h"
+#include "image_capture_worker.h"
+#include "instrumented-channel.h"
+
+using boost::fibers::fiber;
+using fiber_messages::capture::completions_signal_t;
+using fiber_messages::capture::dark_frame_t;
+using fiber_messages::capture::fluorescence_frame_t;
+using fiber_messages::capture::fpm_frame_t;
+
+namespace {
+
+/** Capture one frame of each kind from all 24 cameras, and wait for the
+ * capture worker to finish. */
+void
+captureAllKinds(fiber_messages::capture::queue_t& capture_queue,
+                completions_signal_t& completion) {
+    completions_signal_t::value_type is_done{};
+    for (uint8_t led_id = 1; led_id <= 2; led_id++) {
+        capture_queue.push(fpm_frame_t{led_id, &completion});
+        completion.pop(is_done);
+    }
+    capture_queue.push(fluorescence_frame_t{3, EGFP, &completion});
+    completion.pop(is_done);
+    capture_queue.push(dark_frame_t{&completion});
+    completion.pop(is_done);
+}
+
+}  // namespace
+
+TEST_CASE("No heap allocation in the capture and write loops after warm-up", "[alloc]") {
+    REQUIRE(telemetry::alloc::isTracking());
+
+    // Keep the log records off the TAP output.
+    telemetry::log::setOutput(stderr);
+
+    auto& stats = telemetry::channelStats("test", "test", "test");
+    fiber_messages::capture::queue_t capture_queue{2, stats};
+    fiber_messages::write::queue_t write_queue{4, stats};
+    completions_signal_t completion{2, stats};
+
+    fiber capture_task{imageCaptureWorker, 0, std::ref(capture_queue), std::ref(write_queue)};
+    fiber write_task{fileWriteWorker, std::ref(write_queue)};
+
+    // Warm up: fill the frame pools, the log ring buffers and the channel
+    // statistics.
+    captureAllKinds(capture_queue, completion);
+    REQUIRE(telemetry::alloc::stageStats("capture").total.n_allocations > 0);
+
+    telemetry::alloc::beginSteadyState();
+    for (int round = 0; round < 3; round++) {
+        captureAllKinds(capture_queue, completion);
+    }
+
+    capture_queue.close();
+    capture_task.join();
+    write_task.join();
+    telemetry::log::flush();
+
+    CHECK(telemetry::alloc::stageStats("capture").steady_state.n_allocations == 0);
+    CHECK(telemetry::alloc::stageStats("writer").steady_state.n_allocations == 0);
+    if (telemetry::alloc::stageStats("capture").steady_state.n_allocations > 0 ||
+        telemetry::alloc::stageStats("writer").steady_state.n_allocations > 0) {
+        telemetry::alloc::printAllocationReport(stderr);
+    }
+}